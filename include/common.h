@@ -80,13 +80,14 @@ enum class wait : uint32_t
 	kill_console_grace_period	= 1500,		// How many milliseconds to wait for the application to die after sending a Control-C event to its console. Override in registry. - NSSM_KILL_CONSOLE_GRACE_PERIOD
 	kill_window_grace_period	= 1500,		// How many milliseconds to wait for the application to die after posting to its windows' message queues. Override in registry. - NSSM_KILL_WINDOW_GRACE_PERIOD
 	kill_threads_grace_period	= 1500,		// How many milliseconds to wait for the application to die after posting to its threads' message queues. Override in registry. - NSSM_KILL_THREADS_GRACE_PERIOD
-	rotatedelay					= 0,		// How many milliseconds to pause after rotating logs - NSSM_ROTATE_DELAY
+	rotatedelay					= 0,		// How many milliseconds copy-and-truncate rotation at startup waits for more output - NSSM_ROTATE_DELAY
 	waithintmargin				= 2000,		// Margin of error for service status wait hints in milliseconds - NSSM_WAITHINT_MARGIN
 	statusdeadline				= 20000,	// How many milliseconds to wait before updating service status - NSSM_SERVICE_STATUS_DEADLINE
 	controlstart				= 0,		// User-defined service controls can be in the range 128-255 - NSSM_SERVICE_CONTROL_START
 	controlrotate				= 128,		//  - NSSM_SERVICE_CONTROL_ROTATE
 	hookdeadline				= 60000,	// How many milliseconds to wait for a hook - NSSM_HOOK_DEADLINE
 	threaddeadline				= 80000,	// How many milliseconds to wait for outstanding hooks - NSSM_HOOK_THREAD_DEADLINE
+	queuereport					= 60000,	// How many milliseconds between reports of discarded log output - NSSM_QUEUE_REPORT_INTERVAL
 	cleanupdeadline				= 1500		// How many milliseconds to wait for closing logging thread - NSSM_CLEANUP_LOGGERS_DEADLINE
 };
 
@@ -78,6 +78,7 @@ MSDISABLE_WARNING_PUSH(4514 5262 5264)
 //#include <algorithm>
 //#include <any>
 #include <array>
+#include <atomic>
 //#include <charconv>
 #include <chrono>
 //#include <complex>
@@ -115,6 +116,10 @@ MSDISABLE_WARNING_PUSH(4514 5262 5264)
 #include <fcntl.h>
 #include <io.h>
 //#include <tchar.h>
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
 MSDISABLE_WARNING_POP
 GCCDISABLE_WARNING_POP
 
@@ -122,6 +127,7 @@ MSDISABLE_WARNING_PUSH(4820 5039)
 #include <ntstatus.h>
 #define WIN32_NO_STATUS
 #include <windows.h>
+#include <winioctl.h>
 #include <psapi.h>
 #include <ntsecapi.h>
 #include <tlhelp32.h>
@@ -131,6 +137,8 @@ MSDISABLE_WARNING_PUSH(4820 5039)
 #include <commdlg.h>
 #include <shellapi.h>
 #include <shlwapi.h>
+#include <winsock2.h>
+#include <ws2tcpip.h>
 MSDISABLE_WARNING_POP
 
 //MSDISABLE_WARNING_PUSH(4061 4365 4514 4625 4626 4820 5026 5027 6326)
@@ -149,6 +157,12 @@ MSDISABLE_WARNING_POP
 ////MSADD_LIBRARY("gmock_main.lib")
 //MSDISABLE_WARNING_POP
 
+// zlib, for gzip compression of rotated output files
+MSDISABLE_WARNING_PUSH(4820)
+#include <zlib.h>
+MSADD_LIBRARY("zlib.lib")
+MSDISABLE_WARNING_POP
+
 // enum bit mask operations
 #ifndef ENABLE_ENUM_BITMASKS
 #define ENABLE_ENUM_BITMASKS(e) _BITMASK_OPS(, e) // <type_traits>
@@ -0,0 +1,383 @@
+/*******************************************************************************
+ compress.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "compress.h"
+
+/*
+  Compression and retention of rotated output files.
+
+  Rotated files are never written again so we can ask the filesystem to
+  compress them in place.  The file keeps its name and contents as far as
+  any reader is concerned, so there is no window in which it is missing or
+  half written, and the data never passes through our own buffers.
+
+  The Windows Overlay Filter (Windows 10 and later) gives much better ratios
+  than NTFS compression but is only available on some volumes.  If it can't
+  be used we fall back to NTFS compression.
+
+  Filesystem compression is invisible once the file leaves the volume and
+  isn't available at all on FAT or ReFS.  With NSSM_COMPRESS_GZIP we instead
+  write a gzip copy next to the file under a temporary name, rename it to
+  <rotated>.gz once it is complete and then delete the original.  A reader
+  sees either the whole of one file or the whole of the other.  The
+  compressor works on a fixed window so memory use doesn't depend on the
+  size of the file.
+
+  The work is done by a single background thread running at low CPU and I/O
+  priority.  The logging thread only ever queues a path and never waits.
+  Once the new rotation is compressed the same thread applies the retention
+  policy to the older ones.
+*/
+
+/* The Windows 7 SDK headers don't know about the Windows Overlay Filter. */
+#ifndef WOF_CURRENT_VERSION
+#define WOF_CURRENT_VERSION 1
+#define WOF_PROVIDER_FILE 2
+typedef struct
+{
+	ULONG Version;
+	ULONG Provider;
+} WOF_EXTERNAL_INFO;
+#endif
+
+#ifndef FILE_PROVIDER_CURRENT_VERSION
+#define FILE_PROVIDER_CURRENT_VERSION 1
+#define FILE_PROVIDER_COMPRESSION_LZX 1
+#define FILE_PROVIDER_COMPRESSION_XPRESS8K 2
+typedef struct
+{
+	ULONG Version;
+	ULONG Algorithm;
+	ULONG Flags;
+} FILE_PROVIDER_EXTERNAL_INFO_V1;
+#endif
+
+#ifndef FSCTL_SET_EXTERNAL_BACKING
+#define FSCTL_SET_EXTERNAL_BACKING CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 195, METHOD_BUFFERED, FILE_SPECIAL_ACCESS)
+#endif
+
+#ifndef ERROR_COMPRESSION_NOT_BENEFICIAL
+#define ERROR_COMPRESSION_NOT_BENEFICIAL 344L
+#endif
+
+static compress_job_t jobs[NSSM_COMPRESS_QUEUE];
+static uint32_t first_job;
+static uint32_t queued_jobs;
+static HANDLE compress_thread;
+static SRWLOCK compress_lock = SRWLOCK_INIT;
+static CONDITION_VARIABLE compress_condition = CONDITION_VARIABLE_INIT;
+
+static uint32_t wof_compress(HANDLE file, uint32_t method)
+{
+	struct
+	{
+		WOF_EXTERNAL_INFO wof;
+		FILE_PROVIDER_EXTERNAL_INFO_V1 provider;
+	} info;
+
+	info.wof.Version = WOF_CURRENT_VERSION;
+	info.wof.Provider = WOF_PROVIDER_FILE;
+	info.provider.Version = FILE_PROVIDER_CURRENT_VERSION;
+	info.provider.Algorithm = (method == NSSM_COMPRESS_LZX) ? FILE_PROVIDER_COMPRESSION_LZX : FILE_PROVIDER_COMPRESSION_XPRESS8K;
+	info.provider.Flags = 0;
+
+	unsigned long bytes;
+	if (DeviceIoControl(file, FSCTL_SET_EXTERNAL_BACKING, &info, sizeof(info), 0, 0, &bytes, 0))
+		return ERROR_SUCCESS;
+	return GetLastError();
+}
+
+static uint32_t ntfs_compress(HANDLE file)
+{
+	USHORT format = COMPRESSION_FORMAT_DEFAULT;
+	unsigned long bytes;
+	if (DeviceIoControl(file, FSCTL_SET_COMPRESSION, &format, sizeof(format), 0, 0, &bytes, 0))
+		return ERROR_SUCCESS;
+	return GetLastError();
+}
+
+/* Seconds since 1970 for the gzip header, or zero if the time is earlier or too late to fit. */
+static uint32_t unix_time(FILETIME* ft)
+{
+	ULARGE_INTEGER time;
+	time.LowPart = ft->dwLowDateTime;
+	time.HighPart = ft->dwHighDateTime;
+	/* 100ns intervals between 1601 and 1970. */
+	if (time.QuadPart < 116444736000000000ULL)
+		return 0;
+	uint64_t seconds = (time.QuadPart - 116444736000000000ULL) / 10000000;
+	return (seconds > UINT32_MAX) ? 0 : (uint32_t)seconds;
+}
+
+/*
+  Compress file to out, giving it the modification time modified.
+  Returns 0 on success or the error, with *function set to what failed.
+*/
+static uint32_t write_gzip(HANDLE file, HANDLE out, FILETIME* modified, wchar_t** function)
+{
+	deflate_t d;
+	if (init_deflate(&d, unix_time(modified)))
+	{
+		*function = L"deflateInit2()";
+		return ERROR_NOT_ENOUGH_MEMORY;
+	}
+
+	uint32_t error = ERROR_SUCCESS;
+	unsigned long got = 1;
+	while (got && error == ERROR_SUCCESS)
+	{
+		if (!::ReadFile(file, d.in, NSSM_DEFLATE_INPUT, &got, 0))
+		{
+			*function = L"ReadFile()";
+			error = GetLastError();
+			break;
+		}
+
+		/* End of file finishes the stream. */
+		deflate_input(&d, got, !got);
+		int32_t ret;
+		while ((ret = deflate_output(&d)) > 0)
+		{
+			unsigned long written;
+			if (!::WriteFile(out, d.out, d.out_len, &written, 0))
+			{
+				*function = L"WriteFile()";
+				error = GetLastError();
+				break;
+			}
+		}
+		if (ret < 0)
+		{
+			*function = L"deflate()";
+			error = ERROR_INVALID_DATA;
+		}
+	}
+
+	free_deflate(&d);
+	return error;
+}
+
+/* Replace the rotated file with <rotated>.gz. */
+static void gzip_file(compress_job_t* job)
+{
+	wchar_t gzip_path[nssmconst::pathlength];
+	wchar_t temporary[nssmconst::pathlength];
+	if (::_snwprintf_s(gzip_path, std::size(gzip_path), _TRUNCATE, L"%s%s", job->rotated, NSSM_GZIP_EXTENSION) < 0 || ::_snwprintf_s(temporary, std::size(temporary), _TRUNCATE, L"%s%s", gzip_path, NSSM_GZIP_TEMPORARY) < 0)
+	{
+		log_event(EVENTLOG_WARNING_TYPE, NSSM_EVENT_COMPRESS_FAILED, job->service_name, job->rotated, L"_snwprintf_s()", error_string(ERROR_FILENAME_EXCED_RANGE), 0);
+		return;
+	}
+
+	/* Nobody should be writing to a rotated file. */
+	HANDLE file = ::CreateFileW(job->rotated, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		uint32_t error = GetLastError();
+		/* Retention may have removed it already. */
+		if (error != ERROR_FILE_NOT_FOUND)
+			log_event(EVENTLOG_WARNING_TYPE, NSSM_EVENT_COMPRESS_FAILED, job->service_name, job->rotated, L"::CreateFileW()", error_string(error), 0);
+		return;
+	}
+
+	HANDLE out = ::CreateFileW(temporary, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (out == INVALID_HANDLE_VALUE)
+	{
+		uint32_t error = GetLastError();
+		CloseHandle(file);
+		log_event(EVENTLOG_WARNING_TYPE, NSSM_EVENT_COMPRESS_FAILED, job->service_name, job->rotated, L"::CreateFileW()", error_string(error), 0);
+		return;
+	}
+
+	/* The copy keeps the original's modification time, which the gzip header records too. */
+	FILETIME modified;
+	wchar_t* function = L"GetFileTime()";
+	uint32_t error = ERROR_SUCCESS;
+	if (!GetFileTime(file, 0, 0, &modified))
+		error = GetLastError();
+	if (error == ERROR_SUCCESS)
+		error = write_gzip(file, out, &modified, &function);
+	if (error == ERROR_SUCCESS && !SetFileTime(out, 0, 0, &modified))
+	{
+		function = L"SetFileTime()";
+		error = GetLastError();
+	}
+	/* The rename mustn't reach the disk before the data. */
+	if (error == ERROR_SUCCESS && !FlushFileBuffers(out))
+	{
+		function = L"FlushFileBuffers()";
+		error = GetLastError();
+	}
+	CloseHandle(out);
+	CloseHandle(file);
+
+	if (error == ERROR_SUCCESS && !::MoveFileExW(temporary, gzip_path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+	{
+		function = L"::MoveFileExW()";
+		error = GetLastError();
+	}
+	if (error != ERROR_SUCCESS)
+	{
+		::DeleteFileW(temporary);
+		log_event(EVENTLOG_WARNING_TYPE, NSSM_EVENT_COMPRESS_FAILED, job->service_name, job->rotated, function, error_string(error), 0);
+		return;
+	}
+
+	if (!::DeleteFileW(job->rotated))
+	{
+		/* Keep one copy of the output, not two. */
+		error = GetLastError();
+		::DeleteFileW(gzip_path);
+		log_event(EVENTLOG_WARNING_TYPE, NSSM_EVENT_COMPRESS_FAILED, job->service_name, job->rotated, L"::DeleteFileW()", error_string(error), 0);
+		return;
+	}
+	/* Offsets in the time index are into the uncompressed file. */
+	delete_time_index(job->rotated);
+}
+
+static void compress_file(compress_job_t* job)
+{
+	if (job->method == NSSM_COMPRESS_NONE)
+		return;
+	if (job->method == NSSM_COMPRESS_GZIP)
+	{
+		gzip_file(job);
+		return;
+	}
+
+	/* Nobody should be writing to a rotated file. */
+	HANDLE file = ::CreateFileW(job->rotated, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		uint32_t error = GetLastError();
+		/* Retention may have removed it already. */
+		if (error != ERROR_FILE_NOT_FOUND)
+			log_event(EVENTLOG_WARNING_TYPE, NSSM_EVENT_COMPRESS_FAILED, job->service_name, job->rotated, L"::CreateFileW()", error_string(error), 0);
+		return;
+	}
+
+	wchar_t* function = L"FSCTL_SET_COMPRESSION";
+	uint32_t error = ERROR_NOT_SUPPORTED;
+	if (job->method != NSSM_COMPRESS_NTFS)
+	{
+		function = L"FSCTL_SET_EXTERNAL_BACKING";
+		error = wof_compress(file, job->method);
+		/* Too small or incompressible data is not a failure. */
+		if (error == ERROR_COMPRESSION_NOT_BENEFICIAL)
+			error = ERROR_SUCCESS;
+	}
+	if (error != ERROR_SUCCESS)
+	{
+		function = L"FSCTL_SET_COMPRESSION";
+		error = ntfs_compress(file);
+	}
+	CloseHandle(file);
+
+	if (error != ERROR_SUCCESS)
+		log_event(EVENTLOG_WARNING_TYPE, NSSM_EVENT_COMPRESS_FAILED, job->service_name, job->rotated, function, error_string(error), 0);
+}
+
+/* Background thread which works through the queue. */
+static ULONG __stdcall compress_files(void*)
+{
+	/* Lowers both CPU and I/O priority so the application is unaffected. */
+	SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+
+	while (true)
+	{
+		AcquireSRWLockExclusive(&compress_lock);
+		while (!queued_jobs)
+			SleepConditionVariableSRW(&compress_condition, &compress_lock, INFINITE, 0);
+		compress_job_t job = jobs[first_job];
+		first_job = (first_job + 1) % NSSM_COMPRESS_QUEUE;
+		queued_jobs--;
+		ReleaseSRWLockExclusive(&compress_lock);
+
+		compress_file(&job);
+		apply_retention(job.service_name, job.path, &job.retention);
+		/* Both paths share one allocation. */
+		HeapFree(GetProcessHeap(), 0, job.path);
+	}
+
+	return 0;
+}
+
+/*
+  Queue a freshly rotated file for compression and retention.
+  Never blocks: if the queue is full the file is left as it is and old
+  rotations will be cleaned up after the next one.
+*/
+void queue_rotated_file(wchar_t* service_name, wchar_t* path, wchar_t* rotated, uint32_t method, retention_t* retention)
+{
+	if (method > NSSM_COMPRESS_MAX)
+		method = NSSM_COMPRESS_NONE;
+	if (method == NSSM_COMPRESS_NONE && !want_retention(retention))
+		return;
+
+	size_t len = wcslen(path) + 1;
+	size_t rotated_len = wcslen(rotated) + 1;
+	wchar_t* copy = (wchar_t*)HeapAlloc(GetProcessHeap(), 0, (len + rotated_len) * sizeof(wchar_t));
+	if (!copy)
+	{
+		log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_OUT_OF_MEMORY, L"path", L"queue_rotated_file()", 0);
+		return;
+	}
+	memmove(copy, path, len * sizeof(wchar_t));
+	memmove(copy + len, rotated, rotated_len * sizeof(wchar_t));
+
+	wchar_t* function = 0;
+	uint32_t error = ERROR_SUCCESS;
+	AcquireSRWLockExclusive(&compress_lock);
+	if (!compress_thread)
+	{
+		compress_thread = CreateThread(nullptr, 0, compress_files, nullptr, 0, nullptr);
+		if (!compress_thread)
+		{
+			function = L"CreateThread()";
+			error = GetLastError();
+		}
+	}
+	if (compress_thread)
+	{
+		if (queued_jobs < NSSM_COMPRESS_QUEUE)
+		{
+			compress_job_t* job = &jobs[(first_job + queued_jobs) % NSSM_COMPRESS_QUEUE];
+			job->service_name = service_name;
+			job->path = copy;
+			job->rotated = copy + len;
+			job->method = method;
+			if (retention)
+				job->retention = *retention;
+			else
+				ZeroMemory(&job->retention, sizeof(job->retention));
+			queued_jobs++;
+			copy = 0;
+		}
+		else
+		{
+			function = L"queue_rotated_file()";
+			error = ERROR_BUSY;
+		}
+	}
+	ReleaseSRWLockExclusive(&compress_lock);
+
+	if (copy)
+	{
+		log_event(EVENTLOG_WARNING_TYPE, NSSM_EVENT_COMPRESS_FAILED, service_name, rotated, function, error_string(error), 0);
+		HeapFree(GetProcessHeap(), 0, copy);
+	}
+	else
+		WakeConditionVariable(&compress_condition);
+}
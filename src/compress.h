@@ -0,0 +1,46 @@
+/*******************************************************************************
+ compress.h - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+#pragma once
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+/* How rotated files are compressed (AppRotateCompress). */
+#define NSSM_COMPRESS_NONE      0
+#define NSSM_COMPRESS_NTFS      1	/* LZNT1 */
+#define NSSM_COMPRESS_XPRESS    2	/* Windows Overlay Filter XPRESS 8K */
+#define NSSM_COMPRESS_LZX       3	/* Windows Overlay Filter LZX */
+#define NSSM_COMPRESS_GZIP      4	/* gzip copy which replaces the file */
+#define NSSM_COMPRESS_MAX       NSSM_COMPRESS_GZIP
+
+/* Added to the name of a rotated file written with NSSM_COMPRESS_GZIP. */
+#define NSSM_GZIP_EXTENSION     L".gz"
+/* Added to that while it is being written. */
+#define NSSM_GZIP_TEMPORARY     L".tmp"
+
+/* Rotated files waiting for the background thread. */
+#define NSSM_COMPRESS_QUEUE     64
+
+typedef struct
+{
+	wchar_t* service_name;
+	wchar_t* path;
+	wchar_t* rotated;
+	uint32_t method;
+	retention_t retention;
+} compress_job_t;
+
+void queue_rotated_file(wchar_t*, wchar_t*, wchar_t*, uint32_t, retention_t*);
+
+#endif
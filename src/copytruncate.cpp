@@ -0,0 +1,296 @@
+/*******************************************************************************
+ copytruncate.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "copytruncate.h"
+
+/*
+  Copy-and-truncate rotation.
+
+  A file which another process holds open can't be renamed, so we copy it
+  and truncate the original.  CopyFileW() followed by a fixed pause and a
+  truncate throws away whatever was written after the copy finished.
+  Instead we copy in large chunks through our own read handle, go back for
+  anything appended while we were busy, and truncate once we have caught
+  up.  Output which keeps arriving faster than we can copy it is counted
+  as lost rather than chased forever.
+
+  Where the volume supports block cloning (ReFS) the bulk of the file is
+  cloned instead, so even a very large file is rotated in moments and its
+  data isn't duplicated on disk.
+*/
+
+/* The Windows 7 SDK headers don't know about block cloning. */
+#ifndef FSCTL_DUPLICATE_EXTENTS_TO_FILE
+#define FSCTL_DUPLICATE_EXTENTS_TO_FILE CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 209, METHOD_BUFFERED, FILE_WRITE_DATA)
+typedef struct
+{
+	HANDLE FileHandle;
+	LARGE_INTEGER SourceFileOffset;
+	LARGE_INTEGER TargetFileOffset;
+	LARGE_INTEGER ByteCount;
+} DUPLICATE_EXTENTS_DATA;
+#endif
+
+#ifndef FILE_SUPPORTS_BLOCK_REFCOUNTING
+#define FILE_SUPPORTS_BLOCK_REFCOUNTING 0x08000000
+#endif
+
+/*
+  Clone the whole clusters among the first size bytes of source into the
+  empty target and leave its file pointer after them.  Returns the number
+  of bytes cloned, which is zero if the volume can't clone.
+*/
+static uint64_t clone_blocks(wchar_t* path, HANDLE source, HANDLE target, uint64_t size)
+{
+	unsigned long flags;
+	if (!::GetVolumeInformationByHandleW(source, 0, 0, 0, 0, &flags, 0, 0) || !(flags & FILE_SUPPORTS_BLOCK_REFCOUNTING))
+		return 0;
+
+	wchar_t volume[nssmconst::pathlength];
+	unsigned long sectors_per_cluster;
+	unsigned long bytes_per_sector;
+	unsigned long free_clusters;
+	unsigned long total_clusters;
+	if (!::GetVolumePathNameW(path, volume, (uint32_t)std::size(volume)) || !::GetDiskFreeSpaceW(volume, &sectors_per_cluster, &bytes_per_sector, &free_clusters, &total_clusters))
+		return 0;
+	uint64_t cluster = (uint64_t)sectors_per_cluster * bytes_per_sector;
+	if (!cluster || NSSM_CLONE_CHUNK % cluster)
+		return 0;
+
+	/* The tail of a partial cluster is copied. */
+	uint64_t whole = size / cluster * cluster;
+	if (!whole)
+		return 0;
+
+	/* A sparse source needs a sparse target. */
+	BY_HANDLE_FILE_INFORMATION info;
+	unsigned long bytes;
+	if (GetFileInformationByHandle(source, &info) && (info.dwFileAttributes & FILE_ATTRIBUTE_SPARSE_FILE))
+	{
+		if (!DeviceIoControl(target, FSCTL_SET_SPARSE, 0, 0, 0, 0, &bytes, 0))
+			return 0;
+	}
+
+	/* Cloned ranges must lie within the target. */
+	LARGE_INTEGER end;
+	end.QuadPart = (int64_t)whole;
+	if (!SetFilePointerEx(target, end, 0, FILE_BEGIN) || !SetEndOfFile(target))
+		return 0;
+
+	DUPLICATE_EXTENTS_DATA extents;
+	extents.FileHandle = source;
+	for (uint64_t offset = 0; offset < whole; offset += NSSM_CLONE_CHUNK)
+	{
+		uint64_t count = whole - offset;
+		if (count > NSSM_CLONE_CHUNK)
+			count = NSSM_CLONE_CHUNK;
+		extents.SourceFileOffset.QuadPart = (int64_t)offset;
+		extents.TargetFileOffset.QuadPart = (int64_t)offset;
+		extents.ByteCount.QuadPart = (int64_t)count;
+		if (!DeviceIoControl(target, FSCTL_DUPLICATE_EXTENTS_TO_FILE, &extents, sizeof(extents), 0, 0, &bytes, 0))
+		{
+			/* Eg a source with integrity streams.  Copy it all instead. */
+			end.QuadPart = 0;
+			SetFilePointerEx(target, end, 0, FILE_BEGIN);
+			SetEndOfFile(target);
+			return 0;
+		}
+	}
+	return whole;
+}
+
+/* Append bytes result->copied to end of source to target.  Returns 0 on success. */
+static uint32_t copy_range(HANDLE source, HANDLE target, char* buffer, uint64_t end, copy_truncate_t* result)
+{
+	LARGE_INTEGER offset;
+	offset.QuadPart = (int64_t)result->copied;
+	if (!SetFilePointerEx(source, offset, 0, FILE_BEGIN))
+	{
+		result->function = L"SetFilePointerEx()";
+		return GetLastError();
+	}
+
+	while (result->copied < end)
+	{
+		uint64_t remaining = end - result->copied;
+		unsigned long want = (remaining < NSSM_COPY_CHUNK) ? (unsigned long)remaining : NSSM_COPY_CHUNK;
+		unsigned long got;
+		if (!ReadFile(source, buffer, want, &got, 0))
+		{
+			result->function = L"ReadFile()";
+			return GetLastError();
+		}
+		/* Someone else truncated it. */
+		if (!got)
+			break;
+
+		unsigned long written;
+		if (!WriteFile(target, buffer, got, &written, 0))
+		{
+			result->function = L"WriteFile()";
+			return GetLastError();
+		}
+		if (written != got)
+		{
+			result->function = L"WriteFile()";
+			return ERROR_HANDLE_DISK_FULL;
+		}
+		result->copied += got;
+	}
+	return ERROR_SUCCESS;
+}
+
+/*
+  Copy path to rotated, which mustn't exist, then truncate path through
+  file, which must have write access.  If another process is writing to
+  path we go back for its output up to passes times, and once we have
+  caught up we wait up to settle milliseconds for more.  A caller which
+  holds the only write handle passes zero for both, so nothing waits.
+  If the copy fails path is left alone and rotated is removed.
+  Returns 0 on success or an error code, in which case result->function
+  says what failed.
+*/
+uint32_t copy_and_truncate_file(wchar_t* path, HANDLE file, wchar_t* rotated, uint32_t settle, uint32_t passes, copy_truncate_t* result)
+{
+	ZeroMemory(result, sizeof(*result));
+	uint64_t started = GetTickCount64();
+
+	HANDLE source = ::CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (source == INVALID_HANDLE_VALUE)
+	{
+		result->function = L"::CreateFileW()";
+		return GetLastError();
+	}
+
+	HANDLE target = ::CreateFileW(rotated, GENERIC_READ | GENERIC_WRITE, 0, 0, CREATE_NEW, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (target == INVALID_HANDLE_VALUE)
+	{
+		result->function = L"::CreateFileW()";
+		uint32_t error = GetLastError();
+		CloseHandle(source);
+		return error;
+	}
+
+	uint32_t error = ERROR_SUCCESS;
+	LARGE_INTEGER size;
+	char* buffer = (char*)HeapAlloc(GetProcessHeap(), 0, NSSM_COPY_CHUNK);
+	if (!buffer)
+	{
+		result->function = L"HeapAlloc()";
+		error = ERROR_OUTOFMEMORY;
+	}
+	else if (!GetFileSizeEx(source, &size))
+	{
+		result->function = L"GetFileSizeEx()";
+		error = GetLastError();
+	}
+	else
+	{
+		uint64_t initial = (uint64_t)size.QuadPart;
+		result->cloned = result->copied = clone_blocks(path, source, target, initial);
+		error = copy_range(source, target, buffer, initial, result);
+
+		/* Go back for output appended while we were copying. */
+		uint64_t deadline = 0;
+		while (error == ERROR_SUCCESS)
+		{
+			if (!GetFileSizeEx(source, &size))
+			{
+				result->function = L"GetFileSizeEx()";
+				error = GetLastError();
+				break;
+			}
+
+			if ((uint64_t)size.QuadPart <= result->copied)
+			{
+				/* Caught up. */
+				uint64_t now = GetTickCount64();
+				if (!deadline)
+					deadline = now + settle;
+				if (now >= deadline)
+					break;
+				uint64_t wait = deadline - now;
+				Sleep((wait < NSSM_COPY_SETTLE_POLL) ? (uint32_t)wait : NSSM_COPY_SETTLE_POLL);
+				continue;
+			}
+
+			/* Give up; what we didn't copy is counted as lost below. */
+			if (!passes--)
+				break;
+			error = copy_range(source, target, buffer, (uint64_t)size.QuadPart, result);
+		}
+		if (result->copied > initial)
+			result->grown = result->copied - initial;
+	}
+
+	bool copied = (error == ERROR_SUCCESS);
+	if (copied)
+	{
+		/* Keep the original's times, as CopyFileW() would. */
+		FILETIME created;
+		FILETIME written;
+		if (GetFileTime(source, &created, 0, &written))
+			SetFileTime(target, &created, 0, &written);
+
+		/*
+		  Look again right before truncating, so that output appended since
+		  the last check is counted too.  Only what is written between this
+		  call and the next goes unnoticed.
+		*/
+		if (GetFileSizeEx(source, &size) && (uint64_t)size.QuadPart > result->copied)
+			result->lost = (uint64_t)size.QuadPart - result->copied;
+
+		LARGE_INTEGER zero;
+		zero.QuadPart = 0;
+		if (!SetFilePointerEx(file, zero, 0, FILE_BEGIN) || !SetEndOfFile(file))
+		{
+			result->function = L"SetEndOfFile()";
+			error = GetLastError();
+			result->lost = 0;
+		}
+	}
+
+	if (buffer)
+		HeapFree(GetProcessHeap(), 0, buffer);
+	CloseHandle(target);
+	CloseHandle(source);
+	if (!copied)
+		::DeleteFileW(rotated);
+	result->elapsed = GetTickCount64() - started;
+	return error;
+}
+
+/* Log how long a copy-and-truncate rotation took and what it lost. */
+void report_copy_and_truncate(wchar_t* service_name, wchar_t* path, wchar_t* rotated, copy_truncate_t* result)
+{
+	wchar_t copied[32];
+	wchar_t cloned[32];
+	wchar_t grown[32];
+	wchar_t elapsed[32];
+	::_snwprintf_s(copied, std::size(copied), _TRUNCATE, L"%llu", result->copied);
+	::_snwprintf_s(cloned, std::size(cloned), _TRUNCATE, L"%llu", result->cloned);
+	::_snwprintf_s(grown, std::size(grown), _TRUNCATE, L"%llu", result->grown);
+	::_snwprintf_s(elapsed, std::size(elapsed), _TRUNCATE, L"%llu", result->elapsed);
+	log_event(EVENTLOG_INFORMATION_TYPE, NSSM_EVENT_COPIED_AND_TRUNCATED, service_name, path, rotated, elapsed, copied, cloned, grown, 0);
+
+	if (result->lost)
+	{
+		wchar_t lost[32];
+		::_snwprintf_s(lost, std::size(lost), _TRUNCATE, L"%llu", result->lost);
+		log_event(EVENTLOG_WARNING_TYPE, NSSM_EVENT_COPY_TRUNCATE_LOST, service_name, path, rotated, lost, 0);
+	}
+}
@@ -0,0 +1,43 @@
+/*******************************************************************************
+ copytruncate.h - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#pragma once
+
+#ifndef COPYTRUNCATE_H
+#define COPYTRUNCATE_H
+
+/* Bytes copied at a time when blocks can't be cloned. */
+#define NSSM_COPY_CHUNK         1048576
+/* Bytes cloned at a time, a multiple of any cluster size. */
+#define NSSM_CLONE_CHUNK        1073741824
+/* Passes made over output written during the copy before giving up on it. */
+#define NSSM_COPY_PASSES        8
+/* Milliseconds between checks for more output while we let the file settle. */
+#define NSSM_COPY_SETTLE_POLL   50
+
+/* What a copy-and-truncate rotation did. */
+typedef struct
+{
+	uint64_t copied;	/* Bytes in the rotated file. */
+	uint64_t cloned;	/* Of which shared by block cloning. */
+	uint64_t grown;		/* Of which written while we were copying. */
+	uint64_t lost;		/* Written too late to copy and discarded by truncation. */
+	uint64_t elapsed;	/* Milliseconds taken. */
+	wchar_t* function;	/* What failed. */
+} copy_truncate_t;
+
+uint32_t copy_and_truncate_file(wchar_t*, HANDLE, wchar_t*, uint32_t, uint32_t, copy_truncate_t*);
+void report_copy_and_truncate(wchar_t*, wchar_t*, wchar_t*, copy_truncate_t*);
+
+#endif
@@ -0,0 +1,99 @@
+/*******************************************************************************
+ deflate.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "deflate.h"
+
+/*
+  gzip (RFC 1952) compression with zlib.
+
+  The caller fills d->in with up to NSSM_DEFLATE_INPUT bytes and hands them
+  over with deflate_input(), then calls deflate_output() until it returns 0,
+  writing out d->out_len bytes from d->out each time it returns 1.  The last
+  input, which may be empty, is passed with finish set so that zlib writes
+  the rest of its output and the trailer.
+*/
+
+static voidpf deflate_alloc(voidpf, uInt items, uInt size)
+{
+	return HeapAlloc(GetProcessHeap(), 0, (size_t)items * size);
+}
+
+static void deflate_free(voidpf, voidpf address)
+{
+	HeapFree(GetProcessHeap(), 0, address);
+}
+
+/* Set up d to compress with modified (seconds since 1970) in the gzip header.  Returns 0 on success. */
+int32_t init_deflate(deflate_t* d, uint32_t modified)
+{
+	ZeroMemory(d, sizeof(*d));
+	d->in = (unsigned char*)HeapAlloc(GetProcessHeap(), 0, NSSM_DEFLATE_INPUT + NSSM_DEFLATE_OUTPUT);
+	if (!d->in)
+		return -1;
+	d->out = d->in + NSSM_DEFLATE_INPUT;
+
+	d->z.zalloc = deflate_alloc;
+	d->z.zfree = deflate_free;
+	if (deflateInit2(&d->z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, NSSM_DEFLATE_GZIP_BITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		HeapFree(GetProcessHeap(), 0, d->in);
+		d->in = 0;
+		return -1;
+	}
+
+	d->header.time = modified;
+	d->header.os = NSSM_GZIP_OS_NTFS;
+	if (deflateSetHeader(&d->z, &d->header) != Z_OK)
+	{
+		free_deflate(d);
+		return -1;
+	}
+	return 0;
+}
+
+void free_deflate(deflate_t* d)
+{
+	if (!d->in)
+		return;
+	deflateEnd(&d->z);
+	HeapFree(GetProcessHeap(), 0, d->in);
+	d->in = d->out = 0;
+}
+
+/* Compress the first len bytes of d->in, ending the stream if finish is set. */
+void deflate_input(deflate_t* d, uint32_t len, bool finish)
+{
+	d->z.next_in = d->in;
+	d->z.avail_in = len;
+	d->finish = finish;
+}
+
+/*
+  Compress some more of the input.
+  Returns 1 if there is output in d->out, 0 once the input is used up or
+  the stream has ended, or -1 on error.
+*/
+int32_t deflate_output(deflate_t* d)
+{
+	d->z.next_out = d->out;
+	d->z.avail_out = NSSM_DEFLATE_OUTPUT;
+	int32_t ret = deflate(&d->z, d->finish ? Z_FINISH : Z_NO_FLUSH);
+	d->out_len = NSSM_DEFLATE_OUTPUT - d->z.avail_out;
+	/* Z_BUF_ERROR only means there was nothing to do. */
+	if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+		return -1;
+	return d->out_len ? 1 : 0;
+}
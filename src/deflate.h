@@ -0,0 +1,46 @@
+/*******************************************************************************
+ deflate.h - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+#pragma once
+
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+/* Input taken and output given back at a time. */
+#define NSSM_DEFLATE_INPUT      65536
+#define NSSM_DEFLATE_OUTPUT     65536
+/* zlib window bits, plus 16 for a gzip header and trailer. */
+#define NSSM_DEFLATE_GZIP_BITS  (16 + MAX_WBITS)
+/* gzip's operating system code for NTFS. */
+#define NSSM_GZIP_OS_NTFS       11
+
+/*
+  gzip compressor for a stream of data.  The memory it uses is fixed when it
+  is created, whatever the size of the stream.
+*/
+typedef struct
+{
+	z_stream z;
+	gz_header header;
+	unsigned char* in;
+	unsigned char* out;
+	uint32_t out_len;
+	bool finish;
+} deflate_t;
+
+int32_t init_deflate(deflate_t*, uint32_t);
+void free_deflate(deflate_t*);
+void deflate_input(deflate_t*, uint32_t, bool);
+int32_t deflate_output(deflate_t*);
+
+#endif
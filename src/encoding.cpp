@@ -0,0 +1,125 @@
+/*******************************************************************************
+ encoding.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "encoding.h"
+
+/*
+  Decide on the character size from what we've seen so far.
+  ASCII range text in UTF-16LE has a NUL at every odd offset and almost
+  none at even offsets.  8-bit text has no NULs at all, and NULs in
+  binary output fall at even and odd offsets alike.
+*/
+static uint32_t decide(detector_t* detector, const void* address, uint32_t bufsize)
+{
+	if (!detector->even_nuls && !detector->odd_nuls)
+	{
+		/* Nothing to go on but the text itself, eg UTF-16 outside Latin scripts. */
+		if (detector->charsize)
+			return detector->charsize;
+		if (IsTextUnicode(address, bufsize, 0))
+			return (uint32_t)sizeof(wchar_t);
+		return (uint32_t)sizeof(char);
+	}
+
+	uint64_t units = detector->bytes / sizeof(wchar_t);
+	if (detector->odd_nuls * 32 >= units && detector->odd_nuls > detector->even_nuls * 8)
+		return (uint32_t)sizeof(wchar_t);
+	return (uint32_t)sizeof(char);
+}
+
+static const uint8_t utf16_bom[] = { 0xff, 0xfe };
+static const uint8_t utf8_bom[] = { 0xef, 0xbb, 0xbf };
+
+/* Does the start of the stream match as much of a BOM as there is? */
+static inline bool bom_prefix(const uint8_t* start, uint32_t len, const uint8_t* bom, uint32_t bom_len)
+{
+	return !memcmp(start, bom, (len < bom_len) ? len : bom_len);
+}
+
+/*
+  Feed the next chunk of a stream to the detector and return the character
+  size it should be read as.  skip is set to the number of bytes of a byte
+  order mark at the start of the stream, which the caller should drop.
+
+  While the stream so far could still be the start of a BOM the whole
+  chunk is skipped and held.  If it turns out not to be a BOM, the held
+  bytes are left in detector->held and the caller must write them before
+  the chunk.
+*/
+uint32_t detect_encoding(detector_t* detector, const void* address, uint32_t bufsize, uint32_t* skip)
+{
+	*skip = 0;
+	if (detector->certain || !bufsize)
+		return detector->charsize;
+
+	if (!detector->bytes)
+	{
+		uint8_t start[sizeof(utf8_bom)];
+		uint32_t held = detector->held_len;
+		uint32_t len = held + bufsize;
+		if (len > sizeof(start))
+			len = sizeof(start);
+		memmove(start, detector->held, held);
+		memmove(start + held, address, len - held);
+
+		if (len >= sizeof(utf16_bom) && bom_prefix(start, len, utf16_bom, sizeof(utf16_bom)))
+		{
+			detector->charsize = (uint32_t)sizeof(wchar_t);
+			detector->certain = true;
+			detector->held_len = 0;
+			*skip = (uint32_t)sizeof(utf16_bom) - held;
+			return detector->charsize;
+		}
+		if (len >= sizeof(utf8_bom) && bom_prefix(start, len, utf8_bom, sizeof(utf8_bom)))
+		{
+			detector->charsize = (uint32_t)sizeof(char);
+			detector->certain = true;
+			detector->held_len = 0;
+			*skip = (uint32_t)sizeof(utf8_bom) - held;
+			return detector->charsize;
+		}
+		if ((len < sizeof(utf16_bom) && bom_prefix(start, len, utf16_bom, sizeof(utf16_bom))) || (len < sizeof(utf8_bom) && bom_prefix(start, len, utf8_bom, sizeof(utf8_bom))))
+		{
+			memmove(detector->held, start, len);
+			detector->held_len = len;
+			*skip = bufsize;
+			return detector->charsize;
+		}
+
+		/* Not a BOM after all.  The held bytes start the stream. */
+		detector->bytes = held;
+	}
+
+	/* Offsets are relative to the start of the stream, not the chunk. */
+	uint32_t even, odd;
+	count_nuls(address, bufsize, &even, &odd);
+	if (detector->bytes & 1)
+	{
+		detector->even_nuls += odd;
+		detector->odd_nuls += even;
+	}
+	else
+	{
+		detector->even_nuls += even;
+		detector->odd_nuls += odd;
+	}
+	detector->bytes += bufsize;
+
+	detector->charsize = decide(detector, address, bufsize);
+	if (detector->bytes >= NSSM_DETECT_CERTAIN)
+		detector->certain = true;
+	return detector->charsize;
+}
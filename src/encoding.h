@@ -0,0 +1,45 @@
+/*******************************************************************************
+ encoding.h - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+#pragma once
+
+#ifndef ENCODING_H
+#define ENCODING_H
+
+/* Bytes of evidence after which a guess is no longer revised. */
+#define NSSM_DETECT_CERTAIN 512
+
+/*
+  Per-stream state for detecting whether an application writes UTF-16 or
+  8-bit text.  Statistics are kept across reads so that a guess made on a
+  short first read can be corrected.  A UTF-16 stream read in pieces of odd
+  length has its last byte held back so that no code unit is split.  The
+  start of a byte order mark split across reads is held back too, and
+  left in held for the caller to write if it turns out not to be one.
+*/
+typedef struct
+{
+	uint32_t charsize;
+	bool certain;
+	uint64_t bytes;
+	uint64_t even_nuls;
+	uint64_t odd_nuls;
+	uint8_t odd_byte;
+	bool odd;
+	uint8_t held[3];
+	uint32_t held_len;
+} detector_t;
+
+uint32_t detect_encoding(detector_t*, const void*, uint32_t, uint32_t*);
+
+#endif
@@ -0,0 +1,467 @@
+/*******************************************************************************
+ forward.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "forward.h"
+
+/*
+  Forwarding a stream to a local log agent.
+
+  The target is a named pipe on this machine or a TCP port on the loopback
+  interface.  Output is copied into the forwarder's own queue after it has
+  been written to the file, and a thread per forwarder sends it on.  The
+  queue is separate from the stream's, so an agent which stops reading
+  fills only its own queue and never holds up the file.
+*/
+
+/*
+  Work out what sort of target we have.  A TCP target is tcp://host:port,
+  with IPv6 addresses in brackets.  Returns NSSM_FORWARD_NONE if the target
+  isn't valid.
+*/
+uint32_t forward_target_type(const wchar_t* target, wchar_t* host, uint32_t hostlen, wchar_t* port, uint32_t portlen)
+{
+	size_t len = ::wcslen(NSSM_FORWARD_PIPE_PREFIX);
+	if (!::_wcsnicmp(target, NSSM_FORWARD_PIPE_PREFIX, len))
+		return target[len] ? NSSM_FORWARD_PIPE : NSSM_FORWARD_NONE;
+
+	len = ::wcslen(NSSM_FORWARD_TCP_PREFIX);
+	if (::_wcsnicmp(target, NSSM_FORWARD_TCP_PREFIX, len))
+		return NSSM_FORWARD_NONE;
+
+	const wchar_t* start = target + len;
+	const wchar_t* end;
+	const wchar_t* colon;
+	if (*start == L'[')
+	{
+		end = ::wcschr(++start, L']');
+		if (!end || end[1] != L':')
+			return NSSM_FORWARD_NONE;
+		colon = end + 1;
+	}
+	else
+	{
+		colon = end = ::wcschr(start, L':');
+		if (!colon || ::wcschr(colon + 1, L':'))
+			return NSSM_FORWARD_NONE;
+	}
+
+	if (end == start || (size_t)(end - start) >= hostlen || !colon[1] || ::wcslen(colon + 1) >= portlen)
+		return NSSM_FORWARD_NONE;
+	for (const wchar_t* s = colon + 1; *s; s++)
+	{
+		if (*s < L'0' || *s > L'9')
+			return NSSM_FORWARD_NONE;
+	}
+
+	::wmemcpy(host, start, end - start);
+	host[end - start] = L'\0';
+	::wcscpy_s(port, portlen, colon + 1);
+	return NSSM_FORWARD_TCP;
+}
+
+static inline bool is_connected(forwarder_t* forwarder)
+{
+	return forwarder->pipe || forwarder->socket != INVALID_SOCKET;
+}
+
+static void disconnect(forwarder_t* forwarder)
+{
+	close_handle(&forwarder->pipe);
+	if (forwarder->socket != INVALID_SOCKET)
+	{
+		closesocket(forwarder->socket);
+		forwarder->socket = INVALID_SOCKET;
+	}
+}
+
+/* Returns 0 on success or an error code. */
+static uint32_t connect_pipe(forwarder_t* forwarder)
+{
+	uint32_t error = ERROR_PIPE_BUSY;
+	for (int32_t tries = 0; tries < 2; tries++)
+	{
+		/*
+		  The handle isn't inherited and the agent may only identify us, not
+		  impersonate us.  Writes are overlapped so they can time out.
+		*/
+		HANDLE pipe = ::CreateFileW(forwarder->target, GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_FLAG_OVERLAPPED | SECURITY_SQOS_PRESENT | SECURITY_IDENTIFICATION, 0);
+		if (pipe != INVALID_HANDLE_VALUE)
+		{
+			forwarder->pipe = pipe;
+			return 0;
+		}
+
+		error = GetLastError();
+		if (error != ERROR_PIPE_BUSY || !::WaitNamedPipeW(forwarder->target, NSSM_FORWARD_TIMEOUT))
+			break;
+	}
+	return error;
+}
+
+/* Output must not leave the machine, whatever the host name resolves to. */
+static bool is_loopback(ADDRINFOW* address)
+{
+	if (address->ai_family == AF_INET)
+		return (ntohl(((sockaddr_in*)address->ai_addr)->sin_addr.s_addr) >> 24) == 127;
+	if (address->ai_family == AF_INET6)
+		return IN6_IS_ADDR_LOOPBACK(&((sockaddr_in6*)address->ai_addr)->sin6_addr);
+	return false;
+}
+
+/* Returns 0 on success or an error code. */
+static uint32_t connect_tcp(forwarder_t* forwarder)
+{
+	ADDRINFOW hints;
+	ZeroMemory(&hints, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+
+	ADDRINFOW* addresses;
+	int32_t ret = ::GetAddrInfoW(forwarder->host, forwarder->port, &hints, &addresses);
+	if (ret)
+		return (uint32_t)ret;
+
+	uint32_t error = WSAEADDRNOTAVAIL;
+	for (ADDRINFOW* address = addresses; address; address = address->ai_next)
+	{
+		if (!is_loopback(address))
+		{
+			error = WSAEACCES;
+			continue;
+		}
+
+		/* The application inherits our handles so the socket must not be one of them. */
+		SOCKET s = ::WSASocketW(address->ai_family, address->ai_socktype, address->ai_protocol, nullptr, 0, WSA_FLAG_NO_HANDLE_INHERIT);
+		if (s == INVALID_SOCKET)
+		{
+			error = (uint32_t)WSAGetLastError();
+			continue;
+		}
+
+		/* A listener which stops reading gets dropped rather than waited for. */
+		DWORD timeout = NSSM_FORWARD_TIMEOUT;
+		setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout));
+		if (connect(s, address->ai_addr, (int)address->ai_addrlen) == SOCKET_ERROR)
+		{
+			error = (uint32_t)WSAGetLastError();
+			closesocket(s);
+			continue;
+		}
+
+		forwarder->socket = s;
+		error = 0;
+		break;
+	}
+
+	::FreeAddrInfoW(addresses);
+	return error;
+}
+
+/*
+  Write to the pipe, giving up if the agent doesn't read it within the
+  timeout or the forwarder is closing.  Returns 0 on success or an error
+  code.
+*/
+static uint32_t write_pipe(forwarder_t* forwarder, const char* data, uint32_t len, uint32_t* sent)
+{
+	OVERLAPPED overlapped;
+	ZeroMemory(&overlapped, sizeof(overlapped));
+	overlapped.hEvent = forwarder->written;
+
+	unsigned long written = 0;
+	if (!WriteFile(forwarder->pipe, data, len, &written, &overlapped))
+	{
+		uint32_t error = GetLastError();
+		if (error != ERROR_IO_PENDING)
+			return error;
+
+		HANDLE handles[] = { forwarder->written, forwarder->cancel };
+		if (WaitForMultipleObjects((DWORD)std::size(handles), handles, false, NSSM_FORWARD_TIMEOUT) != WAIT_OBJECT_0)
+		{
+			/* The write must be finished with before the buffer is reused. */
+			::CancelIoEx(forwarder->pipe, &overlapped);
+			GetOverlappedResult(forwarder->pipe, &overlapped, &written, true);
+			return ERROR_TIMEOUT;
+		}
+		if (!GetOverlappedResult(forwarder->pipe, &overlapped, &written, false))
+			return GetLastError();
+	}
+
+	*sent = written;
+	return 0;
+}
+
+/* Returns 0 on success or an error code. */
+static uint32_t send_piece(forwarder_t* forwarder, const char* data, uint32_t len)
+{
+	while (len)
+	{
+		uint32_t sent;
+		if (forwarder->pipe)
+		{
+			uint32_t error = write_pipe(forwarder, data, len, &sent);
+			if (error)
+				return error;
+		}
+		else
+		{
+			int32_t n = send(forwarder->socket, data, (int)len, 0);
+			if (n == SOCKET_ERROR)
+				return (uint32_t)WSAGetLastError();
+			sent = (uint32_t)n;
+		}
+
+		if (!sent)
+			return ERROR_NO_DATA;
+		data += sent;
+		len -= sent;
+	}
+	return 0;
+}
+
+/* Complain once per outage. */
+static void complain(forwarder_t* forwarder, uint32_t error)
+{
+	if (forwarder->complained)
+		return;
+	log_event(EVENTLOG_WARNING_TYPE, NSSM_EVENT_FORWARD_FAILED, forwarder->service_name, forwarder->target, error_string(error), 0);
+	forwarder->complained = true;
+}
+
+/*
+  Forwarding thread.  The lock is held only to take output off the queue,
+  never while connecting or sending.
+*/
+static ULONG __stdcall forward_logs(void* arg)
+{
+	forwarder_t* forwarder = (forwarder_t*)arg;
+	uint32_t retry = NSSM_FORWARD_RETRY;
+
+	AcquireSRWLockExclusive(&forwarder->lock);
+	for (;;)
+	{
+		while (!forwarder->queue.records && !forwarder->closing)
+			SleepConditionVariableSRW(&forwarder->wake, &forwarder->lock, INFINITE, 0);
+		if (!forwarder->queue.records)
+			break;
+
+		if (!is_connected(forwarder))
+		{
+			/* Nobody is listening so whatever is left will be lost. */
+			if (forwarder->closing)
+				break;
+
+			ReleaseSRWLockExclusive(&forwarder->lock);
+			uint32_t error = (forwarder->type == NSSM_FORWARD_PIPE) ? connect_pipe(forwarder) : connect_tcp(forwarder);
+			AcquireSRWLockExclusive(&forwarder->lock);
+			if (error)
+			{
+				complain(forwarder, error);
+				/* Output keeps queueing meanwhile; forward() won't wake us while the queue isn't empty. */
+				SleepConditionVariableSRW(&forwarder->wake, &forwarder->lock, retry, 0);
+				retry = (retry < NSSM_FORWARD_RETRY_MAX / 2) ? retry * 2 : NSSM_FORWARD_RETRY_MAX;
+				continue;
+			}
+
+			if (forwarder->connected_once)
+				count_stat(forwarder->stats->forward_reconnects, 1);
+			forwarder->connected_once = true;
+			forwarder->complained = false;
+			retry = NSSM_FORWARD_RETRY;
+		}
+
+		uint32_t len = queue_get(&forwarder->queue, forwarder->work, NSSM_FORWARD_PIECE);
+		ReleaseSRWLockExclusive(&forwarder->lock);
+
+		uint32_t error = send_piece(forwarder, forwarder->work, len);
+		if (error)
+			disconnect(forwarder);
+		else
+			count_stat(forwarder->stats->forwarded, len);
+
+		AcquireSRWLockExclusive(&forwarder->lock);
+		if (error)
+		{
+			/* The writing thread counts drops too, under the same lock. */
+			count_stat(forwarder->stats->forward_dropped, len);
+			complain(forwarder, error);
+		}
+	}
+
+	uint64_t dropped = 0;
+	while (forwarder->queue.records)
+		dropped += queue_drop(&forwarder->queue);
+	if (dropped)
+		count_stat(forwarder->stats->forward_dropped, dropped);
+	ReleaseSRWLockExclusive(&forwarder->lock);
+
+	disconnect(forwarder);
+	return 0;
+}
+
+static void free_forwarder(forwarder_t* forwarder)
+{
+	close_handle(&forwarder->thread);
+	disconnect(forwarder);
+	close_handle(&forwarder->written);
+	close_handle(&forwarder->cancel);
+	if (forwarder->winsock)
+		WSACleanup();
+	if (forwarder->work)
+		HeapFree(GetProcessHeap(), 0, forwarder->work);
+	free_queue(&forwarder->queue);
+	HeapFree(GetProcessHeap(), 0, forwarder);
+}
+
+/*
+  Start forwarding to target, queueing up to size bytes.
+  Returns nullptr if the target isn't valid or the forwarder couldn't be
+  started, in which case the stream is logged to its file only.
+*/
+forwarder_t* create_forwarder(wchar_t* service_name, wchar_t* target, uint32_t size, stream_stats_t* stats)
+{
+	if (!size)
+		size = NSSM_FORWARD_SIZE;
+	else if (size < NSSM_FORWARD_MIN)
+		size = NSSM_FORWARD_MIN;
+	else if (size > NSSM_FORWARD_MAX)
+		size = NSSM_FORWARD_MAX;
+
+	forwarder_t* forwarder = (forwarder_t*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(forwarder_t));
+	if (!forwarder)
+	{
+		log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_OUT_OF_MEMORY, L"forwarder", L"create_forwarder()", 0);
+		return nullptr;
+	}
+	forwarder->socket = INVALID_SOCKET;
+
+	forwarder->type = forward_target_type(target, forwarder->host, (uint32_t)std::size(forwarder->host), forwarder->port, (uint32_t)std::size(forwarder->port));
+	if (forwarder->type == NSSM_FORWARD_NONE)
+	{
+		log_event(EVENTLOG_WARNING_TYPE, NSSM_EVENT_BAD_FORWARD_TARGET, service_name, target, 0);
+		free_forwarder(forwarder);
+		return nullptr;
+	}
+
+	forwarder->work = (char*)HeapAlloc(GetProcessHeap(), 0, NSSM_FORWARD_PIECE);
+	if (!forwarder->work || init_queue(&forwarder->queue, size))
+	{
+		log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_OUT_OF_MEMORY, L"forwarder->queue", L"create_forwarder()", 0);
+		free_forwarder(forwarder);
+		return nullptr;
+	}
+
+	if (forwarder->type == NSSM_FORWARD_PIPE)
+	{
+		forwarder->written = CreateEventW(nullptr, true, false, nullptr);
+		forwarder->cancel = CreateEventW(nullptr, true, false, nullptr);
+		if (!forwarder->written || !forwarder->cancel)
+		{
+			log_event(EVENTLOG_WARNING_TYPE, NSSM_EVENT_FORWARD_FAILED, service_name, target, error_string(GetLastError()), 0);
+			free_forwarder(forwarder);
+			return nullptr;
+		}
+	}
+	else
+	{
+		WSADATA data;
+		int32_t ret = WSAStartup(MAKEWORD(2, 2), &data);
+		if (ret)
+		{
+			log_event(EVENTLOG_WARNING_TYPE, NSSM_EVENT_FORWARD_FAILED, service_name, target, error_string((uint32_t)ret), 0);
+			free_forwarder(forwarder);
+			return nullptr;
+		}
+		forwarder->winsock = true;
+	}
+
+	forwarder->service_name = service_name;
+	::_snwprintf_s(forwarder->target, std::size(forwarder->target), _TRUNCATE, L"%s", target);
+	forwarder->stats = stats;
+	InitializeSRWLock(&forwarder->lock);
+	InitializeConditionVariable(&forwarder->wake);
+
+	forwarder->thread = CreateThread(nullptr, 0, forward_logs, (void*)forwarder, 0, nullptr);
+	if (!forwarder->thread)
+	{
+		log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_CREATETHREAD_FAILED, error_string(GetLastError()), 0);
+		free_forwarder(forwarder);
+		return nullptr;
+	}
+
+	return forwarder;
+}
+
+/*
+  Queue output which has been written to the file.  Never blocks for
+  longer than it takes to copy the output.  If the queue can't take all of
+  it the whole write is dropped, so the agent never sees a piece missing
+  from the middle of a write.
+*/
+void forward(forwarder_t* forwarder, const void* address, uint32_t len)
+{
+	const char* data = (const char*)address;
+	uint64_t pieces = ((uint64_t)len + NSSM_FORWARD_PIECE - 1) / NSSM_FORWARD_PIECE;
+	uint64_t needed = (uint64_t)len + pieces * NSSM_QUEUE_HEADER;
+
+	AcquireSRWLockExclusive(&forwarder->lock);
+	bool wake = !forwarder->queue.records;
+	if ((uint64_t)forwarder->queue.used + needed > forwarder->queue.size)
+	{
+		count_stat(forwarder->stats->forward_dropped, len);
+		wake = false;
+	}
+	else
+	{
+		while (len)
+		{
+			uint32_t piece = (len < NSSM_FORWARD_PIECE) ? len : NSSM_FORWARD_PIECE;
+			queue_put(&forwarder->queue, data, piece);
+			data += piece;
+			len -= piece;
+		}
+	}
+	ReleaseSRWLockExclusive(&forwarder->lock);
+
+	if (wake)
+		WakeConditionVariable(&forwarder->wake);
+}
+
+/*
+  Give the forwarding thread a moment to send what is queued, then stop it.
+  If it is stuck connecting or sending to a listener which has stopped
+  reading, cancel the send.  A thread which still won't stop keeps its forwarder.
+*/
+void close_forwarder(forwarder_t* forwarder)
+{
+	AcquireSRWLockExclusive(&forwarder->lock);
+	forwarder->closing = true;
+	ReleaseSRWLockExclusive(&forwarder->lock);
+	WakeConditionVariable(&forwarder->wake);
+
+	if (WaitForSingleObject(forwarder->thread, NSSM_FORWARD_DRAIN) == WAIT_TIMEOUT)
+	{
+		if (forwarder->cancel)
+			SetEvent(forwarder->cancel);
+		::CancelSynchronousIo(forwarder->thread);
+		if (WaitForSingleObject(forwarder->thread, NSSM_FORWARD_DRAIN) == WAIT_TIMEOUT)
+			return;
+	}
+
+	free_forwarder(forwarder);
+}
@@ -0,0 +1,81 @@
+/*******************************************************************************
+ forward.h - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#pragma once
+
+#ifndef FORWARD_H
+#define FORWARD_H
+
+/* Kinds of forwarding target (AppForward). */
+#define NSSM_FORWARD_NONE       0
+#define NSSM_FORWARD_PIPE       1
+#define NSSM_FORWARD_TCP        2
+
+/* Named pipe targets must be local. */
+#define NSSM_FORWARD_PIPE_PREFIX L"\\\\.\\pipe\\"
+#define NSSM_FORWARD_TCP_PREFIX  L"tcp://"
+
+/* Bytes of output which may wait to be forwarded (AppForwardBytes). */
+#define NSSM_FORWARD_SIZE       1048576
+#define NSSM_FORWARD_MIN        131072
+#define NSSM_FORWARD_MAX        NSSM_QUEUE_MAX
+
+/* Output is queued and sent in pieces of at most this many bytes. */
+#define NSSM_FORWARD_PIECE      65536
+
+/* Milliseconds between attempts to connect, doubling up to the maximum. */
+#define NSSM_FORWARD_RETRY      1000
+#define NSSM_FORWARD_RETRY_MAX  30000
+
+/* Milliseconds to wait for a busy pipe or for a send to a stalled listener. */
+#define NSSM_FORWARD_TIMEOUT    5000
+
+/* Milliseconds allowed to send what is queued when the stream closes. */
+#define NSSM_FORWARD_DRAIN      1000
+
+/*
+  Copy of a stream's output on its way to a local log agent.  The writing
+  thread only ever queues output, so a slow or absent agent costs the file
+  nothing but a copy; when the queue is full new output is dropped and
+  counted.  The forwarding thread connects, sends and reconnects.
+*/
+typedef struct
+{
+	wchar_t* service_name;
+	wchar_t target[nssmconst::pathlength];
+	uint32_t type;
+	wchar_t host[nssmconst::pathlength];
+	wchar_t port[16];
+	SRWLOCK lock;
+	CONDITION_VARIABLE wake;
+	log_queue_t queue;
+	bool closing;
+	HANDLE pipe;
+	HANDLE written;
+	HANDLE cancel;
+	SOCKET socket;
+	bool winsock;
+	bool connected_once;
+	bool complained;
+	HANDLE thread;
+	char* work;
+	stream_stats_t* stats;
+} forwarder_t;
+
+uint32_t forward_target_type(const wchar_t*, wchar_t*, uint32_t, wchar_t*, uint32_t);
+forwarder_t* create_forwarder(wchar_t*, wchar_t*, uint32_t, stream_stats_t*);
+void forward(forwarder_t*, const void*, uint32_t);
+void close_forwarder(forwarder_t*);
+
+#endif
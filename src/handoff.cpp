@@ -0,0 +1,365 @@
+/*******************************************************************************
+ handoff.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "handoff.h"
+
+/*
+  Passing output from the thread which reads every stream to the thread
+  which writes them all.
+
+  The reader queues each chunk it reads and wakes the writer, unless a wake
+  is already on its way.  The writer takes chunks until the queue is empty.
+  When the queue is full the reader applies the stream's AppQueuePolicy.
+  Under NSSM_QUEUE_BLOCK it keeps the chunk in its buffer and issues no
+  more reads for the stream until the writer has made room and posted it a
+  resume packet.
+
+  Once the reader has closed the stream the writer is woken one last time,
+  and the stream is finished with when the queue is empty and no stream
+  sharing its file is still writing.
+*/
+
+/* Largest read which still leaves room in the queue for another. */
+uint32_t max_read_size(uint32_t queue_size)
+{
+	uint32_t size = queue_size / 2 - NSSM_QUEUE_HEADER;
+	return (size < NSSM_STDIO_BUFFER_MAX) ? size : NSSM_STDIO_BUFFER_MAX;
+}
+
+/*
+  Allocate the buffers and queues for a stream reading up to buffer_size
+  bytes at a time.  With spill the queue policy is NSSM_QUEUE_SPILL and
+  the writer takes overflow from a second queue.  Returns 0 on success.
+*/
+int32_t init_handoff(handoff_t* h, uint32_t buffer_size, uint32_t queue_size, uint32_t policy, bool spill, stream_stats_t* stats)
+{
+	ZeroMemory(h, sizeof(*h));
+	InitializeSRWLock(&h->lock);
+	h->policy = policy;
+	h->stats = stats;
+
+	h->buffer = (char*)HeapAlloc(GetProcessHeap(), 0, buffer_size);
+	if (!h->buffer)
+	{
+		log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_OUT_OF_MEMORY, L"handoff->buffer", L"init_handoff()", 0);
+		return 1;
+	}
+	h->buffer_size = buffer_size;
+
+	h->work = (char*)HeapAlloc(GetProcessHeap(), 0, buffer_size);
+	if (!h->work || init_queue(&h->queue, queue_size))
+	{
+		log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_OUT_OF_MEMORY, L"handoff->queue", L"init_handoff()", 0);
+		return 2;
+	}
+	h->work_size = buffer_size;
+
+	if (spill && init_queue(&h->spill_queue, queue_size))
+	{
+		log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_OUT_OF_MEMORY, L"handoff->spill_queue", L"init_handoff()", 0);
+		return 3;
+	}
+	return 0;
+}
+
+void free_handoff(handoff_t* h)
+{
+	if (h->buffer)
+		HeapFree(GetProcessHeap(), 0, h->buffer);
+	if (h->work)
+		HeapFree(GetProcessHeap(), 0, h->work);
+	free_queue(&h->queue);
+	free_queue(&h->spill_queue);
+	h->buffer = h->work = 0;
+}
+
+/*
+  Grow the read buffer if the application is producing output faster than
+  we can read it, ie several consecutive reads filled the buffer completely.
+  Failure to grow is not an error; we just carry on with the old buffer.
+  Called by the reading thread after it has queued in bytes.
+*/
+void grow_buffer(handoff_t* h, uint32_t in)
+{
+	if (in < h->buffer_size)
+	{
+		h->full_reads = 0;
+		return;
+	}
+
+	if (++h->full_reads < NSSM_STDIO_BUFFER_GROW)
+		return;
+	h->full_reads = 0;
+
+	uint32_t max_size = max_read_size(h->queue.size);
+	if (h->buffer_size >= max_size)
+		return;
+
+	uint32_t buffer_size = h->buffer_size * 2;
+	if (buffer_size > max_size)
+		buffer_size = max_size;
+
+	char* buffer = (char*)HeapReAlloc(GetProcessHeap(), 0, h->buffer, buffer_size);
+	if (!buffer)
+		return;
+
+	h->buffer = buffer;
+	h->buffer_size = buffer_size;
+}
+
+/* Ask the writing thread to look at a stream.  Call with the lock held. */
+static inline bool wake_writer(handoff_t* h)
+{
+	if (h->wake_pending)
+		return false;
+	h->wake_pending = true;
+	return true;
+}
+
+/*
+  Pass the first in bytes of the buffer to the writing thread.
+  Returns:  0 if the next read can be issued.
+            1 if the queue is full and we must wait for the writing thread.
+*/
+int32_t queue_chunk(handoff_t* h, uint32_t in)
+{
+	int32_t ret = 0;
+	bool wake = false;
+
+	/* A blocked chunk was counted when it was first read. */
+	if (!h->blocked)
+		count_stat(h->stats->bytes_in, in);
+
+	AcquireSRWLockExclusive(&h->lock);
+	if (!queue_fits(&h->queue, in))
+	{
+		switch (h->policy)
+		{
+		case NSSM_QUEUE_DROP_OLDEST:
+			while (!queue_fits(&h->queue, in) && h->queue.records)
+			{
+				uint32_t dropped = queue_drop(&h->queue);
+				h->dropped += dropped;
+				count_stat(h->stats->dropped, dropped);
+			}
+			break;
+
+		case NSSM_QUEUE_DROP_NEWEST:
+			h->dropped += in;
+			count_stat(h->stats->dropped, in);
+			in = 0;
+			break;
+
+		case NSSM_QUEUE_SPILL:
+			/* The reading thread mustn't wait for a disk, so when the spill queue is full too we drop. */
+			if (!queue_put(&h->spill_queue, h->buffer, in))
+			{
+				h->dropped += in;
+				count_stat(h->stats->dropped, in);
+			}
+			in = 0;
+			break;
+
+		default:
+			/* Keep the chunk in the read buffer until there is room. */
+			h->blocked = true;
+			h->pending = in;
+			ret = 1;
+			in = 0;
+		}
+	}
+	if (in)
+	{
+		queue_put(&h->queue, h->buffer, in);
+		if (h->blocked)
+		{
+			h->blocked = false;
+			h->pending = 0;
+		}
+	}
+	wake = wake_writer(h);
+	ReleaseSRWLockExclusive(&h->lock);
+
+	if (wake)
+		PostQueuedCompletionStatus(h->writer_port, 0, h->key, nullptr);
+	return ret;
+}
+
+/*
+  Handle a packet with no read attached: a new stream, which the writer
+  must be told about, or one which was waiting for room in its queue.
+  Returns as for queue_chunk().
+*/
+int32_t resume_reading(handoff_t* h)
+{
+	AcquireSRWLockExclusive(&h->lock);
+	h->resume_posted = false;
+	/* Queueing the chunk we kept back will wake the writer. */
+	bool wake = (!h->blocked && wake_writer(h));
+	ReleaseSRWLockExclusive(&h->lock);
+
+	if (h->blocked)
+		return queue_chunk(h, h->pending);
+	if (wake)
+		PostQueuedCompletionStatus(h->writer_port, 0, h->key, nullptr);
+	return 0;
+}
+
+/*
+  The pipe is finished.  Hand the stream over to the writing thread, which
+  will release it once the queue is empty.  The reader mustn't touch it again.
+*/
+void close_handoff(handoff_t* h)
+{
+	AcquireSRWLockExclusive(&h->lock);
+	h->closed = true;
+	bool wake = wake_writer(h);
+	ReleaseSRWLockExclusive(&h->lock);
+
+	/* If a wake is already pending the writing thread will see we closed. */
+	if (wake)
+		PostQueuedCompletionStatus(h->writer_port, 0, h->key, nullptr);
+}
+
+/* The writer has been woken and will take everything queued from now on. */
+void start_draining(handoff_t* h)
+{
+	AcquireSRWLockExclusive(&h->lock);
+	h->wake_pending = false;
+	ReleaseSRWLockExclusive(&h->lock);
+}
+
+/*
+  Take the next chunk into work, setting *len to its length or to 0 if the
+  queue is empty, and *dropped and *spilled to the totals so far.
+  Returns:  0 if the stream is still open.
+            1 if the queue is empty and the stream is finished with.
+           -1 if work couldn't hold the chunk, which was dropped.
+*/
+int32_t take_chunk(handoff_t* h, uint32_t* len, uint64_t* dropped, uint64_t* spilled)
+{
+	*len = 0;
+	AcquireSRWLockExclusive(&h->lock);
+	uint32_t size = queue_peek(&h->queue);
+	while (size > h->work_size)
+	{
+		/* The reading thread grew its buffer. */
+		ReleaseSRWLockExclusive(&h->lock);
+		char* work = (char*)HeapReAlloc(GetProcessHeap(), 0, h->work, size);
+		AcquireSRWLockExclusive(&h->lock);
+		if (!work)
+		{
+			log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_OUT_OF_MEMORY, L"handoff->work", L"take_chunk()", 0);
+			uint32_t lost = queue_drop(&h->queue);
+			h->dropped += lost;
+			count_stat(h->stats->dropped, lost);
+			*dropped = h->dropped;
+			*spilled = h->spilled;
+			ReleaseSRWLockExclusive(&h->lock);
+			return -1;
+		}
+		h->work = work;
+		h->work_size = size;
+		size = queue_peek(&h->queue);
+	}
+	*len = queue_get(&h->queue, h->work, h->work_size);
+
+	/* Let the reading thread resume now that there is room. */
+	bool resume = false;
+	if (h->blocked && !h->resume_posted && queue_fits(&h->queue, h->pending))
+		resume = h->resume_posted = true;
+	/*
+	  Another wake is on its way if the reading thread closed meanwhile.
+	  A file's owner must also wait for the streams sharing it.
+	*/
+	bool finished = (!*len && h->closed && !h->wake_pending && !h->followers);
+	*dropped = h->dropped;
+	*spilled = h->spilled;
+	ReleaseSRWLockExclusive(&h->lock);
+
+	if (resume)
+		PostQueuedCompletionStatus(h->reader_port, 0, h->key, nullptr);
+	return finished ? 1 : 0;
+}
+
+/*
+  Take the next chunk which overflowed to the spill queue into work.
+  Returns its length, or 0 if there are no more.
+*/
+uint32_t take_spilled(handoff_t* h)
+{
+	AcquireSRWLockExclusive(&h->lock);
+	uint32_t size = queue_peek(&h->spill_queue);
+	while (size > h->work_size)
+	{
+		ReleaseSRWLockExclusive(&h->lock);
+		char* work = (char*)HeapReAlloc(GetProcessHeap(), 0, h->work, size);
+		AcquireSRWLockExclusive(&h->lock);
+		if (work)
+		{
+			h->work = work;
+			h->work_size = size;
+		}
+		else
+		{
+			log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_OUT_OF_MEMORY, L"handoff->work", L"take_spilled()", 0);
+			uint32_t lost = queue_drop(&h->spill_queue);
+			h->dropped += lost;
+			count_stat(h->stats->dropped, lost);
+		}
+		size = queue_peek(&h->spill_queue);
+	}
+	uint32_t len = queue_get(&h->spill_queue, h->work, h->work_size);
+	ReleaseSRWLockExclusive(&h->lock);
+	return len;
+}
+
+/* Count a chunk taken by take_spilled() as spilled to disk, or dropped if it couldn't be. */
+void count_spilled(handoff_t* h, uint32_t len, bool spilled)
+{
+	AcquireSRWLockExclusive(&h->lock);
+	if (spilled)
+		h->spilled += len;
+	else
+	{
+		h->dropped += len;
+		count_stat(h->stats->dropped, len);
+	}
+	ReleaseSRWLockExclusive(&h->lock);
+}
+
+/* A stream sharing this one's file has finished, so it may be finished with too. */
+void release_follower(handoff_t* h)
+{
+	AcquireSRWLockExclusive(&h->lock);
+	bool wake = (!--h->followers && wake_writer(h));
+	ReleaseSRWLockExclusive(&h->lock);
+
+	if (wake)
+		PostQueuedCompletionStatus(h->writer_port, 0, h->key, nullptr);
+}
+
+/* The writer stopped short of emptying the queue and can carry on now. */
+void wake_stream(handoff_t* h)
+{
+	AcquireSRWLockExclusive(&h->lock);
+	bool wake = wake_writer(h);
+	ReleaseSRWLockExclusive(&h->lock);
+
+	if (wake)
+		PostQueuedCompletionStatus(h->writer_port, 0, h->key, nullptr);
+}
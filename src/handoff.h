@@ -0,0 +1,76 @@
+/*******************************************************************************
+ handoff.h - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#pragma once
+
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+/*
+  Size of the buffer used to read from the application's stdout/stderr pipe.
+  The buffer starts at the configured BufferSize and doubles, up to the
+  maximum, when successive reads keep filling it.
+*/
+#define NSSM_STDIO_BUFFER_SIZE  65536
+#define NSSM_STDIO_BUFFER_MIN   1024
+#define NSSM_STDIO_BUFFER_MAX   4194304
+#define NSSM_STDIO_BUFFER_GROW  4
+
+/*
+  A stream's output on its way from the reading thread to the writing
+  thread.  The reader reads into buffer and queues what it read; the writer
+  takes each chunk out into work.  Each side wakes the other by posting a
+  packet keyed by key to its completion port.  Everything from queue to
+  followers is guarded by lock.
+*/
+typedef struct
+{
+	HANDLE reader_port;
+	HANDLE writer_port;
+	ULONG_PTR key;
+	stream_stats_t* stats;
+	char* buffer;
+	uint32_t buffer_size;
+	uint32_t full_reads;
+	char* work;
+	uint32_t work_size;
+	SRWLOCK lock;
+	log_queue_t queue;
+	uint32_t policy;
+	log_queue_t spill_queue;
+	uint32_t pending;
+	bool blocked;
+	bool resume_posted;
+	bool wake_pending;
+	bool closed;
+	uint32_t followers;
+	uint64_t dropped;
+	uint64_t spilled;
+} handoff_t;
+
+uint32_t max_read_size(uint32_t);
+int32_t init_handoff(handoff_t*, uint32_t, uint32_t, uint32_t, bool, stream_stats_t*);
+void free_handoff(handoff_t*);
+void grow_buffer(handoff_t*, uint32_t);
+int32_t queue_chunk(handoff_t*, uint32_t);
+int32_t resume_reading(handoff_t*);
+void close_handoff(handoff_t*);
+void start_draining(handoff_t*);
+int32_t take_chunk(handoff_t*, uint32_t*, uint64_t*, uint64_t*);
+uint32_t take_spilled(handoff_t*);
+void count_spilled(handoff_t*, uint32_t, bool);
+void release_follower(handoff_t*);
+void wake_stream(handoff_t*);
+
+#endif
@@ -16,11 +16,29 @@
 
 #include "ioimpl.h"
 
-#define COMPLAINED_READ   (1 << 0)
-#define COMPLAINED_WRITE  (1 << 1)
-#define COMPLAINED_ROTATE (1 << 2)
-#define TIMESTAMP_FORMAT  "%04u-%02u-%02u %02u:%02u:%02u.%03u: "
-#define TIMESTAMP_LEN     25
+#define COMPLAINED_READ    (1 << 0)
+#define COMPLAINED_WRITE   (1 << 1)
+#define COMPLAINED_ROTATE  (1 << 2)
+#define COMPLAINED_SPILL   (1 << 3)
+#define COMPLAINED_FLUSH   (1 << 4)
+#define COMPLAINED_INDEX   (1 << 5)
+
+/* Pieces of a JSON record. */
+#define JSON_TIME            "{\"time\":\""
+#define JSON_TIME_LEN        33
+#define JSON_SERVICE         "\",\"service\":\""
+#define JSON_STREAM          "\",\"stream\":\"%s\",\"pid\":"
+#define JSON_MESSAGE         "%lu,\"message\":\""
+#define JSON_END             "\"}\n"
+#define JSON_END_LEN         3
+
+/* Summary of lines suppressed as repeats. */
+#define NSSM_REPEATED_UTF8   "last message repeated %llu times\r\n"
+#define NSSM_REPEATED_UTF16  L"last message repeated %llu times\r\n"
+
+/* Summary of lines dropped by the rate limit. */
+#define NSSM_LIMITED_UTF8    "rate limit dropped %llu lines (%llu bytes)\r\n"
+#define NSSM_LIMITED_UTF16   L"rate limit dropped %llu lines (%llu bytes)\r\n"
 
 static int32_t dup_handle(HANDLE source_handle, HANDLE* dest_handle_ptr, wchar_t* source_description, wchar_t* dest_description, uint32_t flags)
 {
@@ -40,76 +58,406 @@ static int32_t dup_handle(HANDLE source_handle, HANDLE* dest_handle_ptr, wchar_t
 	return dup_handle(source_handle, dest_handle_ptr, source_description, dest_description, DUPLICATE_SAME_ACCESS);
 }
 
+/* One pair of threads serves every redirected stream in the process. */
+static logger_engine_t engine;
+static SRWLOCK engine_lock = SRWLOCK_INIT;
+
+/*
+  Anonymous pipes don't support overlapped I/O so we create a uniquely named
+  pipe instead.  The server end is read by the logging thread and the client
+  end is inherited by the application as its stdout/stderr.
+*/
+static int32_t create_logging_pipe(wchar_t* service_name, wchar_t* path, HANDLE* read_handle_ptr, HANDLE* pipe_handle_ptr, uint32_t buffer_size)
+{
+	static volatile LONG serial;
+	wchar_t name[PIPE_NAME_LENGTH];
+
+	::_snwprintf_s(name, std::size(name), _TRUNCATE, NSSM_LOGGER_PIPE, GetCurrentProcessId(), InterlockedIncrement(&serial));
+	*read_handle_ptr = ::CreateNamedPipeW(name, PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS, 1, buffer_size, buffer_size, 0, nullptr);
+	if (*read_handle_ptr == INVALID_HANDLE_VALUE)
+	{
+		*read_handle_ptr = 0;
+		log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_CREATEPIPE_FAILED, service_name, path, error_string(GetLastError()));
+		return 1;
+	}
+
+	*pipe_handle_ptr = ::CreateFileW(name, GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (*pipe_handle_ptr == INVALID_HANDLE_VALUE)
+	{
+		*pipe_handle_ptr = 0;
+		log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_CREATEPIPE_FAILED, service_name, path, error_string(GetLastError()));
+		close_handle(read_handle_ptr);
+		return 2;
+	}
+
+	SetHandleInformation(*pipe_handle_ptr, HANDLE_FLAG_INHERIT, HANDLE_FLAG_INHERIT);
+	return 0;
+}
+
+static ULONG __stdcall write_logs(void*);
+
+/* Start the shared logging threads if necessary.  Call with engine_lock held. */
+static int32_t start_logger_engine()
+{
+	if (engine.thread)
+		return 0;
+
+	engine.port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, 0, 0, 1);
+	engine.writer_port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, 0, 0, 1);
+	if (!engine.port || !engine.writer_port)
+	{
+		log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_CREATEIOCOMPLETIONPORT_FAILED, error_string(GetLastError()), 0);
+		close_handle(&engine.port);
+		close_handle(&engine.writer_port);
+		return 1;
+	}
+
+	engine.writer_thread = CreateThread(nullptr, 0, write_logs, (void*)engine.writer_port, 0, nullptr);
+	if (!engine.writer_thread)
+	{
+		log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_CREATETHREAD_FAILED, error_string(GetLastError()), 0);
+		close_handle(&engine.port);
+		close_handle(&engine.writer_port);
+		return 2;
+	}
+
+	engine.thread = CreateThread(nullptr, 0, log_and_rotate, (void*)engine.port, 0, &engine.tid);
+	if (!engine.thread)
+	{
+		log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_CREATETHREAD_FAILED, error_string(GetLastError()), 0);
+		/* The writing thread closes its port on the way out. */
+		PostQueuedCompletionStatus(engine.writer_port, 0, 0, nullptr);
+		close_handle(&engine.writer_thread);
+		close_handle(&engine.port);
+		engine.writer_port = 0;
+		engine.tid = 0;
+		return 3;
+	}
+
+	engine.loggers = 0;
+	return 0;
+}
+
+static void free_logger(logger_t* logger)
+{
+	close_handle(&logger->read_handle);
+	close_handle(&logger->write_handle);
+	close_handle(&logger->spill_handle);
+	close_handle(&logger->index_handle);
+	free_handoff(&logger->handoff);
+	if (logger->staging)
+		HeapFree(GetProcessHeap(), 0, logger->staging);
+	if (logger->held)
+		HeapFree(GetProcessHeap(), 0, logger->held);
+	if (logger->carry)
+		HeapFree(GetProcessHeap(), 0, logger->carry);
+	if (logger->json_head)
+		HeapFree(GetProcessHeap(), 0, logger->json_head);
+	if (logger->transcode)
+		HeapFree(GetProcessHeap(), 0, logger->transcode);
+	if (logger->spill_path)
+		HeapFree(GetProcessHeap(), 0, logger->spill_path);
+	if (logger->forwarder)
+		close_forwarder(logger->forwarder);
+	HeapFree(GetProcessHeap(), 0, logger);
+}
+
+/*
+  Release a stream which has finished.  Called by the writing thread once
+  the reading thread has let go of the stream and its queue is empty.
+  Returns true if the logging threads still have other streams to serve.
+*/
+static bool stop_logger(logger_t* logger)
+{
+	free_logger(logger);
+
+	AcquireSRWLockExclusive(&engine_lock);
+	bool running = (--engine.loggers > 0);
+	if (!running)
+	{
+		/* Each thread will close its own port on the way out. */
+		PostQueuedCompletionStatus(engine.port, 0, 0, nullptr);
+		close_handle(&engine.thread);
+		close_handle(&engine.writer_thread);
+		engine.port = engine.writer_port = 0;
+		engine.tid = 0;
+	}
+	ReleaseSRWLockExclusive(&engine_lock);
+
+	return running;
+}
+
+/*
+  Build the part of a JSON record between the time and the process ID:
+  ","service":"<name>","stream":"stdout","pid":
+*/
+static int32_t make_json_head(logger_t* logger, wchar_t* service_name, stream which)
+{
+	char* name;
+	uint32_t namelen;
+	if (to_utf8(service_name, &name, &namelen))
+		return 1;
+
+	const char* stream_name = (which == stream::err) ? "stderr" : "stdout";
+	uint32_t size = namelen * JSON_ESCAPE_MAX + 64;
+	logger->json_head = (char*)HeapAlloc(GetProcessHeap(), 0, size);
+	if (!logger->json_head)
+	{
+		HeapFree(GetProcessHeap(), 0, name);
+		return 2;
+	}
+
+	char* s = logger->json_head;
+	memmove(s, JSON_SERVICE, strlen(JSON_SERVICE));
+	s += strlen(JSON_SERVICE);
+	s += json_escape(name, namelen, s);
+	s += ::_snprintf_s(s, size - (s - logger->json_head), _TRUNCATE, JSON_STREAM, stream_name);
+	logger->json_head_len = (uint32_t)(s - logger->json_head);
+
+	HeapFree(GetProcessHeap(), 0, name);
+	return 0;
+}
+
 /*
   read_handle:  read from application
   pipe_handle:  stdout of application
   write_handle: to file
+  sink:         if set, the stream which owns the file we share;
+                otherwise set to the new stream on success
+  config:       everything else about the stream
+
+  Returns a handle to the shared logging thread, which the caller must close.
 */
-static HANDLE create_logging_thread(wchar_t* service_name, wchar_t* path, uint32_t sharing, uint32_t disposition, uint32_t flags, HANDLE* read_handle_ptr, HANDLE* pipe_handle_ptr, HANDLE* write_handle_ptr, uint32_t rotate_bytes_low, uint32_t rotate_bytes_high, uint32_t rotate_delay, uint32_t* tid_ptr, uint32_t* rotate_online, bool timestamp_log, bool copy_and_truncate)
+static HANDLE create_logger(logger_config_t* config, HANDLE* read_handle_ptr, HANDLE* pipe_handle_ptr, HANDLE* write_handle_ptr, uint32_t* tid_ptr, uint32_t* rotate_online, logger_t** sink_ptr)
 {
 	*tid_ptr = 0;
 
+	uint32_t buffer_size = config->buffer_size;
+	if (!buffer_size)
+		buffer_size = NSSM_STDIO_BUFFER_SIZE;
+	else if (buffer_size < NSSM_STDIO_BUFFER_MIN)
+		buffer_size = NSSM_STDIO_BUFFER_MIN;
+	else if (buffer_size > NSSM_STDIO_BUFFER_MAX)
+		buffer_size = NSSM_STDIO_BUFFER_MAX;
+
+	uint32_t queue_size = config->queue_size;
+	if (!queue_size)
+		queue_size = NSSM_QUEUE_SIZE;
+	else if (queue_size < NSSM_QUEUE_MIN)
+		queue_size = NSSM_QUEUE_MIN;
+	else if (queue_size > NSSM_QUEUE_MAX)
+		queue_size = NSSM_QUEUE_MAX;
+	/* Every read must fit in the queue. */
+	if (buffer_size > max_read_size(queue_size))
+		buffer_size = max_read_size(queue_size);
+
 	/* Pipe between application's stdout/stderr and our logging handle. */
 	if (read_handle_ptr && !*read_handle_ptr)
 	{
 		if (pipe_handle_ptr && !*pipe_handle_ptr)
 		{
-			if (CreatePipe(read_handle_ptr, pipe_handle_ptr, 0, 0))
-			{
-				SetHandleInformation(*pipe_handle_ptr, HANDLE_FLAG_INHERIT, HANDLE_FLAG_INHERIT);
-			}
-			else
-			{
-				log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_CREATEPIPE_FAILED, service_name, path, error_string(GetLastError()));
+			/* Size the pipe to match our reads so the application doesn't block on a full pipe. */
+			if (create_logging_pipe(config->service_name, config->path, read_handle_ptr, pipe_handle_ptr, buffer_size))
 				return (HANDLE)0;
-			}
 		}
 	}
 
 	logger_t* logger = (logger_t*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(logger_t));
 	if (!logger)
 	{
-		log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_OUT_OF_MEMORY, L"logger", L"create_logging_thread()", 0);
+		log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_OUT_OF_MEMORY, L"logger", L"create_logger()", 0);
 		return (HANDLE)0;
 	}
 
-	ULARGE_INTEGER size;
-	size.LowPart = rotate_bytes_low;
-	size.HighPart = rotate_bytes_high;
-
-	logger->service_name = service_name;
-	logger->path = path;
-	logger->sharing = sharing;
-	logger->disposition = disposition;
-	logger->flags = flags;
+	/* Timestamped, tagged or formatted records are assembled here before writing. */
+	if ((config->timestamp_log || config->stream_tag || config->format != NSSM_FORMAT_TEXT) && !*sink_ptr)
+	{
+		/* Leave room for escaping. */
+		logger->staging_size = buffer_size * ((config->format == NSSM_FORMAT_JSON) ? 4 : 2);
+		logger->staging = (char*)HeapAlloc(GetProcessHeap(), 0, logger->staging_size);
+		if (!logger->staging)
+		{
+			log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_OUT_OF_MEMORY, L"logger->staging", L"create_logger()", 0);
+			free_logger(logger);
+			return (HANDLE)0;
+		}
+	}
+
+	/*
+    Overflow goes to a file of the same name in the spill directory.
+    The writing thread writes it out from a second queue of the same size.
+  */
+	uint32_t queue_policy = config->queue_policy;
+	if (queue_policy == NSSM_QUEUE_SPILL)
+	{
+		if (config->spill_dir && config->spill_dir[0])
+		{
+			logger->spill_path = (wchar_t*)HeapAlloc(GetProcessHeap(), 0, nssmconst::pathlength * sizeof(wchar_t));
+			if (!logger->spill_path)
+			{
+				log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_OUT_OF_MEMORY, L"logger->spill_path", L"create_logger()", 0);
+				free_logger(logger);
+				return (HANDLE)0;
+			}
+			::_snwprintf_s(logger->spill_path, nssmconst::pathlength, _TRUNCATE, L"%s\\%s", config->spill_dir, ::PathFindFileNameW(config->path));
+		}
+		else
+			queue_policy = NSSM_QUEUE_DROP_NEWEST;
+	}
+
+	/* Output waits here between the reading and writing threads. */
+	logger->stats = open_stream_stats(config->service_name, config->which, config->path);
+	if (init_handoff(&logger->handoff, buffer_size, queue_size, queue_policy, queue_policy == NSSM_QUEUE_SPILL, logger->stats))
+	{
+		free_logger(logger);
+		return (HANDLE)0;
+	}
+
+	/* Each JSON record repeats the service name and stream, escaped once here. */
+	if (config->format == NSSM_FORMAT_JSON)
+	{
+		if (make_json_head(logger, config->service_name, config->which))
+		{
+			log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_OUT_OF_MEMORY, L"logger->json_head", L"create_logger()", 0);
+			free_logger(logger);
+			return (HANDLE)0;
+		}
+	}
+
+	logger->service_name = config->service_name;
+	logger->path = config->path;
+	logger->sharing = config->sharing;
+	logger->disposition = config->disposition;
+	logger->flags = config->flags;
 	logger->read_handle = *read_handle_ptr;
 	logger->write_handle = *write_handle_ptr;
-	logger->size = (int64_t)size.QuadPart;
+	logger->size = config->size;
 	logger->tid_ptr = tid_ptr;
-	logger->timestamp_log = timestamp_log;
+	logger->timestamp_log = config->timestamp_log;
+	logger->tag = config->stream_tag ? NSSM_TAG_STDOUT + (uint32_t)config->which : NSSM_TAG_NONE;
+	logger->format = config->format;
+	/* JSON is always UTF-8. */
+	logger->encoding = (config->format == NSSM_FORMAT_JSON) ? NSSM_ENCODING_UTF8 : config->encoding;
+	logger->multiline = config->multiline;
+	logger->repeat_interval = config->repeat_interval;
+	logger->limit = config->limit;
+	logger->pid_ptr = config->pid_ptr;
 	logger->line_length = 0;
 	logger->rotate_online = rotate_online;
-	logger->rotate_delay = rotate_delay;
-	logger->copy_and_truncate = copy_and_truncate;
+	logger->rotate_seconds = config->rotate_seconds;
+	logger->rotate_boundary = config->rotate_boundary;
+	logger->rotate_sequence = config->rotate_sequence;
+	logger->copy_and_truncate = config->copy_and_truncate;
+	logger->flush_interval = config->flush_interval;
+	logger->flush_bytes = config->flush_bytes;
+	logger->flush_rotate = config->flush_rotate;
+	logger->compress = config->compress;
+	logger->retention = config->retention;
+
+	/*
+    A stream which shares another's file has no handle of its own.  From
+    now on both streams write whole lines only, so they can't split each
+    other's lines, and the file is sized and rotated once.
+  */
+	logger_t* sink = *sink_ptr;
+	if (sink)
+	{
+		logger->sink = sink;
+		AcquireSRWLockExclusive(&sink->handoff.lock);
+		sink->handoff.followers++;
+		sink->merged = logger->merged = true;
+		ReleaseSRWLockExclusive(&sink->handoff.lock);
+	}
+	else
+	{
+		logger->sink = logger;
+
+		/* Find initial file size. */
+		BY_HANDLE_FILE_INFORMATION info;
+		if (GetFileInformationByHandle(logger->write_handle, &info))
+		{
+			ULARGE_INTEGER l;
+			l.HighPart = info.nFileSizeHigh;
+			l.LowPart = info.nFileSizeLow;
+			logger->file_size = (int64_t)l.QuadPart;
+		}
+
+		/* The owner of the file forwards whatever is written to it. */
+		if (config->forward_target && config->forward_target[0])
+			logger->forwarder = create_forwarder(config->service_name, config->forward_target, config->forward_size, logger->stats);
+
+		/* And indexes it. */
+		if (config->time_index)
+		{
+			logger->time_index = true;
+			logger->index_bytes = config->index_bytes;
+			logger->index_interval = (config->index_bytes || config->index_interval) ? config->index_interval : NSSM_TIME_INDEX_INTERVAL;
+			logger->index_handle = open_time_index(config->path, logger->file_size);
+			if (!logger->index_handle)
+			{
+				log_event(EVENTLOG_WARNING_TYPE, NSSM_EVENT_TIME_INDEX_FAILED, config->service_name, config->path, error_string(GetLastError()), 0);
+				logger->complained |= COMPLAINED_INDEX;
+			}
+		}
+	}
+
+	/* Hand the stream to the logging thread, which will issue the first read. */
+	HANDLE thread_handle = 0;
+	AcquireSRWLockExclusive(&engine_lock);
+	if (!start_logger_engine())
+	{
+		logger->handoff.reader_port = engine.port;
+		logger->handoff.writer_port = engine.writer_port;
+		logger->handoff.key = (ULONG_PTR)logger;
+		if (!CreateIoCompletionPort(logger->read_handle, engine.port, (ULONG_PTR)logger, 0))
+			log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_CREATEIOCOMPLETIONPORT_FAILED, error_string(GetLastError()), 0);
+		else if (!DuplicateHandle(GetCurrentProcess(), engine.thread, GetCurrentProcess(), &thread_handle, 0, false, DUPLICATE_SAME_ACCESS))
+			log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_DUPLICATEHANDLE_FAILED, L"logger", L"thread", error_string(GetLastError()), 0);
+		else if (!PostQueuedCompletionStatus(engine.port, 0, (ULONG_PTR)logger, nullptr))
+		{
+			log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_CREATEIOCOMPLETIONPORT_FAILED, error_string(GetLastError()), 0);
+			close_handle(&thread_handle);
+		}
+		else
+		{
+			engine.loggers++;
+			*tid_ptr = engine.tid;
+		}
+
+		/* Don't leave idle threads behind if we couldn't register the first stream. */
+		if (!engine.loggers)
+		{
+			PostQueuedCompletionStatus(engine.port, 0, 0, nullptr);
+			PostQueuedCompletionStatus(engine.writer_port, 0, 0, nullptr);
+			close_handle(&engine.thread);
+			close_handle(&engine.writer_thread);
+			engine.port = engine.writer_port = 0;
+			engine.tid = 0;
+		}
+	}
+	ReleaseSRWLockExclusive(&engine_lock);
 
-	HANDLE thread_handle = CreateThread(nullptr, 0, log_and_rotate, (void*)logger, 0, logger->tid_ptr);
 	if (!thread_handle)
 	{
-		log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_CREATETHREAD_FAILED, error_string(GetLastError()), 0);
-		HeapFree(GetProcessHeap(), 0, logger);
+		if (sink)
+		{
+			/* No output has been written yet. */
+			AcquireSRWLockExclusive(&sink->handoff.lock);
+			if (!--sink->handoff.followers)
+				sink->merged = false;
+			ReleaseSRWLockExclusive(&sink->handoff.lock);
+		}
+
+		/* The caller still owns the handles. */
+		logger->read_handle = logger->write_handle = 0;
+		free_logger(logger);
 	}
+	else if (!sink)
+		*sink_ptr = logger;
 
 	return thread_handle;
 }
 
-static inline uint32_t guess_charsize(void* address, uint32_t bufsize)
-{
-	if (IsTextUnicode(address, bufsize, 0))
-		return (uint32_t)sizeof(wchar_t);
-	else
-		return (uint32_t)sizeof(char);
-}
-
 static inline void write_bom(logger_t* logger, uint32_t* out)
 {
 	wchar_t bom = L'\ufeff';
@@ -138,8 +486,8 @@ void close_handle(HANDLE* handle)
 	close_handle(handle, nullptr);
 }
 
-/* Get path, share mode, creation disposition and flags for a stream. */
-int32_t get_createfile_parameters(HKEY key, wchar_t* prefix, wchar_t* path, uint32_t* sharing, uint32_t default_sharing, uint32_t* disposition, uint32_t default_disposition, uint32_t* flags, uint32_t default_flags, bool* copy_and_truncate)
+/* Get path, share mode, creation disposition, flags and buffer size for a stream. */
+int32_t get_createfile_parameters(HKEY key, wchar_t* prefix, wchar_t* path, uint32_t* sharing, uint32_t default_sharing, uint32_t* disposition, uint32_t default_disposition, uint32_t* flags, uint32_t default_flags, bool* copy_and_truncate, uint32_t* buffer_size)
 {
 	wchar_t value[std::to_underlying(registry_const::stdiolength)];
 
@@ -235,6 +583,26 @@ int32_t get_createfile_parameters(HKEY key, wchar_t* prefix, wchar_t* path, uint
 		}
 	}
 
+	/* Size of the read buffer used by the logging thread. */
+	if (buffer_size)
+	{
+		if (::_snwprintf_s(value, std::size(value), _TRUNCATE, L"%s%s", prefix, regliterals::regbuffersize) < 0)
+		{
+			log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_OUT_OF_MEMORY, regliterals::regbuffersize, L"get_createfile_parameters()", 0);
+			return 10;
+		}
+		switch (get_number(key, value, buffer_size, false))
+		{
+		case 0:
+			*buffer_size = 0;
+			break; /* Missing. */
+		case 1:
+			break; /* Found. */
+		case -2:
+			return 10; /* Error. */
+		}
+	}
+
 	return 0;
 }
 
@@ -281,25 +649,96 @@ HANDLE write_to_file(wchar_t* path, uint32_t sharing, SECURITY_ATTRIBUTES* attri
 	return ret;
 }
 
-static void rotated_filename(wchar_t* path, wchar_t* rotated, uint32_t rotated_len, SYSTEMTIME* st)
+/* Retention limits for rotated files. */
+void get_retention(nssm_service_t* service, retention_t* retention)
 {
-	if (!st)
+	ULARGE_INTEGER bytes;
+	bytes.LowPart = service->rotate_keep_bytes_low;
+	bytes.HighPart = service->rotate_keep_bytes_high;
+
+	retention->files = service->rotate_keep_files;
+	retention->bytes = bytes.QuadPart;
+	retention->days = service->rotate_keep_days;
+}
+
+void get_multiline(nssm_service_t* service, multiline_t* multiline)
+{
+	multiline->rule = service->multiline;
+	multiline->timeout = service->multiline_timeout;
+	multiline->tokens = 0;
+	if (multiline->rule == NSSM_MULTILINE_PATTERN && compile_pattern(service->multiline_pattern, multiline))
 	{
-		SYSTEMTIME now;
-		st = &now;
-		GetSystemTime(st);
+		log_event(EVENTLOG_WARNING_TYPE, NSSM_EVENT_BAD_MULTILINE_PATTERN, service->name, service->multiline_pattern, 0);
+		multiline->rule = NSSM_MULTILINE_NONE;
 	}
+}
+
+/* Settings shared by both streams. */
+static void get_logger_config(nssm_service_t* service, logger_config_t* config)
+{
+	ZeroMemory(config, sizeof(*config));
+
+	ULARGE_INTEGER size;
+	size.LowPart = service->rotate_bytes_low;
+	size.HighPart = service->rotate_bytes_high;
+
+	config->service_name = service->name;
+	config->size = (int64_t)size.QuadPart;
+	config->rotate_seconds = service->rotate_seconds;
+	config->rotate_boundary = service->rotate_boundary;
+	config->compress = service->rotate_compress;
+	get_retention(service, &config->retention);
+	config->timestamp_log = service->timestamp_log;
+	config->stream_tag = service->stream_tag;
+	config->format = service->log_format;
+	config->encoding = service->log_encoding;
+	get_multiline(service, &config->multiline);
+	config->repeat_interval = service->suppress_repeats ? service->repeat_interval : 0;
+	init_rate_limit(&config->limit, service->rate_limit_bytes, service->rate_limit_lines, service->rate_limit_policy, service->rate_limit_sample);
+	config->queue_size = service->queue_bytes;
+	config->queue_policy = service->queue_policy;
+	config->spill_dir = service->queue_spill;
+	config->flush_interval = service->flush_interval;
+	config->flush_bytes = service->flush_bytes;
+	config->flush_rotate = service->flush_rotate;
+	config->forward_target = service->forward;
+	config->forward_size = service->forward_bytes;
+	config->time_index = service->time_index;
+	config->index_bytes = service->time_index_bytes;
+	config->index_interval = service->time_index_interval;
+	config->pid_ptr = &service->pid;
+}
 
-	wchar_t buffer[nssmconst::pathlength];
-	memmove(buffer, path, sizeof(buffer));
-	wchar_t* ext = ::PathFindExtensionW(buffer);
-	wchar_t extension[nssmconst::pathlength];
-	::_snwprintf_s(extension, std::size(extension), _TRUNCATE, L"-%04u%02u%02uT%02u%02u%02u.%03u%s", st->wYear, st->wMonth, st->wDay, st->wHour, st->wMinute, st->wSecond, st->wMilliseconds, ext);
-	*ext = _T('\0');
-	::_snwprintf_s(rotated, rotated_len, _TRUNCATE, L"%s%s", buffer, extension);
+/* Settings of one stream's file. */
+static void get_stream_config(nssm_service_t* service, stream which, uint32_t rotate_sequence, logger_config_t* config)
+{
+	config->which = which;
+	config->rotate_sequence = rotate_sequence;
+	if (which == stream::out)
+	{
+		config->path = service->stdout_path;
+		config->sharing = service->stdout_sharing;
+		config->disposition = service->stdout_disposition;
+		config->flags = service->stdout_flags;
+		config->buffer_size = service->stdout_buffer_size;
+		config->copy_and_truncate = service->stdout_copy_and_truncate;
+	}
+	else
+	{
+		config->path = service->stderr_path;
+		config->sharing = service->stderr_sharing;
+		config->disposition = service->stderr_disposition;
+		config->flags = service->stderr_flags;
+		config->buffer_size = service->stderr_buffer_size;
+		config->copy_and_truncate = service->stderr_copy_and_truncate;
+	}
 }
 
-void rotate_file(wchar_t* service_name, wchar_t* path, uint32_t seconds, uint32_t delay, uint32_t low, uint32_t high, bool copy_and_truncate)
+/*
+  Rotate a file which isn't open.  If sequence isn't null the rotated name
+  takes the number it points to, which is then advanced.
+*/
+void rotate_file(wchar_t* service_name, wchar_t* path, uint32_t seconds, uint32_t low, uint32_t high, uint32_t delay, bool copy_and_truncate, uint32_t compress, retention_t* retention, uint32_t* sequence)
 {
 	uint32_t error;
 
@@ -363,37 +802,38 @@ void rotate_file(wchar_t* service_name, wchar_t* path, uint32_t seconds, uint32_
 	FileTimeToSystemTime(&info.ftLastWriteTime, &st);
 
 	wchar_t rotated[nssmconst::pathlength];
-	rotated_filename(path, rotated, std::size(rotated), &st);
+	rotated_filename(path, rotated, std::size(rotated), &st, sequence ? *sequence : 0);
+	if (sequence)
+		(*sequence)++;
 
 	/* Rotate. */
-	bool ok = true;
 	wchar_t* function;
+	copy_truncate_t copy;
 	if (copy_and_truncate)
 	{
-		function = L"::CopyFileW()";
-		if (::CopyFileW(path, rotated, TRUE))
-		{
-			file = write_to_file(path, NSSM_STDOUT_SHARING, 0, NSSM_STDOUT_DISPOSITION, NSSM_STDOUT_FLAGS);
-			Sleep(delay);
-			SetFilePointer(file, 0, 0, FILE_BEGIN);
-			SetEndOfFile(file);
-			CloseHandle(file);
-		}
-		else
-			ok = false;
+		/* Another process may be writing to it; the delay lets it settle. */
+		file = write_to_file(path, NSSM_STDOUT_SHARING, 0, NSSM_STDOUT_DISPOSITION, NSSM_STDOUT_FLAGS);
+		if (file == INVALID_HANDLE_VALUE)
+			return;
+		error = copy_and_truncate_file(path, file, rotated, delay, NSSM_COPY_PASSES, &copy);
+		function = copy.function;
+		CloseHandle(file);
 	}
 	else
 	{
 		function = L"::MoveFileW()";
-		if (!::MoveFileW(path, rotated))
-			ok = false;
+		error = ::MoveFileW(path, rotated) ? ERROR_SUCCESS : GetLastError();
 	}
-	if (ok)
+	if (error == ERROR_SUCCESS)
 	{
-		log_event(EVENTLOG_INFORMATION_TYPE, NSSM_EVENT_ROTATED, service_name, path, rotated, 0);
+		if (copy_and_truncate)
+			report_copy_and_truncate(service_name, path, rotated, &copy);
+		else
+			log_event(EVENTLOG_INFORMATION_TYPE, NSSM_EVENT_ROTATED, service_name, path, rotated, 0);
+		move_time_index(path, rotated, copy_and_truncate);
+		queue_rotated_file(service_name, path, rotated, compress, retention);
 		return;
 	}
-	error = GetLastError();
 
 	if (error == ERROR_FILE_NOT_FOUND)
 		return;
@@ -410,6 +850,12 @@ int32_t get_output_handles(nssm_service_t* service, STARTUPINFOW* si)
 	/* Allocate a new console so we get a fresh stdin, stdout and stderr. */
 	alloc_console(service);
 
+	logger_config_t config;
+	get_logger_config(service, &config);
+
+	/* The stdout logger, which stderr can share. */
+	logger_t* sink = 0;
+
 	/* stdin */
 	if (service->stdin_path[0])
 	{
@@ -426,17 +872,27 @@ int32_t get_output_handles(nssm_service_t* service, STARTUPINFOW* si)
 	/* stdout */
 	if (service->stdout_path[0])
 	{
+		/* Sequence numbers carry on from the highest already on disk. */
+		uint32_t stdout_sequence = service->rotate_sequence ? next_rotated_sequence(service->stdout_path) : 0;
 		if (service->rotate_files)
-			rotate_file(service->name, service->stdout_path, service->rotate_seconds, service->rotate_bytes_low, service->rotate_bytes_high, service->rotate_delay, service->stdout_copy_and_truncate);
+			rotate_file(service->name, service->stdout_path, service->rotate_seconds, service->rotate_bytes_low, service->rotate_bytes_high, service->rotate_delay, service->stdout_copy_and_truncate, service->rotate_compress, &config.retention, stdout_sequence ? &stdout_sequence : 0);
+		/* Let the logging thread rename the file while it is open. */
+		if (service->use_stdout_pipe)
+			service->stdout_sharing |= FILE_SHARE_DELETE;
 		HANDLE stdout_handle = write_to_file(service->stdout_path, service->stdout_sharing, 0, service->stdout_disposition, service->stdout_flags);
 		if (stdout_handle == INVALID_HANDLE_VALUE)
 			return 4;
 		service->stdout_si = 0;
 
+		/*
+      Passthrough: unless we have to timestamp or rotate online we give the
+      application the file handle itself and never copy its output.
+    */
 		if (service->use_stdout_pipe)
 		{
 			service->stdout_pipe = si->hStdOutput = 0;
-			service->stdout_thread = create_logging_thread(service->name, service->stdout_path, service->stdout_sharing, service->stdout_disposition, service->stdout_flags, &service->stdout_pipe, &service->stdout_si, &stdout_handle, service->rotate_bytes_low, service->rotate_bytes_high, service->rotate_delay, &service->stdout_tid, &service->rotate_stdout_online, service->timestamp_log, service->stdout_copy_and_truncate);
+			get_stream_config(service, stream::out, stdout_sequence, &config);
+			service->stdout_thread = create_logger(&config, &service->stdout_pipe, &service->stdout_si, &stdout_handle, &service->stdout_tid, &service->rotate_stdout_online, &sink);
 			if (!service->stdout_thread)
 			{
 				CloseHandle(service->stdout_pipe);
@@ -468,17 +924,42 @@ int32_t get_output_handles(nssm_service_t* service, STARTUPINFOW* si)
 			service->stderr_sharing = service->stdout_sharing;
 			service->stderr_disposition = service->stdout_disposition;
 			service->stderr_flags = service->stdout_flags;
+			service->stderr_buffer_size = service->stdout_buffer_size;
 			service->rotate_stderr_online = NSSM_ROTATE_OFFLINE;
+			service->stderr_thread = 0;
+
+			/*
+        Two handles to the same file will create a race, so stderr gets its
+        own pipe and its lines are written by the stdout logger.
+      */
+			if (sink)
+			{
+				HANDLE no_file = 0;
+				service->stderr_pipe = service->stderr_si = 0;
+				get_stream_config(service, stream::err, 0, &config);
+				config.copy_and_truncate = service->stdout_copy_and_truncate;
+				service->stderr_thread = create_logger(&config, &service->stderr_pipe, &service->stderr_si, &no_file, &service->stderr_tid, &service->rotate_stderr_online, &sink);
+				if (!service->stderr_thread)
+				{
+					close_handle(&service->stderr_pipe);
+					close_handle(&service->stderr_si);
+				}
+			}
 
-			/* Two handles to the same file will create a race. */
-			/* XXX: Here we assume that either both or neither handle must be a pipe. */
-			if (dup_handle(service->stdout_si, &service->stderr_si, L"stdout", L"stderr"))
-				return 6;
+			/* Otherwise the application writes both streams to one handle. */
+			if (!service->stderr_thread)
+			{
+				if (dup_handle(service->stdout_si, &service->stderr_si, L"stdout", L"stderr"))
+					return 6;
+			}
 		}
 		else
 		{
+			uint32_t stderr_sequence = service->rotate_sequence ? next_rotated_sequence(service->stderr_path) : 0;
 			if (service->rotate_files)
-				rotate_file(service->name, service->stderr_path, service->rotate_seconds, service->rotate_bytes_low, service->rotate_bytes_high, service->rotate_delay, service->stderr_copy_and_truncate);
+				rotate_file(service->name, service->stderr_path, service->rotate_seconds, service->rotate_bytes_low, service->rotate_bytes_high, service->rotate_delay, service->stderr_copy_and_truncate, service->rotate_compress, &config.retention, stderr_sequence ? &stderr_sequence : 0);
+			if (service->use_stderr_pipe)
+				service->stderr_sharing |= FILE_SHARE_DELETE;
 			HANDLE stderr_handle = write_to_file(service->stderr_path, service->stderr_sharing, 0, service->stderr_disposition, service->stderr_flags);
 			if (stderr_handle == INVALID_HANDLE_VALUE)
 				return 7;
@@ -486,8 +967,10 @@ int32_t get_output_handles(nssm_service_t* service, STARTUPINFOW* si)
 
 			if (service->use_stderr_pipe)
 			{
+				logger_t* stderr_sink = 0;
 				service->stderr_pipe = si->hStdError = 0;
-				service->stderr_thread = create_logging_thread(service->name, service->stderr_path, service->stderr_sharing, service->stderr_disposition, service->stderr_flags, &service->stderr_pipe, &service->stderr_si, &stderr_handle, service->rotate_bytes_low, service->rotate_bytes_high, service->rotate_delay, &service->stderr_tid, &service->rotate_stderr_online, service->timestamp_log, service->stderr_copy_and_truncate);
+				get_stream_config(service, stream::err, stderr_sequence, &config);
+				service->stderr_thread = create_logger(&config, &service->stderr_pipe, &service->stderr_si, &stderr_handle, &service->stderr_tid, &service->rotate_stderr_online, &stderr_sink);
 				if (!service->stderr_thread)
 				{
 					CloseHandle(service->stderr_pipe);
@@ -563,365 +1046,1895 @@ void close_output_handles(STARTUPINFOW* si)
 void cleanup_loggers(nssm_service_t* service)
 {
 	uint32_t interval = wait::cleanupdeadline;
-	HANDLE thread_handle = INVALID_HANDLE_VALUE;
 
-	close_handle(&service->stdout_thread, &thread_handle);
-	/* Close write end of the data pipe so logging thread can finalise read. */
+	/* Close write ends of the data pipes so the logging thread can finalise reads. */
 	close_handle(&service->stdout_si);
-	/* Await logging thread then close read end. */
-	if (thread_handle != INVALID_HANDLE_VALUE)
-		WaitForSingleObject(thread_handle, interval);
-	close_handle(&service->stdout_pipe);
-
-	thread_handle = INVALID_HANDLE_VALUE;
-	close_handle(&service->stderr_thread, &thread_handle);
 	close_handle(&service->stderr_si);
-	if (thread_handle != INVALID_HANDLE_VALUE)
-		WaitForSingleObject(thread_handle, interval);
-	close_handle(&service->stderr_pipe);
+
+	/* Both streams are served by the same thread, which exits after the last one. */
+	if (service->stdout_thread)
+		WaitForSingleObject(service->stdout_thread, interval);
+	else if (service->stderr_thread)
+		WaitForSingleObject(service->stderr_thread, interval);
+	close_handle(&service->stdout_thread);
+	close_handle(&service->stderr_thread);
+
+	/* The read ends belong to the logging thread. */
+	service->stdout_pipe = service->stderr_pipe = 0;
 }
 
 /*
-  Try multiple times to read from a file.
-  Returns:  0 on success.
-            1 on non-fatal error.
+  Handle a failed read from the pipe.
+  Returns:  1 if the read should be retried.
+            2 if the read should be retried later.
            -1 on fatal error.
 */
-static int32_t try_read(logger_t* logger, void* address, uint32_t bufsize, uint32_t* in, int32_t* complained)
+static int32_t read_failed(logger_t* logger, uint32_t error)
 {
-	int32_t ret = 1;
-	uint32_t error;
-	for (int32_t tries = 0; tries < 5; tries++)
+	int32_t ret;
+	switch (error)
 	{
-		if (ReadFile(logger->read_handle, address, bufsize, in, 0))
-			return 0;
-
-		error = GetLastError();
-		switch (error)
-		{
-		/* Other end closed the pipe. */
-		case ERROR_BROKEN_PIPE:
-			ret = -1;
-			goto complain_read;
+	/* Other end closed the pipe. */
+	case ERROR_BROKEN_PIPE:
+		ret = -1;
+		break;
 
-		/* Couldn't lock the buffer. */
-		case ERROR_NOT_ENOUGH_QUOTA:
-			Sleep(2000 + tries * 3000);
-			ret = 1;
-			continue;
+	/* Couldn't lock the buffer. */
+	case ERROR_NOT_ENOUGH_QUOTA:
+		return 2;
 
-		/* Write was cancelled by the other end. */
-		case ERROR_OPERATION_ABORTED:
-			ret = 1;
-			goto complain_read;
+	/* Write was cancelled by the other end. */
+	case ERROR_OPERATION_ABORTED:
+		ret = 1;
+		break;
 
-		default:
-			ret = -1;
-		}
+	default:
+		ret = -1;
 	}
 
-complain_read:
 	/* Ignore the error if we've been requested to exit anyway. */
 	if (*logger->rotate_online != NSSM_ROTATE_ONLINE)
 		return ret;
-	if (!(*complained & COMPLAINED_READ))
+	if (!(logger->read_complained & COMPLAINED_READ))
 		log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_READFILE_FAILED, logger->service_name, logger->path, error_string(error), 0);
-	*complained |= COMPLAINED_READ;
+	logger->read_complained |= COMPLAINED_READ;
 	return ret;
 }
 
 /*
-  Try multiple times to write to a file.
+  Try multiple times to start an overlapped read from the pipe.
+  The data will be delivered to the logging thread's completion port.
   Returns:  0 on success.
-            1 on non-fatal error.
+            2 if the read should be retried later.
            -1 on fatal error.
 */
-static int32_t try_write(logger_t* logger, void* address, uint32_t bufsize, uint32_t* out, int32_t* complained)
+static int32_t try_read(logger_t* logger)
 {
-	int32_t ret = 1;
-	uint32_t error;
 	for (int32_t tries = 0; tries < 5; tries++)
 	{
-		if (WriteFile(logger->write_handle, address, bufsize, out, 0))
+		ZeroMemory(&logger->overlapped, sizeof(logger->overlapped));
+		if (ReadFile(logger->read_handle, logger->handoff.buffer, logger->handoff.buffer_size, 0, &logger->overlapped))
 			return 0;
 
-		error = GetLastError();
+		uint32_t error = GetLastError();
 		if (error == ERROR_IO_PENDING)
-		{
-			/* Operation was successful pending flush to disk. */
 			return 0;
-		}
-
-		switch (error)
-		{
-		/* Other end closed the pipe. */
-		case ERROR_BROKEN_PIPE:
-			ret = -1;
-			goto complain_write;
-
-		/* Couldn't lock the buffer. */
-		case ERROR_NOT_ENOUGH_QUOTA:
-		/* Out of disk space. */
-		case ERROR_DISK_FULL:
-			Sleep(2000 + tries * 3000);
-			ret = 1;
-			continue;
 
-		default:
-			/* We'll lose this line but try to read and write subsequent ones. */
-			ret = 1;
-		}
+		int32_t ret = read_failed(logger, error);
+		if (ret < 0 || ret == 2)
+			return ret;
+		count_stat(logger->stats->read_retries, 1);
 	}
 
-complain_write:
-	if (!(*complained & COMPLAINED_WRITE))
-		log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_WRITEFILE_FAILED, logger->service_name, logger->path, error_string(error), 0);
-	*complained |= COMPLAINED_WRITE;
-	return ret;
+	return -1;
 }
 
-/* Note that the timestamp is created in UTF-8. */
-static inline int32_t write_timestamp(logger_t* logger, uint32_t charsize, uint32_t* out, int32_t* complained)
+/*
+  Schedule another try at a read which couldn't lock its buffer, backing
+  off each time.  The reading thread carries on with the other streams
+  meanwhile.
+  Returns:  2 if the read will be retried.
+           -1 if we have given up on the stream.
+*/
+static int32_t read_later(logger_t* logger)
 {
-	char timestamp[TIMESTAMP_LEN + 1];
-
-	SYSTEMTIME now;
-	GetSystemTime(&now);
-	_snprintf_s(timestamp, std::size(timestamp), _TRUNCATE, TIMESTAMP_FORMAT, now.wYear, now.wMonth, now.wDay, now.wHour, now.wMinute, now.wSecond, now.wMilliseconds);
-
-	if (charsize == sizeof(char))
-		return try_write(logger, (void*)timestamp, TIMESTAMP_LEN, out, complained);
-
-	wchar_t* utf16;
-	uint32_t utf16len;
-	if (to_utf16(timestamp, &utf16, &utf16len))
+	if (logger->read_tries >= 5)
 		return -1;
-	int32_t ret = try_write(logger, (void*)*utf16, utf16len * sizeof(wchar_t), out, complained);
-	HeapFree(GetProcessHeap(), 0, utf16);
-	return ret;
+
+	logger->read_at = GetTickCount64() + 2000 + logger->read_tries * 3000;
+	logger->read_tries++;
+	count_stat(logger->stats->read_retries, 1);
+	return 2;
 }
 
-static int32_t write_with_timestamp(logger_t* logger, void* address, uint32_t bufsize, uint32_t* out, int32_t* complained, uint32_t charsize)
+/*
+  Retry the reads which are due.  Called by the reading thread.
+  Returns the number of milliseconds until the next retry is due.
+*/
+static uint32_t retry_reads(logger_t** retrying)
 {
-	if (logger->timestamp_log)
+	uint64_t now = GetTickCount64();
+	uint64_t next = 0;
+	for (logger_t** l = retrying; *l; )
 	{
-		uint32_t log_out;
-		int32_t log_complained;
-		uint32_t timestamp_out = 0;
-		int32_t timestamp_complained;
-		if (!logger->line_length)
+		logger_t* logger = *l;
+		int32_t ret = 2;
+		if (logger->failed)
+			ret = -1;
+		else if (now >= logger->read_at)
 		{
-			write_timestamp(logger, charsize, &timestamp_out, &timestamp_complained);
-			logger->line_length += (int64_t)timestamp_out;
-			*out += timestamp_out;
-			*complained |= timestamp_complained;
+			ret = try_read(logger);
+			if (ret == 2)
+				ret = read_later(logger);
 		}
 
-		uint32_t i;
-		void* line = address;
-		uint32_t offset = 0;
-		int32_t ret;
-		for (i = 0; i < bufsize; i++)
+		if (ret == 2)
 		{
-			if (((char*)address)[i] == '\n')
-			{
-				ret = try_write(logger, line, i - offset + 1, &log_out, &log_complained);
-				line = (void*)((char*)line + i - offset + 1);
-				logger->line_length = 0LL;
-				*out += log_out;
-				*complained |= log_complained;
-				offset = i + 1;
-				if (offset < bufsize)
-				{
-					write_timestamp(logger, charsize, &timestamp_out, &timestamp_complained);
-					logger->line_length += (int64_t)timestamp_out;
-					*out += timestamp_out;
-					*complained |= timestamp_complained;
-				}
-			}
+			if (!next || logger->read_at < next)
+				next = logger->read_at;
+			l = &logger->read_next;
+			continue;
 		}
 
-		if (offset < bufsize)
+		*l = logger->read_next;
+		if (ret < 0)
+			close_handoff(&logger->handoff);
+	}
+
+	if (!next)
+		return INFINITE;
+	return (uint32_t)(next - now);
+}
+
+/* Account for output which made it to the file. */
+static inline void count_written(logger_t* logger, void* address, uint32_t out)
+{
+	count_stat(logger->stats->bytes_out, out);
+	logger->unflushed += out;
+	if (logger->forwarder)
+		forward(logger->forwarder, address, out);
+}
+
+/*
+  Keep output which couldn't be written because the disk was full, after
+  any already kept.  It is written by retry_write() from the timer so the
+  writing thread never waits for space.  Returns 0 on success.
+*/
+static int32_t hold_write(logger_t* logger, void* address, uint32_t bufsize)
+{
+	if (logger->held_len + bufsize > logger->held_size)
+	{
+		uint32_t size = logger->held_len + bufsize;
+		char* held;
+		if (logger->held)
+			held = (char*)HeapReAlloc(GetProcessHeap(), 0, logger->held, size);
+		else
+			held = (char*)HeapAlloc(GetProcessHeap(), 0, size);
+		if (!held)
+		{
+			log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_OUT_OF_MEMORY, L"held", L"hold_write()", 0);
+			return 1;
+		}
+		logger->held = held;
+		logger->held_size = size;
+	}
+
+	memmove(logger->held + logger->held_len, address, bufsize);
+	logger->held_len += bufsize;
+	return 0;
+}
+
+/*
+  Try multiple times to write to a file.
+  Output which doesn't fit on a full disk is held back and counts as
+  written, as does everything after it until it has been retried.
+  Returns:  0 on success.
+            1 on non-fatal error.
+           -1 on fatal error.
+*/
+static int32_t try_write(logger_t* logger, void* address, uint32_t bufsize, uint32_t* out, int32_t* complained)
+{
+	int32_t ret = 1;
+	uint32_t error;
+	/* Keep the file in order behind what is held back. */
+	if (logger->held_len)
+	{
+		if (hold_write(logger, address, bufsize))
+			return 1;
+		*out = bufsize;
+		return 0;
+	}
+
+	for (int32_t tries = 0; tries < 5; tries++)
+	{
+		if (tries)
+			count_stat(logger->stats->write_retries, 1);
+
+		LARGE_INTEGER start;
+		QueryPerformanceCounter(&start);
+		bool ok = WriteFile(logger->write_handle, address, bufsize, out, 0);
+		error = ok ? ERROR_SUCCESS : GetLastError();
+		record_latency(logger->stats, &start);
+
+		/* ERROR_IO_PENDING means success pending flush to disk. */
+		if (ok || error == ERROR_IO_PENDING)
+		{
+			count_written(logger, address, *out);
+			return 0;
+		}
+
+		switch (error)
+		{
+		/* Other end closed the pipe. */
+		case ERROR_BROKEN_PIPE:
+			ret = -1;
+			goto complain_write;
+
+		/* Couldn't lock the buffer. */
+		case ERROR_NOT_ENOUGH_QUOTA:
+		/* Out of disk space. */
+		case ERROR_DISK_FULL:
+			/* Don't keep every other stream waiting for space; retry_write() tries again later. */
+			if (hold_write(logger, address, bufsize))
+				goto complain_write;
+			logger->write_at = GetTickCount64() + 2000;
+			logger->write_tries = 0;
+			*out = bufsize;
+			return 0;
+
+		default:
+			/* We'll lose this line but try to read and write subsequent ones. */
+			ret = 1;
+		}
+	}
+
+complain_write:
+	if (!(*complained & COMPLAINED_WRITE))
+		log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_WRITEFILE_FAILED, logger->service_name, logger->path, error_string(error), 0);
+	*complained |= COMPLAINED_WRITE;
+	return ret;
+}
+
+/* Write out everything in the staging buffer with a single call. */
+static int32_t flush_staging(logger_t* logger, uint32_t* out, int32_t* complained)
+{
+	if (!logger->staged)
+		return 0;
+
+	uint32_t written = 0;
+	int32_t ret = try_write(logger, (void*)logger->staging, logger->staged, &written, complained);
+	logger->staged = 0;
+	*out += written;
+	return ret;
+}
+
+/*
+  Append data to the staging buffer, flushing it first if there isn't room.
+  Anything too big to be staged at all is written straight through.
+*/
+static int32_t stage(logger_t* logger, void* address, uint32_t bufsize, uint32_t* out, int32_t* complained)
+{
+	if (logger->staged + bufsize > logger->staging_size)
+	{
+		int32_t ret = flush_staging(logger, out, complained);
+		if (ret < 0)
+			return ret;
+
+		if (bufsize > logger->staging_size)
+		{
+			uint32_t written = 0;
+			ret = try_write(logger, address, bufsize, &written, complained);
+			*out += written;
+			return ret;
+		}
+	}
+
+	memmove(logger->staging + logger->staged, address, bufsize);
+	logger->staged += bufsize;
+	return 0;
+}
+
+static const char tags_utf8[][TAG_LEN + 1] = {"", "stdout: ", "stderr: "};
+static const wchar_t tags_utf16[][TAG_LEN + 1] = {L"", L"stdout: ", L"stderr: "};
+
+/*
+  Write the timestamp and/or stream tag which start a line, and start
+  counting the line's length from the bytes they take.
+  Note that the prefix is created in UTF-8 or UTF-16 to match the output.
+*/
+static inline int32_t write_timestamp(logger_t* logger, uint32_t charsize, uint32_t tag, uint32_t* out, int32_t* complained)
+{
+	int32_t ret = 0;
+	logger->line_length = 0LL;
+	if (logger->timestamp_log)
+	{
+		update_timestamp(&logger->timestamp);
+		if (charsize == sizeof(char))
+			ret = stage(logger, (void*)logger->timestamp.utf8, TIMESTAMP_LEN, out, complained);
+		else
+			ret = stage(logger, (void*)logger->timestamp.utf16, TIMESTAMP_LEN * sizeof(wchar_t), out, complained);
+		if (ret < 0)
+			return ret;
+		logger->line_length += (int64_t)(TIMESTAMP_LEN * charsize);
+	}
+
+	if (tag)
+	{
+		if (charsize == sizeof(char))
+			ret = stage(logger, (void*)tags_utf8[tag], TAG_LEN, out, complained);
+		else
+			ret = stage(logger, (void*)tags_utf16[tag], TAG_LEN * sizeof(wchar_t), out, complained);
+		if (ret < 0)
+			return ret;
+		logger->line_length += (int64_t)(TAG_LEN * charsize);
+	}
+	return ret;
+}
+
+/*
+  Decide whether the line starting at address continues the last record
+  written by the stream, rather than starting a new one.  A line from the
+  other stream sharing the file always starts a new record.
+*/
+static inline bool continue_record(logger_t* logger, void* address, uint32_t bufsize, uint32_t charsize)
+{
+	logger_t* sink = logger->sink;
+	bool continues = (sink->in_record && sink->record_owner == logger && continues_record(&sink->multiline, address, bufsize, charsize));
+	sink->in_record = false;
+	return continues;
+}
+
+/* Leave the record open to continuation lines after its line ends. */
+static inline void end_line(logger_t* logger)
+{
+	logger_t* sink = logger->sink;
+	if (sink->multiline.rule == NSSM_MULTILINE_NONE)
+		return;
+	sink->in_record = true;
+	sink->record_owner = logger;
+}
+
+/*
+  Timestamped records are assembled in the staging buffer so that a read
+  containing many lines costs one write rather than two per line.  The
+  buffer is always flushed before returning, so no data is held back
+  beyond the read which delivered it.
+  Continuation lines of a multi-line record are not stamped.
+*/
+static int32_t write_with_timestamp(logger_t* logger, void* address, uint32_t bufsize, uint32_t* out, int32_t* complained, logger_t* stream)
+{
+	uint32_t charsize = stream->charsize;
+	uint32_t tag = stream->tag;
+	if (!logger->timestamp_log && !tag)
+		return try_write(logger, address, bufsize, out, complained);
+
+	*out = 0;
+	int32_t ret;
+	if (!logger->line_length && !continue_record(stream, address, bufsize, charsize))
+	{
+		ret = write_timestamp(logger, charsize, tag, out, complained);
+		if (ret < 0)
+			return ret;
+	}
+
+	uint32_t ends[NSSM_LINE_ENDS];
+	uint32_t offset = 0;
+	uint32_t count;
+	do
+	{
+		count = find_line_ends((char*)address + offset, bufsize - offset, charsize, ends, std::size(ends));
+		uint32_t base = offset;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint32_t end = base + ends[i];
+			ret = stage(logger, (char*)address + offset, end - offset, out, complained);
+			if (ret < 0)
+				return ret;
+			logger->line_length = 0LL;
+			end_line(stream);
+			offset = end;
+			if (offset < bufsize && !continue_record(stream, (char*)address + offset, bufsize - offset, charsize))
+			{
+				ret = write_timestamp(logger, charsize, tag, out, complained);
+				if (ret < 0)
+					return ret;
+			}
+		}
+	} while (count == std::size(ends));
+
+	if (offset < bufsize)
+	{
+		ret = stage(logger, (char*)address + offset, bufsize - offset, out, complained);
+		if (ret < 0)
+			return ret;
+		logger->line_length += (int64_t)(bufsize - offset);
+	}
+
+	return flush_staging(logger, out, complained);
+}
+
+/* Escape UTF-8 text into the staging buffer as part of a JSON string. */
+static int32_t stage_json(logger_t* logger, const char* address, uint32_t bufsize, uint32_t* out, int32_t* complained)
+{
+	uint32_t max_piece = logger->staging_size / JSON_ESCAPE_MAX;
+	while (bufsize)
+	{
+		uint32_t piece = (bufsize < max_piece) ? bufsize : max_piece;
+		if (logger->staged + piece * JSON_ESCAPE_MAX > logger->staging_size)
+		{
+			int32_t ret = flush_staging(logger, out, complained);
+			if (ret < 0)
+				return ret;
+		}
+
+		logger->staged += json_escape(address, piece, logger->staging + logger->staged);
+		address += piece;
+		bufsize -= piece;
+	}
+	return 0;
+}
+
+/* Start a JSON record with the time, service, stream and process ID. */
+static int32_t open_record(logger_t* logger, uint32_t* out)
+{
+	logger_t* sink = logger->sink;
+	update_timestamp(&sink->timestamp);
+
+	/* ISO 8601 in UTC, eg 2016-09-06T10:17:09.451Z */
+	char time[JSON_TIME_LEN];
+	uint32_t len = (uint32_t)strlen(JSON_TIME);
+	memmove(time, JSON_TIME, len);
+	memmove(time + len, sink->timestamp.utf8, JSON_TIME_LEN - len - 1);
+	time[len + 10] = 'T';
+	time[JSON_TIME_LEN - 1] = 'Z';
+
+	char pid[32];
+	int32_t pidlen = ::_snprintf_s(pid, std::size(pid), _TRUNCATE, JSON_MESSAGE, *logger->pid_ptr);
+
+	int32_t ret = stage(sink, time, JSON_TIME_LEN, out, &sink->complained);
+	if (ret >= 0)
+		ret = stage(sink, logger->json_head, logger->json_head_len, out, &sink->complained);
+	if (ret >= 0)
+		ret = stage(sink, pid, (uint32_t)pidlen, out, &sink->complained);
+	sink->line_length = 1;
+	return ret;
+}
+
+/*
+  Start a line, either as a new record or as the next line of the record
+  left open by the previous one.  Lines within a record are separated by
+  an escaped newline.
+*/
+static int32_t start_json_line(logger_t* logger, void* address, uint32_t bufsize, uint32_t* out)
+{
+	logger_t* sink = logger->sink;
+	bool open = sink->in_record;
+	if (continue_record(logger, address, bufsize, sizeof(char)))
+	{
+		sink->line_length = 1;
+		return stage_json(sink, "\n", 1, out, &sink->complained);
+	}
+
+	if (open)
+	{
+		int32_t ret = stage(sink, (void*)JSON_END, JSON_END_LEN, out, &sink->complained);
+		if (ret < 0)
+			return ret;
+	}
+	return open_record(logger, out);
+}
+
+/*
+  Write lines as JSON records, one per line.  Records are opened at the
+  start of a line and closed at its end, in the same pass which finds the
+  line endings, so a line which arrives in several reads is still one
+  record.  The line ending itself is not part of the message.
+  With multi-line aggregation a record is closed only when the next line
+  turns out not to continue it.
+  UTF-16 output has already been converted to UTF-8 by log_chunk().
+*/
+static int32_t write_json(logger_t* logger, void* address, uint32_t bufsize, uint32_t* out)
+{
+	logger_t* sink = logger->sink;
+	uint32_t charsize = sizeof(char);
+	*out = 0;
+	int32_t ret;
+
+	uint32_t ends[NSSM_LINE_ENDS];
+	uint32_t offset = 0;
+	uint32_t count;
+	do
+	{
+		count = find_line_ends((char*)address + offset, bufsize - offset, charsize, ends, std::size(ends));
+		uint32_t base = offset;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint32_t end = base + ends[i];
+			if (!sink->line_length)
+			{
+				ret = start_json_line(logger, (char*)address + offset, bufsize - offset, out);
+				if (ret < 0)
+					return ret;
+			}
+
+			/* Drop the newline and any carriage return before it. */
+			uint32_t text = end - charsize;
+			if (text > offset && ((char*)address)[text - 1] == '\r')
+				text--;
+
+			ret = stage_json(sink, (char*)address + offset, text - offset, out, &sink->complained);
+			if (ret < 0)
+				return ret;
+			if (sink->multiline.rule == NSSM_MULTILINE_NONE)
+			{
+				ret = stage(sink, (void*)JSON_END, JSON_END_LEN, out, &sink->complained);
+				if (ret < 0)
+					return ret;
+			}
+			sink->line_length = 0LL;
+			end_line(logger);
+			offset = end;
+		}
+	} while (count == std::size(ends));
+
+	if (offset < bufsize)
+	{
+		if (!sink->line_length)
+		{
+			ret = start_json_line(logger, (char*)address + offset, bufsize - offset, out);
+			if (ret < 0)
+				return ret;
+		}
+		ret = stage_json(sink, (char*)address + offset, bufsize - offset, out, &sink->complained);
+		if (ret < 0)
+			return ret;
+		sink->line_length += (int64_t)(bufsize - offset);
+	}
+
+	return flush_staging(sink, out, &sink->complained);
+}
+
+/*
+  Close the JSON record left open by a stream which ended mid-line, or
+  by the last line of a multi-line record.
+*/
+static void close_record(logger_t* logger)
+{
+	logger_t* sink = logger->sink;
+	bool open = (sink->line_length || (sink->in_record && sink->record_owner == logger));
+	if (sink->record_owner == logger)
+		sink->in_record = false;
+	if (sink->format != NSSM_FORMAT_JSON || !open || !sink->write_handle)
+		return;
+
+	uint32_t out = 0;
+	if (stage(sink, (void*)JSON_END, JSON_END_LEN, &out, &sink->complained) >= 0)
+		flush_staging(sink, &out, &sink->complained);
+	sink->file_size += (int64_t)out;
+	sink->line_length = 0LL;
+}
+
+/* Write part of a stream in the file's record format. */
+static inline int32_t write_lines(logger_t* logger, void* address, uint32_t bufsize, uint32_t* out)
+{
+	logger_t* sink = logger->sink;
+	if (sink->format == NSSM_FORMAT_JSON)
+		return write_json(logger, address, bufsize, out);
+	return write_with_timestamp(sink, address, bufsize, out, &sink->complained, logger);
+}
+
+/* Is any flush policy configured? */
+static inline bool want_flush(logger_t* logger)
+{
+	return logger->flush_interval || logger->flush_bytes || logger->flush_rotate;
+}
+
+/* Commit everything written so far to disk.  Called by the writing thread. */
+static void flush_file(logger_t* logger)
+{
+	logger->flush_at = 0;
+	if (!logger->unflushed || !logger->write_handle)
+		return;
+	logger->unflushed = 0;
+
+	if (FlushFileBuffers(logger->write_handle))
+		return;
+	if (!(logger->complained & COMPLAINED_FLUSH))
+		log_event(EVENTLOG_WARNING_TYPE, NSSM_EVENT_FLUSHFILEBUFFERS_FAILED, logger->service_name, logger->path, error_string(GetLastError()), 0);
+	logger->complained |= COMPLAINED_FLUSH;
+}
+
+/*
+  Apply the flush policy after writing.  Once enough bytes have piled up
+  they are flushed straight away, otherwise the writing thread's timer
+  will flush them when the interval is up.
+*/
+static inline void flush_if_due(logger_t* logger)
+{
+	if (!logger->unflushed)
+		return;
+	if (logger->flush_bytes && logger->unflushed >= logger->flush_bytes)
+		flush_file(logger);
+	else if (logger->flush_interval && !logger->flush_at)
+		logger->flush_at = GetTickCount64() + logger->flush_interval;
+}
+
+/* The real filesystem, for rename_live_file(). */
+static bool move_live_file(wchar_t* from, wchar_t* to)
+{
+	return ::MoveFileW(from, to) ? true : false;
+}
+
+/* write_to_file() complains if it fails. */
+static HANDLE open_live_file(wchar_t* path, uint32_t sharing, uint32_t disposition, uint32_t flags)
+{
+	return write_to_file(path, sharing, 0, disposition, flags);
+}
+
+static void close_live_file(HANDLE* handle)
+{
+	close_handle(handle);
+}
+
+static const rotate_fs_t live_fs = {move_live_file, open_live_file, close_live_file};
+
+/*
+  Rotate the file we are writing without closing it first, as described
+  for rename_live_file(), or by copying and truncating it.  Data which
+  arrives meanwhile waits in the queue.
+
+  Returns:  0 on success.
+            1 if rotation failed but we are still writing the old file.
+           -1 if we can't log anything further.
+*/
+static int32_t rotate_live_file(logger_t* logger)
+{
+	/* Output held back by a full disk belongs in this file. */
+	if (logger->held_len)
+		return 1;
+
+	/* A record can't span files. */
+	if (logger->in_record)
+		close_record(logger->record_owner);
+
+	wchar_t rotated[nssmconst::pathlength];
+	rotated_filename(logger->path, rotated, std::size(rotated), 0, logger->rotate_sequence);
+	/* A failed rotation uses up its number so a clashing name isn't retried. */
+	if (logger->rotate_sequence)
+		logger->rotate_sequence++;
+
+	uint64_t started = GetTickCount64();
+	uint32_t error = ERROR_SUCCESS;
+	const wchar_t* function;
+	copy_truncate_t copy;
+	if (logger->copy_and_truncate)
+	{
+		/*
+		  Copy, then truncate through our own handle.  Nothing else writes
+		  to the file, and this thread won't until we return, so there is
+		  nothing to wait for.
+		*/
+		FlushFileBuffers(logger->write_handle);
+		error = copy_and_truncate_file(logger->path, logger->write_handle, rotated, 0, 0, &copy);
+		function = copy.function;
+	}
+	else
+	{
+		/* Make sure the outgoing file is on disk before we let go of it. */
+		if (want_flush(logger))
+			flush_file(logger);
+
+		if (rename_live_file(&live_fs, logger->path, rotated, &logger->write_handle, logger->sharing, &logger->disposition, logger->flags, &error, &function) < 0)
+			return -1;
+	}
+
+	if (error == ERROR_SUCCESS)
+	{
+		if (logger->copy_and_truncate)
+		{
+			report_copy_and_truncate(logger->service_name, logger->path, rotated, &copy);
+			count_stat(logger->stats->truncate_lost, copy.lost);
+		}
+		else
+			log_event(EVENTLOG_INFORMATION_TYPE, NSSM_EVENT_ROTATED, logger->service_name, logger->path, rotated, 0);
+		logger->complained &= ~COMPLAINED_ROTATE;
+		count_stat(logger->stats->rotations, 1);
+		count_stat(logger->stats->rotation_ms, GetTickCount64() - started);
+		logger->file_size = logger->rotate_offset = 0LL;
+		logger->unflushed = logger->flush_at = 0;
+		if (logger->time_index)
+		{
+			/* The index goes with the rotated file and the new file starts its own. */
+			close_handle(&logger->index_handle);
+			move_time_index(logger->path, rotated, logger->copy_and_truncate);
+			logger->index_handle = open_time_index(logger->path, 0LL);
+			if (!logger->index_handle && !(logger->complained & COMPLAINED_INDEX))
+			{
+				log_event(EVENTLOG_WARNING_TYPE, NSSM_EVENT_TIME_INDEX_FAILED, logger->service_name, logger->path, error_string(GetLastError()), 0);
+				logger->complained |= COMPLAINED_INDEX;
+			}
+			logger->index_offset = 0LL;
+			logger->index_at = 0;
+		}
+		/* Hand off to the background thread; we don't wait for it. */
+		queue_rotated_file(logger->service_name, logger->path, rotated, logger->compress, &logger->retention);
+		return 0;
+	}
+
+	if (error != ERROR_FILE_NOT_FOUND)
+	{
+		if (!(logger->complained & COMPLAINED_ROTATE))
+			log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_ROTATE_FILE_FAILED, logger->service_name, logger->path, function, rotated, error_string(error), 0);
+		logger->complained |= COMPLAINED_ROTATE;
+	}
+	/* Don't retry on every chunk; wait for another file's worth of output. */
+	logger->rotate_offset = logger->file_size;
+	return 1;
+}
+
+/*
+  Add an entry to the time index if enough output or time has passed since
+  the last one.  Costs a comparison per chunk.
+*/
+static inline void index_chunk(logger_t* sink)
+{
+	if (!sink->index_handle)
+		return;
+
+	uint64_t now = GetTickCount64();
+	bool due = (sink->index_interval && now >= sink->index_at) || (sink->index_bytes && sink->file_size - sink->index_offset >= (int64_t)sink->index_bytes);
+	/* The first entry for a file is always due. */
+	if (!due && sink->index_at)
+		return;
+	if (sink->index_at && sink->file_size == sink->index_offset)
+		return;
+
+	if (!append_time_index(sink->index_handle, sink->file_size))
+	{
+		if (!(sink->complained & COMPLAINED_INDEX))
+			log_event(EVENTLOG_WARNING_TYPE, NSSM_EVENT_TIME_INDEX_FAILED, sink->service_name, sink->path, error_string(GetLastError()), 0);
+		sink->complained |= COMPLAINED_INDEX;
+		/* Don't try again on every write. */
+		close_handle(&sink->index_handle);
+		return;
+	}
+
+	sink->index_offset = sink->file_size;
+	sink->index_at = now + sink->index_interval;
+}
+
+/*
+  Write data read from the application, rotating the file if necessary.
+  The file belongs to the stream's sink, which is the stream itself unless
+  it shares stdout's file.
+*/
+static int32_t write_chunk(logger_t* logger, void* address, uint32_t in)
+{
+	logger_t* sink = logger->sink;
+	uint32_t out;
+	int32_t ret;
+
+	/* Remember whether the file will end mid-line, for timed rotation. */
+	if (in)
+	{
+		count_stat(logger->stats->lines, count_line_ends(address, in, logger->charsize));
+		if (logger->charsize == sizeof(wchar_t))
+			sink->mid_line = (in < sizeof(wchar_t) || *(wchar_t*)((char*)address + in - sizeof(wchar_t)) != L'\n');
+		else
+			sink->mid_line = (((char*)address)[in - 1] != '\n');
+	}
+
+	if (*sink->rotate_online == NSSM_ROTATE_ONLINE_ASAP || (sink->size && sink->file_size - sink->rotate_offset + (int64_t)in >= sink->size))
+	{
+		/* Look for newline. */
+		uint32_t i;
+		if (find_line_ends(address, in, logger->charsize, &i, 1))
+		{
+			/* Write up to the newline. */
+			out = 0;
+			ret = write_lines(logger, address, i, &out);
+			if (ret < 0)
+				return -1;
+			sink->file_size += (int64_t)out;
+
+			/* Rotate. */
+			*sink->rotate_online = NSSM_ROTATE_ONLINE;
+			if (rotate_live_file(sink) < 0)
+				return -1;
+
+			/* Resume writing after the newline. */
+			address = (void*)((char*)address + i);
+			in -= i;
+		}
+	}
+
+	/* Note where this output starts, before any BOM so that it starts a line. */
+	if (in)
+		index_chunk(sink);
+
+	/* JSON records are always UTF-8, which needs no BOM. */
+	if (!sink->file_size && sink->format != NSSM_FORMAT_JSON)
+	{
+		/* Write a BOM to the new file. */
+		out = 0;
+		if (logger->charsize == sizeof(wchar_t))
+			write_bom(sink, &out);
+		sink->file_size += (int64_t)out;
+	}
+
+	/* Write the data, if any. */
+	if (!in)
+		return 0;
+
+	out = 0;
+	ret = write_lines(logger, address, in, &out);
+	sink->file_size += (int64_t)out;
+	if (ret < 0)
+		return -1;
+
+	return 0;
+}
+
+/* Offset just past the last line end in a chunk, or 0 if there is none. */
+static inline uint32_t last_line_end(void* address, uint32_t in, uint32_t charsize)
+{
+	if (charsize == sizeof(wchar_t))
+	{
+		wchar_t* s = (wchar_t*)address;
+		for (uint32_t n = in / sizeof(wchar_t); n; n--)
+			if (s[n - 1] == L'\n')
+				return n * (uint32_t)sizeof(wchar_t);
+		return 0;
+	}
+
+	char* s = (char*)address;
+	for (uint32_t n = in; n; n--)
+		if (s[n - 1] == '\n')
+			return n;
+	return 0;
+}
+
+/* Write a summary of the lines suppressed as repeats of the last one. */
+static int32_t write_repeats(logger_t* logger)
+{
+	if (!logger->repeats)
+		return 0;
+
+	uint64_t repeats = logger->repeats;
+	logger->repeats = 0;
+	logger->repeat_at = 0;
+
+	if (logger->charsize == sizeof(wchar_t))
+	{
+		wchar_t summary[64];
+		int32_t len = ::_snwprintf_s(summary, std::size(summary), _TRUNCATE, NSSM_REPEATED_UTF16, repeats);
+		return write_chunk(logger, summary, (uint32_t)len * sizeof(wchar_t));
+	}
+
+	char summary[64];
+	int32_t len = ::_snprintf_s(summary, std::size(summary), _TRUNCATE, NSSM_REPEATED_UTF8, repeats);
+	return write_chunk(logger, summary, (uint32_t)len);
+}
+
+/* Write a count of the lines dropped by the rate limit. */
+static int32_t write_limited(logger_t* logger)
+{
+	rate_limit_t* limit = &logger->limit;
+	if (!limit->dropped_lines)
+		return 0;
+
+	uint64_t lines = limit->dropped_lines;
+	uint64_t bytes = limit->dropped_bytes;
+	limit->dropped_lines = limit->dropped_bytes = 0;
+	limit->report_at = 0;
+
+	if (logger->charsize == sizeof(wchar_t))
+	{
+		wchar_t summary[96];
+		int32_t len = ::_snwprintf_s(summary, std::size(summary), _TRUNCATE, NSSM_LIMITED_UTF16, lines, bytes);
+		return write_chunk(logger, summary, (uint32_t)len * sizeof(wchar_t));
+	}
+
+	char summary[96];
+	int32_t len = ::_snprintf_s(summary, std::size(summary), _TRUNCATE, NSSM_LIMITED_UTF8, lines, bytes);
+	return write_chunk(logger, summary, (uint32_t)len);
+}
+
+/*
+  Apply the rate limit to the line from offset to end.  Lines to be written
+  are left in the run starting at start, which is written out before
+  anything else.
+*/
+static int32_t limit_line(logger_t* logger, void* address, uint32_t* start, uint32_t offset, uint32_t end)
+{
+	rate_limit_t* limit = &logger->limit;
+	int32_t ret;
+	switch (admit_line(limit, end - offset))
+	{
+	case NSSM_LINE_DROPPED:
+		if (offset > *start)
+		{
+			ret = write_chunk(logger, (char*)address + *start, offset - *start);
+			if (ret < 0)
+				return ret;
+		}
+		*start = end;
+		count_stat(logger->stats->limited, 1);
+		if (!limit->report_at)
+			limit->report_at = GetTickCount64() + NSSM_RATE_LIMIT_REPORT;
+		return 0;
+
+	case NSSM_LINE_ADMITTED:
+		if (!limit->dropped_lines)
+			return 0;
+		/* Back within the limit; say what we dropped. */
+		if (offset > *start)
+		{
+			ret = write_chunk(logger, (char*)address + *start, offset - *start);
+			if (ret < 0)
+				return ret;
+		}
+		*start = offset;
+		return write_limited(logger);
+	}
+
+	return 0;
+}
+
+/*
+  Write lines within the stream's rate limit.  Lines over the limit are
+  dropped, or one in N of them written when sampling, and counted.  The
+  count is written before the next line within the limit, or by the timer
+  if the stream stays over its limit.  Runs of lines which are written are
+  still written with one call.
+  merge_chunk() passes whole lines only, so each line costs one token and
+  is admitted or dropped whole.  Only a line held back past its timeout,
+  or too long to hold back, arrives in pieces, each counting as a line.
+*/
+static int32_t limit_chunk(logger_t* logger, void* address, uint32_t in)
+{
+	rate_limit_t* limit = &logger->limit;
+	if (!want_rate_limit(limit))
+		return write_chunk(logger, address, in);
+
+	refill_rate_limit(limit, GetTickCount64());
+
+	int32_t ret;
+	uint32_t ends[NSSM_LINE_ENDS];
+	uint32_t start = 0;
+	uint32_t offset = 0;
+	uint32_t count;
+	do
+	{
+		count = find_line_ends((char*)address + offset, in - offset, logger->charsize, ends, std::size(ends));
+		uint32_t base = offset;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint32_t end = base + ends[i];
+			ret = limit_line(logger, address, &start, offset, end);
+			if (ret < 0)
+				return ret;
+			offset = end;
+		}
+	} while (count == std::size(ends));
+
+	if (offset < in)
+	{
+		ret = limit_line(logger, address, &start, offset, in);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (in > start)
+		return write_chunk(logger, (char*)address + start, in - start);
+	return 0;
+}
+
+/*
+  Suppress lines identical to the one before, which are counted instead.
+  Lines are compared by length and hash so nothing needs to be kept of
+  the last one.  The count is written out when a different line arrives or
+  the repeat interval passes, whichever is first.  Lines which aren't
+  repeats go on to the rate limit.
+  A partial line is never counted as a repeat.
+*/
+static int32_t suppress_repeats(logger_t* logger, void* address, uint32_t in)
+{
+	int32_t ret;
+	uint32_t ends[NSSM_LINE_ENDS];
+	uint32_t start = 0;
+	uint32_t offset = 0;
+	uint32_t count;
+	do
+	{
+		count = find_line_ends((char*)address + offset, in - offset, logger->charsize, ends, std::size(ends));
+		uint32_t base = offset;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint32_t end = base + ends[i];
+			uint32_t length = end - offset;
+			uint64_t hash = hash_bytes((char*)address + offset, length);
+			if (length == logger->last_length && hash == logger->last_hash)
+			{
+				/* Write the lines before this one. */
+				if (offset > start)
+				{
+					ret = limit_chunk(logger, (char*)address + start, offset - start);
+					if (ret < 0)
+						return ret;
+				}
+				if (!logger->repeats++)
+					logger->repeat_at = GetTickCount64() + logger->repeat_interval;
+				count_stat(logger->stats->repeats, 1);
+				start = end;
+			}
+			else
+			{
+				/* Anything before this line was written already. */
+				ret = write_repeats(logger);
+				if (ret < 0)
+					return ret;
+				logger->last_hash = hash;
+				logger->last_length = length;
+			}
+			offset = end;
+		}
+	} while (count == std::size(ends));
+
+	if (offset < in)
+	{
+		ret = write_repeats(logger);
+		if (ret < 0)
+			return ret;
+		logger->last_length = 0;
+	}
+
+	if (in > start)
+		return limit_chunk(logger, (char*)address + start, in - start);
+	return 0;
+}
+
+/* Write whole lines, suppressing repeats if asked to. */
+static inline int32_t filter_chunk(logger_t* logger, void* address, uint32_t in)
+{
+	if (logger->repeat_interval)
+		return suppress_repeats(logger, address, in);
+	return limit_chunk(logger, address, in);
+}
+
+/* Write out the start of a line we were holding back. */
+static int32_t flush_carry(logger_t* logger)
+{
+	if (!logger->carried)
+		return 0;
+
+	uint32_t carried = logger->carried;
+	logger->carried = 0;
+	return filter_chunk(logger, logger->carry, carried);
+}
+
+/*
+  Hold back the start of a line until the rest of it arrives.
+  A line which won't fit in the largest read buffer is written in pieces.
+*/
+static int32_t carry_line(logger_t* logger, void* address, uint32_t in)
+{
+	uint32_t carried = logger->carried + in;
+	if (carried > logger->carry_size && carried <= NSSM_STDIO_BUFFER_MAX)
+	{
+		uint32_t carry_size = logger->carry_size ? logger->carry_size : NSSM_STDIO_BUFFER_MIN;
+		while (carry_size < carried)
+			carry_size *= 2;
+
+		char* carry;
+		if (logger->carry)
+			carry = (char*)HeapReAlloc(GetProcessHeap(), 0, logger->carry, carry_size);
+		else
+			carry = (char*)HeapAlloc(GetProcessHeap(), 0, carry_size);
+		if (carry)
+		{
+			logger->carry = carry;
+			logger->carry_size = carry_size;
+		}
+	}
+
+	if (carried > logger->carry_size)
+	{
+		int32_t ret = flush_carry(logger);
+		if (ret < 0)
+			return ret;
+		return filter_chunk(logger, address, in);
+	}
+
+	memmove(logger->carry + logger->carried, address, in);
+	logger->carried = carried;
+	return 0;
+}
+
+/*
+  Streams which share a file write whole lines only, so that a line from
+  one is never split by a line from the other.  Both are written by the
+  same thread so nothing more is needed to keep them apart.
+  The held back start of a line is joined to its end before filtering, so
+  repeats and the rate limit see it as one line.
+*/
+static int32_t merge_chunk(logger_t* logger, void* address, uint32_t in)
+{
+	int32_t ret;
+	uint32_t end = last_line_end(address, in, logger->charsize);
+	if (end && logger->carried)
+	{
+		/* The held back line finishes at the start of this chunk. */
+		uint32_t first;
+		find_line_ends(address, in, logger->charsize, &first, 1);
+		ret = carry_line(logger, address, first);
+		if (ret < 0)
+			return ret;
+		ret = flush_carry(logger);
+		if (ret < 0)
+			return ret;
+
+		address = (void*)((char*)address + first);
+		in -= first;
+		end -= first;
+	}
+
+	if (end)
+	{
+		ret = filter_chunk(logger, address, end);
+		if (ret < 0)
+			return ret;
+		address = (void*)((char*)address + end);
+		in -= end;
+	}
+
+	if (!in)
+		return 0;
+	return carry_line(logger, address, in);
+}
+
+/*
+  Write a chunk which is already in the file's encoding.
+  Multi-line records, repeated lines and rate limits are handled a whole
+  line at a time, so partial lines are held back as for a shared file,
+  until the rest arrives or the timeout passes.
+*/
+static int32_t write_converted(logger_t* logger, void* address, uint32_t in)
+{
+	int32_t ret;
+	if (logger->merged || logger->multiline.rule || logger->repeat_interval || want_rate_limit(&logger->limit))
+		ret = merge_chunk(logger, address, in);
+	else
+		ret = write_chunk(logger, address, in);
+	flush_if_due(logger->sink);
+
+	if (logger->multiline.rule)
+	{
+		if (logger->carried || logger->sink->in_record)
+			logger->hold_at = GetTickCount64() + logger->multiline.timeout;
+		else
+			logger->hold_at = 0;
+	}
+	return ret;
+}
+
+/*
+  Write whole characters read from the application, converting UTF-16
+  output to UTF-8 if the file should be UTF-8.
+*/
+static int32_t log_characters(logger_t* logger, void* address, uint32_t in)
+{
+	if (logger->in_charsize != logger->charsize)
+	{
+		/* The reading thread may have grown its buffer. */
+		uint32_t size = UTF8_SIZE_FROM_UTF16(in);
+		if (size > logger->transcode_size)
+		{
+			char* transcode;
+			if (logger->transcode)
+				transcode = (char*)HeapReAlloc(GetProcessHeap(), 0, logger->transcode, size);
+			else
+				transcode = (char*)HeapAlloc(GetProcessHeap(), 0, size);
+			if (!transcode)
+			{
+				log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_OUT_OF_MEMORY, L"logger->transcode", L"log_chunk()", 0);
+				return -1;
+			}
+			logger->transcode = transcode;
+			logger->transcode_size = size;
+		}
+
+		/* Part of a character may be held back until the next chunk. */
+		in = utf16_to_utf8(&logger->transcoder, address, in, logger->transcode);
+		address = (void*)logger->transcode;
+		if (!in)
+			return 0;
+	}
+
+	return write_converted(logger, address, in);
+}
+
+/* Write out a character left incomplete when the stream ended. */
+static int32_t flush_transcoder(logger_t* logger)
+{
+	if (!logger->transcoder.pending_len)
+		return 0;
+
+	char end[8];
+	uint32_t len = utf16_to_utf8_end(&logger->transcoder, end);
+	return write_converted(logger, end, len);
+}
+
+/* Write out the odd byte held back from a UTF-16 stream. */
+static int32_t flush_odd_byte(logger_t* logger)
+{
+	if (!logger->detector.odd)
+		return 0;
+
+	logger->detector.odd = false;
+	return log_characters(logger, &logger->detector.odd_byte, 1);
+}
+
+/* Switch to a new input character size, finishing anything in the old one. */
+static int32_t set_charsize(logger_t* logger, uint32_t charsize)
+{
+	if (logger->in_charsize)
+	{
+		int32_t ret = flush_odd_byte(logger);
+		if (ret >= 0)
+			ret = flush_transcoder(logger);
+		if (ret >= 0)
+			ret = flush_carry(logger);
+		if (ret < 0)
+			return ret;
+		ZeroMemory(&logger->transcoder, sizeof(logger->transcoder));
+	}
+
+	/* From here on charsize describes what we write, not what we read. */
+	logger->in_charsize = charsize;
+	logger->charsize = (logger->encoding == NSSM_ENCODING_UTF8) ? (uint32_t)sizeof(char) : charsize;
+	return 0;
+}
+
+/*
+  Write out the start of the stream which looked like a byte order mark
+  but wasn't one.  A lone byte of a UTF-16 stream waits for the rest of
+  its code unit like any other odd byte.
+*/
+static int32_t flush_held_bytes(logger_t* logger)
+{
+	detector_t* detector = &logger->detector;
+	if (!detector->held_len)
+		return 0;
+
+	uint32_t len = detector->held_len;
+	detector->held_len = 0;
+	/* The stream ended before we could tell. */
+	if (!logger->in_charsize)
+	{
+		int32_t ret = set_charsize(logger, (uint32_t)sizeof(char));
+		if (ret < 0)
+			return ret;
+	}
+
+	if (logger->in_charsize == sizeof(wchar_t) && (len & 1))
+	{
+		detector->odd_byte = detector->held[--len];
+		detector->odd = true;
+	}
+	if (!len)
+		return 0;
+	return log_characters(logger, detector->held, len);
+}
+
+/*
+  Write a chunk of the stream's queue.  Chunks of a UTF-16 stream are
+  realigned so that line splitting never sees half a code unit.
+*/
+static int32_t log_chunk(logger_t* logger, void* address, uint32_t in)
+{
+	/* A timed rotation left us without a file. */
+	if (!logger->sink->write_handle)
+		return -1;
+
+	uint32_t skip;
+	uint32_t charsize = detect_encoding(&logger->detector, address, in, &skip);
+	if (charsize != logger->in_charsize)
+	{
+		bool written = (logger->in_charsize != 0);
+		int32_t ret = set_charsize(logger, charsize);
+		if (ret < 0)
+			return ret;
+
+		/* After a change of mind, skip the rest of a code unit already written. */
+		if (written && charsize == sizeof(wchar_t) && ((logger->detector.bytes - in) & 1))
+			skip = 1;
+	}
+
+	/* Drop the application's BOM; the file gets its own if it needs one. */
+	address = (void*)((char*)address + skip);
+	in -= skip;
+
+	/* What we held back in case it was a BOM comes first. */
+	if (logger->detector.held_len && logger->in_charsize)
+	{
+		int32_t ret = flush_held_bytes(logger);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (logger->in_charsize == sizeof(wchar_t))
+	{
+		detector_t* detector = &logger->detector;
+		if (detector->odd && in)
 		{
-			ret = try_write(logger, line, bufsize - offset, &log_out, &log_complained);
-			*out += log_out;
-			*complained |= log_complained;
+			/* Complete the code unit split by the previous read. */
+			uint8_t unit[2] = { detector->odd_byte, *(uint8_t*)address };
+			detector->odd = false;
+			int32_t ret = log_characters(logger, unit, sizeof(unit));
+			if (ret < 0)
+				return ret;
+			address = (void*)((char*)address + 1);
+			in--;
 		}
 
-		return ret;
+		if (in & 1)
+		{
+			detector->odd_byte = ((uint8_t*)address)[in - 1];
+			detector->odd = true;
+			in--;
+		}
 	}
-	else
-		return try_write(logger, address, bufsize, out, complained);
+
+	if (!in)
+		return 0;
+	return log_characters(logger, address, in);
 }
 
-/* Wrapper to be called in a new thread for logging. */
-ULONG __stdcall log_and_rotate(void* arg)
+static inline uint64_t filetime_now()
 {
-	logger_t* logger = (logger_t*)arg;
-	if (!logger)
-		return 1;
+	FILETIME ft;
+	GetSystemTimeAsFileTime(&ft);
 
-	int64_t size;
-	BY_HANDLE_FILE_INFORMATION info;
+	ULARGE_INTEGER now;
+	now.LowPart = ft.dwLowDateTime;
+	now.HighPart = ft.dwHighDateTime;
+	return now.QuadPart;
+}
+
+/*
+  Rotate streams whose time is up.  Called by the writing thread.
+  A file which ends with a complete line is rotated straight away, so idle
+  services still get a new file at the boundary.  Otherwise we rotate after
+  the line is finished, exactly as for a rotation requested by a control.
+  Returns the number of milliseconds until the next timed rotation.
+*/
+static uint32_t rotate_on_time(logger_t* loggers)
+{
+	uint64_t now = filetime_now();
+	uint64_t next = 0;
+	for (logger_t* logger = loggers; logger; logger = logger->next)
+	{
+		/* A shared file is rotated by the stream which owns it. */
+		if (logger->sink != logger)
+			continue;
+		if (*logger->rotate_online == NSSM_ROTATE_OFFLINE)
+			continue;
+		if (!logger->rotate_at)
+			continue;
+
+		if (now >= logger->rotate_at)
+		{
+			int32_t ret = 0;
+			if (logger->mid_line)
+				*logger->rotate_online = NSSM_ROTATE_ONLINE_ASAP;
+			else if (logger->file_size && logger->write_handle && !logger->failed)
+				ret = rotate_live_file(logger);
+
+			logger->rotate_at = next_rotation(logger->rotate_seconds, logger->rotate_boundary, now);
+			/* As for a failed write; the stream can't log anything further. */
+			if (ret < 0)
+				logger->failed = true;
+			/*
+			  Rotation failed and we are still writing the old file.  Try
+			  again soon rather than letting it run for a whole period.
+			*/
+			else if (ret > 0)
+			{
+				uint64_t retry = now + NSSM_ROTATE_RETRY * 10000000ULL;
+				if (!logger->rotate_at || retry < logger->rotate_at)
+					logger->rotate_at = retry;
+			}
+		}
+
+		if (logger->rotate_at && (!next || logger->rotate_at < next))
+			next = logger->rotate_at;
+	}
+
+	if (!next)
+		return INFINITE;
+	/* Round up so we don't wake just before the deadline. */
+	uint64_t ms = (next - now + 9999) / 10000;
+	if (ms >= INFINITE)
+		ms = INFINITE - 1;
+	return (uint32_t)ms;
+}
+
+/*
+  Flush files whose interval is up.  Called by the writing thread.
+  Returns the number of milliseconds until the next flush is due.
+*/
+static uint32_t flush_on_time(logger_t* loggers)
+{
+	uint64_t now = GetTickCount64();
+	uint64_t next = 0;
+	for (logger_t* logger = loggers; logger; logger = logger->next)
+	{
+		if (!logger->flush_at)
+			continue;
+
+		if (now >= logger->flush_at)
+			flush_file(logger);
+		else if (!next || logger->flush_at < next)
+			next = logger->flush_at;
+	}
+
+	if (!next)
+		return INFINITE;
+	return (uint32_t)(next - now);
+}
 
-	/* Find initial file size. */
-	if (!GetFileInformationByHandle(logger->write_handle, &info))
-		logger->size = 0LL;
+/*
+  Try again to write output held back by a full disk, backing off each time.
+  Returns:  0 if it is still held for another try.
+            1 if it was written, or dropped after the last try.
+*/
+static int32_t retry_write(logger_t* logger)
+{
+	count_stat(logger->stats->write_retries, 1);
+
+	uint32_t out = 0;
+	LARGE_INTEGER start;
+	QueryPerformanceCounter(&start);
+	bool ok = WriteFile(logger->write_handle, logger->held, logger->held_len, &out, 0);
+	uint32_t error = ok ? ERROR_SUCCESS : GetLastError();
+	record_latency(logger->stats, &start);
+
+	if (ok || error == ERROR_IO_PENDING)
+		count_written(logger, logger->held, out);
+	else if ((error == ERROR_DISK_FULL || error == ERROR_NOT_ENOUGH_QUOTA) && ++logger->write_tries < 5)
+	{
+		logger->write_at = GetTickCount64() + 2000 + logger->write_tries * 3000;
+		return 0;
+	}
 	else
 	{
-		ULARGE_INTEGER l;
-		l.HighPart = info.nFileSizeHigh;
-		l.LowPart = info.nFileSizeLow;
-		size = l.QuadPart;
+		/* We'll lose what was held but try to write subsequent output. */
+		count_spilled(&logger->handoff, logger->held_len, false);
+		if (!(logger->complained & COMPLAINED_WRITE))
+			log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_WRITEFILE_FAILED, logger->service_name, logger->path, error_string(error), 0);
+		logger->complained |= COMPLAINED_WRITE;
 	}
 
-	char buffer[1024];
-	void* address;
-	uint32_t in, out;
-	uint32_t charsize = 0;
-	uint32_t error;
-	int32_t ret;
-	int32_t complained = 0;
+	logger->held_len = 0;
+	logger->write_tries = 0;
+	return 1;
+}
 
-	while (true)
+/*
+  Retry writes held back by a full disk.  Called by the writing thread.
+  Streams writing to a file stop taking output from their queues while
+  it has output held, and are woken again once it has gone.
+  Returns the number of milliseconds until the next retry is due.
+*/
+static uint32_t writes_on_time(logger_t* loggers)
+{
+	uint64_t now = GetTickCount64();
+	uint64_t next = 0;
+	for (logger_t* logger = loggers; logger; logger = logger->next)
 	{
-		/* Read data from the pipe. */
-		address = &buffer;
-		ret = try_read(logger, address, sizeof(buffer), &in, &complained);
-		if (ret < 0)
+		if (!logger->held_len)
+			continue;
+
+		if (now >= logger->write_at && retry_write(logger))
 		{
-			close_handle(&logger->read_handle);
-			close_handle(&logger->write_handle);
-			HeapFree(GetProcessHeap(), 0, logger);
-			return 2;
+			for (logger_t* stream = loggers; stream; stream = stream->next)
+			{
+				if (stream->sink == logger)
+					wake_stream(&stream->handoff);
+			}
+		}
+		else if (!next || logger->write_at < next)
+			next = logger->write_at;
+	}
+
+	if (!next)
+		return INFINITE;
+	return (uint32_t)(next - now);
+}
+
+/*
+  Write out partial lines and multi-line records which have waited long
+  enough for more.  Called by the writing thread.
+  Returns the number of milliseconds until the next one is due.
+*/
+static uint32_t aggregate_on_time(logger_t* loggers)
+{
+	uint64_t now = GetTickCount64();
+	uint64_t next = 0;
+	for (logger_t* logger = loggers; logger; logger = logger->next)
+	{
+		if (!logger->hold_at)
+			continue;
+
+		if (now >= logger->hold_at)
+		{
+			logger->hold_at = 0;
+			if (logger->failed || !logger->sink->write_handle)
+				continue;
+			if (flush_carry(logger) < 0)
+				logger->failed = true;
+			else
+				close_record(logger);
+			flush_if_due(logger->sink);
+		}
+		else if (!next || logger->hold_at < next)
+			next = logger->hold_at;
+	}
+
+	if (!next)
+		return INFINITE;
+	return (uint32_t)(next - now);
+}
+
+/*
+  Write out counts of repeated lines which have waited long enough for a
+  different line.  Called by the writing thread.
+  Returns the number of milliseconds until the next one is due.
+*/
+static uint32_t repeats_on_time(logger_t* loggers)
+{
+	uint64_t now = GetTickCount64();
+	uint64_t next = 0;
+	for (logger_t* logger = loggers; logger; logger = logger->next)
+	{
+		if (!logger->repeat_at)
+			continue;
+
+		if (now >= logger->repeat_at)
+		{
+			if (logger->failed || !logger->sink->write_handle)
+				logger->repeats = logger->repeat_at = 0;
+			else if (write_repeats(logger) < 0)
+				logger->failed = true;
+			else
+				flush_if_due(logger->sink);
+		}
+		else if (!next || logger->repeat_at < next)
+			next = logger->repeat_at;
+	}
+
+	if (!next)
+		return INFINITE;
+	return (uint32_t)(next - now);
+}
+
+/*
+  Write out counts of lines dropped by streams which are still over their
+  rate limits.  Called by the writing thread.
+  Returns the number of milliseconds until the next one is due.
+*/
+static uint32_t limits_on_time(logger_t* loggers)
+{
+	uint64_t now = GetTickCount64();
+	uint64_t next = 0;
+	for (logger_t* logger = loggers; logger; logger = logger->next)
+	{
+		rate_limit_t* limit = &logger->limit;
+		if (!limit->report_at)
+			continue;
+
+		if (now >= limit->report_at)
+		{
+			if (logger->failed || !logger->sink->write_handle)
+				limit->dropped_lines = limit->dropped_bytes = limit->report_at = 0;
+			else if (write_limited(logger) < 0)
+				logger->failed = true;
+			else
+				flush_if_due(logger->sink);
+		}
+		else if (!next || limit->report_at < next)
+			next = limit->report_at;
+	}
+
+	if (!next)
+		return INFINITE;
+	return (uint32_t)(next - now);
+}
+
+/* Run timed work.  Returns the number of milliseconds until more is due. */
+static uint32_t on_timer(logger_t* loggers)
+{
+	uint32_t timeout = rotate_on_time(loggers);
+	uint32_t flush = flush_on_time(loggers);
+	if (flush < timeout)
+		timeout = flush;
+	uint32_t aggregate = aggregate_on_time(loggers);
+	if (aggregate < timeout)
+		timeout = aggregate;
+	uint32_t repeats = repeats_on_time(loggers);
+	if (repeats < timeout)
+		timeout = repeats;
+	uint32_t limits = limits_on_time(loggers);
+	if (limits < timeout)
+		timeout = limits;
+	uint32_t writes = writes_on_time(loggers);
+	if (writes < timeout)
+		timeout = writes;
+	return timeout;
+}
+
+/* Tell the event log how much output we had to throw away or divert. */
+static void report_drops(logger_t* logger, uint64_t dropped, uint64_t spilled, bool force)
+{
+	if (dropped == logger->dropped_reported && spilled == logger->spilled_reported)
+		return;
+
+	uint64_t now = GetTickCount64();
+	if (!force && logger->reported_at && now - logger->reported_at < (uint64_t)wait::queuereport)
+		return;
+	logger->reported_at = now;
+
+	wchar_t bytes[32];
+	if (dropped != logger->dropped_reported)
+	{
+		::_snwprintf_s(bytes, std::size(bytes), _TRUNCATE, L"%llu", dropped - logger->dropped_reported);
+		log_event(EVENTLOG_WARNING_TYPE, NSSM_EVENT_OUTPUT_DROPPED, logger->service_name, logger->path, bytes, 0);
+		logger->dropped_reported = dropped;
+	}
+	if (spilled != logger->spilled_reported)
+	{
+		::_snwprintf_s(bytes, std::size(bytes), _TRUNCATE, L"%llu", spilled - logger->spilled_reported);
+		log_event(EVENTLOG_WARNING_TYPE, NSSM_EVENT_OUTPUT_SPILLED, logger->service_name, logger->path, bytes, logger->spill_path, 0);
+		logger->spilled_reported = spilled;
+	}
+}
+
+/* Append a chunk which didn't fit in the queue to the spill file. */
+static bool spill_chunk(logger_t* logger, void* address, uint32_t in)
+{
+	if (!logger->spill_handle)
+	{
+		logger->spill_handle = ::CreateFileW(logger->spill_path, FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+		if (logger->spill_handle == INVALID_HANDLE_VALUE)
+		{
+			logger->spill_handle = 0;
+			if (!(logger->complained & COMPLAINED_SPILL))
+				log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_CREATEFILE_FAILED, logger->spill_path, error_string(GetLastError()), 0);
+			logger->complained |= COMPLAINED_SPILL;
+			return false;
 		}
-		else if (ret)
+	}
+
+	uint32_t out;
+	if (WriteFile(logger->spill_handle, address, in, &out, 0) && out == in)
+		return true;
+	if (!(logger->complained & COMPLAINED_SPILL))
+		log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_WRITEFILE_FAILED, logger->service_name, logger->spill_path, error_string(GetLastError()), 0);
+	logger->complained |= COMPLAINED_SPILL;
+	return false;
+}
+
+/* Write out everything the reading thread put in the spill queue. */
+static void drain_spill(logger_t* logger)
+{
+	uint32_t len;
+	while ((len = take_spilled(&logger->handoff)))
+		count_spilled(&logger->handoff, len, spill_chunk(logger, logger->handoff.work, len));
+}
+
+/*
+  Write everything queued for a stream.
+  Returns:  0 if the stream is still open.
+            1 if the stream is finished and can be released.
+*/
+static int32_t drain_queue(logger_t* logger)
+{
+	start_draining(&logger->handoff);
+
+	/* Any spilled later will wake us again. */
+	if (logger->spill_path)
+		drain_spill(logger);
+
+	while (true)
+	{
+		/* Leave the rest queued until writes_on_time() has written what the file is holding back. */
+		if (logger->sink->held_len)
+			return 0;
+
+		uint32_t len;
+		uint64_t dropped;
+		uint64_t spilled;
+		int32_t finished = take_chunk(&logger->handoff, &len, &dropped, &spilled);
+		if (finished < 0)
+		{
+			logger->failed = true;
 			continue;
+		}
 
-		if (*logger->rotate_online == NSSM_ROTATE_ONLINE_ASAP || (logger->size && size + (int64_t)in >= logger->size))
+		if (!len)
 		{
-			/* Look for newline. */
-			uint32_t i;
-			for (i = 0; i < in; i++)
+			/* Write out any unfinished last line. */
+			if (finished && !logger->failed)
 			{
-				if (buffer[i] == '\n')
-				{
-					if (!charsize)
-						charsize = guess_charsize(address, in);
-					i += charsize;
+				if (flush_held_bytes(logger) < 0 || flush_odd_byte(logger) < 0 || flush_transcoder(logger) < 0 || flush_carry(logger) < 0 || write_repeats(logger) < 0 || write_limited(logger) < 0)
+					logger->failed = true;
+				else
+					close_record(logger);
+			}
+			if (finished && logger->sink->held_len)
+				return 0;
+			if (finished && want_flush(logger))
+				flush_file(logger);
+			report_drops(logger, dropped, spilled, finished);
+			return finished;
+		}
 
-					/* Write up to the newline. */
-					ret = try_write(logger, address, i, &out, &complained);
-					if (ret < 0)
-					{
-						close_handle(&logger->read_handle);
-						close_handle(&logger->write_handle);
-						HeapFree(GetProcessHeap(), 0, logger);
-						return 3;
-					}
-					size += (int64_t)out;
-
-					/* Rotate. */
-					*logger->rotate_online = NSSM_ROTATE_ONLINE;
-					wchar_t rotated[nssmconst::pathlength];
-					rotated_filename(logger->path, rotated, std::size(rotated), 0);
-
-					/*
-            Ideally we'd try the rename first then close the handle but
-            ::MoveFileW() will fail if the handle is still open so we must
-            risk losing everything.
-          */
-					if (logger->copy_and_truncate)
-						FlushFileBuffers(logger->write_handle);
-					close_handle(&logger->write_handle);
-					bool ok = true;
-					wchar_t* function;
-					if (logger->copy_and_truncate)
-					{
-						function = L"::CopyFileW()";
-						if (::CopyFileW(logger->path, rotated, TRUE))
-						{
-							HANDLE file = write_to_file(logger->path, NSSM_STDOUT_SHARING, 0, NSSM_STDOUT_DISPOSITION, NSSM_STDOUT_FLAGS);
-							Sleep(logger->rotate_delay);
-							SetFilePointer(file, 0, 0, FILE_BEGIN);
-							SetEndOfFile(file);
-							CloseHandle(file);
-						}
-						else
-							ok = false;
-					}
-					else
-					{
-						function = L"::MoveFileW()";
-						if (!::MoveFileW(logger->path, rotated))
-							ok = false;
-					}
-					if (ok)
-					{
-						log_event(EVENTLOG_INFORMATION_TYPE, NSSM_EVENT_ROTATED, logger->service_name, logger->path, rotated, 0);
-						size = 0LL;
-					}
-					else
-					{
-						error = GetLastError();
-						if (error != ERROR_FILE_NOT_FOUND)
-						{
-							if (!(complained & COMPLAINED_ROTATE))
-								log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_ROTATE_FILE_FAILED, logger->service_name, logger->path, function, rotated, error_string(error), 0);
-							complained |= COMPLAINED_ROTATE;
-							/* We can at least try to re-open the existing file. */
-							logger->disposition = OPEN_ALWAYS;
-						}
-					}
-
-					/* Reopen. */
-					logger->write_handle = write_to_file(logger->path, logger->sharing, 0, logger->disposition, logger->flags);
-					if (logger->write_handle == INVALID_HANDLE_VALUE)
-					{
-						error = GetLastError();
-						log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_CREATEFILE_FAILED, logger->path, error_string(error), 0);
-						/* Oh dear.  Now we can't log anything further. */
-						close_handle(&logger->read_handle);
-						close_handle(&logger->write_handle);
-						HeapFree(GetProcessHeap(), 0, logger);
-						return 4;
-					}
-
-					/* Resume writing after the newline. */
-					address = (void*)((char*)address + i);
-					in -= i;
-				}
+		/* After a fatal error we keep emptying the queue until the pipe closes. */
+		if (!logger->failed && log_chunk(logger, logger->handoff.work, len) < 0)
+			logger->failed = true;
+		report_drops(logger, dropped, spilled, false);
+	}
+}
+
+/*
+  Thread which writes every logging stream to disk.
+  A packet keyed by a logger_t means it has data queued or has finished.
+  A stream sharing another's file is released first, then its owner.
+  A packet with no key tells the thread to exit.
+  Timed rotation and flushing are driven by the wait timeout.
+*/
+static ULONG __stdcall write_logs(void* arg)
+{
+	HANDLE port = (HANDLE)arg;
+	if (!port)
+		return 1;
+
+	/* Streams served by this thread. */
+	logger_t* loggers = 0;
+	uint32_t timeout = INFINITE;
+
+	while (true)
+	{
+		uint32_t in = 0;
+		ULONG_PTR key = 0;
+		OVERLAPPED* overlapped = 0;
+
+		if (!GetQueuedCompletionStatus(port, &in, &key, &overlapped, timeout))
+		{
+			if (GetLastError() == WAIT_TIMEOUT)
+			{
+				timeout = on_timer(loggers);
+				continue;
 			}
+			/* The port itself failed. */
+			break;
 		}
 
-		if (!size || logger->timestamp_log)
-			if (!charsize)
-				charsize = guess_charsize(address, in);
-		if (!size)
+		logger_t* logger = (logger_t*)key;
+		if (!logger)
+			break;
+
+		if (!logger->registered)
 		{
-			/* Write a BOM to the new file. */
-			if (charsize == sizeof(wchar_t))
-				write_bom(logger, &out);
-			size += (int64_t)out;
+			/* New stream. */
+			logger->registered = true;
+			logger->next = loggers;
+			loggers = logger;
+			logger->rotate_at = next_rotation(logger->rotate_seconds, logger->rotate_boundary, filetime_now());
 		}
 
-		/* Write the data, if any. */
-		if (!in)
-			continue;
+		if (drain_queue(logger))
+		{
+			/* The owner of a shared file may have been waiting for us. */
+			if (logger->sink != logger)
+				release_follower(&logger->sink->handoff);
 
-		ret = write_with_timestamp(logger, address, in, &out, &complained, charsize);
-		size += (int64_t)out;
-		if (ret < 0)
+			for (logger_t** l = &loggers; *l; l = &(*l)->next)
+			{
+				if (*l != logger)
+					continue;
+				*l = logger->next;
+				break;
+			}
+			if (!stop_logger(logger))
+				break;
+		}
+
+		timeout = on_timer(loggers);
+	}
+
+	CloseHandle(port);
+	return 0;
+}
+
+/*
+  Thread which reads every logging stream.
+  Reads complete on the shared I/O completion port, keyed by the logger_t,
+  and are passed to the writing thread through the stream's queue.
+  A packet with no OVERLAPPED is a new stream waiting for its first read,
+  or one which was waiting for room in its queue.
+  A packet with no key tells the thread to exit.
+  Reads which must be retried later are driven by the wait timeout.
+*/
+ULONG __stdcall log_and_rotate(void* arg)
+{
+	HANDLE port = (HANDLE)arg;
+	if (!port)
+		return 1;
+
+	/* Streams waiting to retry a read. */
+	logger_t* retrying = 0;
+	uint32_t timeout = INFINITE;
+
+	while (true)
+	{
+		uint32_t in = 0;
+		ULONG_PTR key = 0;
+		OVERLAPPED* overlapped = 0;
+		uint32_t error = ERROR_SUCCESS;
+
+		if (!GetQueuedCompletionStatus(port, &in, &key, &overlapped, timeout))
+		{
+			error = GetLastError();
+			if (!overlapped)
+			{
+				if (error == WAIT_TIMEOUT)
+				{
+					timeout = retry_reads(&retrying);
+					continue;
+				}
+				/* The port itself failed. */
+				break;
+			}
+		}
+
+		logger_t* logger = (logger_t*)key;
+		if (!logger)
+			break;
+
+		int32_t ret = 0;
+		if (logger->failed)
+			ret = -1;
+		else if (!overlapped)
+			ret = resume_reading(&logger->handoff);
+		else if (error != ERROR_SUCCESS)
+			ret = read_failed(logger, error);
+		else
 		{
-			close_handle(&logger->read_handle);
-			close_handle(&logger->write_handle);
-			HeapFree(GetProcessHeap(), 0, logger);
-			return 3;
+			logger->read_tries = 0;
+			ret = queue_chunk(&logger->handoff, in);
+			/* Resize for the next read now that the data has been queued. */
+			if (!ret)
+				grow_buffer(&logger->handoff, in);
 		}
+
+		/* Unless still waiting for room in the queue. */
+		if ((ret == 0 || ret == 1) && !logger->handoff.blocked)
+			ret = try_read(logger);
+		if (ret == 2)
+			ret = read_later(logger);
+		if (ret == 2)
+		{
+			logger->read_next = retrying;
+			retrying = logger;
+		}
+
+		if (ret < 0)
+			close_handoff(&logger->handoff);
+		timeout = retry_reads(&retrying);
 	}
 
-	close_handle(&logger->read_handle);
-	close_handle(&logger->write_handle);
-	HeapFree(GetProcessHeap(), 0, logger);
+	CloseHandle(port);
 	return 0;
 }
@@ -26,7 +26,66 @@
 #define NSSM_STDERR_DISPOSITION OPEN_ALWAYS
 #define NSSM_STDERR_FLAGS       FILE_ATTRIBUTE_NORMAL
 
+/* Named pipe used to capture the application's output; process ID and serial. */
+#define NSSM_LOGGER_PIPE        L"\\\\.\\pipe\\nssm-%lu-%ld"
+#define PIPE_NAME_LENGTH        64
+
+/* Tags which can prefix each line to show which stream it came from. */
+#define NSSM_TAG_NONE           0
+#define NSSM_TAG_STDOUT         1
+#define NSSM_TAG_STDERR         2
+#define TAG_LEN                 8
+
+/* Format of the records written to the file. */
+#define NSSM_FORMAT_TEXT        0
+#define NSSM_FORMAT_JSON        1
+
+/* Milliseconds before a count of repeated lines is written anyway. */
+#define NSSM_REPEAT_INTERVAL    30000
+
+/* Encoding of the file. */
+#define NSSM_ENCODING_AS_IS     0
+#define NSSM_ENCODING_UTF8      1
+
+/* Settings for a new logging stream, from get_logger_config() and get_stream_config(). */
 typedef struct
+{
+	wchar_t* service_name;
+	stream which;
+	wchar_t* path;
+	uint32_t sharing;
+	uint32_t disposition;
+	uint32_t flags;
+	uint32_t buffer_size;
+	bool copy_and_truncate;
+	uint32_t rotate_sequence;
+	int64_t size;
+	uint32_t rotate_seconds;
+	uint32_t rotate_boundary;
+	uint32_t compress;
+	retention_t retention;
+	bool timestamp_log;
+	bool stream_tag;
+	uint32_t format;
+	uint32_t encoding;
+	multiline_t multiline;
+	uint32_t repeat_interval;
+	rate_limit_t limit;
+	uint32_t queue_size;
+	uint32_t queue_policy;
+	wchar_t* spill_dir;
+	uint32_t flush_interval;
+	uint32_t flush_bytes;
+	bool flush_rotate;
+	wchar_t* forward_target;
+	uint32_t forward_size;
+	bool time_index;
+	uint32_t index_bytes;
+	uint32_t index_interval;
+	uint32_t* pid_ptr;
+} logger_config_t;
+
+typedef struct logger_t
 {
 	wchar_t* service_name;
 	wchar_t* path;
@@ -39,18 +98,106 @@ typedef struct
 	uint32_t* tid_ptr;
 	uint32_t* rotate_online;
 	bool timestamp_log;
+	uint32_t tag;
+	uint32_t format;
+	uint32_t* pid_ptr;
+	char* json_head;
+	uint32_t json_head_len;
+	uint32_t encoding;
+	multiline_t multiline;
+	bool in_record;
+	struct logger_t* record_owner;
+	uint64_t hold_at;
+	uint32_t repeat_interval;
+	uint64_t last_hash;
+	uint32_t last_length;
+	uint64_t repeats;
+	uint64_t repeat_at;
+	rate_limit_t limit;
+	uint32_t in_charsize;
+	detector_t detector;
+	transcoder_t transcoder;
+	char* transcode;
+	uint32_t transcode_size;
 	int64_t line_length;
 	bool copy_and_truncate;
-	uint32_t rotate_delay;
+	uint32_t flush_interval;
+	uint32_t flush_bytes;
+	bool flush_rotate;
+	uint64_t unflushed;
+	uint64_t flush_at;
+	uint32_t compress;
+	retention_t retention;
+	bool time_index;
+	HANDLE index_handle;
+	uint32_t index_bytes;
+	uint32_t index_interval;
+	int64_t index_offset;
+	uint64_t index_at;
+	uint32_t rotate_seconds;
+	uint32_t rotate_boundary;
+	uint32_t rotate_sequence;
+	uint64_t rotate_at;
+	bool mid_line;
+	OVERLAPPED overlapped;
+	int32_t read_complained;
+	uint32_t read_tries;
+	uint64_t read_at;
+	struct logger_t* read_next;
+	handoff_t handoff;
+	wchar_t* spill_path;
+	HANDLE spill_handle;
+	volatile bool failed;
+	bool registered;
+	uint64_t dropped_reported;
+	uint64_t spilled_reported;
+	uint64_t reported_at;
+	stream_stats_t* stats;
+	forwarder_t* forwarder;
+	struct logger_t* sink;
+	bool merged;
+	char* carry;
+	uint32_t carry_size;
+	uint32_t carried;
+	int64_t file_size;
+	int64_t rotate_offset;
+	uint32_t charsize;
+	int32_t complained;
+	char* staging;
+	uint32_t staging_size;
+	uint32_t staged;
+	char* held;
+	uint32_t held_size;
+	uint32_t held_len;
+	uint32_t write_tries;
+	uint64_t write_at;
+	timestamp_t timestamp;
+	struct logger_t* next;
 } logger_t;
 
+/*
+  The threads which multiplex all logging streams.
+  One reads from the pipes and the other writes to disk.
+*/
+typedef struct
+{
+	HANDLE port;
+	HANDLE thread;
+	uint32_t tid;
+	HANDLE writer_port;
+	HANDLE writer_thread;
+	uint32_t loggers;
+} logger_engine_t;
+
 void close_handle(HANDLE*, HANDLE*);
 void close_handle(HANDLE*);
-int32_t get_createfile_parameters(HKEY, wchar_t*, wchar_t*, uint32_t*, uint32_t, uint32_t*, uint32_t, uint32_t*, uint32_t, bool*);
+int32_t get_createfile_parameters(HKEY, wchar_t*, wchar_t*, uint32_t*, uint32_t, uint32_t*, uint32_t, uint32_t*, uint32_t, bool*, uint32_t*);
 int32_t set_createfile_parameter(HKEY, wchar_t*, wchar_t*, uint32_t);
 int32_t delete_createfile_parameter(HKEY, wchar_t*, wchar_t*);
 HANDLE write_to_file(wchar_t*, uint32_t, SECURITY_ATTRIBUTES*, uint32_t, uint32_t);
-void rotate_file(wchar_t*, wchar_t*, uint32_t, uint32_t, uint32_t, uint32_t, bool);
+void get_retention(nssm_service_t*, retention_t*);
+void get_multiline(nssm_service_t*, multiline_t*);
+void rotate_file(wchar_t*, wchar_t*, uint32_t, uint32_t, uint32_t, uint32_t, bool, uint32_t, retention_t*, uint32_t*);
 int32_t get_output_handles(nssm_service_t*, STARTUPINFOW*);
 int32_t use_output_handles(nssm_service_t*, STARTUPINFOW*);
 void close_output_handles(STARTUPINFOW*);
@@ -0,0 +1,143 @@
+/*******************************************************************************
+ json.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "json.h"
+
+/*
+  Vectorised escaping of UTF-8 text for JSON strings.
+
+  Only the quote, the backslash and control characters need escaping, and
+  in log output they are rare.  We build a bitmask of those bytes for each
+  block of 16 (SSE2) or 32 (AVX2) bytes, as the newline scanners do, and
+  copy the runs between them in one go.  Bytes of multibyte UTF-8
+  sequences are never escaped so they pass through untouched.
+*/
+
+static const char hex[] = "0123456789abcdef";
+
+/* Write the escape sequence for one byte.  Returns its length. */
+static inline uint32_t escape_char(uint8_t c, char* out)
+{
+	out[0] = '\\';
+	switch (c)
+	{
+	case '"':
+		out[1] = '"';
+		return 2;
+	case '\\':
+		out[1] = '\\';
+		return 2;
+	case '\b':
+		out[1] = 'b';
+		return 2;
+	case '\f':
+		out[1] = 'f';
+		return 2;
+	case '\n':
+		out[1] = 'n';
+		return 2;
+	case '\r':
+		out[1] = 'r';
+		return 2;
+	case '\t':
+		out[1] = 't';
+		return 2;
+	}
+
+	out[1] = 'u';
+	out[2] = '0';
+	out[3] = '0';
+	out[4] = hex[c >> 4];
+	out[5] = hex[c & 0xf];
+	return 6;
+}
+
+static inline bool needs_escape(uint8_t c)
+{
+	return c < 0x20 || c == '"' || c == '\\';
+}
+
+/* Copy the run before each set bit of a block mask, then escape the byte. */
+static inline void escape_block(uint32_t mask, const uint8_t* buffer, uint32_t base, uint32_t* run, char** out)
+{
+	while (mask)
+	{
+		uint32_t i = base + (uint32_t)std::countr_zero(mask);
+		memmove(*out, buffer + *run, i - *run);
+		*out += i - *run;
+		*out += escape_char(buffer[i], *out);
+		*run = i + 1;
+		mask &= mask - 1;
+	}
+}
+
+/*
+  Escape bufsize bytes of UTF-8 text for use inside a JSON string.
+  out must have room for JSON_ESCAPE_MAX times the input.
+  Returns the number of bytes written to out.
+*/
+uint32_t json_escape(const char* address, uint32_t bufsize, char* out)
+{
+	const uint8_t* buffer = (const uint8_t*)address;
+	char* start = out;
+	uint32_t run = 0;
+	uint32_t i = 0;
+
+#ifdef NSSM_SCAN_SIMD
+	if (have_avx2())
+	{
+		const __m256i quote = _mm256_set1_epi8('"');
+		const __m256i backslash = _mm256_set1_epi8('\\');
+		const __m256i control = _mm256_set1_epi8(0x1f);
+		for (; i + 32 <= bufsize; i += 32)
+		{
+			__m256i block = _mm256_loadu_si256((const __m256i*)(buffer + i));
+			__m256i special = _mm256_or_si256(_mm256_cmpeq_epi8(block, quote), _mm256_cmpeq_epi8(block, backslash));
+			/* Unsigned c <= 0x1f. */
+			special = _mm256_or_si256(special, _mm256_cmpeq_epi8(_mm256_min_epu8(block, control), block));
+			escape_block((uint32_t)_mm256_movemask_epi8(special), buffer, i, &run, &out);
+		}
+	}
+
+	{
+		const __m128i quote = _mm_set1_epi8('"');
+		const __m128i backslash = _mm_set1_epi8('\\');
+		const __m128i control = _mm_set1_epi8(0x1f);
+		for (; i + 16 <= bufsize; i += 16)
+		{
+			__m128i block = _mm_loadu_si128((const __m128i*)(buffer + i));
+			__m128i special = _mm_or_si128(_mm_cmpeq_epi8(block, quote), _mm_cmpeq_epi8(block, backslash));
+			special = _mm_or_si128(special, _mm_cmpeq_epi8(_mm_min_epu8(block, control), block));
+			escape_block((uint32_t)_mm_movemask_epi8(special), buffer, i, &run, &out);
+		}
+	}
+#endif
+
+	/* Scalar fallback and tail. */
+	for (; i < bufsize; i++)
+	{
+		if (!needs_escape(buffer[i]))
+			continue;
+		memmove(out, buffer + run, i - run);
+		out += i - run;
+		out += escape_char(buffer[i], out);
+		run = i + 1;
+	}
+
+	memmove(out, buffer + run, bufsize - run);
+	out += bufsize - run;
+	return (uint32_t)(out - start);
+}
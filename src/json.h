@@ -0,0 +1,24 @@
+/*******************************************************************************
+ json.h - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+#pragma once
+
+#ifndef JSON_H
+#define JSON_H
+
+/* Escaping can grow the input up to six times, ie every byte becomes \u00XX. */
+#define JSON_ESCAPE_MAX 6
+
+uint32_t json_escape(const char*, uint32_t, char*);
+
+#endif
@@ -0,0 +1,379 @@
+/*******************************************************************************
+ logread.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "logread.h"
+
+/*
+  Reading of log files for nssm logs.  Output is copied a buffer at a time
+  from a window of a file, or followed as the service writes it, across
+  its rotations.
+*/
+
+static int32_t write_output(log_reader_t* reader, const char* data, uint32_t len, uint32_t charsize)
+{
+	while (len)
+	{
+		unsigned long written;
+		if (reader->console && charsize == sizeof(wchar_t))
+		{
+			if (!WriteConsoleW(reader->output, data, len / sizeof(wchar_t), &written, 0))
+				return 1;
+			written *= sizeof(wchar_t);
+		}
+		else if (!WriteFile(reader->output, data, len, &written, 0))
+			return 1;
+
+		if (!written)
+			return 1;
+		data += written;
+		len -= written;
+	}
+	return 0;
+}
+
+/* Open a log file for reading.  Returns 0 on success or an error code. */
+static uint32_t open_log_file(wchar_t* path, log_file_t* file)
+{
+	ZeroMemory(file, sizeof(*file));
+	file->charsize = 1;
+	file->handle = ::CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (file->handle == INVALID_HANDLE_VALUE)
+	{
+		file->handle = 0;
+		return GetLastError();
+	}
+	return 0;
+}
+
+/*
+  UTF-16 files start with a BOM, which is printed once at most.  The BOM
+  is written in one go so an empty file is the only one we can't judge
+  yet.  Returns 0 on success or 2 if the output couldn't be written.
+*/
+static int32_t detect_encoding(log_reader_t* reader, log_file_t* file)
+{
+	if (file->detected)
+		return 0;
+
+	unsigned char head[2];
+	unsigned long got;
+	LARGE_INTEGER zero;
+	zero.QuadPart = 0;
+	if (!SetFilePointerEx(file->handle, zero, 0, FILE_BEGIN) || !ReadFile(file->handle, head, sizeof(head), &got, 0) || !got)
+		return 0;
+
+	file->detected = true;
+	if (got < sizeof(head) || head[0] != 0xff || head[1] != 0xfe)
+		return 0;
+
+	file->charsize = sizeof(wchar_t);
+	if (!reader->bom_written && !reader->console && write_output(reader, (char*)head, sizeof(head), 1))
+		return 2;
+	reader->bom_written = true;
+	return 0;
+}
+
+/*
+  Print from *offset up to end, or to the end of the file if end is -1,
+  and move *offset past what was read.  If skipping, output starts at the
+  beginning of the next line.  A partly written character is left for
+  next time.
+  Returns 0 on success, 1 if the file couldn't be read and 2 if the output
+  couldn't be written.
+*/
+static int32_t copy_log(log_reader_t* reader, log_file_t* file, wchar_t* path, int64_t* offset, int64_t end, bool skipping)
+{
+	if (detect_encoding(reader, file))
+		return 2;
+	if (!file->detected)
+		return 0;
+
+	int64_t bom = (file->charsize == sizeof(wchar_t)) ? sizeof(wchar_t) : 0;
+	if (*offset < bom)
+		*offset = bom;
+	if (end >= 0 && end <= *offset)
+		return 0;
+
+	/*
+    Index entries may fall mid-line.  Read from the character before the
+    offset and skip to the end of its line, which is the offset itself if
+    the previous line ended there.
+  */
+	if (*offset <= bom)
+		skipping = false;
+	LARGE_INTEGER position;
+	position.QuadPart = skipping ? *offset - file->charsize : *offset;
+	if (!SetFilePointerEx(file->handle, position, 0, FILE_BEGIN))
+	{
+		print_message(stderr, NSSM_MESSAGE_READ_LOG_FAILED, path, error_string(GetLastError()));
+		return 1;
+	}
+
+	while (end < 0 || position.QuadPart < end)
+	{
+		int64_t remaining = (end >= 0) ? end - position.QuadPart : NSSM_LOGS_BUFFER_SIZE;
+		uint32_t want = (remaining < NSSM_LOGS_BUFFER_SIZE) ? (uint32_t)remaining : NSSM_LOGS_BUFFER_SIZE;
+		unsigned long got;
+		if (!ReadFile(file->handle, reader->buffer, want, &got, 0))
+		{
+			print_message(stderr, NSSM_MESSAGE_READ_LOG_FAILED, path, error_string(GetLastError()));
+			return 1;
+		}
+
+		uint32_t len = got - got % file->charsize;
+		position.QuadPart += len;
+		if (position.QuadPart > *offset)
+			*offset = position.QuadPart;
+
+		char* data = reader->buffer;
+		if (skipping && len)
+		{
+			uint32_t line_end;
+			if (!find_line_ends(data, len, file->charsize, &line_end, 1))
+				len = 0;
+			else
+			{
+				skipping = false;
+				data += line_end;
+				len -= line_end;
+			}
+		}
+
+		if (len && write_output(reader, data, len, file->charsize))
+			return 2;
+		if (got < want || got % file->charsize)
+			break;
+	}
+	return 0;
+}
+
+/*
+  Print bytes start to end of a log file, or to the end of the file if end
+  is -1.  Output starts at the beginning of a line.  If printed isn't null
+  it receives the offset printing stopped at.
+  Returns 0 on success, 1 if the file couldn't be read and 2 if the output
+  couldn't be written.
+*/
+int32_t print_log_range(log_reader_t* reader, wchar_t* path, int64_t start, int64_t end, int64_t* printed)
+{
+	log_file_t file;
+	uint32_t error = open_log_file(path, &file);
+	if (error)
+	{
+		/* Retention may have removed a rotation since we listed it. */
+		if (error == ERROR_FILE_NOT_FOUND)
+			return 0;
+		print_message(stderr, NSSM_MESSAGE_READ_LOG_FAILED, path, error_string(error));
+		return 1;
+	}
+
+	int64_t offset = start;
+	int32_t ret = copy_log(reader, &file, path, &offset, end, start > 0);
+	CloseHandle(file.handle);
+	if (printed)
+		*printed = offset;
+	return ret;
+}
+
+/*
+  Do two handles refer to the same file?  A file ID can be reused once
+  its file is deleted, so the creation time must match as well.
+*/
+static bool same_file(HANDLE a, HANDLE b)
+{
+	BY_HANDLE_FILE_INFORMATION info_a;
+	BY_HANDLE_FILE_INFORMATION info_b;
+	if (!GetFileInformationByHandle(a, &info_a) || !GetFileInformationByHandle(b, &info_b))
+		return true;
+	return info_a.dwVolumeSerialNumber == info_b.dwVolumeSerialNumber && info_a.nFileIndexHigh == info_b.nFileIndexHigh && info_a.nFileIndexLow == info_b.nFileIndexLow && !CompareFileTime(&info_a.ftCreationTime, &info_b.ftCreationTime);
+}
+
+/* Is copy a copy-and-truncate rotation of file?  Copies keep the original's creation time. */
+static bool copied_from(HANDLE copy, HANDLE file)
+{
+	FILETIME copy_created;
+	FILETIME file_created;
+	if (!GetFileTime(copy, &copy_created, 0, 0) || !GetFileTime(file, &file_created, 0, 0))
+		return false;
+	return !CompareFileTime(&copy_created, &file_created);
+}
+
+/* Was rotation a made after b? */
+static inline bool newer_rotation(rotated_file_t* a, rotated_file_t* b)
+{
+	if (a->stamp != b->stamp)
+		return a->stamp > b->stamp;
+	return a->sequence > b->sequence;
+}
+
+/*
+  Print the rotations made since *seen, oldest first, and move *seen on.
+
+  The first which is the file we are following holds our output from
+  offset onwards, and *found is set.  It is either that file renamed, in
+  which case we let go of our handle, or if the file is still live a
+  copy of it, which has its creation time.  Until we have a file the
+  first new rotation is taken to be it.  Later rotations were made
+  before we looked and are printed whole.
+
+  A copy still being made can't be opened, so we stop there, set
+  *pending and try again next time.
+  Returns 0 on success, 1 if a file couldn't be read and 2 if the output
+  couldn't be written.
+*/
+static int32_t print_rotations(log_reader_t* reader, wchar_t* path, log_file_t* following, bool live, int64_t offset, rotated_file_t* seen, bool* found, bool* pending)
+{
+	*found = false;
+	*pending = false;
+	rotated_file_t* files;
+	uint32_t count = find_rotated_files(path, &files);
+	uint32_t fresh = 0;
+	while (fresh < count && newer_rotation(&files[fresh], seen))
+		fresh++;
+
+	int32_t ret = 0;
+	for (uint32_t i = fresh; i-- && ret < 2; )
+	{
+		/*
+      We can't print compressed output.  If it was our file renamed we still
+      have it open and finish it below.
+    */
+		if (files[i].gzip)
+		{
+			*seen = files[i];
+			continue;
+		}
+
+		wchar_t rotated[nssmconst::pathlength];
+		rotated_file_path(path, &files[i], rotated, std::size(rotated));
+		log_file_t file;
+		uint32_t error = open_log_file(rotated, &file);
+		if (error == ERROR_SHARING_VIOLATION)
+		{
+			*pending = true;
+			break;
+		}
+		*seen = files[i];
+		/* Retention or compression may have got there first. */
+		if (error)
+			continue;
+
+		int64_t start = 0;
+		if (!*found)
+		{
+			if (!following->handle)
+				*found = true;
+			else if (same_file(file.handle, following->handle))
+			{
+				*found = true;
+				close_handle(&following->handle);
+			}
+			else if (live && copied_from(file.handle, following->handle))
+				*found = true;
+			if (*found)
+				start = offset;
+		}
+		ret |= copy_log(reader, &file, rotated, &start, -1, false);
+		CloseHandle(file.handle);
+	}
+
+	if (files)
+		HeapFree(GetProcessHeap(), 0, files);
+	return ret;
+}
+
+/* Start following path from offset.  seen is the newest rotation when offset was taken. */
+void start_following(log_follower_t* follower, wchar_t* path, int64_t offset, rotated_file_t* seen)
+{
+	ZeroMemory(follower, sizeof(*follower));
+	follower->path = path;
+	follower->offset = offset;
+	follower->seen = *seen;
+}
+
+void stop_following(log_follower_t* follower)
+{
+	close_handle(&follower->file.handle);
+}
+
+/*
+  Print what has been written since the last look.  Our handle allows
+  deletion so rotation can rename the file under us.  Rotations made
+  since the last look are printed first, however many there were,
+  starting with what we hadn't read of our own file, whether it was
+  renamed or copied and truncated, then the live file from the
+  beginning.  Only the one buffer is used however large the files grow.
+  Returns 0 on success, 1 if a file couldn't be read and 2 if the output
+  couldn't be written or the file can't be followed at all.
+*/
+int32_t poll_log(log_reader_t* reader, log_follower_t* follower)
+{
+	log_file_t* file = &follower->file;
+	while (true)
+	{
+		log_file_t current;
+		uint32_t error = open_log_file(follower->path, &current);
+		/* The file may be missing briefly while it is rotated. */
+		if (error && !file->handle && error != ERROR_FILE_NOT_FOUND)
+		{
+			print_message(stderr, NSSM_MESSAGE_READ_LOG_FAILED, follower->path, error_string(error));
+			return 2;
+		}
+
+		bool live = (!error && file->handle && same_file(file->handle, current.handle));
+		bool found;
+		bool pending;
+		int32_t ret = print_rotations(reader, follower->path, file, live, follower->offset, &follower->seen, &found, &pending);
+		if (ret == 2)
+		{
+			close_handle(&current.handle);
+			return ret;
+		}
+		if (found)
+			follower->offset = 0;
+
+		if (!error)
+		{
+			if (!file->handle)
+				*file = current;
+			else if (!live && !pending)
+			{
+				/* Renamed, but the rotation is gone already.  Nothing more will be written to the old file. */
+				ret = copy_log(reader, file, follower->path, &follower->offset, -1, false);
+				CloseHandle(file->handle);
+				*file = current;
+				follower->offset = 0;
+				if (ret == 2)
+					return ret;
+				continue;
+			}
+			else
+				CloseHandle(current.handle);
+		}
+
+		/* Don't read on until the copy is made and we know where the file was cut. */
+		if (file->handle && !pending)
+		{
+			/* Truncated, but we couldn't find the copy. */
+			LARGE_INTEGER size;
+			if (GetFileSizeEx(file->handle, &size) && size.QuadPart < follower->offset)
+				follower->offset = 0;
+			ret = copy_log(reader, file, follower->path, &follower->offset, -1, false);
+		}
+		return ret;
+	}
+}
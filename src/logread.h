@@ -0,0 +1,50 @@
+/*******************************************************************************
+ logread.h - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#pragma once
+
+#ifndef LOGREAD_H
+#define LOGREAD_H
+
+/* Where output goes, and the buffer it is read into. */
+typedef struct
+{
+	HANDLE output;
+	bool console;
+	bool bom_written;
+	char* buffer;
+} log_reader_t;
+
+typedef struct
+{
+	HANDLE handle;
+	uint32_t charsize;
+	bool detected;
+} log_file_t;
+
+/* A live file being followed and how far we have got. */
+typedef struct
+{
+	wchar_t* path;
+	log_file_t file;
+	int64_t offset;
+	rotated_file_t seen;
+} log_follower_t;
+
+int32_t print_log_range(log_reader_t*, wchar_t*, int64_t, int64_t, int64_t*);
+void start_following(log_follower_t*, wchar_t*, int64_t, rotated_file_t*);
+void stop_following(log_follower_t*);
+int32_t poll_log(log_reader_t*, log_follower_t*);
+
+#endif
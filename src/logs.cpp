@@ -0,0 +1,241 @@
+/*******************************************************************************
+ logs.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "logs.h"
+
+/*
+  nssm logs: print a service's redirected output from the live file and
+  its rotations, oldest first.  With --since or --until each file's time
+  index is used to seek straight to the window, so only the output in it
+  is read however large the files are.  Files without an index are
+  printed whole if they may hold output from the window; their rotation
+  times say which ones do.  --follow then keeps printing the live file as
+  it grows, across rotations.
+*/
+
+/* Find the file a service logs one of its streams to.  Returns 0 on success. */
+static int32_t get_log_path(wchar_t* service_name, stream which, wchar_t* path, uint32_t len)
+{
+	SC_HANDLE services = open_service_manager(SC_MANAGER_CONNECT);
+	if (!services)
+	{
+		print_message(stderr, NSSM_MESSAGE_OPEN_SERVICE_MANAGER_FAILED);
+		return 1;
+	}
+
+	wchar_t canonical_name[SERVICE_NAME_LENGTH];
+	SC_HANDLE service_handle = open_service(services, service_name, SERVICE_QUERY_STATUS, canonical_name, std::size(canonical_name));
+	CloseServiceHandle(services);
+	if (!service_handle)
+		return 2;
+	CloseServiceHandle(service_handle);
+
+	nssm_service_t* service = alloc_nssm_service();
+	if (!service)
+	{
+		print_message(stderr, NSSM_MESSAGE_OUT_OF_MEMORY, L"service", L"get_log_path()");
+		return 3;
+	}
+	::_snwprintf_s(service->name, std::size(service->name), _TRUNCATE, L"%s", canonical_name);
+
+	HKEY key = open_registry(service->name, KEY_READ);
+	if (key)
+	{
+		get_io_parameters(service, key);
+		if (get_string(key, regliterals::regdir.data(), service->dir, sizeof(service->dir), true, true, false))
+			service->dir[0] = L'\0';
+		RegCloseKey(key);
+	}
+
+	int32_t ret = 0;
+	const wchar_t* description = (which == stream::err) ? L"stderr" : L"stdout";
+	wchar_t* stream_path = (which == stream::err) ? service->stderr_path : service->stdout_path;
+	if (!stream_path[0])
+	{
+		print_message(stderr, NSSM_MESSAGE_NO_LOG_FILE, canonical_name, description);
+		ret = 4;
+	}
+	/* The service opens relative paths in its startup directory. */
+	else if (::PathIsRelativeW(stream_path) && service->dir[0])
+		::_snwprintf_s(path, len, _TRUNCATE, L"%s\\%s", service->dir, stream_path);
+	else
+		::_snwprintf_s(path, len, _TRUNCATE, L"%s", stream_path);
+
+	cleanup_nssm_service(service);
+	return ret;
+}
+
+/* Returns 0 on success. */
+/*
+  Print output as the service writes it, from offset in the live file,
+  until the output is closed.  seen is the newest rotation when offset
+  was taken.  Between looks we wait for a change in the file's directory.
+*/
+static int32_t follow_log(log_reader_t* reader, wchar_t* path, int64_t offset, rotated_file_t* seen)
+{
+	wchar_t dir[nssmconst::pathlength];
+	::_snwprintf_s(dir, std::size(dir), _TRUNCATE, L"%s", path);
+	strip_basename(dir);
+	if (!dir[0])
+		::_snwprintf_s(dir, std::size(dir), _TRUNCATE, L".");
+
+	/* Without notifications we still check every timeout. */
+	HANDLE change = ::FindFirstChangeNotificationW(dir, false, FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE);
+	if (change == INVALID_HANDLE_VALUE)
+		change = 0;
+
+	log_follower_t follower;
+	start_following(&follower, path, offset, seen);
+	int32_t ret;
+	while ((ret = poll_log(reader, &follower)) < 2)
+	{
+		if (change)
+		{
+			WaitForSingleObject(change, NSSM_LOGS_FOLLOW_TIMEOUT);
+			::FindNextChangeNotification(change);
+		}
+		else
+			Sleep(NSSM_LOGS_FOLLOW_TIMEOUT);
+	}
+
+	stop_following(&follower);
+	if (change)
+		::FindCloseChangeNotification(change);
+	return ret;
+}
+
+/* nssm logs <servicename> [stdout|stderr] [--since <time>] [--until <time>] [--follow] */
+int32_t service_logs(int32_t argc, wchar_t** argv)
+{
+	if (argc < 1)
+		return usage(1);
+
+	stream which = stream::out;
+	uint64_t since = 0;
+	uint64_t until = 0;
+	bool follow = false;
+	for (int32_t i = 1; i < argc; i++)
+	{
+		if (str_equiv(argv[i], L"stdout"))
+			which = stream::out;
+		else if (str_equiv(argv[i], L"stderr"))
+			which = stream::err;
+		else if ((str_equiv(argv[i], L"--since") || str_equiv(argv[i], L"--until")) && i + 1 < argc)
+		{
+			uint64_t* time = str_equiv(argv[i], L"--since") ? &since : &until;
+			if (!parse_log_time(argv[++i], time))
+			{
+				print_message(stderr, NSSM_MESSAGE_INVALID_LOG_TIME, argv[i]);
+				return 1;
+			}
+		}
+		else if (str_equiv(argv[i], L"--follow"))
+			follow = true;
+		else
+			return usage(1);
+	}
+	/* Following never ends. */
+	if (follow && until)
+		return usage(1);
+
+	wchar_t path[nssmconst::pathlength];
+	if (get_log_path(argv[0], which, path, std::size(path)))
+		return 1;
+
+	log_reader_t reader;
+	ZeroMemory(&reader, sizeof(reader));
+	reader.output = GetStdHandle(STD_OUTPUT_HANDLE);
+	unsigned long mode;
+	reader.console = GetConsoleMode(reader.output, &mode) ? true : false;
+	reader.buffer = (char*)HeapAlloc(GetProcessHeap(), 0, NSSM_LOGS_BUFFER_SIZE);
+	if (!reader.buffer)
+	{
+		print_message(stderr, NSSM_MESSAGE_OUT_OF_MEMORY, L"buffer", L"service_logs()");
+		return 1;
+	}
+
+	int64_t live_end = 0;
+	rotated_file_t seen;
+	ZeroMemory(&seen, sizeof(seen));
+	int32_t ret = 0;
+	if (follow && !since)
+	{
+		/* Start following from the current end of the live file, after the rotations made so far. */
+		rotated_file_t* files;
+		if (find_rotated_files(path, &files))
+			seen = files[0];
+		if (files)
+			HeapFree(GetProcessHeap(), 0, files);
+
+		WIN32_FILE_ATTRIBUTE_DATA data;
+		if (::GetFileAttributesExW(path, GetFileExInfoStandard, &data))
+		{
+			ULARGE_INTEGER size;
+			size.LowPart = data.nFileSizeLow;
+			size.HighPart = data.nFileSizeHigh;
+			live_end = (int64_t)size.QuadPart;
+		}
+	}
+	else
+	{
+		/* Rotations oldest first, then the live file.  Each holds output from the previous rotation to its own. */
+		rotated_file_t* files;
+		uint32_t count = find_rotated_files(path, &files);
+		if (count)
+			seen = files[0];
+		uint64_t from = 0;
+		for (uint32_t i = 0; i <= count && ret < 2; i++)
+		{
+			wchar_t rotated[nssmconst::pathlength];
+			wchar_t* file_path = path;
+			uint64_t to = 0;
+			bool compressed = false;
+			if (i < count)
+			{
+				rotated_file_t* file = &files[count - 1 - i];
+				rotated_file_path(path, file, rotated, std::size(rotated));
+				file_path = rotated;
+				to = rotated_file_time(file);
+				compressed = file->gzip;
+			}
+
+			if (until && from > until)
+				break;
+			if (compressed)
+			{
+				if (!since || to >= since)
+					print_message(stderr, NSSM_MESSAGE_LOG_COMPRESSED, rotated);
+			}
+			else if (!since || !to || to >= since)
+			{
+				int64_t start;
+				int64_t end;
+				find_time_range(file_path, since, until, &start, &end);
+				ret |= print_log_range(&reader, file_path, start, end, (i == count) ? &live_end : nullptr);
+			}
+			from = to;
+		}
+
+		if (files)
+			HeapFree(GetProcessHeap(), 0, files);
+	}
+
+	if (follow && ret < 2)
+		ret |= follow_log(&reader, path, live_end, &seen);
+	HeapFree(GetProcessHeap(), 0, reader.buffer);
+	return ret ? 1 : 0;
+}
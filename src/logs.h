@@ -0,0 +1,31 @@
+/*******************************************************************************
+ logs.h - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#pragma once
+
+#ifndef LOGS_H
+#define LOGS_H
+
+/* Bytes read from a log file at a time. */
+#define NSSM_LOGS_BUFFER_SIZE   65536
+/*
+  Milliseconds --follow waits for a change notification before looking
+  anyway.  Growth of a file held open may not be notified until the
+  writer flushes or closes it.
+*/
+#define NSSM_LOGS_FOLLOW_TIMEOUT 1000
+
+int32_t service_logs(int32_t, wchar_t**);
+
+#endif
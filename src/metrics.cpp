@@ -0,0 +1,201 @@
+/*******************************************************************************
+ metrics.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "metrics.h"
+
+/*
+  Logging statistics.
+
+  The counters live in a named section which `nssm stats` maps read-only,
+  so publishing them costs nothing beyond updating the counters themselves
+  and nobody has to talk to the service to read them.  If the section
+  can't be created the counters are kept in private memory instead, so the
+  logging threads never have to check.
+*/
+
+static nssm_stats_t* stats;
+static nssm_stats_t private_stats;
+static SRWLOCK stats_lock = SRWLOCK_INIT;
+
+/* Record the time since start, taken with QueryPerformanceCounter(). */
+void record_latency(stream_stats_t* stream_stats, LARGE_INTEGER* start)
+{
+	static LARGE_INTEGER frequency;
+	if (!frequency.QuadPart)
+		QueryPerformanceFrequency(&frequency);
+
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	uint64_t us = (uint64_t)(now.QuadPart - start->QuadPart) * 1000000ULL / (uint64_t)frequency.QuadPart;
+	count_stat(stream_stats->latency[latency_bucket(us)], 1);
+}
+
+/* Create the statistics section for this service.  Call with stats_lock held. */
+static nssm_stats_t* create_stats(wchar_t* service_name)
+{
+	wchar_t name[SERVICE_NAME_LENGTH + 32];
+	::_snwprintf_s(name, std::size(name), _TRUNCATE, NSSM_STATS_SECTION, service_name);
+
+	SECURITY_ATTRIBUTES attributes;
+	ZeroMemory(&attributes, sizeof(attributes));
+	attributes.nLength = sizeof(attributes);
+	if (!::ConvertStringSecurityDescriptorToSecurityDescriptorW(NSSM_STATS_SDDL, SDDL_REVISION_1, &attributes.lpSecurityDescriptor, 0))
+		return 0;
+
+	HANDLE section = ::CreateFileMappingW(INVALID_HANDLE_VALUE, &attributes, PAGE_READWRITE, 0, sizeof(nssm_stats_t), name);
+	LocalFree(attributes.lpSecurityDescriptor);
+	if (!section)
+		return 0;
+
+	/* The section stays mapped for the life of the process. */
+	nssm_stats_t* section_stats = (nssm_stats_t*)MapViewOfFile(section, FILE_MAP_WRITE, 0, 0, sizeof(nssm_stats_t));
+	if (!section_stats)
+	{
+		CloseHandle(section);
+		return 0;
+	}
+
+	section_stats->version = NSSM_STATS_VERSION;
+	section_stats->pid = GetCurrentProcessId();
+	return section_stats;
+}
+
+/* Counters for one of the service's output streams. */
+stream_stats_t* open_stream_stats(wchar_t* service_name, stream which, wchar_t* path)
+{
+	AcquireSRWLockExclusive(&stats_lock);
+	if (!stats)
+	{
+		stats = create_stats(service_name);
+		if (!stats)
+		{
+			log_event(EVENTLOG_WARNING_TYPE, NSSM_EVENT_CREATEFILEMAPPING_FAILED, service_name, error_string(GetLastError()), 0);
+			stats = &private_stats;
+		}
+	}
+	stream_stats_t* stream_stats = &stats->streams[(uint32_t)which];
+	::_snwprintf_s(stream_stats->path, std::size(stream_stats->path), _TRUNCATE, L"%s", path);
+	ReleaseSRWLockExclusive(&stats_lock);
+
+	return stream_stats;
+}
+
+/* Smallest latency at or above the given fraction of writes. */
+static uint64_t percentile(stream_stats_t* stream_stats, uint64_t writes, uint32_t permille)
+{
+	uint64_t threshold = (writes * permille + 999) / 1000;
+	uint64_t seen = 0;
+	for (uint32_t i = 0; i < NSSM_LATENCY_BUCKETS; i++)
+	{
+		seen += stream_stats->latency[i].load(std::memory_order_relaxed);
+		if (seen >= threshold)
+			return latency_bucket_value(i);
+	}
+	return latency_bucket_value(NSSM_LATENCY_BUCKETS - 1);
+}
+
+static void print_stream_stats(wchar_t* description, stream_stats_t* stream_stats)
+{
+	if (!stream_stats->path[0])
+		return;
+
+	uint64_t writes = 0;
+	uint32_t highest = 0;
+	for (uint32_t i = 0; i < NSSM_LATENCY_BUCKETS; i++)
+	{
+		uint64_t n = stream_stats->latency[i].load(std::memory_order_relaxed);
+		writes += n;
+		if (n)
+			highest = i;
+	}
+
+	fwprintf(stdout, L"%s: %s\n", description, stream_stats->path);
+	fwprintf(stdout, L"  bytes in:       %llu\n", stream_stats->bytes_in.load(std::memory_order_relaxed));
+	fwprintf(stdout, L"  bytes out:      %llu\n", stream_stats->bytes_out.load(std::memory_order_relaxed));
+	fwprintf(stdout, L"  lines:          %llu\n", stream_stats->lines.load(std::memory_order_relaxed));
+	fwprintf(stdout, L"  rotations:      %llu\n", stream_stats->rotations.load(std::memory_order_relaxed));
+	fwprintf(stdout, L"  rotation ms:    %llu\n", stream_stats->rotation_ms.load(std::memory_order_relaxed));
+	fwprintf(stdout, L"  truncate lost:  %llu\n", stream_stats->truncate_lost.load(std::memory_order_relaxed));
+	fwprintf(stdout, L"  read retries:   %llu\n", stream_stats->read_retries.load(std::memory_order_relaxed));
+	fwprintf(stdout, L"  write retries:  %llu\n", stream_stats->write_retries.load(std::memory_order_relaxed));
+	fwprintf(stdout, L"  dropped bytes:  %llu\n", stream_stats->dropped.load(std::memory_order_relaxed));
+	fwprintf(stdout, L"  repeated lines: %llu\n", stream_stats->repeats.load(std::memory_order_relaxed));
+	fwprintf(stdout, L"  limited lines:  %llu\n", stream_stats->limited.load(std::memory_order_relaxed));
+	fwprintf(stdout, L"  forward bytes:  %llu\n", stream_stats->forwarded.load(std::memory_order_relaxed));
+	fwprintf(stdout, L"  forward drops:  %llu\n", stream_stats->forward_dropped.load(std::memory_order_relaxed));
+	fwprintf(stdout, L"  reconnects:     %llu\n", stream_stats->forward_reconnects.load(std::memory_order_relaxed));
+	fwprintf(stdout, L"  writes:         %llu\n", writes);
+	if (writes)
+		fwprintf(stdout, L"  write latency:  p50 %lluus p90 %lluus p99 %lluus p99.9 %lluus max %lluus\n", percentile(stream_stats, writes, 500), percentile(stream_stats, writes, 900), percentile(stream_stats, writes, 990), percentile(stream_stats, writes, 999), latency_bucket_value(highest));
+}
+
+/* nssm stats <servicename> ... */
+int32_t service_stats(int32_t argc, wchar_t** argv)
+{
+	if (argc < 1)
+		return usage(1);
+
+	SC_HANDLE services = open_service_manager(SC_MANAGER_CONNECT);
+	if (!services)
+	{
+		print_message(stderr, NSSM_MESSAGE_OPEN_SERVICE_MANAGER_FAILED);
+		return 1;
+	}
+
+	int32_t errors = 0;
+	for (int32_t i = 0; i < argc; i++)
+	{
+		wchar_t canonical_name[SERVICE_NAME_LENGTH];
+		SC_HANDLE service_handle = open_service(services, argv[i], SERVICE_QUERY_STATUS, canonical_name, std::size(canonical_name));
+		if (!service_handle)
+		{
+			errors++;
+			continue;
+		}
+		CloseServiceHandle(service_handle);
+
+		wchar_t name[SERVICE_NAME_LENGTH + 32];
+		::_snwprintf_s(name, std::size(name), _TRUNCATE, NSSM_STATS_SECTION, canonical_name);
+		HANDLE section = ::OpenFileMappingW(FILE_MAP_READ, false, name);
+		if (!section)
+		{
+			print_message(stderr, NSSM_MESSAGE_NO_STATS, canonical_name, error_string(GetLastError()));
+			errors++;
+			continue;
+		}
+
+		nssm_stats_t* section_stats = (nssm_stats_t*)MapViewOfFile(section, FILE_MAP_READ, 0, 0, sizeof(nssm_stats_t));
+		if (!section_stats || section_stats->version != NSSM_STATS_VERSION)
+		{
+			print_message(stderr, NSSM_MESSAGE_NO_STATS, canonical_name, error_string(section_stats ? ERROR_REVISION_MISMATCH : GetLastError()));
+			if (section_stats)
+				UnmapViewOfFile(section_stats);
+			CloseHandle(section);
+			errors++;
+			continue;
+		}
+
+		fwprintf(stdout, L"%s: %lu\n", canonical_name, section_stats->pid);
+		print_stream_stats(L"stdout", &section_stats->streams[(uint32_t)stream::out]);
+		print_stream_stats(L"stderr", &section_stats->streams[(uint32_t)stream::err]);
+
+		UnmapViewOfFile(section_stats);
+		CloseHandle(section);
+	}
+
+	CloseServiceHandle(services);
+	return errors ? 1 : 0;
+}
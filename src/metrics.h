@@ -0,0 +1,106 @@
+/*******************************************************************************
+ metrics.h - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+#pragma once
+
+#ifndef METRICS_H
+#define METRICS_H
+
+/* Shared memory section holding the logging statistics of a service. */
+#define NSSM_STATS_SECTION      L"Global\\nssm-stats-%s"
+#define NSSM_STATS_SDDL         L"D:(A;;GA;;;SY)(A;;GR;;;BA)"
+#define NSSM_STATS_VERSION      5
+
+/*
+  Write latency histogram in microseconds.  Values below 8 have a bucket
+  each; above that each power of two is split into 8 buckets, so any value
+  is recorded to within 12.5%.
+*/
+#define NSSM_LATENCY_SUB_BITS   3
+#define NSSM_LATENCY_SUB        (1 << NSSM_LATENCY_SUB_BITS)
+#define NSSM_LATENCY_BUCKETS    (NSSM_LATENCY_SUB * 30)
+
+enum class stream : uint32_t
+{
+	out		= 0,
+	err		= 1,
+	count	= 2
+};
+
+/*
+  Counters for one stream.  Each counter has a single writer, or writers
+  which already share a lock, so updates are plain relaxed loads and
+  stores, with no locked instructions.
+*/
+typedef struct
+{
+	wchar_t path[nssmconst::pathlength];
+	std::atomic<uint64_t> bytes_in;
+	std::atomic<uint64_t> bytes_out;
+	std::atomic<uint64_t> lines;
+	std::atomic<uint64_t> rotations;
+	std::atomic<uint64_t> rotation_ms;
+	std::atomic<uint64_t> truncate_lost;
+	std::atomic<uint64_t> read_retries;
+	std::atomic<uint64_t> write_retries;
+	std::atomic<uint64_t> dropped;
+	std::atomic<uint64_t> repeats;
+	std::atomic<uint64_t> limited;
+	std::atomic<uint64_t> forwarded;
+	std::atomic<uint64_t> forward_dropped;
+	std::atomic<uint64_t> forward_reconnects;
+	std::atomic<uint64_t> latency[NSSM_LATENCY_BUCKETS];
+} stream_stats_t;
+
+typedef struct
+{
+	uint32_t version;
+	uint32_t pid;
+	stream_stats_t streams[(uint32_t)stream::count];
+} nssm_stats_t;
+
+/* Add to a counter which only one thread updates. */
+static inline void count_stat(std::atomic<uint64_t>& counter, uint64_t n)
+{
+	counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+/* Histogram bucket for a latency in microseconds. */
+static inline uint32_t latency_bucket(uint64_t us)
+{
+	if (us < NSSM_LATENCY_SUB)
+		return (uint32_t)us;
+
+	uint32_t bits = 63 - (uint32_t)std::countl_zero(us);
+	uint32_t bucket = (bits - NSSM_LATENCY_SUB_BITS + 1) * NSSM_LATENCY_SUB + (uint32_t)((us >> (bits - NSSM_LATENCY_SUB_BITS)) & (NSSM_LATENCY_SUB - 1));
+	if (bucket >= NSSM_LATENCY_BUCKETS)
+		bucket = NSSM_LATENCY_BUCKETS - 1;
+	return bucket;
+}
+
+/* Lowest value which falls in a bucket. */
+static inline uint64_t latency_bucket_value(uint32_t bucket)
+{
+	if (bucket < NSSM_LATENCY_SUB)
+		return bucket;
+
+	uint32_t bits = bucket / NSSM_LATENCY_SUB + NSSM_LATENCY_SUB_BITS - 1;
+	uint64_t sub = bucket % NSSM_LATENCY_SUB;
+	return (NSSM_LATENCY_SUB + sub) << (bits - NSSM_LATENCY_SUB_BITS);
+}
+
+void record_latency(stream_stats_t*, LARGE_INTEGER*);
+stream_stats_t* open_stream_stats(wchar_t*, stream, wchar_t*);
+int32_t service_stats(int32_t, wchar_t**);
+
+#endif
@@ -0,0 +1,367 @@
+/*******************************************************************************
+ multiline.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "multiline.h"
+
+/*
+  Start patterns are a small subset of regular expressions, always
+  anchored at the start of the line:
+
+    .  \d \w \s  \D \W \S  [abc] [a-z] [^abc]  \x for a literal x
+    *  +  ?  {n}  {n,}  {n,m}
+
+  There are no groups or alternation, so a pattern compiles to a list of
+  character sets.  Counts are expanded into copies of the set, so {n,m}
+  costs m positions.  Matching follows every position the line could have
+  reached at once, in a 64-bit mask, so it costs a table lookup and a few
+  shifts per character however the pattern is written.  Nothing matches a
+  line ending.
+*/
+
+static inline void set_bit(pattern_token_t* token, uint32_t c)
+{
+	token->bits[c >> 5] |= 1U << (c & 31);
+}
+
+static inline bool test_bit(const pattern_token_t* token, uint32_t c)
+{
+	if (c > 0xff)
+		return token->high;
+	return (token->bits[c >> 5] >> (c & 31)) & 1;
+}
+
+static void set_range(pattern_token_t* token, uint32_t from, uint32_t to)
+{
+	for (uint32_t c = from; c <= to; c++)
+		set_bit(token, c);
+}
+
+/* Add the class named by the escape \c.  Returns false for a literal escape. */
+static bool set_class(pattern_token_t* token, wchar_t c)
+{
+	pattern_token_t set;
+	ZeroMemory(&set, sizeof(set));
+	switch (towlower(c))
+	{
+	case L'd':
+		set_range(&set, L'0', L'9');
+		break;
+
+	case L'w':
+		set_range(&set, L'0', L'9');
+		set_range(&set, L'A', L'Z');
+		set_range(&set, L'a', L'z');
+		set_bit(&set, L'_');
+		break;
+
+	case L's':
+		set_bit(&set, L' ');
+		set_bit(&set, L'\t');
+		set_bit(&set, L'\v');
+		set_bit(&set, L'\f');
+		break;
+
+	default:
+		return false;
+	}
+
+	/* Upper case means everything else. */
+	bool negate = (c >= L'A' && c <= L'Z');
+	for (uint32_t i = 0; i < std::size(set.bits); i++)
+		token->bits[i] |= negate ? ~set.bits[i] : set.bits[i];
+	if (negate)
+		token->high = true;
+	return true;
+}
+
+/* Parse [...] starting after the bracket.  Returns the length parsed or 0. */
+static uint32_t parse_set(const wchar_t* pattern, pattern_token_t* token)
+{
+	uint32_t i = 0;
+	bool negate = (pattern[i] == L'^');
+	if (negate)
+		i++;
+
+	for (bool first = true; pattern[i]; first = false)
+	{
+		wchar_t c = pattern[i++];
+		if (c == L']' && !first)
+		{
+			if (negate)
+			{
+				for (uint32_t j = 0; j < std::size(token->bits); j++)
+					token->bits[j] = ~token->bits[j];
+				token->high = !token->high;
+			}
+			return i;
+		}
+
+		if (c == L'\\')
+		{
+			c = pattern[i++];
+			if (!c)
+				return 0;
+			if (c == L't')
+				c = L'\t';
+			else if (set_class(token, c))
+				continue;
+		}
+		if (c > 0xff)
+			return 0;
+
+		if (pattern[i] == L'-' && pattern[i + 1] && pattern[i + 1] != L']')
+		{
+			wchar_t to = pattern[i + 1];
+			if (to > 0xff || to < c)
+				return 0;
+			set_range(token, c, to);
+			i += 2;
+		}
+		else
+			set_bit(token, c);
+	}
+
+	/* No closing bracket. */
+	return 0;
+}
+
+/* Parse {n}, {n,} or {n,m} starting after the brace.  Returns the length parsed or 0. */
+static uint32_t parse_count(const wchar_t* pattern, pattern_token_t* token)
+{
+	wchar_t* end;
+	unsigned long min = wcstoul(pattern, &end, 10);
+	if (end == pattern)
+		return 0;
+
+	unsigned long max = min;
+	if (*end == L',')
+	{
+		const wchar_t* from = end + 1;
+		max = wcstoul(from, &end, 10);
+		if (end == from)
+			max = NSSM_PATTERN_UNBOUNDED;
+	}
+	if (*end != L'}' || min > max || min >= NSSM_PATTERN_UNBOUNDED || (max != NSSM_PATTERN_UNBOUNDED && max >= NSSM_PATTERN_UNBOUNDED))
+		return 0;
+
+	token->min = (uint8_t)min;
+	token->max = (uint8_t)max;
+	return (uint32_t)(end - pattern) + 1;
+}
+
+/* Add a position matching the token's set.  Returns false if there is no room. */
+static bool add_position(multiline_t* multiline, const pattern_token_t* token, bool optional, bool repeats)
+{
+	if (multiline->tokens == NSSM_PATTERN_TOKENS)
+		return false;
+
+	uint64_t bit = 1ULL << multiline->tokens++;
+	for (uint32_t c = 0; c < std::size(multiline->accepts); c++)
+	{
+		if (test_bit(token, c))
+			multiline->accepts[c] |= bit;
+	}
+	if (token->high)
+		multiline->high |= bit;
+	if (optional)
+		multiline->optional |= bit;
+	if (repeats)
+		multiline->repeats |= bit;
+	return true;
+}
+
+/*
+  Expand a token into min positions which must match, the last repeating
+  if the token is unbounded, then optional positions up to max.
+*/
+static bool add_token(multiline_t* multiline, const pattern_token_t* token)
+{
+	for (uint32_t n = 0; n < token->min; n++)
+	{
+		if (!add_position(multiline, token, false, token->max == NSSM_PATTERN_UNBOUNDED && n + 1 == token->min))
+			return false;
+	}
+
+	if (token->max == NSSM_PATTERN_UNBOUNDED)
+		return token->min || add_position(multiline, token, true, true);
+
+	for (uint32_t n = token->min; n < token->max; n++)
+	{
+		if (!add_position(multiline, token, true, false))
+			return false;
+	}
+	return true;
+}
+
+/*
+  Compile a start pattern.  Only ASCII and Latin-1 literals can be used.
+  Returns: 0 on success.
+           1 if the pattern is invalid.
+*/
+int32_t compile_pattern(const wchar_t* pattern, multiline_t* multiline)
+{
+	multiline->tokens = 0;
+	ZeroMemory(multiline->accepts, sizeof(multiline->accepts));
+	multiline->high = multiline->optional = multiline->repeats = 0;
+	if (*pattern == L'^')
+		pattern++;
+
+	while (*pattern)
+	{
+		pattern_token_t set;
+		pattern_token_t* token = &set;
+		ZeroMemory(token, sizeof(*token));
+		token->min = token->max = 1;
+
+		wchar_t c = *pattern++;
+		if (c == L'.')
+		{
+			set_range(token, 0, 0xff);
+			token->high = true;
+		}
+		else if (c == L'[')
+		{
+			uint32_t len = parse_set(pattern, token);
+			if (!len)
+				return 1;
+			pattern += len;
+		}
+		else if (c == L'*' || c == L'+' || c == L'?' || c == L'{')
+			return 1;
+		else
+		{
+			if (c == L'\\')
+			{
+				c = *pattern++;
+				if (!c)
+					return 1;
+				if (c == L't')
+					c = L'\t';
+			}
+			if (!set_class(token, c))
+			{
+				if (c > 0xff)
+					return 1;
+				set_bit(token, c);
+			}
+		}
+
+		/* Lines end where they end, whatever the pattern says. */
+		token->bits[L'\n' >> 5] &= ~(1U << (L'\n' & 31));
+		token->bits[L'\r' >> 5] &= ~(1U << (L'\r' & 31));
+
+		switch (*pattern)
+		{
+		case L'*':
+			token->min = 0;
+			token->max = NSSM_PATTERN_UNBOUNDED;
+			pattern++;
+			break;
+
+		case L'+':
+			token->max = NSSM_PATTERN_UNBOUNDED;
+			pattern++;
+			break;
+
+		case L'?':
+			token->min = 0;
+			pattern++;
+			break;
+
+		case L'{':
+		{
+			uint32_t len = parse_count(pattern + 1, token);
+			if (!len)
+				return 1;
+			pattern += len + 1;
+			break;
+		}
+		}
+
+		if (!add_token(multiline, token))
+			return 1;
+	}
+
+	return 0;
+}
+
+static inline uint32_t char_at(const void* line, uint32_t i, uint32_t charsize)
+{
+	if (charsize == sizeof(wchar_t))
+		return ((const wchar_t*)line)[i];
+	return ((const uint8_t*)line)[i];
+}
+
+/* Add the positions reachable by skipping optional ones. */
+static inline uint64_t skip_optional(multiline_t* multiline, uint64_t states)
+{
+	for (;;)
+	{
+		uint64_t next = states | ((states & multiline->optional) << 1);
+		if (next == states)
+			return states;
+		states = next;
+	}
+}
+
+/*
+  Match the pattern against the start of the line.  Bit n of states is set
+  while the line so far could be followed by position n; bit tokens means
+  the whole pattern has matched.
+*/
+static bool match_tokens(multiline_t* multiline, const void* line, uint32_t len, uint32_t charsize)
+{
+	uint64_t done = 1ULL << multiline->tokens;
+	uint64_t states = skip_optional(multiline, 1);
+	for (uint32_t i = 0; !(states & done); i++)
+	{
+		if (i == len)
+			return false;
+
+		uint32_t c = char_at(line, i, charsize);
+		uint64_t matched = states & ((c > 0xff) ? multiline->high : multiline->accepts[c]);
+		if (!matched)
+			return false;
+		states = skip_optional(multiline, (matched << 1) | (matched & multiline->repeats));
+	}
+	return true;
+}
+
+/*
+  Decide whether a line continues the previous record.  The line may run
+  on into the rest of the chunk; bufsize is in bytes.
+*/
+bool continues_record(multiline_t* multiline, const void* line, uint32_t bufsize, uint32_t charsize)
+{
+	uint32_t len = bufsize / charsize;
+	switch (multiline->rule)
+	{
+	case NSSM_MULTILINE_INDENT:
+	{
+		if (!len)
+			return false;
+		uint32_t c = char_at(line, 0, charsize);
+		return (c == L' ' || c == L'\t');
+	}
+
+	case NSSM_MULTILINE_PATTERN:
+		if (len > NSSM_PATTERN_SCAN)
+			len = NSSM_PATTERN_SCAN;
+		return !match_tokens(multiline, line, len, charsize);
+	}
+
+	return false;
+}
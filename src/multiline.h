@@ -0,0 +1,66 @@
+/*******************************************************************************
+ multiline.h - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+#pragma once
+
+#ifndef MULTILINE_H
+#define MULTILINE_H
+
+/* How to tell that a line continues the record started by an earlier one. */
+#define NSSM_MULTILINE_NONE     0
+#define NSSM_MULTILINE_INDENT   1
+#define NSSM_MULTILINE_PATTERN  2
+
+/* Milliseconds to wait for more of a record before writing it out. */
+#define NSSM_MULTILINE_TIMEOUT  1000
+
+/*
+  Longest start pattern, in positions once counts are expanded, and how
+  far into a line it may look.  One more bit marks the end of the pattern.
+*/
+#define NSSM_PATTERN_TOKENS     63
+#define NSSM_PATTERN_SCAN       1024
+#define NSSM_PATTERN_UNBOUNDED  0xff
+
+/*
+  One step of a start pattern: a set of characters and how many times it
+  may repeat.  Characters above 255 only match sets which say so.
+*/
+typedef struct
+{
+	uint32_t bits[8];
+	bool high;
+	uint8_t min;
+	uint8_t max;
+} pattern_token_t;
+
+/*
+  A compiled start pattern has one bit per position.  accepts[c] says which
+  positions match character c, high which match characters above 255.
+  Optional positions may be skipped and repeating ones matched again.
+*/
+typedef struct
+{
+	uint32_t rule;
+	uint32_t timeout;
+	uint32_t tokens;
+	uint64_t accepts[256];
+	uint64_t high;
+	uint64_t optional;
+	uint64_t repeats;
+} multiline_t;
+
+int32_t compile_pattern(const wchar_t*, multiline_t*);
+bool continues_record(multiline_t*, const void*, uint32_t, uint32_t);
+
+#endif
@@ -408,6 +408,10 @@ int32_t __cdecl wmain(int32_t argc, wchar_t** argv)
 			nssm_exit(list_nssm_services(argc - 2, argv + 2));
 		if (str_equiv(argv[1], L"processes"))
 			nssm_exit(service_process_tree(argc - 2, argv + 2));
+		if (str_equiv(argv[1], L"stats"))
+			nssm_exit(service_stats(argc - 2, argv + 2));
+		if (str_equiv(argv[1], L"logs"))
+			nssm_exit(service_logs(argc - 2, argv + 2));
 		if (str_equiv(argv[1], L"remove"))
 		{
 			if (!is_admin)
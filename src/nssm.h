@@ -62,6 +62,7 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include "utf8.h"
+#include "encoding.h"
 #include "service.h"
 #include "account.h"
 #include "console.h"
@@ -73,6 +74,23 @@
 #include "process_impl.h"
 #include "registry.h"
 #include "settings.h"
+#include "scan.h"
+#include "json.h"
+#include "multiline.h"
+#include "retention.h"
+#include "rotate.h"
+#include "timeindex.h"
+#include "deflate.h"
+#include "compress.h"
+#include "copytruncate.h"
+#include "queue.h"
+#include "ratelimit.h"
+#include "timestamp.h"
+#include "metrics.h"
+#include "handoff.h"
+#include "forward.h"
+#include "logread.h"
+#include "logs.h"
 #include "io-impl.h"
 #include "gui.h"
 #endif
@@ -0,0 +1,127 @@
+/*******************************************************************************
+ queue.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "queue.h"
+
+/*
+  Bounded queue between the thread which reads the application's output and
+  the thread which writes it to disk.  Records are stored back to back and
+  may wrap around the end of the buffer, so no space is wasted on padding.
+*/
+
+/* Copy into the ring at offset, wrapping if necessary. */
+static inline void ring_write(log_queue_t* queue, uint32_t offset, const void* address, uint32_t len)
+{
+	offset %= queue->size;
+	uint32_t first = queue->size - offset;
+	if (first > len)
+		first = len;
+	memmove(queue->data + offset, address, first);
+	if (len > first)
+		memmove(queue->data, (const char*)address + first, len - first);
+}
+
+/* Copy out of the ring at offset, wrapping if necessary. */
+static inline void ring_read(log_queue_t* queue, uint32_t offset, void* address, uint32_t len)
+{
+	offset %= queue->size;
+	uint32_t first = queue->size - offset;
+	if (first > len)
+		first = len;
+	memmove(address, queue->data + offset, first);
+	if (len > first)
+		memmove((char*)address + first, queue->data, len - first);
+}
+
+int32_t init_queue(log_queue_t* queue, uint32_t size)
+{
+	ZeroMemory(queue, sizeof(*queue));
+	queue->data = (char*)HeapAlloc(GetProcessHeap(), 0, size);
+	if (!queue->data)
+		return 1;
+	queue->size = size;
+	return 0;
+}
+
+void free_queue(log_queue_t* queue)
+{
+	if (queue->data)
+		HeapFree(GetProcessHeap(), 0, queue->data);
+	ZeroMemory(queue, sizeof(*queue));
+}
+
+bool queue_fits(log_queue_t* queue, uint32_t len)
+{
+	return queue->used + NSSM_QUEUE_HEADER + len <= queue->size;
+}
+
+bool queue_put(log_queue_t* queue, const void* address, uint32_t len)
+{
+	if (!queue_fits(queue, len))
+		return false;
+
+	uint32_t tail = queue->head + queue->used;
+	ring_write(queue, tail, &len, NSSM_QUEUE_HEADER);
+	ring_write(queue, tail + NSSM_QUEUE_HEADER, address, len);
+	queue->used += NSSM_QUEUE_HEADER + len;
+	queue->records++;
+	return true;
+}
+
+/* Length of the oldest record, or 0 if the queue is empty. */
+uint32_t queue_peek(log_queue_t* queue)
+{
+	if (!queue->records)
+		return 0;
+
+	uint32_t len;
+	ring_read(queue, queue->head, &len, NSSM_QUEUE_HEADER);
+	return len;
+}
+
+/* Remove the oldest record and return its length. */
+static uint32_t queue_remove(log_queue_t* queue, void* address)
+{
+	uint32_t len = queue_peek(queue);
+	if (!queue->records)
+		return 0;
+
+	if (address)
+		ring_read(queue, queue->head + NSSM_QUEUE_HEADER, address, len);
+	queue->head = (queue->head + NSSM_QUEUE_HEADER + len) % queue->size;
+	queue->used -= NSSM_QUEUE_HEADER + len;
+	if (!--queue->records)
+		queue->head = queue->used = 0;
+	return len;
+}
+
+/*
+  Copy the oldest record into a buffer of bufsize bytes and remove it.
+  Returns the length of the record, or 0 if the queue is empty or the
+  record doesn't fit.
+*/
+uint32_t queue_get(log_queue_t* queue, void* address, uint32_t bufsize)
+{
+	if (queue_peek(queue) > bufsize)
+		return 0;
+	return queue_remove(queue, address);
+}
+
+/* Discard the oldest record and return its length. */
+uint32_t queue_drop(log_queue_t* queue)
+{
+	return queue_remove(queue, 0);
+}
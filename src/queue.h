@@ -0,0 +1,54 @@
+/*******************************************************************************
+ queue.h - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+#pragma once
+
+#ifndef QUEUE_H
+#define QUEUE_H
+
+/* What to do with output when the queue is full (AppQueuePolicy). */
+#define NSSM_QUEUE_BLOCK        0
+#define NSSM_QUEUE_DROP_OLDEST  1
+#define NSSM_QUEUE_DROP_NEWEST  2
+#define NSSM_QUEUE_SPILL        3
+
+/* Bytes of output which may wait to be written (AppQueueBytes). */
+#define NSSM_QUEUE_SIZE         1048576
+#define NSSM_QUEUE_MIN          65536
+#define NSSM_QUEUE_MAX          268435456
+
+/* Each record is prefixed by its length. */
+#define NSSM_QUEUE_HEADER       sizeof(uint32_t)
+
+/*
+  Ring buffer of variable length records.
+  The caller is responsible for locking.
+*/
+typedef struct
+{
+	char* data;
+	uint32_t size;
+	uint32_t head;
+	uint32_t used;
+	uint32_t records;
+} log_queue_t;
+
+int32_t init_queue(log_queue_t*, uint32_t);
+void free_queue(log_queue_t*);
+bool queue_fits(log_queue_t*, uint32_t);
+bool queue_put(log_queue_t*, const void*, uint32_t);
+uint32_t queue_peek(log_queue_t*);
+uint32_t queue_get(log_queue_t*, void*, uint32_t);
+uint32_t queue_drop(log_queue_t*);
+
+#endif
@@ -0,0 +1,93 @@
+/*******************************************************************************
+ ratelimit.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "ratelimit.h"
+
+void init_rate_limit(rate_limit_t* limit, uint32_t bytes, uint32_t lines, uint32_t policy, uint32_t sample)
+{
+	ZeroMemory(limit, sizeof(*limit));
+	limit->bytes.rate = bytes;
+	limit->bytes.tokens = (int64_t)bytes * 1000;
+	limit->lines.rate = lines;
+	limit->lines.tokens = (int64_t)lines * 1000;
+	limit->policy = policy;
+	limit->sample = sample ? sample : NSSM_RATE_LIMIT_SAMPLE_DEFAULT;
+	limit->refilled_at = GetTickCount64();
+}
+
+bool want_rate_limit(rate_limit_t* limit)
+{
+	return limit->bytes.rate || limit->lines.rate;
+}
+
+static inline void refill_bucket(bucket_t* bucket, uint64_t elapsed)
+{
+	if (!bucket->rate)
+		return;
+
+	int64_t full = (int64_t)bucket->rate * 1000;
+	if (elapsed >= 1000)
+		bucket->tokens = full;
+	else
+	{
+		bucket->tokens += (int64_t)elapsed * bucket->rate;
+		if (bucket->tokens > full)
+			bucket->tokens = full;
+	}
+}
+
+/*
+  Top up the buckets for the time since the last call.  Call once per
+  chunk with GetTickCount64(), which reads shared memory rather than
+  making a system call.
+*/
+void refill_rate_limit(rate_limit_t* limit, uint64_t now)
+{
+	uint64_t elapsed = now - limit->refilled_at;
+	if (!elapsed)
+		return;
+
+	refill_bucket(&limit->bytes, elapsed);
+	refill_bucket(&limit->lines, elapsed);
+	limit->refilled_at = now;
+}
+
+/*
+  Decide whether a line of the given length should be written.
+  Sampled lines don't spend tokens, so they don't delay the stream's
+  return to within its limit.
+*/
+uint32_t admit_line(rate_limit_t* limit, uint32_t length)
+{
+	bool over = ((limit->bytes.rate && limit->bytes.tokens <= 0) || (limit->lines.rate && limit->lines.tokens <= 0));
+	if (over)
+	{
+		if (limit->policy == NSSM_RATE_LIMIT_SAMPLE && ++limit->skipped >= limit->sample)
+		{
+			limit->skipped = 0;
+			return NSSM_LINE_SAMPLED;
+		}
+		limit->dropped_lines++;
+		limit->dropped_bytes += length;
+		return NSSM_LINE_DROPPED;
+	}
+
+	if (limit->bytes.rate)
+		limit->bytes.tokens -= (int64_t)length * 1000;
+	if (limit->lines.rate)
+		limit->lines.tokens -= 1000;
+	return NSSM_LINE_ADMITTED;
+}
@@ -0,0 +1,68 @@
+/*******************************************************************************
+ ratelimit.h - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+#pragma once
+
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+/* What to do with lines over the rate limit (AppRateLimitPolicy). */
+#define NSSM_RATE_LIMIT_DROP    0
+#define NSSM_RATE_LIMIT_SAMPLE  1
+
+/* Write one in this many lines over the limit when sampling (AppRateLimitSample). */
+#define NSSM_RATE_LIMIT_SAMPLE_DEFAULT 100
+
+/* Milliseconds between counts of dropped lines while a stream is over its limit. */
+#define NSSM_RATE_LIMIT_REPORT  1000
+
+/* What admit_line() decided. */
+#define NSSM_LINE_DROPPED       0
+#define NSSM_LINE_ADMITTED      1
+#define NSSM_LINE_SAMPLED       2
+
+/*
+  Token bucket holding up to a second's worth of tokens, in thousandths
+  so that refilling every millisecond loses nothing to rounding.  A line
+  may take the bucket below zero, so lines longer than the rate still get
+  through at the right average.
+*/
+typedef struct
+{
+	int64_t tokens;
+	uint32_t rate;
+} bucket_t;
+
+/*
+  Rate limit for one stream.  Only the writing thread touches it, so it
+  needs no locks or atomics.
+*/
+typedef struct
+{
+	bucket_t bytes;
+	bucket_t lines;
+	uint64_t refilled_at;
+	uint32_t policy;
+	uint32_t sample;
+	uint32_t skipped;
+	uint64_t dropped_lines;
+	uint64_t dropped_bytes;
+	uint64_t report_at;
+} rate_limit_t;
+
+void init_rate_limit(rate_limit_t*, uint32_t, uint32_t, uint32_t, uint32_t);
+bool want_rate_limit(rate_limit_t*);
+void refill_rate_limit(rate_limit_t*, uint64_t);
+uint32_t admit_line(rate_limit_t*, uint32_t);
+
+#endif
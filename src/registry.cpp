@@ -236,6 +236,10 @@ int32_t create_parameters(nssm_service_t* service, bool editing)
 			set_createfile_parameter(key, regliterals::regstdout, regliterals::regcopytruncate, 1);
 		else if (editing)
 			delete_createfile_parameter(key, regliterals::regstdout, regliterals::regcopytruncate);
+		if (service->stdout_buffer_size)
+			set_createfile_parameter(key, regliterals::regstdout, regliterals::regbuffersize, service->stdout_buffer_size);
+		else if (editing)
+			delete_createfile_parameter(key, regliterals::regstdout, regliterals::regbuffersize);
 	}
 	if (service->stderr_path[0] || editing)
 	{
@@ -259,11 +263,91 @@ int32_t create_parameters(nssm_service_t* service, bool editing)
 			set_createfile_parameter(key, regliterals::regstderr, regliterals::regcopytruncate, 1);
 		else if (editing)
 			delete_createfile_parameter(key, regliterals::regstderr, regliterals::regcopytruncate);
+		if (service->stderr_buffer_size)
+			set_createfile_parameter(key, regliterals::regstderr, regliterals::regbuffersize, service->stderr_buffer_size);
+		else if (editing)
+			delete_createfile_parameter(key, regliterals::regstderr, regliterals::regbuffersize);
 	}
 	if (service->timestamp_log)
 		set_number(key, regliterals::regtimestamplog, 1);
 	else if (editing)
 		::RegDeleteValueW(key, regliterals::regtimestamplog);
+	if (service->stream_tag)
+		set_number(key, regliterals::regstreamtag, 1);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regstreamtag);
+	if (service->log_format)
+		set_number(key, regliterals::reglogformat, service->log_format);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::reglogformat);
+	if (service->log_encoding)
+		set_number(key, regliterals::reglogencoding, service->log_encoding);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::reglogencoding);
+	if (service->multiline)
+		set_number(key, regliterals::regmultiline, service->multiline);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regmultiline);
+	if (service->multiline_pattern[0])
+		set_expand_string(key, regliterals::regmultilinepattern.data(), service->multiline_pattern);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regmultilinepattern.data());
+	if (service->multiline_timeout && service->multiline_timeout != NSSM_MULTILINE_TIMEOUT)
+		set_number(key, regliterals::regmultilinetimeout, service->multiline_timeout);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regmultilinetimeout);
+	if (service->suppress_repeats)
+		set_number(key, regliterals::regsuppressrepeats, 1);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regsuppressrepeats);
+	if (service->repeat_interval && service->repeat_interval != NSSM_REPEAT_INTERVAL)
+		set_number(key, regliterals::regrepeatinterval, service->repeat_interval);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regrepeatinterval);
+	if (service->time_index)
+		set_number(key, regliterals::regtimeindex, 1);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regtimeindex);
+	if (service->time_index_bytes != NSSM_TIME_INDEX_BYTES)
+		set_number(key, regliterals::regtimeindexbytes, service->time_index_bytes);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regtimeindexbytes);
+	if (service->time_index_interval != NSSM_TIME_INDEX_INTERVAL)
+		set_number(key, regliterals::regtimeindexinterval, service->time_index_interval);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regtimeindexinterval);
+	if (service->queue_bytes && service->queue_bytes != NSSM_QUEUE_SIZE)
+		set_number(key, regliterals::regqueuebytes, service->queue_bytes);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regqueuebytes);
+	if (service->queue_policy != NSSM_QUEUE_BLOCK)
+		set_number(key, regliterals::regqueuepolicy, service->queue_policy);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regqueuepolicy);
+	if (service->queue_spill[0])
+		set_expand_string(key, regliterals::regqueuespill.data(), service->queue_spill);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regqueuespill.data());
+	if (service->forward[0])
+		set_expand_string(key, regliterals::regforward.data(), service->forward);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regforward.data());
+	if (service->forward_bytes && service->forward_bytes != NSSM_FORWARD_SIZE)
+		set_number(key, regliterals::regforwardbytes, service->forward_bytes);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regforwardbytes);
+	if (service->flush_interval)
+		set_number(key, regliterals::regflushinterval, service->flush_interval);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regflushinterval);
+	if (service->flush_bytes)
+		set_number(key, regliterals::regflushbytes, service->flush_bytes);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regflushbytes);
+	if (service->flush_rotate)
+		set_number(key, regliterals::regflushrotate, 1);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regflushrotate);
 	if (service->hook_share_output_handles)
 		set_number(key, regliterals::regredirecthook, 1);
 	else if (editing)
@@ -288,10 +372,54 @@ int32_t create_parameters(nssm_service_t* service, bool editing)
 		set_number(key, regliterals::regrotatebyteshigh, service->rotate_bytes_high);
 	else if (editing)
 		::RegDeleteValueW(key, regliterals::regrotatebyteshigh);
+	if (service->rate_limit_bytes)
+		set_number(key, regliterals::regratelimitbytes, service->rate_limit_bytes);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regratelimitbytes);
+	if (service->rate_limit_lines)
+		set_number(key, regliterals::regratelimitlines, service->rate_limit_lines);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regratelimitlines);
+	if (service->rate_limit_policy != NSSM_RATE_LIMIT_DROP)
+		set_number(key, regliterals::regratelimitpolicy, service->rate_limit_policy);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regratelimitpolicy);
+	if (service->rate_limit_sample && service->rate_limit_sample != NSSM_RATE_LIMIT_SAMPLE_DEFAULT)
+		set_number(key, regliterals::regratelimitsample, service->rate_limit_sample);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regratelimitsample);
 	if (service->rotate_delay != wait::rotatedelay)
 		set_number(key, regliterals::regrotatedelay, service->rotate_delay);
 	else if (editing)
 		::RegDeleteValueW(key, regliterals::regrotatedelay);
+	if (service->rotate_boundary)
+		set_number(key, regliterals::regrotateboundary, service->rotate_boundary);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regrotateboundary);
+	if (service->rotate_compress)
+		set_number(key, regliterals::regrotatecompress, service->rotate_compress);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regrotatecompress);
+	if (service->rotate_sequence)
+		set_number(key, regliterals::regrotatesequence, 1);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regrotatesequence);
+	if (service->rotate_keep_files)
+		set_number(key, regliterals::regrotatekeepfiles, service->rotate_keep_files);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regrotatekeepfiles);
+	if (service->rotate_keep_bytes_low)
+		set_number(key, regliterals::regrotatekeepbyteslow, service->rotate_keep_bytes_low);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regrotatekeepbyteslow);
+	if (service->rotate_keep_bytes_high)
+		set_number(key, regliterals::regrotatekeepbyteshigh, service->rotate_keep_bytes_high);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regrotatekeepbyteshigh);
+	if (service->rotate_keep_days)
+		set_number(key, regliterals::regrotatekeepdays, service->rotate_keep_days);
+	else if (editing)
+		::RegDeleteValueW(key, regliterals::regrotatekeepdays);
 	if (service->no_console)
 		set_number(key, regliterals::regnoconsole, 1);
 	else if (editing)
@@ -932,7 +1060,7 @@ HKEY open_registry(const wchar_t* service_name, REGSAM sam)
 int32_t get_io_parameters(nssm_service_t* service, HKEY key)
 {
 	/* stdin */
-	if (get_createfile_parameters(key, regliterals::regstdin, service->stdin_path, &service->stdin_sharing, NSSM_STDIN_SHARING, &service->stdin_disposition, NSSM_STDIN_DISPOSITION, &service->stdin_flags, NSSM_STDIN_FLAGS, 0))
+	if (get_createfile_parameters(key, regliterals::regstdin, service->stdin_path, &service->stdin_sharing, NSSM_STDIN_SHARING, &service->stdin_disposition, NSSM_STDIN_DISPOSITION, &service->stdin_flags, NSSM_STDIN_FLAGS, 0, 0))
 	{
 		service->stdin_sharing = service->stdin_disposition = service->stdin_flags = 0;
 		ZeroMemory(service->stdin_path, std::size(service->stdin_path) * sizeof(wchar_t));
@@ -940,7 +1068,7 @@ int32_t get_io_parameters(nssm_service_t* service, HKEY key)
 	}
 
 	/* stdout */
-	if (get_createfile_parameters(key, regliterals::regstdout, service->stdout_path, &service->stdout_sharing, NSSM_STDOUT_SHARING, &service->stdout_disposition, NSSM_STDOUT_DISPOSITION, &service->stdout_flags, NSSM_STDOUT_FLAGS, &service->stdout_copy_and_truncate))
+	if (get_createfile_parameters(key, regliterals::regstdout, service->stdout_path, &service->stdout_sharing, NSSM_STDOUT_SHARING, &service->stdout_disposition, NSSM_STDOUT_DISPOSITION, &service->stdout_flags, NSSM_STDOUT_FLAGS, &service->stdout_copy_and_truncate, &service->stdout_buffer_size))
 	{
 		service->stdout_sharing = service->stdout_disposition = service->stdout_flags = 0;
 		ZeroMemory(service->stdout_path, std::size(service->stdout_path) * sizeof(wchar_t));
@@ -948,7 +1076,7 @@ int32_t get_io_parameters(nssm_service_t* service, HKEY key)
 	}
 
 	/* stderr */
-	if (get_createfile_parameters(key, regliterals::regstderr, service->stderr_path, &service->stderr_sharing, NSSM_STDERR_SHARING, &service->stderr_disposition, NSSM_STDERR_DISPOSITION, &service->stderr_flags, NSSM_STDERR_FLAGS, &service->stderr_copy_and_truncate))
+	if (get_createfile_parameters(key, regliterals::regstderr, service->stderr_path, &service->stderr_sharing, NSSM_STDERR_SHARING, &service->stderr_disposition, NSSM_STDERR_DISPOSITION, &service->stderr_flags, NSSM_STDERR_FLAGS, &service->stderr_copy_and_truncate, &service->stderr_buffer_size))
 	{
 		service->stderr_sharing = service->stderr_disposition = service->stderr_flags = 0;
 		ZeroMemory(service->stderr_path, std::size(service->stderr_path) * sizeof(wchar_t));
@@ -1097,10 +1225,80 @@ int32_t get_parameters(nssm_service_t* service, STARTUPINFOW* si)
 	}
 	else
 		service->timestamp_log = false;
-
-	/* Hook I/O sharing and online rotation need a pipe. */
-	service->use_stdout_pipe = service->rotate_stdout_online || service->timestamp_log || hook_share_output_handles;
-	service->use_stderr_pipe = service->rotate_stderr_online || service->timestamp_log || hook_share_output_handles;
+	/* So does tagging each line with its stream. */
+	uint32_t stream_tag;
+	if (get_number(key, regliterals::regstreamtag, &stream_tag, false) == 1 && stream_tag)
+		service->stream_tag = true;
+	else
+		service->stream_tag = false;
+	/* As does writing records in another format or encoding. */
+	if (get_number(key, regliterals::reglogformat, &service->log_format, false) != 1 || service->log_format > NSSM_FORMAT_JSON)
+		service->log_format = NSSM_FORMAT_TEXT;
+	if (get_number(key, regliterals::reglogencoding, &service->log_encoding, false) != 1 || service->log_encoding > NSSM_ENCODING_UTF8)
+		service->log_encoding = NSSM_ENCODING_AS_IS;
+	/*
+    Grouping multi-line records only matters when lines are stamped, tagged
+    or written as records, any of which already means a pipe.
+  */
+	if (get_number(key, regliterals::regmultiline, &service->multiline, false) != 1 || service->multiline > NSSM_MULTILINE_PATTERN)
+		service->multiline = NSSM_MULTILINE_NONE;
+	if (get_string(key, regliterals::regmultilinepattern.data(), service->multiline_pattern, sizeof(service->multiline_pattern), false, false, false))
+		service->multiline_pattern[0] = L'\0';
+	if (get_number(key, regliterals::regmultilinetimeout, &service->multiline_timeout, false) != 1)
+		service->multiline_timeout = NSSM_MULTILINE_TIMEOUT;
+	/* As does suppressing repeated lines. */
+	uint32_t suppress_repeats;
+	if (get_number(key, regliterals::regsuppressrepeats, &suppress_repeats, false) == 1 && suppress_repeats)
+		service->suppress_repeats = true;
+	else
+		service->suppress_repeats = false;
+	if (get_number(key, regliterals::regrepeatinterval, &service->repeat_interval, false) != 1 || !service->repeat_interval)
+		service->repeat_interval = NSSM_REPEAT_INTERVAL;
+	/* As does keeping a time index. */
+	uint32_t time_index;
+	if (get_number(key, regliterals::regtimeindex, &time_index, false) == 1 && time_index)
+		service->time_index = true;
+	else
+		service->time_index = false;
+	if (get_number(key, regliterals::regtimeindexbytes, &service->time_index_bytes, false) != 1)
+		service->time_index_bytes = NSSM_TIME_INDEX_BYTES;
+	if (get_number(key, regliterals::regtimeindexinterval, &service->time_index_interval, false) != 1)
+		service->time_index_interval = NSSM_TIME_INDEX_INTERVAL;
+	/* And so does flushing on our own schedule. */
+	if (get_number(key, regliterals::regflushinterval, &service->flush_interval, false) != 1)
+		service->flush_interval = 0;
+	if (get_number(key, regliterals::regflushbytes, &service->flush_bytes, false) != 1)
+		service->flush_bytes = 0;
+	uint32_t flush_rotate;
+	if (get_number(key, regliterals::regflushrotate, &flush_rotate, false) == 1 && flush_rotate)
+		service->flush_rotate = true;
+	else
+		service->flush_rotate = false;
+	bool flush_log = service->flush_interval || service->flush_bytes || service->flush_rotate;
+	/* Rate limits are applied by the logger too. */
+	if (get_number(key, regliterals::regratelimitbytes, &service->rate_limit_bytes, false) != 1)
+		service->rate_limit_bytes = 0;
+	if (get_number(key, regliterals::regratelimitlines, &service->rate_limit_lines, false) != 1)
+		service->rate_limit_lines = 0;
+	if (get_number(key, regliterals::regratelimitpolicy, &service->rate_limit_policy, false) != 1 || service->rate_limit_policy > NSSM_RATE_LIMIT_SAMPLE)
+		service->rate_limit_policy = NSSM_RATE_LIMIT_DROP;
+	if (get_number(key, regliterals::regratelimitsample, &service->rate_limit_sample, false) != 1 || !service->rate_limit_sample)
+		service->rate_limit_sample = NSSM_RATE_LIMIT_SAMPLE_DEFAULT;
+	bool rate_limit = service->rate_limit_bytes || service->rate_limit_lines;
+	/* As is forwarding. */
+	if (get_string(key, regliterals::regforward.data(), service->forward, sizeof(service->forward), expand, false, false))
+		service->forward[0] = L'\0';
+	if (get_number(key, regliterals::regforwardbytes, &service->forward_bytes, false) != 1)
+		service->forward_bytes = NSSM_FORWARD_SIZE;
+
+	/*
+    Online rotation, timestamping, tagging, formatting, suppressing repeats,
+    time indexing, rate limiting, forwarding and flushing need a pipe.
+    Otherwise the application writes straight to the file and hooks sharing
+    output handles get a duplicate of the file handle.
+  */
+	service->use_stdout_pipe = service->rotate_stdout_online || service->timestamp_log || service->stream_tag || service->log_format || service->log_encoding || service->suppress_repeats || service->time_index || rate_limit || service->forward[0] || flush_log;
+	service->use_stderr_pipe = service->rotate_stderr_online || service->timestamp_log || service->stream_tag || service->log_format || service->log_encoding || service->suppress_repeats || service->time_index || rate_limit || service->forward[0] || flush_log;
 	if (get_number(key, regliterals::regrotateseconds, &service->rotate_seconds, false) != 1)
 		service->rotate_seconds = 0;
 	if (get_number(key, regliterals::regrotatebyteslow, &service->rotate_bytes_low, false) != 1)
@@ -1108,11 +1306,36 @@ int32_t get_parameters(nssm_service_t* service, STARTUPINFOW* si)
 	if (get_number(key, regliterals::regrotatebyteshigh, &service->rotate_bytes_high, false) != 1)
 		service->rotate_bytes_high = 0;
 	override_milliseconds(service->name, key, regliterals::regrotatedelay, &service->rotate_delay, wait::rotatedelay, NSSM_EVENT_BOGUS_THROTTLE);
+	if (get_number(key, regliterals::regrotateboundary, &service->rotate_boundary, false) != 1 || service->rotate_boundary > NSSM_ROTATE_BOUNDARY_DAY)
+		service->rotate_boundary = NSSM_ROTATE_BOUNDARY_NONE;
+	if (get_number(key, regliterals::regrotatecompress, &service->rotate_compress, false) != 1 || service->rotate_compress > NSSM_COMPRESS_MAX)
+		service->rotate_compress = NSSM_COMPRESS_NONE;
+	uint32_t rotate_sequence;
+	if (get_number(key, regliterals::regrotatesequence, &rotate_sequence, false) == 1 && rotate_sequence)
+		service->rotate_sequence = true;
+	else
+		service->rotate_sequence = false;
+	if (get_number(key, regliterals::regrotatekeepfiles, &service->rotate_keep_files, false) != 1)
+		service->rotate_keep_files = 0;
+	if (get_number(key, regliterals::regrotatekeepbyteslow, &service->rotate_keep_bytes_low, false) != 1)
+		service->rotate_keep_bytes_low = 0;
+	if (get_number(key, regliterals::regrotatekeepbyteshigh, &service->rotate_keep_bytes_high, false) != 1)
+		service->rotate_keep_bytes_high = 0;
+	if (get_number(key, regliterals::regrotatekeepdays, &service->rotate_keep_days, false) != 1)
+		service->rotate_keep_days = 0;
 
 	/* Try to get force new console setting - may fail. */
 	if (get_number(key, regliterals::regnoconsole, &service->no_console, false) != 1)
 		service->no_console = 0;
 
+	/* Try to get log queue settings - may fail. */
+	if (get_number(key, regliterals::regqueuebytes, &service->queue_bytes, false) != 1)
+		service->queue_bytes = NSSM_QUEUE_SIZE;
+	if (get_number(key, regliterals::regqueuepolicy, &service->queue_policy, false) != 1 || service->queue_policy > NSSM_QUEUE_SPILL)
+		service->queue_policy = NSSM_QUEUE_BLOCK;
+	if (get_string(key, regliterals::regqueuespill.data(), service->queue_spill, sizeof(service->queue_spill), expand, true, false))
+		service->queue_spill[0] = L'\0';
+
 	/* Change to startup directory in case stdout/stderr are relative paths. */
 	wchar_t cwd[nssmconst::pathlength];
 	GetCurrentDirectory(std::size(cwd), cwd);
@@ -49,14 +49,45 @@ constexpr std::wstring_view regsharemode                {L"ShareMode"};
 constexpr std::wstring_view regdisposition              {L"CreationDisposition"};                                   // NSSM_REG_STDIO_DISPOSITION
 constexpr std::wstring_view regstdioflags               {L"FlagsAndAttributes"};                                    // NSSM_REG_STDIO_FLAGS
 constexpr std::wstring_view regcopytruncate             {L"CopyAndTruncate"};                                       // NSSM_REG_STDIO_COPY_AND_TRUNCATE
+constexpr std::wstring_view regbuffersize               {L"BufferSize"};                                            // NSSM_REG_STDIO_BUFFER_SIZE
 constexpr std::wstring_view regredirecthook             {L"AppRedirectHook"};                                       // NSSM_REG_HOOK_SHARE_OUTPUT_HANDLES
 constexpr std::wstring_view regrotate                   {L"AppRotateFiles"};                                        // NSSM_REG_ROTATE
 constexpr std::wstring_view regrotateonline             {L"AppRotateOnline"};                                       // NSSM_REG_ROTATE_ONLINE
 constexpr std::wstring_view regrotateseconds            {L"AppRotateSeconds"};                                      // NSSM_REG_ROTATE_SECONDS
 constexpr std::wstring_view regrotatebyteslow           {L"AppRotateBytes"};                                        // NSSM_REG_ROTATE_BYTES_LOW
 constexpr std::wstring_view regrotatebyteshigh          {L"AppRotateBytesHigh"};                                    // NSSM_REG_ROTATE_BYTES_HIGH
+constexpr std::wstring_view regratelimitbytes           {L"AppRateLimitBytes"};                                     // NSSM_REG_RATE_LIMIT_BYTES
+constexpr std::wstring_view regratelimitlines           {L"AppRateLimitLines"};                                     // NSSM_REG_RATE_LIMIT_LINES
+constexpr std::wstring_view regratelimitpolicy          {L"AppRateLimitPolicy"};                                    // NSSM_REG_RATE_LIMIT_POLICY
+constexpr std::wstring_view regratelimitsample          {L"AppRateLimitSample"};                                    // NSSM_REG_RATE_LIMIT_SAMPLE
 constexpr std::wstring_view regrotatedelay              {L"AppRotateDelay"};                                        // NSSM_REG_ROTATE_DELAY
+constexpr std::wstring_view regrotateboundary           {L"AppRotateBoundary"};                                     // NSSM_REG_ROTATE_BOUNDARY
+constexpr std::wstring_view regrotatecompress           {L"AppRotateCompress"};                                     // NSSM_REG_ROTATE_COMPRESS
+constexpr std::wstring_view regrotatesequence           {L"AppRotateSequence"};                                     // NSSM_REG_ROTATE_SEQUENCE
+constexpr std::wstring_view regrotatekeepfiles          {L"AppRotateKeepFiles"};                                    // NSSM_REG_ROTATE_KEEP_FILES
+constexpr std::wstring_view regrotatekeepbyteslow       {L"AppRotateKeepBytes"};                                    // NSSM_REG_ROTATE_KEEP_BYTES_LOW
+constexpr std::wstring_view regrotatekeepbyteshigh      {L"AppRotateKeepBytesHigh"};                                // NSSM_REG_ROTATE_KEEP_BYTES_HIGH
+constexpr std::wstring_view regrotatekeepdays           {L"AppRotateKeepDays"};                                     // NSSM_REG_ROTATE_KEEP_DAYS
+constexpr std::wstring_view regqueuebytes               {L"AppQueueBytes"};                                         // NSSM_REG_QUEUE_BYTES
+constexpr std::wstring_view regqueuepolicy              {L"AppQueuePolicy"};                                        // NSSM_REG_QUEUE_POLICY
+constexpr std::wstring_view regqueuespill               {L"AppQueueSpill"};                                         // NSSM_REG_QUEUE_SPILL
+constexpr std::wstring_view regforward                  {L"AppForward"};                                            // NSSM_REG_FORWARD
+constexpr std::wstring_view regforwardbytes             {L"AppForwardBytes"};                                       // NSSM_REG_FORWARD_BYTES
+constexpr std::wstring_view regflushinterval            {L"AppFlushInterval"};                                      // NSSM_REG_FLUSH_INTERVAL
+constexpr std::wstring_view regflushbytes               {L"AppFlushBytes"};                                         // NSSM_REG_FLUSH_BYTES
+constexpr std::wstring_view regflushrotate              {L"AppFlushRotate"};                                        // NSSM_REG_FLUSH_ROTATE
 constexpr std::wstring_view regtimestamplog             {L"AppTimestampLog"};                                       // NSSM_REG_TIMESTAMP_LOG
+constexpr std::wstring_view regstreamtag                {L"AppStreamTag"};                                          // NSSM_REG_STREAM_TAG
+constexpr std::wstring_view reglogformat                {L"AppLogFormat"};                                          // NSSM_REG_LOG_FORMAT
+constexpr std::wstring_view reglogencoding              {L"AppLogEncoding"};                                        // NSSM_REG_LOG_ENCODING
+constexpr std::wstring_view regmultiline                {L"AppMultiline"};                                          // NSSM_REG_MULTILINE
+constexpr std::wstring_view regmultilinepattern         {L"AppMultilinePattern"};                                   // NSSM_REG_MULTILINE_PATTERN
+constexpr std::wstring_view regmultilinetimeout         {L"AppMultilineTimeout"};                                   // NSSM_REG_MULTILINE_TIMEOUT
+constexpr std::wstring_view regsuppressrepeats          {L"AppSuppressRepeats"};                                    // NSSM_REG_SUPPRESS_REPEATS
+constexpr std::wstring_view regrepeatinterval           {L"AppRepeatInterval"};                                     // NSSM_REG_REPEAT_INTERVAL
+constexpr std::wstring_view regtimeindex                {L"AppTimeIndex"};                                          // NSSM_REG_TIME_INDEX
+constexpr std::wstring_view regtimeindexbytes           {L"AppTimeIndexBytes"};                                     // NSSM_REG_TIME_INDEX_BYTES
+constexpr std::wstring_view regtimeindexinterval        {L"AppTimeIndexInterval"};                                  // NSSM_REG_TIME_INDEX_INTERVAL
 constexpr std::wstring_view regpriority                 {L"AppPriority"};                                           // NSSM_REG_PRIORITY
 constexpr std::wstring_view regaffinity                 {L"AppAffinity"};                                           // NSSM_REG_AFFINITY
 constexpr std::wstring_view regnoconsole                {L"AppNoConsole"};                                          // NSSM_REG_NO_CONSOLE
@@ -0,0 +1,390 @@
+/*******************************************************************************
+ retention.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "retention.h"
+
+/*
+  Removal of old rotated output files.
+
+  The directory is read once.  Everything we need - the rotation time and the
+  size - comes from the file name and the directory entry, so there is no
+  per-file open or stat.  Each file is remembered as a few integers and its
+  name is rebuilt from the rotation time and sequence number when it has to
+  be deleted, so a directory with tens of thousands of rotations costs a few
+  hundred kilobytes.
+
+  The rotation time is packed as the decimal number YYYYMMDDHHMMSSmmm, which
+  sorts in the same order as the times themselves.  With AppRotateSequence
+  the name also carries a number one higher than the last rotation's, which
+  orders rotations made in the same millisecond.  Rotations compressed with
+  gzip have .gz added to the name.
+*/
+
+static inline uint64_t pack_stamp(SYSTEMTIME* st)
+{
+	uint64_t stamp = st->wYear;
+	stamp = stamp * 100 + st->wMonth;
+	stamp = stamp * 100 + st->wDay;
+	stamp = stamp * 100 + st->wHour;
+	stamp = stamp * 100 + st->wMinute;
+	stamp = stamp * 100 + st->wSecond;
+	return stamp * 1000 + st->wMilliseconds;
+}
+
+static inline void unpack_stamp(uint64_t stamp, SYSTEMTIME* st)
+{
+	ZeroMemory(st, sizeof(*st));
+	st->wMilliseconds = (WORD)(stamp % 1000);
+	stamp /= 1000;
+	st->wSecond = (WORD)(stamp % 100);
+	stamp /= 100;
+	st->wMinute = (WORD)(stamp % 100);
+	stamp /= 100;
+	st->wHour = (WORD)(stamp % 100);
+	stamp /= 100;
+	st->wDay = (WORD)(stamp % 100);
+	stamp /= 100;
+	st->wMonth = (WORD)(stamp % 100);
+	st->wYear = (WORD)(stamp / 100);
+}
+
+static inline bool parse_digits(const wchar_t* s, uint32_t digits, uint64_t* value)
+{
+	for (uint32_t i = 0; i < digits; i++)
+	{
+		if (s[i] < L'0' || s[i] > L'9')
+			return false;
+		*value = *value * 10 + (uint64_t)(s[i] - L'0');
+	}
+	return true;
+}
+
+/*
+  Parse the len characters -YYYYMMDDTHHMMSS.mmm[-N] into a packed stamp and
+  a sequence number, which is zero if there isn't one.
+*/
+static bool parse_suffix(const wchar_t* s, size_t len, uint64_t* stamp, uint32_t* sequence)
+{
+	*stamp = 0;
+	*sequence = 0;
+	if (len < NSSM_ROTATED_SUFFIX_LEN || len > NSSM_ROTATED_SUFFIX_LEN + 1 + NSSM_ROTATED_SEQUENCE_DIGITS)
+		return false;
+	if (s[0] != L'-' || s[9] != L'T' || s[16] != L'.')
+		return false;
+	if (!parse_digits(s + 1, 8, stamp))
+		return false;
+	if (!parse_digits(s + 10, 6, stamp))
+		return false;
+	if (!parse_digits(s + 17, 3, stamp))
+		return false;
+	if (len == NSSM_ROTATED_SUFFIX_LEN)
+		return true;
+
+	uint64_t value = 0;
+	if (len == NSSM_ROTATED_SUFFIX_LEN + 1 || s[NSSM_ROTATED_SUFFIX_LEN] != L'-')
+		return false;
+	if (!parse_digits(s + NSSM_ROTATED_SUFFIX_LEN + 1, (uint32_t)(len - NSSM_ROTATED_SUFFIX_LEN - 1), &value))
+		return false;
+	if (!value || value > UINT32_MAX)
+		return false;
+	*sequence = (uint32_t)value;
+	return true;
+}
+
+/*
+  Rotated files are named <base>-YYYYMMDDTHHMMSS.mmm<ext> in UTC, followed
+  by -N before the extension if sequence isn't zero.
+*/
+void rotated_filename(wchar_t* path, wchar_t* rotated, uint32_t rotated_len, SYSTEMTIME* st, uint32_t sequence)
+{
+	if (!st)
+	{
+		SYSTEMTIME now;
+		st = &now;
+		GetSystemTime(st);
+	}
+
+	wchar_t buffer[nssmconst::pathlength];
+	memmove(buffer, path, sizeof(buffer));
+	wchar_t* ext = ::PathFindExtensionW(buffer);
+	wchar_t extension[nssmconst::pathlength];
+	if (sequence)
+		::_snwprintf_s(extension, std::size(extension), _TRUNCATE, L"-%04u%02u%02uT%02u%02u%02u.%03u-%u%s", st->wYear, st->wMonth, st->wDay, st->wHour, st->wMinute, st->wSecond, st->wMilliseconds, sequence, ext);
+	else
+		::_snwprintf_s(extension, std::size(extension), _TRUNCATE, L"-%04u%02u%02uT%02u%02u%02u.%03u%s", st->wYear, st->wMonth, st->wDay, st->wHour, st->wMinute, st->wSecond, st->wMilliseconds, ext);
+	*ext = _T('\0');
+	::_snwprintf_s(rotated, rotated_len, _TRUNCATE, L"%s%s", buffer, extension);
+}
+
+/* Newest first. */
+static int __cdecl compare_rotated(const void* a, const void* b)
+{
+	const rotated_file_t* x = (const rotated_file_t*)a;
+	const rotated_file_t* y = (const rotated_file_t*)b;
+	if (x->stamp != y->stamp)
+		return (x->stamp > y->stamp) ? -1 : 1;
+	if (x->sequence != y->sequence)
+		return (x->sequence > y->sequence) ? -1 : 1;
+	return 0;
+}
+
+bool want_retention(retention_t* retention)
+{
+	if (!retention)
+		return false;
+	return retention->files || retention->bytes || retention->days;
+}
+
+/* A directory scan for the rotations of one file. */
+typedef struct
+{
+	HANDLE find;
+	WIN32_FIND_DATAW data;
+	bool pending;
+	wchar_t* name;
+	size_t name_len;
+	wchar_t* ext;
+	size_t ext_len;
+} rotated_scan_t;
+
+/* Start listing the rotations of path.  Returns false if there are none. */
+static bool start_rotated_scan(wchar_t* path, rotated_scan_t* scan)
+{
+	/* Rotated names are <base>-YYYYMMDDTHHMMSS.mmm[-N]<ext>[.gz] in the same directory. */
+	wchar_t base[nssmconst::pathlength];
+	memmove(base, path, sizeof(base));
+	scan->ext = ::PathFindExtensionW(path);
+	scan->name = ::PathFindFileNameW(path);
+	scan->name_len = (size_t)(scan->ext - scan->name);
+	scan->ext_len = wcslen(scan->ext);
+	base[scan->ext - path] = L'\0';
+
+	wchar_t pattern[nssmconst::pathlength];
+	::_snwprintf_s(pattern, std::size(pattern), _TRUNCATE, L"%s-*%s*", base, scan->ext);
+
+	scan->pending = true;
+	scan->find = ::FindFirstFileExW(pattern, FindExInfoBasic, &scan->data, FindExSearchNameMatch, 0, FIND_FIRST_EX_LARGE_FETCH);
+	return scan->find != INVALID_HANDLE_VALUE;
+}
+
+/* Parse the len characters of filename, less any .gz, as the name of a rotation. */
+static bool parse_rotated_name(rotated_scan_t* scan, const wchar_t* filename, size_t len, rotated_file_t* file)
+{
+	if (len < scan->name_len + NSSM_ROTATED_SUFFIX_LEN + scan->ext_len)
+		return false;
+	/* The wildcard may have matched a longer base name. */
+	if (_wcsnicmp(filename, scan->name, scan->name_len) || _wcsnicmp(filename + len - scan->ext_len, scan->ext, scan->ext_len))
+		return false;
+	return parse_suffix(filename + scan->name_len, len - scan->name_len - scan->ext_len, &file->stamp, &file->sequence);
+}
+
+/* Next rotation in the scan.  Returns false at the end. */
+static bool next_rotated_file(rotated_scan_t* scan, rotated_file_t* file)
+{
+	for (;;)
+	{
+		if (!scan->pending && !::FindNextFileW(scan->find, &scan->data))
+			return false;
+		scan->pending = false;
+
+		if (scan->data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+		wchar_t* filename = scan->data.cFileName;
+		size_t len = wcslen(filename);
+		size_t gzip_len = std::size(NSSM_GZIP_EXTENSION) - 1;
+		/* Try the whole name first in case ext is itself .gz.  A copy still being written ends in .tmp and matches neither. */
+		file->gzip = false;
+		if (!parse_rotated_name(scan, filename, len, file))
+		{
+			if (len <= gzip_len || _wcsicmp(filename + len - gzip_len, NSSM_GZIP_EXTENSION))
+				continue;
+			if (!parse_rotated_name(scan, filename, len - gzip_len, file))
+				continue;
+			file->gzip = true;
+		}
+
+		ULARGE_INTEGER size;
+		size.LowPart = scan->data.nFileSizeLow;
+		size.HighPart = scan->data.nFileSizeHigh;
+		file->size = size.QuadPart;
+		return true;
+	}
+}
+
+static inline void end_rotated_scan(rotated_scan_t* scan)
+{
+	FindClose(scan->find);
+}
+
+/*
+  Find the rotations of path, newest first.  Returns the number found; the
+  caller must free *files with HeapFree() if it isn't zero.
+*/
+uint32_t find_rotated_files(wchar_t* path, rotated_file_t** files_ptr)
+{
+	*files_ptr = 0;
+
+	rotated_scan_t scan;
+	if (!start_rotated_scan(path, &scan))
+		return 0;
+
+	uint32_t count = 0;
+	uint32_t allocated = 256;
+	rotated_file_t* files = (rotated_file_t*)HeapAlloc(GetProcessHeap(), 0, allocated * sizeof(rotated_file_t));
+	if (!files)
+	{
+		end_rotated_scan(&scan);
+		log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_OUT_OF_MEMORY, L"files", L"find_rotated_files()", 0);
+		return 0;
+	}
+
+	rotated_file_t file;
+	while (next_rotated_file(&scan, &file))
+	{
+		if (count == allocated)
+		{
+			rotated_file_t* grown = (rotated_file_t*)HeapReAlloc(GetProcessHeap(), 0, files, allocated * 2 * sizeof(rotated_file_t));
+			if (!grown)
+			{
+				log_event(EVENTLOG_ERROR_TYPE, NSSM_EVENT_OUT_OF_MEMORY, L"files", L"find_rotated_files()", 0);
+				break;
+			}
+			files = grown;
+			allocated *= 2;
+		}
+		files[count++] = file;
+	}
+	end_rotated_scan(&scan);
+
+	if (!count)
+	{
+		HeapFree(GetProcessHeap(), 0, files);
+		return 0;
+	}
+
+	qsort(files, count, sizeof(rotated_file_t), compare_rotated);
+	*files_ptr = files;
+	return count;
+}
+
+/*
+  Sequence number for the next rotation of path: one more than the highest
+  on disk, or 1 if there is none.  This is a single pass over the directory
+  which keeps nothing, so it is cheap even with thousands of rotations.
+  Loggers then count on in memory.
+*/
+uint32_t next_rotated_sequence(wchar_t* path)
+{
+	uint32_t highest = 0;
+	rotated_scan_t scan;
+	if (start_rotated_scan(path, &scan))
+	{
+		rotated_file_t file;
+		while (next_rotated_file(&scan, &file))
+		{
+			if (file.sequence > highest)
+				highest = file.sequence;
+		}
+		end_rotated_scan(&scan);
+	}
+	return (highest < UINT32_MAX) ? highest + 1 : highest;
+}
+
+/* Name of a rotation found by find_rotated_files(). */
+void rotated_file_path(wchar_t* path, rotated_file_t* file, wchar_t* rotated, uint32_t rotated_len)
+{
+	SYSTEMTIME st;
+	unpack_stamp(file->stamp, &st);
+	rotated_filename(path, rotated, rotated_len, &st, file->sequence);
+	if (file->gzip)
+	{
+		size_t len = wcslen(rotated);
+		::_snwprintf_s(rotated + len, rotated_len - len, _TRUNCATE, L"%s", NSSM_GZIP_EXTENSION);
+	}
+}
+
+/* Time of a rotation as a FILETIME, in UTC like the name. */
+uint64_t rotated_file_time(rotated_file_t* file)
+{
+	SYSTEMTIME st;
+	FILETIME ft;
+	unpack_stamp(file->stamp, &st);
+	if (!SystemTimeToFileTime(&st, &ft))
+		return 0;
+
+	ULARGE_INTEGER time;
+	time.LowPart = ft.dwLowDateTime;
+	time.HighPart = ft.dwHighDateTime;
+	return time.QuadPart;
+}
+
+/* Delete rotations of path which fall outside the retention policy. */
+void apply_retention(wchar_t* service_name, wchar_t* path, retention_t* retention)
+{
+	if (!want_retention(retention))
+		return;
+
+	rotated_file_t* files;
+	uint32_t count = find_rotated_files(path, &files);
+	if (!count)
+		return;
+
+	/* Rotations stamped before this are too old. */
+	uint64_t cutoff = 0;
+	if (retention->days)
+	{
+		FILETIME ft;
+		GetSystemTimeAsFileTime(&ft);
+		ULARGE_INTEGER now;
+		now.LowPart = ft.dwLowDateTime;
+		now.HighPart = ft.dwHighDateTime;
+		now.QuadPart -= retention->days * 864000000000ULL;
+		ft.dwLowDateTime = now.LowPart;
+		ft.dwHighDateTime = now.HighPart;
+		SYSTEMTIME st;
+		if (FileTimeToSystemTime(&ft, &st))
+			cutoff = pack_stamp(&st);
+	}
+
+	uint64_t total = 0;
+	bool complained = false;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		total += files[i].size;
+		bool keep = (files[i].stamp >= cutoff);
+		if (retention->files && i >= retention->files)
+			keep = false;
+		if (retention->bytes && total > retention->bytes)
+			keep = false;
+		if (keep)
+			continue;
+
+		wchar_t rotated[nssmconst::pathlength];
+		rotated_file_path(path, &files[i], rotated, std::size(rotated));
+		delete_time_index(rotated);
+		if (!::DeleteFileW(rotated))
+		{
+			uint32_t error = GetLastError();
+			if (error != ERROR_FILE_NOT_FOUND && !complained)
+			{
+				log_event(EVENTLOG_WARNING_TYPE, NSSM_EVENT_RETENTION_FAILED, service_name, rotated, error_string(error), 0);
+				complained = true;
+			}
+		}
+	}
+
+	HeapFree(GetProcessHeap(), 0, files);
+}
@@ -0,0 +1,49 @@
+/*******************************************************************************
+ retention.h - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+#pragma once
+
+#ifndef RETENTION_H
+#define RETENTION_H
+
+/* Length of the -YYYYMMDDTHHMMSS.mmm suffix added by rotation. */
+#define NSSM_ROTATED_SUFFIX_LEN 20
+/* Most digits in the -N sequence number which may follow it. */
+#define NSSM_ROTATED_SEQUENCE_DIGITS 10
+
+/* Which rotated files to keep; zero means no limit. */
+typedef struct
+{
+	uint32_t files;
+	uint64_t bytes;
+	uint32_t days;
+} retention_t;
+
+/* A rotated file found by the directory scan. */
+typedef struct
+{
+	uint64_t stamp;
+	uint64_t size;
+	uint32_t sequence;
+	bool gzip;
+} rotated_file_t;
+
+void rotated_filename(wchar_t*, wchar_t*, uint32_t, SYSTEMTIME*, uint32_t);
+uint32_t find_rotated_files(wchar_t*, rotated_file_t**);
+uint32_t next_rotated_sequence(wchar_t*);
+void rotated_file_path(wchar_t*, rotated_file_t*, wchar_t*, uint32_t);
+uint64_t rotated_file_time(rotated_file_t*);
+bool want_retention(retention_t*);
+void apply_retention(wchar_t*, wchar_t*, retention_t*);
+
+#endif
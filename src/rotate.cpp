@@ -0,0 +1,139 @@
+/*******************************************************************************
+ rotate.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "rotate.h"
+
+/*
+  Rename the file at path, which we are writing through *handle, to
+  rotated and open a new file in its place, without closing it first.
+
+  Log files are opened with FILE_SHARE_DELETE so the live file can be
+  renamed while our handle is open.  Only once the replacement has been
+  opened do we switch handles and close the old one, so if anything fails
+  we simply carry on writing to the file we already have.
+
+  If the handle was opened without FILE_SHARE_DELETE, eg because of an
+  explicit ShareMode, the rename fails with a sharing violation and we fall
+  back to closing the file before moving it.  If that move fails too the
+  file is reopened with OPEN_ALWAYS, which *disposition keeps for later.
+
+  *error is ERROR_SUCCESS if the file was rotated, otherwise the reason it
+  wasn't, from the function named by *function.
+  Returns:  0 if there is a file to write, which is *handle.
+           -1 if there isn't.
+*/
+int32_t rename_live_file(const rotate_fs_t* fs, wchar_t* path, wchar_t* rotated, HANDLE* handle, uint32_t sharing, uint32_t* disposition, uint32_t flags, uint32_t* error, const wchar_t** function)
+{
+	*error = ERROR_SUCCESS;
+	*function = L"::MoveFileW()";
+	if (fs->move(path, rotated))
+	{
+		HANDLE file = fs->open(path, sharing, *disposition, flags);
+		if (file != INVALID_HANDLE_VALUE)
+		{
+			fs->close(handle);
+			*handle = file;
+			return 0;
+		}
+
+		/* Put the file back so we keep writing under its own name and a later rotation can find it. */
+		*error = ERROR_OPEN_FAILED;
+		*function = L"::CreateFileW()";
+		if (!fs->move(rotated, path))
+		{
+			/* We're stuck writing to the rotated file. */
+			*error = GetLastError();
+			*function = L"::MoveFileW()";
+		}
+		return 0;
+	}
+
+	*error = GetLastError();
+	if (*error != ERROR_SHARING_VIOLATION)
+		return 0;
+
+	/* We must risk closing the file before the move. */
+	fs->close(handle);
+	*error = ERROR_SUCCESS;
+	if (!fs->move(path, rotated))
+	{
+		*error = GetLastError();
+		/* We can at least try to re-open the existing file. */
+		*disposition = OPEN_ALWAYS;
+	}
+
+	*handle = fs->open(path, sharing, *disposition, flags);
+	if (*handle == INVALID_HANDLE_VALUE)
+	{
+		/* Oh dear.  Now we can't log anything further. */
+		*handle = 0;
+		return -1;
+	}
+	return 0;
+}
+
+/* Start of the next local hour or day after now, as UTC. */
+uint64_t next_boundary(uint32_t boundary, uint64_t now)
+{
+	ULARGE_INTEGER t;
+	t.QuadPart = now;
+	FILETIME ft;
+	ft.dwLowDateTime = t.LowPart;
+	ft.dwHighDateTime = t.HighPart;
+
+	SYSTEMTIME utc, local;
+	if (!FileTimeToSystemTime(&ft, &utc) || !SystemTimeToTzSpecificLocalTime(nullptr, &utc, &local))
+		return 0;
+
+	/*
+	  The local hour started this long ago, whatever the offset from UTC,
+	  and the next one starts an hour after that even when the clocks change.
+	*/
+	if (boundary == NSSM_ROTATE_BOUNDARY_HOUR)
+		return now - (local.wMinute * 60ULL + local.wSecond) * 10000000ULL - local.wMilliseconds * 10000ULL + 36000000000ULL;
+
+	/* Step forward in local time so that a day may be 23 or 25 hours long. */
+	local.wHour = local.wMinute = local.wSecond = local.wMilliseconds = 0;
+	SystemTimeToFileTime(&local, &ft);
+	t.LowPart = ft.dwLowDateTime;
+	t.HighPart = ft.dwHighDateTime;
+	t.QuadPart += 864000000000ULL;
+	ft.dwLowDateTime = t.LowPart;
+	ft.dwHighDateTime = t.HighPart;
+
+	if (!FileTimeToSystemTime(&ft, &local) || !TzSpecificLocalTimeToSystemTime(nullptr, &local, &utc))
+		return 0;
+	SystemTimeToFileTime(&utc, &ft);
+	t.LowPart = ft.dwLowDateTime;
+	t.HighPart = ft.dwHighDateTime;
+	return t.QuadPart;
+}
+
+/* When a file started at now should be rotated on time; 0 for never. */
+uint64_t next_rotation(uint32_t seconds, uint32_t boundary, uint64_t now)
+{
+	uint64_t at = 0;
+	if (seconds)
+		at = now + seconds * 10000000ULL;
+	if (boundary)
+	{
+		uint64_t next = next_boundary(boundary, now);
+		if (next && (!at || next < at))
+			at = next;
+	}
+	return at;
+}
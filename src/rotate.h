@@ -0,0 +1,44 @@
+/*******************************************************************************
+ rotate.h - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#pragma once
+
+#ifndef ROTATE_H
+#define ROTATE_H
+
+/* Calendar boundaries for online rotation, in local time. */
+#define NSSM_ROTATE_BOUNDARY_NONE      0
+#define NSSM_ROTATE_BOUNDARY_HOUR      1
+#define NSSM_ROTATE_BOUNDARY_DAY       2
+
+/* Seconds before a failed timed rotation is tried again. */
+#define NSSM_ROTATE_RETRY              60
+
+/*
+  The file operations used to rotate a file we have open, so the steps can
+  be followed without a real filesystem.  Failures are reported with
+  SetLastError() as the Win32 functions do.
+*/
+typedef struct
+{
+	bool (*move)(wchar_t*, wchar_t*);
+	HANDLE (*open)(wchar_t*, uint32_t, uint32_t, uint32_t);
+	void (*close)(HANDLE*);
+} rotate_fs_t;
+
+uint64_t next_boundary(uint32_t, uint64_t);
+uint64_t next_rotation(uint32_t, uint32_t, uint64_t);
+int32_t rename_live_file(const rotate_fs_t*, wchar_t*, wchar_t*, HANDLE*, uint32_t, uint32_t*, uint32_t, uint32_t*, const wchar_t**);
+
+#endif
@@ -0,0 +1,290 @@
+/*******************************************************************************
+ scan.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "scan.h"
+
+/*
+  Vectorised scanning of application output.
+
+  The scanners build a bitmask of matching byte positions for each block of
+  16 (SSE2) or 32 (AVX2) bytes and then walk the set bits, so the cost is
+  mostly independent of how many matches there are.  Anything left over at
+  the end of the buffer is handled one character at a time.
+
+  For UTF-16LE data a newline is the code unit 0x000A, ie 0x0A followed by
+  0x00 at an even offset.  Blocks are always an even number of bytes from
+  the start of the buffer so we can compare 16-bit lanes directly.
+*/
+
+#ifdef NSSM_SCAN_SIMD
+bool have_avx2()
+{
+	static int32_t avx2 = -1;
+	if (avx2 >= 0)
+		return avx2 != 0;
+
+	int32_t info[4];
+	avx2 = 0;
+	__cpuid(info, 0);
+	if (info[0] >= 7)
+	{
+		/* The OS must save YMM state as well as the CPU supporting AVX. */
+		__cpuid(info, 1);
+		if ((info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6)
+		{
+			__cpuidex(info, 7, 0);
+			if (info[1] & (1 << 5))
+				avx2 = 1;
+		}
+	}
+
+	return avx2 != 0;
+}
+
+/* Record each set bit of a block mask as a line ending. */
+static inline bool collect_line_ends(uint32_t mask, uint32_t base, uint32_t charsize, uint32_t* ends, uint32_t* count, uint32_t max)
+{
+	while (mask)
+	{
+		ends[(*count)++] = base + (uint32_t)std::countr_zero(mask) + charsize;
+		if (*count == max)
+			return true;
+		mask &= mask - 1;
+	}
+	return false;
+}
+#endif
+
+/*
+  Find the end of every line in a buffer in a single pass.
+
+  ends receives the offset just past each newline, ie the start of the
+  following line.  charsize is 1 for UTF-8/ANSI and 2 for UTF-16LE.
+
+  Returns the number of line endings found, which is at most max.  If it
+  returns max the caller should scan again from the last ending.
+*/
+uint32_t find_line_ends(const void* address, uint32_t bufsize, uint32_t charsize, uint32_t* ends, uint32_t max)
+{
+	const uint8_t* buffer = (const uint8_t*)address;
+	uint32_t count = 0;
+	uint32_t i = 0;
+
+	if (!max)
+		return 0;
+
+#ifdef NSSM_SCAN_SIMD
+	if (have_avx2())
+	{
+		const __m256i newline = (charsize == sizeof(wchar_t)) ? _mm256_set1_epi16(0x000a) : _mm256_set1_epi8('\n');
+		for (; i + 32 <= bufsize; i += 32)
+		{
+			__m256i block = _mm256_loadu_si256((const __m256i*)(buffer + i));
+			uint32_t mask;
+			if (charsize == sizeof(wchar_t))
+				mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi16(block, newline)) & 0x55555555;
+			else
+				mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline));
+			if (collect_line_ends(mask, i, charsize, ends, &count, max))
+				return count;
+		}
+	}
+
+	{
+		const __m128i newline = (charsize == sizeof(wchar_t)) ? _mm_set1_epi16(0x000a) : _mm_set1_epi8('\n');
+		for (; i + 16 <= bufsize; i += 16)
+		{
+			__m128i block = _mm_loadu_si128((const __m128i*)(buffer + i));
+			uint32_t mask;
+			if (charsize == sizeof(wchar_t))
+				mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi16(block, newline)) & 0x5555;
+			else
+				mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+			if (collect_line_ends(mask, i, charsize, ends, &count, max))
+				return count;
+		}
+	}
+#endif
+
+	/* Scalar fallback and tail. */
+	if (charsize == sizeof(wchar_t))
+	{
+		for (; i + 1 < bufsize; i += 2)
+		{
+			if (buffer[i] == '\n' && !buffer[i + 1])
+			{
+				ends[count++] = i + 2;
+				if (count == max)
+					return count;
+			}
+		}
+	}
+	else
+	{
+		for (; i < bufsize; i++)
+		{
+			if (buffer[i] == '\n')
+			{
+				ends[count++] = i + 1;
+				if (count == max)
+					return count;
+			}
+		}
+	}
+
+	return count;
+}
+
+/* Count the newlines in a buffer without recording where they are. */
+uint32_t count_line_ends(const void* address, uint32_t bufsize, uint32_t charsize)
+{
+	const uint8_t* buffer = (const uint8_t*)address;
+	uint32_t count = 0;
+	uint32_t i = 0;
+
+#ifdef NSSM_SCAN_SIMD
+	if (have_avx2())
+	{
+		const __m256i newline = (charsize == sizeof(wchar_t)) ? _mm256_set1_epi16(0x000a) : _mm256_set1_epi8('\n');
+		for (; i + 32 <= bufsize; i += 32)
+		{
+			__m256i block = _mm256_loadu_si256((const __m256i*)(buffer + i));
+			uint32_t mask;
+			if (charsize == sizeof(wchar_t))
+				mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi16(block, newline)) & 0x55555555;
+			else
+				mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline));
+			count += (uint32_t)std::popcount(mask);
+		}
+	}
+
+	{
+		const __m128i newline = (charsize == sizeof(wchar_t)) ? _mm_set1_epi16(0x000a) : _mm_set1_epi8('\n');
+		for (; i + 16 <= bufsize; i += 16)
+		{
+			__m128i block = _mm_loadu_si128((const __m128i*)(buffer + i));
+			uint32_t mask;
+			if (charsize == sizeof(wchar_t))
+				mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi16(block, newline)) & 0x5555;
+			else
+				mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+			count += (uint32_t)std::popcount(mask);
+		}
+	}
+#endif
+
+	/* Scalar fallback and tail. */
+	if (charsize == sizeof(wchar_t))
+	{
+		for (; i + 1 < bufsize; i += 2)
+			if (buffer[i] == '\n' && !buffer[i + 1])
+				count++;
+	}
+	else
+	{
+		for (; i < bufsize; i++)
+			if (buffer[i] == '\n')
+				count++;
+	}
+
+	return count;
+}
+
+/*
+  Count the NUL bytes at even and odd offsets in a buffer.
+  UTF-16LE text in the ASCII range has a NUL at every odd offset.
+*/
+void count_nuls(const void* address, uint32_t bufsize, uint32_t* even, uint32_t* odd)
+{
+	const uint8_t* buffer = (const uint8_t*)address;
+	uint32_t even_count = 0;
+	uint32_t odd_count = 0;
+	uint32_t i = 0;
+
+#ifdef NSSM_SCAN_SIMD
+	if (have_avx2())
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		for (; i + 32 <= bufsize; i += 32)
+		{
+			__m256i block = _mm256_loadu_si256((const __m256i*)(buffer + i));
+			uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, zero));
+			even_count += (uint32_t)std::popcount(mask & 0x55555555);
+			odd_count += (uint32_t)std::popcount(mask & 0xaaaaaaaa);
+		}
+	}
+
+	{
+		const __m128i zero = _mm_setzero_si128();
+		for (; i + 16 <= bufsize; i += 16)
+		{
+			__m128i block = _mm_loadu_si128((const __m128i*)(buffer + i));
+			uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, zero));
+			even_count += (uint32_t)std::popcount(mask & 0x5555);
+			odd_count += (uint32_t)std::popcount(mask & 0xaaaa);
+		}
+	}
+#endif
+
+	/* Scalar fallback and tail.  Blocks are an even number of bytes so i is even here. */
+	for (; i < bufsize; i++)
+	{
+		if (buffer[i])
+			continue;
+		if (i & 1)
+			odd_count++;
+		else
+			even_count++;
+	}
+
+	*even = even_count;
+	*odd = odd_count;
+}
+
+static inline uint64_t hash_mix(uint64_t h)
+{
+	h ^= h >> 32;
+	h *= 0xd6e8feb86659fd93ULL;
+	h ^= h >> 32;
+	return h;
+}
+
+/*
+  Fast non-cryptographic 64-bit hash, for telling lines apart.
+  Eight bytes are mixed in per multiply; the tail is read as one word.
+*/
+uint64_t hash_bytes(const void* address, uint32_t bufsize)
+{
+	const uint8_t* buffer = (const uint8_t*)address;
+	uint64_t h = 0x9e3779b97f4a7c15ULL ^ (uint64_t)bufsize;
+	uint32_t i = 0;
+	for (; i + 8 <= bufsize; i += 8)
+	{
+		uint64_t word;
+		memcpy(&word, buffer + i, sizeof(word));
+		h = (h ^ word) * 0x9e3779b97f4a7c15ULL;
+		h ^= h >> 29;
+	}
+
+	if (i < bufsize)
+	{
+		uint64_t word = 0;
+		memcpy(&word, buffer + i, bufsize - i);
+		h = (h ^ word) * 0x9e3779b97f4a7c15ULL;
+	}
+
+	return hash_mix(h);
+}
@@ -0,0 +1,34 @@
+/*******************************************************************************
+ scan.h - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+#pragma once
+
+#ifndef SCAN_H
+#define SCAN_H
+
+/* How many line endings to collect per call when splitting a buffer. */
+#define NSSM_LINE_ENDS 1024
+
+#if defined(_M_X64) || defined(_M_IX86)
+#define NSSM_SCAN_SIMD
+#endif
+
+#ifdef NSSM_SCAN_SIMD
+bool have_avx2();
+#endif
+uint32_t find_line_ends(const void*, uint32_t, uint32_t, uint32_t*, uint32_t);
+uint32_t count_line_ends(const void*, uint32_t, uint32_t);
+void count_nuls(const void*, uint32_t, uint32_t*, uint32_t*);
+uint64_t hash_bytes(const void*, uint32_t);
+
+#endif
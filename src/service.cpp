@@ -1029,6 +1029,11 @@ void set_nssm_service_defaults(nssm_service_t* service)
 	service->kill_window_delay = wait::kill_window_grace_period;
 	service->kill_threads_delay = wait::kill_threads_grace_period;
 	service->kill_process_tree = 1;
+	service->multiline_timeout = NSSM_MULTILINE_TIMEOUT;
+	service->repeat_interval = NSSM_REPEAT_INTERVAL;
+	service->time_index_bytes = NSSM_TIME_INDEX_BYTES;
+	service->time_index_interval = NSSM_TIME_INDEX_INTERVAL;
+	service->rate_limit_sample = NSSM_RATE_LIMIT_SAMPLE_DEFAULT;
 }
 
 /* Allocate and zero memory for a service. */
@@ -77,6 +77,7 @@ struct nssm_service_t
 	uint32_t stdout_sharing;
 	uint32_t stdout_disposition;
 	uint32_t stdout_flags;
+	uint32_t stdout_buffer_size;
 	bool use_stdout_pipe;
 	HANDLE stdout_si;
 	HANDLE stdout_pipe;
@@ -86,6 +87,7 @@ struct nssm_service_t
 	uint32_t stderr_sharing;
 	uint32_t stderr_disposition;
 	uint32_t stderr_flags;
+	uint32_t stderr_buffer_size;
 	bool use_stderr_pipe;
 	HANDLE stderr_si;
 	HANDLE stderr_pipe;
@@ -94,6 +96,17 @@ struct nssm_service_t
 	bool hook_share_output_handles;
 	bool rotate_files;
 	bool timestamp_log;
+	bool stream_tag;
+	uint32_t log_format;
+	uint32_t log_encoding;
+	uint32_t multiline;
+	wchar_t multiline_pattern[VALUE_LENGTH];
+	uint32_t multiline_timeout;
+	bool suppress_repeats;
+	uint32_t repeat_interval;
+	bool time_index;
+	uint32_t time_index_bytes;
+	uint32_t time_index_interval;
 	bool stdout_copy_and_truncate;
 	bool stderr_copy_and_truncate;
 	uint32_t rotate_stdout_online;
@@ -101,7 +114,26 @@ struct nssm_service_t
 	uint32_t rotate_seconds;
 	uint32_t rotate_bytes_low;
 	uint32_t rotate_bytes_high;
+	uint32_t rate_limit_bytes;
+	uint32_t rate_limit_lines;
+	uint32_t rate_limit_policy;
+	uint32_t rate_limit_sample;
 	uint32_t rotate_delay;
+	uint32_t rotate_boundary;
+	uint32_t rotate_compress;
+	bool rotate_sequence;
+	uint32_t rotate_keep_files;
+	uint32_t rotate_keep_bytes_low;
+	uint32_t rotate_keep_bytes_high;
+	uint32_t rotate_keep_days;
+	uint32_t queue_bytes;
+	uint32_t queue_policy;
+	wchar_t queue_spill[nssmconst::dirlength];
+	wchar_t forward[nssmconst::pathlength];
+	uint32_t forward_bytes;
+	uint32_t flush_interval;
+	uint32_t flush_bytes;
+	bool flush_rotate;
 	uint32_t default_exit_action;
 	uint32_t restart_delay;
 	uint32_t throttle_delay;
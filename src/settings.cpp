@@ -1859,11 +1859,13 @@ settings_t settings[] = {
 	{regliterals::regstdout regliterals::regdisposition, REG_DWORD, (void*)NSSM_STDOUT_DISPOSITION, false, 0, setting_set_number, setting_get_number, 0},
 	{regliterals::regstdout regliterals::regstdioflags, REG_DWORD, (void*)NSSM_STDOUT_FLAGS, false, 0, setting_set_number, setting_get_number, 0},
 	{regliterals::regstdout regliterals::regcopytruncate, REG_DWORD, 0, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::regstdout regliterals::regbuffersize, REG_DWORD, 0, false, 0, setting_set_number, setting_get_number, 0},
 	{regliterals::regstderr, REG_EXPAND_SZ, nullptr, false, 0, setting_set_string, setting_get_string, 0},
 	{regliterals::regstderr regliterals::regsharemode, REG_DWORD, (void*)NSSM_STDERR_SHARING, false, 0, setting_set_number, setting_get_number, 0},
 	{regliterals::regstderr regliterals::regdisposition, REG_DWORD, (void*)NSSM_STDERR_DISPOSITION, false, 0, setting_set_number, setting_get_number, 0},
 	{regliterals::regstderr regliterals::regstdioflags, REG_DWORD, (void*)NSSM_STDERR_FLAGS, false, 0, setting_set_number, setting_get_number, 0},
 	{regliterals::regstderr regliterals::regcopytruncate, REG_DWORD, 0, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::regstderr regliterals::regbuffersize, REG_DWORD, 0, false, 0, setting_set_number, setting_get_number, 0},
 	{regliterals::regstopmethodskip, REG_DWORD, 0, false, 0, setting_set_number, setting_get_number, 0},
 	{regliterals::regkillconsolegraceperiod, REG_DWORD, (void*)wait::kill_console_grace_period, false, 0, setting_set_number, setting_get_number, 0},
 	{regliterals::regkillwindowgraceperiod, REG_DWORD, (void*)wait::kill_window_grace_period, false, 0, setting_set_number, setting_get_number, 0},
@@ -1876,8 +1878,38 @@ settings_t settings[] = {
 	{regliterals::regrotateseconds, REG_DWORD, 0, false, 0, setting_set_number, setting_get_number, 0},
 	{regliterals::regrotatebyteslow, REG_DWORD, 0, false, 0, setting_set_number, setting_get_number, 0},
 	{regliterals::regrotatebyteshigh, REG_DWORD, 0, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::regratelimitbytes, REG_DWORD, 0, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::regratelimitlines, REG_DWORD, 0, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::regratelimitpolicy, REG_DWORD, (void*)NSSM_RATE_LIMIT_DROP, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::regratelimitsample, REG_DWORD, (void*)NSSM_RATE_LIMIT_SAMPLE_DEFAULT, false, 0, setting_set_number, setting_get_number, 0},
 	{regliterals::regrotatedelay, REG_DWORD, (void*)wait::rotatedelay, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::regrotateboundary, REG_DWORD, 0, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::regrotatecompress, REG_DWORD, 0, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::regrotatesequence, REG_DWORD, 0, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::regrotatekeepfiles, REG_DWORD, 0, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::regrotatekeepbyteslow, REG_DWORD, 0, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::regrotatekeepbyteshigh, REG_DWORD, 0, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::regrotatekeepdays, REG_DWORD, 0, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::regqueuebytes, REG_DWORD, (void*)NSSM_QUEUE_SIZE, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::regqueuepolicy, REG_DWORD, (void*)NSSM_QUEUE_BLOCK, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::regqueuespill, REG_EXPAND_SZ, nullptr, false, 0, setting_set_string, setting_get_string, 0},
+	{regliterals::regforward, REG_EXPAND_SZ, nullptr, false, 0, setting_set_string, setting_get_string, 0},
+	{regliterals::regforwardbytes, REG_DWORD, (void*)NSSM_FORWARD_SIZE, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::regflushinterval, REG_DWORD, 0, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::regflushbytes, REG_DWORD, 0, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::regflushrotate, REG_DWORD, 0, false, 0, setting_set_number, setting_get_number, 0},
 	{regliterals::regtimestamplog, REG_DWORD, 0, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::regstreamtag, REG_DWORD, 0, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::reglogformat, REG_DWORD, 0, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::reglogencoding, REG_DWORD, 0, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::regmultiline, REG_DWORD, 0, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::regmultilinepattern, REG_EXPAND_SZ, nullptr, false, 0, setting_set_string, setting_get_string, 0},
+	{regliterals::regmultilinetimeout, REG_DWORD, (void*)NSSM_MULTILINE_TIMEOUT, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::regsuppressrepeats, REG_DWORD, 0, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::regrepeatinterval, REG_DWORD, (void*)NSSM_REPEAT_INTERVAL, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::regtimeindex, REG_DWORD, 0, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::regtimeindexbytes, REG_DWORD, (void*)NSSM_TIME_INDEX_BYTES, false, 0, setting_set_number, setting_get_number, 0},
+	{regliterals::regtimeindexinterval, REG_DWORD, (void*)NSSM_TIME_INDEX_INTERVAL, false, 0, setting_set_number, setting_get_number, 0},
 	{nativeliterals::dependongroup.data(), REG_MULTI_SZ, nullptr, true, additionalarg::crlf, native_set_dependongroup, native_get_dependongroup, native_dump_dependongroup},
 	{nativeliterals::dependonservice.data(), REG_MULTI_SZ, nullptr, true, additionalarg::crlf, native_set_dependonservice, native_get_dependonservice, native_dump_dependonservice},
 	{nativeliterals::description.data(), REG_SZ, L"", true, 0, native_set_description, native_get_description, 0},
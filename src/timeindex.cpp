@@ -0,0 +1,334 @@
+/*******************************************************************************
+ timeindex.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "timeindex.h"
+
+/*
+  Sidecar time index.
+
+  While a stream is written the logger appends a 16-byte entry to
+  <file>.idx every so many bytes or every so often, whichever comes first,
+  giving the time and the offset of the next byte to be written.  Keeping
+  it up costs a comparison per write and one small append per interval.
+  A reader binary searches the index to find where a time window starts
+  and ends, reading a handful of entries however big the file is.  The
+  index is rotated, copied and deleted along with its file.
+*/
+
+void time_index_path(const wchar_t* path, wchar_t* index_path, uint32_t len)
+{
+	::_snwprintf_s(index_path, len, _TRUNCATE, L"%s%s", path, NSSM_TIME_INDEX_SUFFIX);
+}
+
+static bool read_entry(HANDLE index, uint64_t i, time_index_entry_t* entry)
+{
+	LARGE_INTEGER offset;
+	offset.QuadPart = (int64_t)(i * sizeof(*entry));
+	unsigned long got;
+	if (!SetFilePointerEx(index, offset, 0, FILE_BEGIN))
+		return false;
+	return ReadFile(index, entry, sizeof(*entry), &got, 0) && got == sizeof(*entry);
+}
+
+/*
+  Open the index of a file which is file_size bytes long, ready to append.
+  An index which doesn't describe the file as it is now, because the file
+  is new or was truncated behind our back, is started afresh.  So is a
+  torn last entry.  Returns 0 on failure.
+*/
+HANDLE open_time_index(const wchar_t* path, int64_t file_size)
+{
+	wchar_t index_path[nssmconst::pathlength];
+	time_index_path(path, index_path, std::size(index_path));
+
+	/* Readers may look at the index at any time and it is renamed with the file. */
+	HANDLE index = ::CreateFileW(index_path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	if (index == INVALID_HANDLE_VALUE)
+		return 0;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(index, &size))
+		size.QuadPart = 0;
+
+	LARGE_INTEGER keep;
+	keep.QuadPart = file_size ? size.QuadPart - size.QuadPart % (int64_t)sizeof(time_index_entry_t) : 0;
+	if (keep.QuadPart)
+	{
+		time_index_entry_t last;
+		if (!read_entry(index, (uint64_t)keep.QuadPart / sizeof(last) - 1, &last) || last.offset > (uint64_t)file_size)
+			keep.QuadPart = 0;
+	}
+
+	if (!SetFilePointerEx(index, keep, 0, FILE_BEGIN) || (keep.QuadPart != size.QuadPart && !SetEndOfFile(index)))
+	{
+		CloseHandle(index);
+		return 0;
+	}
+	return index;
+}
+
+/* Note that output from offset onwards is written from now on. */
+bool append_time_index(HANDLE index, int64_t offset)
+{
+	FILETIME now;
+	GetSystemTimeAsFileTime(&now);
+
+	time_index_entry_t entry;
+	entry.time = ((uint64_t)now.dwHighDateTime << 32) | now.dwLowDateTime;
+	entry.offset = (uint64_t)offset;
+
+	unsigned long written;
+	return WriteFile(index, &entry, sizeof(entry), &written, 0) && written == sizeof(entry);
+}
+
+/*
+  Give a file's index to its rotation.  After copy and truncate the
+  original is left for open_time_index() to start afresh.
+*/
+void move_time_index(const wchar_t* path, const wchar_t* rotated, bool copy)
+{
+	wchar_t index_path[nssmconst::pathlength];
+	wchar_t rotated_index_path[nssmconst::pathlength];
+	time_index_path(path, index_path, std::size(index_path));
+	time_index_path(rotated, rotated_index_path, std::size(rotated_index_path));
+
+	if (copy)
+		::CopyFileW(index_path, rotated_index_path, FALSE);
+	else
+		::MoveFileExW(index_path, rotated_index_path, MOVEFILE_REPLACE_EXISTING);
+}
+
+void delete_time_index(const wchar_t* path)
+{
+	wchar_t index_path[nssmconst::pathlength];
+	time_index_path(path, index_path, std::size(index_path));
+	::DeleteFileW(index_path);
+}
+
+/* Index of the last entry at or before time, or -1 if there is none. */
+static int64_t last_entry_before(HANDLE index, uint64_t entries, uint64_t time, time_index_entry_t* found)
+{
+	uint64_t low = 0;
+	uint64_t high = entries;
+	while (low < high)
+	{
+		uint64_t mid = low + (high - low) / 2;
+		time_index_entry_t entry;
+		if (!read_entry(index, mid, &entry))
+			return -1;
+		if (entry.time <= time)
+		{
+			*found = entry;
+			low = mid + 1;
+		}
+		else
+			high = mid;
+	}
+	return (int64_t)low - 1;
+}
+
+/*
+  Find the part of a file written between since and until, which are
+  FILETIMEs with 0 meaning no limit.  Sets *start to where to begin
+  reading and *end to where to stop, or -1 for the end of the file.
+  The range is exact to the spacing of the index entries.  Returns false
+  if the file has no usable index, in which case the range is the whole
+  file.
+*/
+bool find_time_range(const wchar_t* path, uint64_t since, uint64_t until, int64_t* start, int64_t* end)
+{
+	*start = 0;
+	*end = -1;
+
+	wchar_t index_path[nssmconst::pathlength];
+	time_index_path(path, index_path, std::size(index_path));
+	HANDLE index = ::CreateFileW(index_path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (index == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	uint64_t entries = GetFileSizeEx(index, &size) ? (uint64_t)size.QuadPart / sizeof(time_index_entry_t) : 0;
+	if (!entries)
+	{
+		CloseHandle(index);
+		return false;
+	}
+
+	time_index_entry_t entry;
+	/* Output before the last entry at or before since was written before since. */
+	if (since && last_entry_before(index, entries, since, &entry) >= 0)
+		*start = (int64_t)entry.offset;
+
+	/* Output after the first entry after until was written after until. */
+	if (until)
+	{
+		int64_t i = last_entry_before(index, entries, until, &entry);
+		if ((uint64_t)(i + 1) < entries && read_entry(index, (uint64_t)(i + 1), &entry))
+			*end = (int64_t)entry.offset;
+	}
+
+	CloseHandle(index);
+	return true;
+}
+
+static const wchar_t* parse_number(const wchar_t* s, uint32_t digits, WORD* value)
+{
+	*value = 0;
+	for (uint32_t i = 0; i < digits; i++)
+	{
+		if (s[i] < L'0' || s[i] > L'9')
+			return nullptr;
+		*value = (WORD)(*value * 10 + (s[i] - L'0'));
+	}
+	return s + digits;
+}
+
+/* Parse N followed by s, m, h or d as that long before now. */
+static bool parse_relative_time(const wchar_t* s, uint64_t* time)
+{
+	uint64_t count = 0;
+	uint32_t digits = 0;
+	for (; *s >= L'0' && *s <= L'9'; s++)
+	{
+		/* A hundred million days is more than a FILETIME can go back. */
+		if (++digits > 9)
+			return false;
+		count = count * 10 + (uint64_t)(*s - L'0');
+	}
+	if (!digits || !*s || s[1])
+		return false;
+
+	uint64_t unit;
+	switch (*s)
+	{
+	case L's':
+	case L'S':
+		unit = 10000000ULL;
+		break;
+	case L'm':
+	case L'M':
+		unit = 600000000ULL;
+		break;
+	case L'h':
+	case L'H':
+		unit = 36000000000ULL;
+		break;
+	case L'd':
+	case L'D':
+		unit = 864000000000ULL;
+		break;
+	default:
+		return false;
+	}
+
+	FILETIME ft;
+	GetSystemTimeAsFileTime(&ft);
+	ULARGE_INTEGER now;
+	now.LowPart = ft.dwLowDateTime;
+	now.HighPart = ft.dwHighDateTime;
+	if (count * unit >= now.QuadPart)
+		return false;
+	*time = now.QuadPart - count * unit;
+	return true;
+}
+
+/*
+  Parse a --since or --until time as a FILETIME in UTC.  Either N followed
+  by s, m, h or d for that long ago, or YYYY-MM-DD[ HH:MM[:SS[.mmm]]] with
+  T allowed instead of the space.  Dates and times are local unless they
+  end with Z for UTC or +HH:MM or -HH:MM for an offset from it.  Returns
+  false if the time is malformed or doesn't exist.
+*/
+bool parse_log_time(const wchar_t* s, uint64_t* time)
+{
+	if (parse_relative_time(s, time))
+		return true;
+
+	SYSTEMTIME st;
+	ZeroMemory(&st, sizeof(st));
+	if (!(s = parse_number(s, 4, &st.wYear)) || *s++ != L'-')
+		return false;
+	if (!(s = parse_number(s, 2, &st.wMonth)) || *s++ != L'-')
+		return false;
+	if (!(s = parse_number(s, 2, &st.wDay)))
+		return false;
+
+	if (*s == L' ' || *s == L'T' || *s == L't')
+	{
+		if (!(s = parse_number(s + 1, 2, &st.wHour)) || *s++ != L':')
+			return false;
+		if (!(s = parse_number(s, 2, &st.wMinute)))
+			return false;
+		if (*s == L':')
+		{
+			if (!(s = parse_number(s + 1, 2, &st.wSecond)))
+				return false;
+			if (*s == L'.')
+			{
+				if (!(s = parse_number(s + 1, 3, &st.wMilliseconds)))
+					return false;
+			}
+		}
+	}
+
+	/* Minutes to subtract to get UTC. */
+	bool local = true;
+	int64_t offset = 0;
+	if (*s == L'Z' || *s == L'z')
+	{
+		local = false;
+		s++;
+	}
+	else if (*s == L'+' || *s == L'-')
+	{
+		int64_t sign = (*s == L'-') ? -1 : 1;
+		WORD hours, minutes;
+		if (!(s = parse_number(s + 1, 2, &hours)) || *s++ != L':' || !(s = parse_number(s, 2, &minutes)))
+			return false;
+		if (hours > 23 || minutes > 59)
+			return false;
+		local = false;
+		offset = sign * (hours * 60 + minutes);
+	}
+	if (*s)
+		return false;
+
+	/* Also rejects dates such as February 30th before they can be normalised. */
+	FILETIME ft;
+	if (!SystemTimeToFileTime(&st, &ft))
+		return false;
+	if (local)
+	{
+		SYSTEMTIME utc;
+		if (!TzSpecificLocalTimeToSystemTime(nullptr, &st, &utc) || !SystemTimeToFileTime(&utc, &ft))
+			return false;
+	}
+
+	ULARGE_INTEGER value;
+	value.LowPart = ft.dwLowDateTime;
+	value.HighPart = ft.dwHighDateTime;
+	/* Early on 1601-01-01 with a positive offset is before any FILETIME. */
+	int64_t shift = offset * 600000000LL;
+	if (shift > 0 && value.QuadPart < (uint64_t)shift)
+		return false;
+	value.QuadPart -= (uint64_t)shift;
+	/* Zero would mean no limit at all. */
+	if (!value.QuadPart)
+		return false;
+	*time = value.QuadPart;
+	return true;
+}
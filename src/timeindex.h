@@ -0,0 +1,47 @@
+/*******************************************************************************
+ timeindex.h - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#pragma once
+
+#ifndef TIMEINDEX_H
+#define TIMEINDEX_H
+
+/* The index of a file is kept beside it with this suffix. */
+#define NSSM_TIME_INDEX_SUFFIX   L".idx"
+
+/* Add an entry after this many bytes (AppTimeIndexBytes)... */
+#define NSSM_TIME_INDEX_BYTES    65536
+/* ...or when this many milliseconds have passed (AppTimeIndexInterval). */
+#define NSSM_TIME_INDEX_INTERVAL 1000
+
+/*
+  Output at or after offset in the file was written at or after time,
+  which is a FILETIME in UTC.  The index is an array of these, appended to
+  as the file grows, so times and offsets both increase.
+*/
+typedef struct
+{
+	uint64_t time;
+	uint64_t offset;
+} time_index_entry_t;
+
+void time_index_path(const wchar_t*, wchar_t*, uint32_t);
+HANDLE open_time_index(const wchar_t*, int64_t);
+bool append_time_index(HANDLE, int64_t);
+void move_time_index(const wchar_t*, const wchar_t*, bool);
+void delete_time_index(const wchar_t*);
+bool find_time_range(const wchar_t*, uint64_t, uint64_t, int64_t*, int64_t*);
+bool parse_log_time(const wchar_t*, uint64_t*);
+
+#endif
@@ -0,0 +1,69 @@
+/*******************************************************************************
+ timestamp.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "timestamp.h"
+
+static inline void format_digits(timestamp_t* timestamp, uint32_t offset, uint32_t value, uint32_t digits)
+{
+	for (uint32_t i = digits; i--; value /= 10)
+	{
+		char c = (char)('0' + value % 10);
+		timestamp->utf8[offset + i] = c;
+		timestamp->utf16[offset + i] = (wchar_t)c;
+	}
+}
+
+/*
+  Bring the cached timestamp up to date with the given time.  Only the
+  fields which changed since the last call are reformatted and both the
+  UTF-8 and UTF-16 renderings are kept ready, so nothing is allocated for
+  each line.
+*/
+void format_timestamp(timestamp_t* timestamp, SYSTEMTIME* now)
+{
+	SYSTEMTIME* last = &timestamp->time;
+	bool all = !last->wYear;
+	if (all)
+	{
+		for (uint32_t i = 0; i <= TIMESTAMP_LEN; i++)
+			timestamp->utf16[i] = (wchar_t)(timestamp->utf8[i] = TIMESTAMP_TEMPLATE[i]);
+	}
+
+	if (all || now->wYear != last->wYear)
+		format_digits(timestamp, 0, now->wYear, 4);
+	if (all || now->wMonth != last->wMonth)
+		format_digits(timestamp, 5, now->wMonth, 2);
+	if (all || now->wDay != last->wDay)
+		format_digits(timestamp, 8, now->wDay, 2);
+	if (all || now->wHour != last->wHour)
+		format_digits(timestamp, 11, now->wHour, 2);
+	if (all || now->wMinute != last->wMinute)
+		format_digits(timestamp, 14, now->wMinute, 2);
+	if (all || now->wSecond != last->wSecond)
+		format_digits(timestamp, 17, now->wSecond, 2);
+	if (all || now->wMilliseconds != last->wMilliseconds)
+		format_digits(timestamp, 20, now->wMilliseconds, 3);
+
+	*last = *now;
+}
+
+/* Refresh the cached timestamp with the current time. */
+void update_timestamp(timestamp_t* timestamp)
+{
+	SYSTEMTIME now;
+	GetSystemTime(&now);
+	format_timestamp(timestamp, &now);
+}
@@ -0,0 +1,34 @@
+/*******************************************************************************
+ timestamp.h - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+#pragma once
+
+#ifndef TIMESTAMP_H
+#define TIMESTAMP_H
+
+/* Prefix of a timestamped line, eg "2016-09-06 10:17:09.451: ". */
+#define TIMESTAMP_TEMPLATE      "0000-00-00 00:00:00.000: "
+#define TIMESTAMP_LEN           25
+
+/* Cached renderings of the most recent log timestamp. */
+typedef struct
+{
+	SYSTEMTIME time;
+	char utf8[TIMESTAMP_LEN + 1];
+	wchar_t utf16[TIMESTAMP_LEN + 1];
+} timestamp_t;
+
+void format_timestamp(timestamp_t*, SYSTEMTIME*);
+void update_timestamp(timestamp_t*);
+
+#endif
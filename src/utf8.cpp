@@ -165,3 +165,385 @@ int32_t from_utf16(const wchar_t* utf16, wchar_t** buffer, uint32_t* buflen)
 	return to_utf8(utf16, buffer, buflen);
 #endif
 }
+
+/*
+  Streaming conversion between UTF-16LE and UTF-8.
+
+  These work on output as it is read from the application, so a character
+  can be split between two reads: half of a surrogate pair, an odd byte of
+  a UTF-16 code unit or the start of a UTF-8 sequence.  Whatever can't be
+  converted yet is kept in the transcoder_t and finished by the next call.
+  The _end() functions flush anything left over when the stream ends.
+
+  Nothing is allocated.  The caller supplies an output buffer with room
+  for UTF8_SIZE_FROM_UTF16() bytes or UTF16_SIZE_FROM_UTF8() characters.
+  Invalid input becomes U+FFFD, as with WideCharToMultiByte().
+
+  Runs of ASCII, which is most log output, are converted 16 or 32
+  characters at a time with SSE2 or AVX2.
+*/
+
+#define REPLACEMENT_CHARACTER 0xfffd
+
+static inline wchar_t load_utf16(const uint8_t* in)
+{
+	return (wchar_t)(in[0] | (in[1] << 8));
+}
+
+static inline uint32_t encode_utf8(uint32_t c, char* out)
+{
+	if (c < 0x80)
+	{
+		out[0] = (char)c;
+		return 1;
+	}
+	if (c < 0x800)
+	{
+		out[0] = (char)(0xc0 | (c >> 6));
+		out[1] = (char)(0x80 | (c & 0x3f));
+		return 2;
+	}
+	if (c < 0x10000)
+	{
+		out[0] = (char)(0xe0 | (c >> 12));
+		out[1] = (char)(0x80 | ((c >> 6) & 0x3f));
+		out[2] = (char)(0x80 | (c & 0x3f));
+		return 3;
+	}
+	out[0] = (char)(0xf0 | (c >> 18));
+	out[1] = (char)(0x80 | ((c >> 12) & 0x3f));
+	out[2] = (char)(0x80 | ((c >> 6) & 0x3f));
+	out[3] = (char)(0x80 | (c & 0x3f));
+	return 4;
+}
+
+/*
+  Convert one character from UTF-16.
+  Returns the number of code units used, or 0 if the input ends with a
+  high surrogate and we must wait for the low surrogate.
+*/
+static inline uint32_t decode_utf16(const uint8_t* in, uint32_t units, char** out)
+{
+	wchar_t c = load_utf16(in);
+	if (c < 0xd800 || c > 0xdfff)
+	{
+		*out += encode_utf8(c, *out);
+		return 1;
+	}
+
+	if (IS_HIGH_SURROGATE(c))
+	{
+		if (units < 2)
+			return 0;
+		wchar_t low = load_utf16(in + 2);
+		if (IS_LOW_SURROGATE(low))
+		{
+			*out += encode_utf8(0x10000 + (((uint32_t)c - 0xd800) << 10) + ((uint32_t)low - 0xdc00), *out);
+			return 2;
+		}
+	}
+
+	/* Unpaired surrogate. */
+	*out += encode_utf8(REPLACEMENT_CHARACTER, *out);
+	return 1;
+}
+
+/*
+  Convert one character from UTF-8.
+  Returns the number of bytes used, or 0 if the input ends partway
+  through a valid sequence and we must wait for the rest of it.
+*/
+static inline uint32_t decode_utf8(const uint8_t* in, uint32_t bufsize, wchar_t** out)
+{
+	uint8_t c = in[0];
+	if (c < 0x80)
+	{
+		*(*out)++ = (wchar_t)c;
+		return 1;
+	}
+
+	uint32_t len, min;
+	uint32_t code;
+	if ((c & 0xe0) == 0xc0)
+	{
+		len = 2;
+		code = c & 0x1f;
+		min = 0x80;
+	}
+	else if ((c & 0xf0) == 0xe0)
+	{
+		len = 3;
+		code = c & 0x0f;
+		min = 0x800;
+	}
+	else if ((c & 0xf8) == 0xf0)
+	{
+		len = 4;
+		code = c & 0x07;
+		min = 0x10000;
+	}
+	else
+	{
+		*(*out)++ = REPLACEMENT_CHARACTER;
+		return 1;
+	}
+
+	uint32_t i;
+	for (i = 1; i < len && i < bufsize; i++)
+	{
+		if ((in[i] & 0xc0) != 0x80)
+			break;
+		code = (code << 6) | (in[i] & 0x3f);
+	}
+	if (i < len)
+	{
+		if (i == bufsize)
+			return 0;
+		/* Resume at the byte which broke the sequence. */
+		*(*out)++ = REPLACEMENT_CHARACTER;
+		return i;
+	}
+
+	/* Overlong, surrogate or out of range. */
+	if (code < min || code > 0x10ffff || (code >= 0xd800 && code <= 0xdfff))
+		*(*out)++ = REPLACEMENT_CHARACTER;
+	else if (code >= 0x10000)
+	{
+		code -= 0x10000;
+		*(*out)++ = (wchar_t)(0xd800 + (code >> 10));
+		*(*out)++ = (wchar_t)(0xdc00 + (code & 0x3ff));
+	}
+	else
+		*(*out)++ = (wchar_t)code;
+	return len;
+}
+
+#ifdef NSSM_SCAN_SIMD
+/*
+  Convert ASCII one character at a time from i up to the first other one,
+  or end.  Used for the block which stopped the vector loop, so a short
+  run of ASCII between other characters isn't checked again and again.
+*/
+static inline uint32_t ascii_prefix_from_utf16(const uint8_t* in, uint32_t i, uint32_t end, char* out)
+{
+	for (; i < end && in[i * 2] < 0x80 && !in[i * 2 + 1]; i++)
+		out[i] = (char)in[i * 2];
+	return i;
+}
+
+static inline uint32_t ascii_prefix_from_utf8(const uint8_t* in, uint32_t i, uint32_t end, wchar_t* out)
+{
+	for (; i < end && in[i] < 0x80; i++)
+		out[i] = (wchar_t)in[i];
+	return i;
+}
+
+/* Convert leading ASCII code units.  Returns how many were converted. */
+static inline uint32_t ascii_from_utf16(const uint8_t* in, uint32_t units, char* out)
+{
+	uint32_t i = 0;
+	if (have_avx2())
+	{
+		const __m256i high = _mm256_set1_epi16((short)0xff80);
+		for (; i + 32 <= units; i += 32)
+		{
+			__m256i a = _mm256_loadu_si256((const __m256i*)(in + i * 2));
+			__m256i b = _mm256_loadu_si256((const __m256i*)(in + i * 2 + 32));
+			if (!_mm256_testz_si256(_mm256_or_si256(a, b), high))
+				return ascii_prefix_from_utf16(in, i, i + 32, out);
+			/* Packing works within each 128-bit lane so put the quarters back in order. */
+			__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8);
+			_mm256_storeu_si256((__m256i*)(out + i), packed);
+		}
+	}
+
+	const __m128i high = _mm_set1_epi16((short)0xff80);
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= units; i += 16)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(in + i * 2));
+		__m128i b = _mm_loadu_si128((const __m128i*)(in + i * 2 + 16));
+		__m128i any = _mm_and_si128(_mm_or_si128(a, b), high);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) != 0xffff)
+			return ascii_prefix_from_utf16(in, i, i + 16, out);
+		_mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(a, b));
+	}
+	return ascii_prefix_from_utf16(in, i, units, out);
+}
+
+/* Convert leading ASCII bytes.  Returns how many were converted. */
+static inline uint32_t ascii_from_utf8(const uint8_t* in, uint32_t bufsize, wchar_t* out)
+{
+	uint32_t i = 0;
+	if (have_avx2())
+	{
+		for (; i + 32 <= bufsize; i += 32)
+		{
+			__m256i block = _mm256_loadu_si256((const __m256i*)(in + i));
+			if (_mm256_movemask_epi8(block))
+				return ascii_prefix_from_utf8(in, i, i + 32, out);
+			_mm256_storeu_si256((__m256i*)(out + i), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(block)));
+			_mm256_storeu_si256((__m256i*)(out + i + 16), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(block, 1)));
+		}
+	}
+
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= bufsize; i += 16)
+	{
+		__m128i block = _mm_loadu_si128((const __m128i*)(in + i));
+		if (_mm_movemask_epi8(block))
+			return ascii_prefix_from_utf8(in, i, i + 16, out);
+		_mm_storeu_si128((__m128i*)(out + i), _mm_unpacklo_epi8(block, zero));
+		_mm_storeu_si128((__m128i*)(out + i + 8), _mm_unpackhi_epi8(block, zero));
+	}
+	return ascii_prefix_from_utf8(in, i, bufsize, out);
+}
+#endif
+
+/*
+  Convert UTF-16LE to UTF-8.
+  Returns the number of bytes written to out.
+*/
+uint32_t utf16_to_utf8(transcoder_t* transcoder, const void* address, uint32_t bufsize, char* out)
+{
+	const uint8_t* in = (const uint8_t*)address;
+	char* start = out;
+
+	/* Finish the character split by the last call. */
+	while (transcoder->pending_len && bufsize)
+	{
+		transcoder->pending[transcoder->pending_len++] = *in++;
+		bufsize--;
+		if (transcoder->pending_len & 1)
+			continue;
+
+		uint32_t used = decode_utf16(transcoder->pending, transcoder->pending_len / 2, &out);
+		if (!used)
+			continue;
+		if (used * 2 < transcoder->pending_len)
+		{
+			/* A high surrogate followed by something else, which we look at again. */
+			transcoder->pending[0] = transcoder->pending[2];
+			transcoder->pending[1] = transcoder->pending[3];
+			transcoder->pending_len = 2;
+			if (decode_utf16(transcoder->pending, 1, &out))
+				transcoder->pending_len = 0;
+		}
+		else
+			transcoder->pending_len = 0;
+	}
+
+	uint32_t units = bufsize / 2;
+	uint32_t i = 0;
+	while (i < units)
+	{
+#ifdef NSSM_SCAN_SIMD
+		if (in[i * 2] < 0x80 && !in[i * 2 + 1])
+		{
+			uint32_t ascii = ascii_from_utf16(in + i * 2, units - i, out);
+			i += ascii;
+			out += ascii;
+			if (i == units)
+				break;
+		}
+#endif
+		uint32_t used = decode_utf16(in + i * 2, units - i, &out);
+		if (!used)
+		{
+			/* Hold the high surrogate until the low one arrives. */
+			transcoder->pending[0] = in[i * 2];
+			transcoder->pending[1] = in[i * 2 + 1];
+			transcoder->pending_len = 2;
+			i++;
+			break;
+		}
+		i += used;
+	}
+
+	if (bufsize & 1)
+		transcoder->pending[transcoder->pending_len++] = in[bufsize - 1];
+
+	return (uint32_t)(out - start);
+}
+
+/* Flush a character left incomplete at the end of the stream. */
+uint32_t utf16_to_utf8_end(transcoder_t* transcoder, char* out)
+{
+	uint32_t len = 0;
+	if (transcoder->pending_len >= 2)
+		len += encode_utf8(REPLACEMENT_CHARACTER, out + len);
+	if (transcoder->pending_len & 1)
+		len += encode_utf8(REPLACEMENT_CHARACTER, out + len);
+	transcoder->pending_len = 0;
+	return len;
+}
+
+/*
+  Convert UTF-8 to UTF-16LE.
+  Returns the number of characters written to out.
+*/
+uint32_t utf8_to_utf16(transcoder_t* transcoder, const void* address, uint32_t bufsize, wchar_t* out)
+{
+	const uint8_t* in = (const uint8_t*)address;
+	wchar_t* start = out;
+
+	/* Finish the sequence split by the last call. */
+	if (transcoder->pending_len && bufsize)
+	{
+		uint8_t sequence[8];
+		uint32_t pending_len = transcoder->pending_len;
+		uint32_t more = (bufsize < 3) ? bufsize : 3;
+		memmove(sequence, transcoder->pending, pending_len);
+		memmove(sequence + pending_len, in, more);
+
+		uint32_t used = decode_utf8(sequence, pending_len + more, &out);
+		if (!used)
+		{
+			/* Still incomplete, so we took all the input. */
+			memmove(transcoder->pending + pending_len, in, more);
+			transcoder->pending_len += more;
+			return (uint32_t)(out - start);
+		}
+
+		/* The pending bytes were a valid prefix so the sequence always ends after them. */
+		in += used - pending_len;
+		bufsize -= used - pending_len;
+		transcoder->pending_len = 0;
+	}
+
+	uint32_t i = 0;
+	while (i < bufsize)
+	{
+#ifdef NSSM_SCAN_SIMD
+		if (in[i] < 0x80)
+		{
+			uint32_t ascii = ascii_from_utf8(in + i, bufsize - i, out);
+			i += ascii;
+			out += ascii;
+			if (i == bufsize)
+				break;
+		}
+#endif
+		uint32_t used = decode_utf8(in + i, bufsize - i, &out);
+		if (!used)
+		{
+			/* Hold the start of the sequence until the rest arrives. */
+			transcoder->pending_len = bufsize - i;
+			memmove(transcoder->pending, in + i, transcoder->pending_len);
+			break;
+		}
+		i += used;
+	}
+
+	return (uint32_t)(out - start);
+}
+
+/* Flush a sequence left incomplete at the end of the stream. */
+uint32_t utf8_to_utf16_end(transcoder_t* transcoder, wchar_t* out)
+{
+	uint32_t len = 0;
+	if (transcoder->pending_len)
+		out[len++] = REPLACEMENT_CHARACTER;
+	transcoder->pending_len = 0;
+	return len;
+}
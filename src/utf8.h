@@ -16,6 +16,20 @@
 #ifndef UTF8_H
 #define UTF8_H
 
+/* State carried between calls by the streaming transcoders. */
+typedef struct
+{
+	uint8_t pending[4];
+	uint32_t pending_len;
+} transcoder_t;
+
+/*
+  Output space needed to transcode bufsize bytes of input, including
+  anything carried over from the previous call.
+*/
+#define UTF8_SIZE_FROM_UTF16(bufsize)  ((((bufsize) + 3) / 2) * 3)
+#define UTF16_SIZE_FROM_UTF8(bufsize)  ((bufsize) + 3)
+
 void setup_utf8();
 void unsetup_utf8();
 int32_t to_utf8(const wchar_t*, char**, uint32_t*);
@@ -24,5 +38,9 @@ int32_t to_utf16(const char*, wchar_t** utf16, uint32_t*);
 int32_t to_utf16(const wchar_t*, wchar_t** utf16, uint32_t*);
 int32_t from_utf8(const char*, wchar_t**, uint32_t*);
 int32_t from_utf16(const wchar_t*, wchar_t**, uint32_t*);
+uint32_t utf16_to_utf8(transcoder_t*, const void*, uint32_t, char*);
+uint32_t utf16_to_utf8_end(transcoder_t*, char*);
+uint32_t utf8_to_utf16(transcoder_t*, const void*, uint32_t, wchar_t*);
+uint32_t utf8_to_utf16_end(transcoder_t*, wchar_t*);
 
 #endif
@@ -0,0 +1,664 @@
+/*******************************************************************************
+ bench.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include <chrono>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "test.h"
+
+/*
+  Benchmarks for the logging hot paths, runnable off Windows.
+
+  Where the code being measured lives in ioimpl.cpp, which can't be built
+  here, the benchmark reproduces the pattern of system calls it makes on
+  a POSIX stand-in and says so.  Results are indicative only: compare
+  the rows of one run rather than numbers from different machines.
+
+    nssm_bench [--quick] [name ...]
+*/
+
+static bool quick;
+
+static inline double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void report(const char* label, double seconds, uint64_t bytes, uint64_t items, const char* unit)
+{
+	printf("  %-28s %9.1f MB/s %12.0f %s/s\n", label, (double)bytes / seconds / 1e6, (double)items / seconds, unit);
+}
+
+/* Log-like lines of 40 to 160 ASCII characters. */
+static std::vector<char> make_lines(size_t size, uint64_t seed)
+{
+	static const char words[] = "2025-05-31 worker INFO request handled status=200 bytes=512 path=/api/v1/items user=service ";
+	std::vector<char> text(size);
+	size_t i = 0;
+	while (i < size)
+	{
+		seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+		size_t len = 40 + (size_t)(seed >> 33) % 120;
+		for (size_t j = 0; j < len && i < size; j++)
+			text[i++] = (j + 1 == len) ? '\n' : words[(j + (seed >> 40)) % (sizeof(words) - 1)];
+	}
+	return text;
+}
+
+/*
+  Read throughput from a pipe standing in for the application's stdout.
+  A writer thread pushes lines as fast as it can.  We read from the pipe
+  into the stream's buffer and queue each read with queue_chunk(), while
+  a second thread takes the chunks as the logging thread's writer does,
+  counts their lines and writes each out with one call.  The pipe is
+  given the read buffer's starting size, as CreateNamedPipe() is, and the
+  buffer is limited by the queue size, as create_logger() limits it.
+  Compares the old fixed 1 KiB buffer, fixed buffers of the default and
+  maximum sizes and the default buffer grown by grow_buffer().
+*/
+static void read_pipe(const char* label, uint32_t size, uint32_t queue_size, bool grow, const std::vector<char>& text, uint32_t passes)
+{
+	int fds[2];
+	if (pipe(fds))
+	{
+		perror("pipe");
+		return;
+	}
+#ifdef F_SETPIPE_SZ
+	fcntl(fds[1], F_SETPIPE_SZ, (int)size);
+#endif
+	int sink = open("/dev/null", O_WRONLY);
+
+	static stream_stats_t stats;
+	handoff_t h;
+	if (init_handoff(&h, std::min(size, max_read_size(queue_size)), queue_size, NSSM_QUEUE_BLOCK, false, &stats))
+		return;
+	h.reader_port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, 0, 0, 1);
+	h.writer_port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, 0, 0, 1);
+	h.key = 1;
+
+	std::thread writer([&]()
+	{
+		for (uint32_t pass = 0; pass < passes; pass++)
+		{
+			for (size_t i = 0; i < text.size(); )
+			{
+				size_t len = text.size() - i;
+				if (len > NSSM_STDIO_BUFFER_SIZE)
+					len = NSSM_STDIO_BUFFER_SIZE;
+				ssize_t n = write(fds[1], text.data() + i, len);
+				if (n <= 0)
+					return;
+				i += (size_t)n;
+			}
+		}
+		close(fds[1]);
+	});
+
+	uint64_t lines = 0;
+	std::thread logger([&]()
+	{
+		uint32_t bytes;
+		ULONG_PTR key;
+		OVERLAPPED* overlapped;
+		int32_t finished = 0;
+		while (!finished && GetQueuedCompletionStatus(h.writer_port, &bytes, &key, &overlapped, INFINITE))
+		{
+			start_draining(&h);
+			uint32_t len;
+			uint64_t dropped;
+			uint64_t spilled;
+			while (!(finished = take_chunk(&h, &len, &dropped, &spilled)) && len)
+			{
+				lines += count_line_ends(h.work, len, 1);
+				if (write(sink, h.work, len) != (ssize_t)len)
+					break;
+			}
+		}
+	});
+
+	uint64_t bytes = 0;
+	uint64_t reads = 0;
+	double start = now();
+	for (;;)
+	{
+		ssize_t n = read(fds[0], h.buffer, h.buffer_size);
+		if (n <= 0)
+			break;
+		reads++;
+		bytes += (uint64_t)n;
+
+		int32_t ret = queue_chunk(&h, (uint32_t)n);
+		while (ret > 0)
+		{
+			/* Wait for the writer to make room, as a blocked stream does. */
+			uint32_t resumed;
+			ULONG_PTR key;
+			OVERLAPPED* overlapped;
+			GetQueuedCompletionStatus(h.reader_port, &resumed, &key, &overlapped, INFINITE);
+			ret = resume_reading(&h);
+		}
+		if (grow)
+			grow_buffer(&h, (uint32_t)n);
+	}
+	close_handoff(&h);
+	logger.join();
+	double seconds = now() - start;
+	writer.join();
+	close(fds[0]);
+	close(sink);
+	fake_close_port(h.reader_port);
+	fake_close_port(h.writer_port);
+	free_handoff(&h);
+
+	report(label, seconds, bytes, lines, "lines");
+	printf("  %-28s %9llu reads, %llu bytes per read\n", "", (unsigned long long)reads, (unsigned long long)(reads ? bytes / reads : 0));
+}
+
+static void bench_reads()
+{
+	std::vector<char> text = make_lines(quick ? 1 << 20 : 16 << 20, 1);
+	uint32_t passes = quick ? 2 : 16;
+	read_pipe("fixed 1 KiB", NSSM_STDIO_BUFFER_MIN, NSSM_QUEUE_SIZE, false, text, passes);
+	read_pipe("fixed 64 KiB", NSSM_STDIO_BUFFER_SIZE, NSSM_QUEUE_SIZE, false, text, passes);
+	/* A 4 MiB read needs room for two in the queue. */
+	read_pipe("fixed 4 MiB, 16 MiB queue", NSSM_STDIO_BUFFER_MAX, 16 << 20, false, text, passes);
+	read_pipe("64 KiB growing", NSSM_STDIO_BUFFER_SIZE, NSSM_QUEUE_SIZE, true, text, passes);
+}
+
+/* The same text as UTF-16LE, with every nth character replaced by c if n is set. */
+static std::vector<char> make_utf16(const std::vector<char>& text, uint32_t n, wchar_t c)
+{
+	std::vector<char> utf16(text.size() * 2);
+	for (size_t i = 0; i < text.size(); i++)
+	{
+		wchar_t unit = (n && i % n == n - 1 && text[i] != '\n') ? c : (wchar_t)text[i];
+		utf16[i * 2] = (char)unit;
+		utf16[i * 2 + 1] = (char)(unit >> 8);
+	}
+	return utf16;
+}
+
+/*
+  Streaming transcoding in reads of the default buffer size, as
+  log_chunk() converts output for AppEncoding.  Run nssm_bench,
+  nssm_bench_sse2 and nssm_bench_scalar to compare the vector paths.
+*/
+static void transcode(const char* label, const std::vector<char>& utf16, uint32_t passes)
+{
+	std::vector<char> utf8(UTF8_SIZE_FROM_UTF16(NSSM_STDIO_BUFFER_SIZE));
+	std::vector<char> converted;
+	transcoder_t transcoder;
+	ZeroMemory(&transcoder, sizeof(transcoder));
+	double start = now();
+	for (uint32_t pass = 0; pass < passes; pass++)
+	{
+		converted.clear();
+		for (size_t i = 0; i < utf16.size(); i += NSSM_STDIO_BUFFER_SIZE)
+		{
+			uint32_t len = (uint32_t)std::min(utf16.size() - i, (size_t)NSSM_STDIO_BUFFER_SIZE);
+			uint32_t out = utf16_to_utf8(&transcoder, utf16.data() + i, len, utf8.data());
+			if (pass + 1 == passes)
+				converted.insert(converted.end(), utf8.data(), utf8.data() + out);
+		}
+	}
+	report((std::string(label) + " to UTF-8").c_str(), now() - start, (uint64_t)utf16.size() * passes, (uint64_t)utf16.size() / 2 * passes, "chars");
+
+	/* And back again, from what we just converted. */
+	std::vector<wchar_t> wide(UTF16_SIZE_FROM_UTF8(NSSM_STDIO_BUFFER_SIZE));
+	uint64_t units = 0;
+	start = now();
+	for (uint32_t pass = 0; pass < passes; pass++)
+	{
+		for (size_t i = 0; i < converted.size(); i += NSSM_STDIO_BUFFER_SIZE)
+		{
+			uint32_t len = (uint32_t)std::min(converted.size() - i, (size_t)NSSM_STDIO_BUFFER_SIZE);
+			units += utf8_to_utf16(&transcoder, converted.data() + i, len, wide.data());
+		}
+	}
+	report((std::string(label) + " from UTF-8").c_str(), now() - start, (uint64_t)converted.size() * passes, units, "chars");
+}
+
+static void bench_transcode()
+{
+	std::vector<char> text = make_lines(quick ? 1 << 20 : 16 << 20, 2);
+	uint32_t passes = quick ? 2 : 8;
+	transcode("ASCII", make_utf16(text, 0, 0), passes);
+	transcode("1 in 64 accented", make_utf16(text, 64, 0x00e9), passes);
+	transcode("1 in 4 CJK", make_utf16(text, 4, 0x4e2d), passes);
+}
+
+/*
+  Timestamp formatting per line.  The old write_timestamp() called
+  GetSystemTime() and _snprintf_s() for every line, and for UTF-16 output
+  to_utf16(), which allocated, converted and freed the copy.  Both ways
+  read the clock for every line.
+*/
+static void bench_timestamps()
+{
+	uint32_t lines = quick ? 200000 : 5000000;
+	uint64_t check = 0;
+
+	double start = now();
+	for (uint32_t i = 0; i < lines; i++)
+	{
+		SYSTEMTIME st;
+		GetSystemTime(&st);
+		char timestamp[64];
+		snprintf(timestamp, sizeof(timestamp), "%04u-%02u-%02u %02u:%02u:%02u.%03u: ", st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond, st.wMilliseconds);
+		check += (uint8_t)timestamp[22];
+	}
+	report("snprintf UTF-8", now() - start, (uint64_t)lines * TIMESTAMP_LEN, lines, "lines");
+
+	start = now();
+	for (uint32_t i = 0; i < lines; i++)
+	{
+		SYSTEMTIME st;
+		GetSystemTime(&st);
+		char timestamp[64];
+		int32_t len = snprintf(timestamp, sizeof(timestamp), "%04u-%02u-%02u %02u:%02u:%02u.%03u: ", st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond, st.wMilliseconds);
+		/* As to_utf16() with MultiByteToWideChar(). */
+		wchar_t* utf16 = (wchar_t*)HeapAlloc(GetProcessHeap(), 0, (len + 1) * sizeof(wchar_t));
+		for (int32_t j = 0; j <= len; j++)
+			utf16[j] = (wchar_t)timestamp[j];
+		check += utf16[22];
+		HeapFree(GetProcessHeap(), 0, utf16);
+	}
+	report("snprintf UTF-16 allocated", now() - start, (uint64_t)lines * TIMESTAMP_LEN * 2, lines, "lines");
+
+	timestamp_t timestamp;
+	ZeroMemory(&timestamp, sizeof(timestamp));
+	start = now();
+	for (uint32_t i = 0; i < lines; i++)
+	{
+		update_timestamp(&timestamp);
+		check += (uint8_t)timestamp.utf8[22] + timestamp.utf16[22];
+	}
+	report("cached UTF-8 and UTF-16", now() - start, (uint64_t)lines * TIMESTAMP_LEN * 3, lines, "lines");
+
+	/* Without the clock, to show what the formatting itself costs. */
+	SYSTEMTIME st;
+	GetSystemTime(&st);
+	start = now();
+	for (uint32_t i = 0; i < lines; i++)
+	{
+		st.wMilliseconds = (WORD)(i % 1000);
+		format_timestamp(&timestamp, &st);
+		check += (uint8_t)timestamp.utf8[22];
+	}
+	report("cached, clock excluded", now() - start, (uint64_t)lines * TIMESTAMP_LEN * 3, lines, "lines");
+	if (!check)
+		printf("\n");
+}
+
+/* An empty temporary file, already unlinked so nothing is left behind. */
+static int temporary_file(int flags)
+{
+	char path[] = "/tmp/nssm_bench_XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0)
+	{
+		perror("mkstemp");
+		return -1;
+	}
+	unlink(path);
+	if (flags)
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | flags);
+	return fd;
+}
+
+/*
+  Timestamped output.  The old write_with_timestamp() made one write for
+  the timestamp and another for each line; now records are staged and a
+  read costs one write.  Both read the text in buffers of the default
+  size and write to a file with write(), standing in for WriteFile().
+*/
+static void coalesce(const char* label, const std::vector<char>& text, uint32_t passes, bool staged)
+{
+	int fd = temporary_file(0);
+	if (fd < 0)
+		return;
+
+	timestamp_t timestamp;
+	ZeroMemory(&timestamp, sizeof(timestamp));
+	/* Twice the read buffer, as in create_logger(), flushed early if it fills. */
+	std::vector<char> staging(NSSM_STDIO_BUFFER_SIZE * 2);
+	uint32_t ends[NSSM_LINE_ENDS];
+	uint64_t lines = 0;
+	uint64_t writes = 0;
+	double start = now();
+	for (uint32_t pass = 0; pass < passes; pass++)
+	{
+		for (size_t i = 0; i < text.size(); i += NSSM_STDIO_BUFFER_SIZE)
+		{
+			const char* buffer = text.data() + i;
+			uint32_t len = (uint32_t)std::min(text.size() - i, (size_t)NSSM_STDIO_BUFFER_SIZE);
+			uint32_t staged_len = 0;
+			uint32_t offset = 0;
+			uint32_t count;
+			do
+			{
+				count = find_line_ends(buffer + offset, len - offset, 1, ends, NSSM_LINE_ENDS);
+				uint32_t base = offset;
+				for (uint32_t j = 0; j < count; j++)
+				{
+					uint32_t end = base + ends[j];
+					update_timestamp(&timestamp);
+					if (staged)
+					{
+						if (staged_len + TIMESTAMP_LEN + end - offset > staging.size())
+						{
+							writes++;
+							if (write(fd, staging.data(), staged_len) < 0)
+								perror("write");
+							staged_len = 0;
+						}
+						memmove(staging.data() + staged_len, timestamp.utf8, TIMESTAMP_LEN);
+						memmove(staging.data() + staged_len + TIMESTAMP_LEN, buffer + offset, end - offset);
+						staged_len += TIMESTAMP_LEN + end - offset;
+					}
+					else
+					{
+						writes += 2;
+						if (write(fd, timestamp.utf8, TIMESTAMP_LEN) < 0 || write(fd, buffer + offset, end - offset) < 0)
+							perror("write");
+					}
+					offset = end;
+					lines++;
+				}
+			} while (count == NSSM_LINE_ENDS);
+
+			/* make_lines() text ends each buffer mid-line, which is written as is. */
+			if (staged)
+			{
+				memmove(staging.data() + staged_len, buffer + offset, len - offset);
+				staged_len += len - offset;
+				writes++;
+				if (write(fd, staging.data(), staged_len) < 0)
+					perror("write");
+			}
+			else if (offset < len)
+			{
+				writes++;
+				if (write(fd, buffer + offset, len - offset) < 0)
+					perror("write");
+			}
+		}
+		if (ftruncate(fd, 0) || lseek(fd, 0, SEEK_SET))
+			perror("ftruncate");
+	}
+	double seconds = now() - start;
+	close(fd);
+
+	report(label, seconds, (uint64_t)text.size() * passes, lines, "lines");
+	printf("  %-28s %9llu writes\n", "", (unsigned long long)writes);
+}
+
+static void bench_coalesce()
+{
+	std::vector<char> text = make_lines(quick ? 1 << 20 : 16 << 20, 3);
+	uint32_t passes = quick ? 2 : 4;
+	coalesce("write per field", text, passes, false);
+	coalesce("staged write per read", text, passes, true);
+}
+
+/*
+  Durability policies.  Output is written in buffers of the default size
+  and committed with fdatasync(), standing in for FlushFileBuffers(), as
+  flush_if_due() would: once flush_bytes have piled up, or flush_interval
+  milliseconds after the first unflushed write.  Write-through opens the
+  file with O_DSYNC, as FILE_FLAG_WRITE_THROUGH does.
+*/
+static void flush_policy(const char* label, const std::vector<char>& text, uint32_t interval, uint32_t bytes, bool write_through)
+{
+	int fd = temporary_file(write_through ? O_DSYNC : 0);
+	if (fd < 0)
+		return;
+
+	uint64_t unflushed = 0;
+	uint64_t flushes = 0;
+	double flush_at = 0;
+	double start = now();
+	for (size_t i = 0; i < text.size(); i += NSSM_STDIO_BUFFER_SIZE)
+	{
+		size_t len = std::min(text.size() - i, (size_t)NSSM_STDIO_BUFFER_SIZE);
+		if (write(fd, text.data() + i, len) < 0)
+			perror("write");
+		unflushed += len;
+
+		bool due = (bytes && unflushed >= bytes);
+		if (interval)
+		{
+			if (!flush_at)
+				flush_at = now() + interval / 1000.0;
+			else if (now() >= flush_at)
+				due = true;
+		}
+		if (due)
+		{
+			fdatasync(fd);
+			flushes++;
+			unflushed = 0;
+			flush_at = 0;
+		}
+	}
+	/* Every policy leaves the file on disk at the end. */
+	if (unflushed && !write_through)
+	{
+		fdatasync(fd);
+		flushes++;
+	}
+	double seconds = now() - start;
+	close(fd);
+
+	report(label, seconds, text.size(), text.size() / NSSM_STDIO_BUFFER_SIZE, "writes");
+	printf("  %-28s %9llu flushes\n", "", (unsigned long long)flushes);
+}
+
+static void bench_flush()
+{
+	std::vector<char> text = make_lines(quick ? 4 << 20 : 64 << 20, 4);
+
+	/* Write it once untimed so the first row doesn't pay to warm the page cache. */
+	int fd = temporary_file(0);
+	if (fd >= 0)
+	{
+		if (write(fd, text.data(), text.size()) < 0)
+			perror("write");
+		close(fd);
+	}
+
+	flush_policy("none", text, 0, 0, false);
+	flush_policy("every 1000 ms", text, 1000, 0, false);
+	flush_policy("every 100 ms", text, 100, 0, false);
+	flush_policy("every 1 MiB", text, 0, 1 << 20, false);
+	flush_policy("every 64 KiB", text, 0, 1 << 16, false);
+	flush_policy("write-through", text, 0, 0, true);
+}
+
+/*
+  Encoding detection as log_chunk() runs it on every read.  Statistics
+  are gathered until NSSM_DETECT_CERTAIN bytes have been seen, after
+  which each call returns straight away.  count_nuls() is what the
+  detector spends its time in until then, shown on whole buffers.
+*/
+static void detect(const char* label, const std::vector<char>& text, uint32_t read_size, uint32_t passes)
+{
+	uint64_t calls = 0;
+	uint32_t charsize = 0;
+	double start = now();
+	for (uint32_t pass = 0; pass < passes; pass++)
+	{
+		detector_t detector;
+		ZeroMemory(&detector, sizeof(detector));
+		for (size_t i = 0; i < text.size(); i += read_size)
+		{
+			uint32_t skip;
+			charsize += detect_encoding(&detector, text.data() + i, (uint32_t)std::min(text.size() - i, (size_t)read_size), &skip);
+			calls++;
+		}
+	}
+	report(label, now() - start, (uint64_t)text.size() * passes, calls, "reads");
+	if (!charsize)
+		printf("\n");
+}
+
+static void bench_detect()
+{
+	std::vector<char> text = make_lines(quick ? 1 << 20 : 16 << 20, 5);
+	std::vector<char> utf16 = make_utf16(text, 0, 0);
+	uint32_t passes = quick ? 2 : 8;
+	detect("8-bit, 64 byte reads", text, 64, passes);
+	detect("8-bit, 64 KiB reads", text, NSSM_STDIO_BUFFER_SIZE, passes);
+	detect("UTF-16, 64 byte reads", utf16, 64, passes);
+	detect("UTF-16, 64 KiB reads", utf16, NSSM_STDIO_BUFFER_SIZE, passes);
+
+	uint64_t nuls = 0;
+	double start = now();
+	for (uint32_t pass = 0; pass < passes; pass++)
+	{
+		for (size_t i = 0; i < utf16.size(); i += NSSM_STDIO_BUFFER_SIZE)
+		{
+			uint32_t even, odd;
+			count_nuls(utf16.data() + i, (uint32_t)std::min(utf16.size() - i, (size_t)NSSM_STDIO_BUFFER_SIZE), &even, &odd);
+			nuls += even + odd;
+		}
+	}
+	report("count_nuls, 64 KiB buffers", now() - start, (uint64_t)utf16.size() * passes, nuls, "NULs");
+}
+
+/*
+  Compression of a rotated file as compress.cpp does it, 64 KiB at a time,
+  at zlib's default level and, for comparison, its fastest.  Lines differ in their
+  fields so the ratio is nearer that of real logs than make_lines() text.
+*/
+static void bench_gzip()
+{
+	std::vector<char> text;
+	uint64_t seed = 13;
+	uint32_t second = 0;
+	uint64_t lines = 0;
+	while (text.size() < (quick ? 4U << 20 : 64U << 20))
+	{
+		char line[160];
+		seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+		uint32_t r = (uint32_t)(seed >> 33);
+		second += r % 3;
+		int32_t len = snprintf(line, sizeof(line), "2025-06-01 %02u:%02u:%02u.%03u [%s] worker %u handled job %u in %u ms\r\n", second / 3600 % 24, second / 60 % 60, second % 60, r % 1000, (r & 7) ? "INFO" : "WARN", r % 64, r % 100000, r % 997);
+		text.insert(text.end(), line, line + len);
+		lines++;
+	}
+
+	deflate_t d;
+	if (init_deflate(&d, 0))
+		return;
+	uint64_t compressed = 0;
+	double start = now();
+	for (size_t done = 0; ; )
+	{
+		uint32_t len = (uint32_t)std::min(text.size() - done, (size_t)NSSM_DEFLATE_INPUT);
+		memmove(d.in, text.data() + done, len);
+		done += len;
+		deflate_input(&d, len, done == text.size());
+		while (deflate_output(&d) > 0)
+			compressed += d.out_len;
+		if (done == text.size())
+			break;
+	}
+	report("deflate_output", now() - start, text.size(), lines, "lines");
+	printf("  %-28s %9.1f%%\n", "deflate_output size", 100.0 * (double)compressed / (double)text.size());
+	free_deflate(&d);
+
+	for (int32_t level : { 1 })
+	{
+		z_stream z;
+		memset(&z, 0, sizeof(z));
+		if (deflateInit2(&z, level, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+			return;
+		std::vector<unsigned char> out(NSSM_STDIO_BUFFER_SIZE * 2);
+		compressed = 0;
+		start = now();
+		for (size_t done = 0; done < text.size(); )
+		{
+			uint32_t len = (uint32_t)std::min(text.size() - done, (size_t)NSSM_STDIO_BUFFER_SIZE);
+			z.next_in = (Bytef*)text.data() + done;
+			z.avail_in = len;
+			done += len;
+			int32_t flush = (done == text.size()) ? Z_FINISH : Z_NO_FLUSH;
+			do
+			{
+				z.next_out = out.data();
+				z.avail_out = (uInt)out.size();
+				deflate(&z, flush);
+				compressed += out.size() - z.avail_out;
+			} while (!z.avail_out);
+		}
+		deflateEnd(&z);
+		char label[32];
+		snprintf(label, sizeof(label), "zlib level %d", level);
+		report(label, now() - start, text.size(), lines, "lines");
+		snprintf(label, sizeof(label), "zlib level %d size", level);
+		printf("  %-28s %9.1f%%\n", label, 100.0 * (double)compressed / (double)text.size());
+	}
+}
+
+typedef struct
+{
+	const char* name;
+	void (*function)();
+} bench_t;
+
+static const bench_t benches[] = {
+	{ "reads", bench_reads },
+	{ "coalesce", bench_coalesce },
+	{ "transcode", bench_transcode },
+	{ "timestamps", bench_timestamps },
+	{ "flush", bench_flush },
+	{ "detect", bench_detect },
+	{ "gzip", bench_gzip },
+};
+
+int main(int argc, char** argv)
+{
+	std::vector<const char*> names;
+	for (int32_t i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "--quick"))
+			quick = true;
+		else
+			names.push_back(argv[i]);
+	}
+
+	printf("vector path: %s\n", simd_path());
+	for (const bench_t& bench : benches)
+	{
+		bool wanted = names.empty();
+		for (const char* name : names)
+		{
+			if (!strcmp(name, bench.name))
+				wanted = true;
+		}
+		if (!wanted)
+			continue;
+
+		printf("%s\n", bench.name);
+		bench.function();
+	}
+	return 0;
+}
@@ -0,0 +1,194 @@
+/*******************************************************************************
+ deflate_test.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "test.h"
+
+/* gzip input in chunks of at most chunk bytes, or as much as there is space for if chunk is zero. */
+static std::string gzip(const std::string& in, uint32_t chunk, uint64_t* seed)
+{
+	std::string out;
+	deflate_t d;
+	if (init_deflate(&d, 1234567890))
+		return out;
+
+	size_t done = 0;
+	while (true)
+	{
+		uint32_t len = NSSM_DEFLATE_INPUT;
+		if (chunk && len > chunk)
+			len = 1 + (seed ? test_random(seed) % chunk : chunk - 1);
+		if (len > in.size() - done)
+			len = (uint32_t)(in.size() - done);
+		memmove(d.in, in.data() + done, len);
+		done += len;
+		deflate_input(&d, len, done == in.size());
+		int32_t ret;
+		while ((ret = deflate_output(&d)) > 0)
+		{
+			CHECK(d.out_len <= NSSM_DEFLATE_OUTPUT);
+			out.append((char*)d.out, d.out_len);
+		}
+		CHECK(!ret);
+		if (done == in.size())
+			break;
+	}
+
+	/* Nothing more comes out once the stream has ended. */
+	CHECK(!deflate_output(&d));
+	free_deflate(&d);
+	return out;
+}
+
+/* Decompress with zlib, which checks the header, the codes, the CRC and the length. */
+static bool gunzip(const std::string& in, std::string* out)
+{
+	z_stream z;
+	memset(&z, 0, sizeof(z));
+	if (inflateInit2(&z, 16 + MAX_WBITS) != Z_OK)
+		return false;
+	z.next_in = (Bytef*)in.data();
+	z.avail_in = (uInt)in.size();
+	out->clear();
+	int ret;
+	do
+	{
+		char buffer[65536];
+		z.next_out = (Bytef*)buffer;
+		z.avail_out = sizeof(buffer);
+		ret = inflate(&z, Z_NO_FLUSH);
+		out->append(buffer, sizeof(buffer) - z.avail_out);
+	} while (ret == Z_OK);
+	bool ok = (ret == Z_STREAM_END && !z.avail_in);
+	inflateEnd(&z);
+	return ok;
+}
+
+static bool round_trip(const std::string& in, uint32_t chunk, uint64_t* seed, size_t* compressed)
+{
+	std::string gz = gzip(in, chunk, seed);
+	std::string out;
+	if (compressed)
+		*compressed = gz.size();
+	return gunzip(gz, &out) && out == in;
+}
+
+/* Lines like a service's log, with timestamps and a few varying fields. */
+static std::string log_text(size_t size, uint64_t* seed)
+{
+	static const char* messages[] = { "GET /api/orders 200", "POST /api/login 401", "Worker %u picked up job %u", "Cache miss for key user:%u", "Retrying connection to db-%u after %u ms" };
+	std::string text;
+	uint32_t second = 0;
+	while (text.size() < size)
+	{
+		char line[160];
+		char message[96];
+		snprintf(message, sizeof(message), messages[test_random(seed) % std::size(messages)], test_random(seed) % 64, test_random(seed) % 100000);
+		second += test_random(seed) % 3;
+		snprintf(line, sizeof(line), "2025-06-01 %02u:%02u:%02u.%03u [%s] %s\r\n", second / 3600 % 24, second / 60 % 60, second % 60, test_random(seed) % 1000, (test_random(seed) % 8) ? "INFO" : "WARN", message);
+		text += line;
+	}
+	return text;
+}
+
+TEST(deflate_small)
+{
+	CHECK(round_trip("", 0, 0, 0));
+	CHECK(round_trip("a", 0, 0, 0));
+	CHECK(round_trip("ab", 0, 0, 0));
+	CHECK(round_trip("abc", 0, 0, 0));
+	CHECK(round_trip("abcabcabcabc", 0, 0, 0));
+	CHECK(round_trip("hello, world\n", 0, 0, 0));
+	std::string bytes;
+	for (uint32_t i = 0; i < 256; i++)
+		bytes += (char)i;
+	CHECK(round_trip(bytes, 0, 0, 0));
+}
+
+TEST(deflate_header)
+{
+	std::string gz = gzip("x", 0, 0);
+	CHECK(gz.size() > 18);
+	CHECK((unsigned char)gz[0] == 0x1f && (unsigned char)gz[1] == 0x8b && gz[2] == 8);
+	CHECK((unsigned char)gz[4] == 0xd2 && (unsigned char)gz[5] == 0x02 && (unsigned char)gz[6] == 0x96 && (unsigned char)gz[7] == 0x49);
+	CHECK(gz[9] == NSSM_GZIP_OS_NTFS);
+
+	/* The trailer's CRC matches zlib's. */
+	std::string text = "The quick brown fox jumps over the lazy dog";
+	gz = gzip(text, 0, 0);
+	uint32_t crc = (uint32_t)crc32(0, (const Bytef*)text.data(), (uInt)text.size());
+	const unsigned char* trailer = (const unsigned char*)gz.data() + gz.size() - 8;
+	CHECK(trailer[0] == (crc & 0xff) && trailer[3] == crc >> 24);
+	CHECK(trailer[4] == text.size() && !trailer[5]);
+}
+
+/* Runs, long matches, matches across the window slide and incompressible data. */
+TEST(deflate_patterns)
+{
+	uint64_t seed = 3;
+	CHECK(round_trip(std::string(1000000, '\0'), 0, 0, 0));
+	CHECK(round_trip(std::string(300, 'a') + "b" + std::string(70000, 'a'), 0, 0, 0));
+
+	std::string random;
+	for (uint32_t i = 0; i < 200000; i++)
+		random += (char)test_random(&seed);
+	size_t compressed;
+	CHECK(round_trip(random, 0, 0, &compressed));
+	/* Incompressible data is stored rather than grown. */
+	CHECK(compressed < random.size() + random.size() / 100);
+
+	/* The same 40000 bytes twice: the repeat is just within reach. */
+	std::string block = random.substr(0, 32000) + log_text(8000, &seed);
+	CHECK(round_trip(block + block + block, 0, 0, 0));
+
+	/* A small alphabet makes codes of very different lengths. */
+	std::string skewed;
+	for (uint32_t i = 0; i < 100000; i++)
+	{
+		uint32_t r = test_random(&seed);
+		uint32_t bits = 0;
+		while (bits < 20 && (r & (1U << bits)))
+			bits++;
+		skewed += (char)('a' + bits);
+	}
+	CHECK(round_trip(skewed, 0, 0, 0));
+}
+
+/* Input fed in odd sized pieces compresses as well as when it is read in one go. */
+TEST(deflate_chunks)
+{
+	uint64_t seed = 5;
+	std::string text = log_text(300000, &seed);
+	size_t whole = gzip(text, 0, 0).size();
+	for (uint32_t chunk : { 1U, 7U, 258U, 259U, 4096U, 40000U })
+	{
+		uint64_t pieces = chunk;
+		std::string gz = gzip(text, chunk, (chunk > 1) ? &pieces : 0);
+		std::string out;
+		CHECK(gunzip(gz, &out) && out == text);
+		CHECK(gz.size() < whole + whole / 100);
+	}
+}
+
+/* Log text should compress well. */
+TEST(deflate_ratio)
+{
+	uint64_t seed = 9;
+	std::string text = log_text(2000000, &seed);
+	size_t compressed;
+	CHECK(round_trip(text, 0, 0, &compressed));
+	CHECK(compressed < text.size() / 4);
+}
@@ -0,0 +1,169 @@
+/*******************************************************************************
+ encoding_test.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "test.h"
+
+/* Feed a sample to a fresh detector in pieces of the given size. */
+static uint32_t detect_in_pieces(detector_t* detector, const void* address, uint32_t len, uint32_t piece, uint32_t* skipped)
+{
+	ZeroMemory(detector, sizeof(*detector));
+	uint32_t charsize = 0;
+	*skipped = 0;
+	for (uint32_t i = 0; i < len; i += piece)
+	{
+		uint32_t skip;
+		charsize = detect_encoding(detector, (const char*)address + i, std::min(piece, len - i), &skip);
+		*skipped += skip;
+	}
+	return charsize;
+}
+
+static uint32_t detect(const void* address, uint32_t len)
+{
+	detector_t detector;
+	uint32_t skipped;
+	return detect_in_pieces(&detector, address, len, len, &skipped);
+}
+
+/* Fixtures: what services really write. */
+static const char ascii[] = "2026-10-17 12:00:00 Service started\r\nListening on port 8080\r\n";
+static const wchar_t utf16[] = L"2026-10-17 12:00:00 Service started\r\nListening on port 8080\r\n";
+static const wchar_t utf16_cjk[] = { 0x670d, 0x52a1, 0x5df2, 0x542f, 0x52a8, 0x3002, 0x2029 };
+static const char utf8[] = "Dienst gestartet: \xc3\xbc\xc3\xb6\xc3\xa4 \xe2\x9c\x93\n";
+static const uint8_t binary[] = { 0x00, 0x01, 0x00, 0x00, 0x7f, 0x00, 0x00, 0x45, 0x4c, 0x46, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00 };
+
+TEST(encoding_fixtures)
+{
+	text_unicode = false;
+	CHECK(detect(ascii, sizeof(ascii) - 1) == sizeof(char));
+	CHECK(detect(utf8, sizeof(utf8) - 1) == sizeof(char));
+	CHECK(detect(utf16, sizeof(utf16) - sizeof(wchar_t)) == sizeof(wchar_t));
+	/* NULs at even and odd offsets alike aren't UTF-16. */
+	CHECK(detect(binary, sizeof(binary)) == sizeof(char));
+
+	/* With no NULs to count only IsTextUnicode() can tell. */
+	CHECK(detect(utf16_cjk, sizeof(utf16_cjk)) == sizeof(char));
+	text_unicode = true;
+	CHECK(detect(utf16_cjk, sizeof(utf16_cjk)) == sizeof(wchar_t));
+	text_unicode = false;
+}
+
+/* A BOM is recognised and skipped however the reads split it. */
+TEST(encoding_split_bom)
+{
+	uint8_t sample[64];
+	detector_t detector;
+	uint32_t skipped;
+
+	for (uint32_t piece = 1; piece <= 4; piece++)
+	{
+		sample[0] = 0xff;
+		sample[1] = 0xfe;
+		memmove(sample + 2, utf16, 20);
+		CHECK(detect_in_pieces(&detector, sample, 22, piece, &skipped) == sizeof(wchar_t));
+		CHECK(skipped == 2 && detector.certain && !detector.held_len);
+
+		sample[0] = 0xef;
+		sample[1] = 0xbb;
+		sample[2] = 0xbf;
+		memmove(sample + 3, ascii, 20);
+		CHECK(detect_in_pieces(&detector, sample, 23, piece, &skipped) == sizeof(char));
+		CHECK(skipped == 3 && detector.certain && !detector.held_len);
+	}
+
+	/* The start of a BOM which isn't one is held and handed back. */
+	sample[0] = 0xef;
+	sample[1] = 0xbb;
+	sample[2] = 'x';
+	CHECK(detect_in_pieces(&detector, sample, 3, 1, &skipped) == sizeof(char));
+	CHECK(skipped == 2 && detector.held_len == 2 && detector.held[0] == 0xef && detector.held[1] == 0xbb);
+	CHECK(detector.bytes == 3 && !detector.certain);
+
+	sample[0] = 0xff;
+	sample[1] = 'a';
+	CHECK(detect_in_pieces(&detector, sample, 2, 1, &skipped) == sizeof(char));
+	CHECK(skipped == 1 && detector.held_len == 1 && detector.bytes == 2);
+
+	/* Nothing is held when the first read rules a BOM out. */
+	CHECK(detect_in_pieces(&detector, ascii, 20, 20, &skipped) == sizeof(char));
+	CHECK(!skipped && !detector.held_len);
+}
+
+/* A short first read is corrected by later ones, but not after NSSM_DETECT_CERTAIN bytes. */
+TEST(encoding_certain)
+{
+	static char text[NSSM_DETECT_CERTAIN * 2];
+	detector_t detector;
+	uint32_t skip;
+	text_unicode = false;
+
+	/* "a" then UTF-16: the first guess is revised. */
+	ZeroMemory(&detector, sizeof(detector));
+	CHECK(detect_encoding(&detector, utf16, 1, &skip) == sizeof(char));
+	CHECK(detect_encoding(&detector, (const char*)utf16 + 1, sizeof(utf16) - sizeof(wchar_t) - 1, &skip) == sizeof(wchar_t));
+	CHECK(!detector.certain);
+
+	/* Short of the cut-off the guess can still change... */
+	memset(text, 'a', sizeof(text));
+	ZeroMemory(&detector, sizeof(detector));
+	CHECK(detect_encoding(&detector, text, NSSM_DETECT_CERTAIN - 2, &skip) == sizeof(char));
+	CHECK(!detector.certain);
+	for (uint32_t i = 0; i < NSSM_DETECT_CERTAIN; i += 2)
+		text[i + 1] = 0;
+	CHECK(detect_encoding(&detector, text, NSSM_DETECT_CERTAIN, &skip) == sizeof(wchar_t));
+	CHECK(detector.certain);
+
+	/* ...but once it has seen that much it stops looking. */
+	memset(text, 'a', sizeof(text));
+	ZeroMemory(&detector, sizeof(detector));
+	CHECK(detect_encoding(&detector, text, NSSM_DETECT_CERTAIN, &skip) == sizeof(char));
+	CHECK(detector.certain);
+	for (uint32_t i = 0; i < sizeof(text); i += 2)
+		text[i + 1] = 0;
+	text_unicode_calls = 0;
+	CHECK(detect_encoding(&detector, text, sizeof(text), &skip) == sizeof(char));
+	CHECK(!text_unicode_calls);
+	CHECK(detector.bytes == NSSM_DETECT_CERTAIN);
+}
+
+/* Compare the vector paths with a byte at a time count for every block size and alignment. */
+TEST(encoding_count_nuls)
+{
+	static uint8_t storage[2048 + 64];
+	uint64_t seed = 17;
+
+	for (uint32_t round = 0; round < 2000; round++)
+	{
+		uint32_t offset = test_random(&seed) % 64;
+		uint32_t len = (round < 200) ? round : test_random(&seed) % 2048;
+		uint8_t* buffer = storage + offset;
+		for (uint32_t i = 0; i < len; i++)
+			buffer[i] = (test_random(&seed) % 3) ? 0 : (uint8_t)test_random(&seed);
+
+		uint32_t want[2] = { 0, 0 };
+		for (uint32_t i = 0; i < len; i++)
+		{
+			if (!buffer[i])
+				want[i & 1]++;
+		}
+
+		uint32_t even, odd;
+		count_nuls(buffer, len, &even, &odd);
+		CHECK(even == want[0]);
+		CHECK(odd == want[1]);
+	}
+}
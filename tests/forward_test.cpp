@@ -0,0 +1,259 @@
+/*******************************************************************************
+ forward_test.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "test.h"
+
+#include <poll.h>
+
+/* Forwarding to a listener on the loopback interface, standing in for a log agent. */
+
+static stream_stats_t stats;
+
+static void reset_stats()
+{
+	stats.forwarded = 0;
+	stats.forward_dropped = 0;
+	stats.forward_reconnects = 0;
+}
+
+/* Listen on an unused loopback port and set target to a forwarding target for it. */
+static SOCKET listen_loopback(wchar_t* target, size_t len)
+{
+	SOCKET s = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in address;
+	ZeroMemory(&address, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t size = sizeof(address);
+	CHECK(!bind(s, (sockaddr*)&address, sizeof(address)));
+	CHECK(!listen(s, 4));
+	CHECK(!getsockname(s, (sockaddr*)&address, &size));
+	_snwprintf_s(target, len, _TRUNCATE, L"tcp://127.0.0.1:%u", (uint32_t)ntohs(address.sin_port));
+	return s;
+}
+
+/* Accept a connection if one arrives within timeout milliseconds. */
+static SOCKET accept_within(SOCKET listener, int32_t timeout)
+{
+	pollfd p = { listener, POLLIN, 0 };
+	if (poll(&p, 1, timeout) != 1)
+		return INVALID_SOCKET;
+	return accept(listener, nullptr, nullptr);
+}
+
+/* Everything read from s until want has arrived, the connection closes or five seconds pass. */
+static std::string receive(SOCKET s, const char* want)
+{
+	std::string got;
+	uint64_t deadline = GetTickCount64() + 5000;
+	while (got.find(want) == std::string::npos && GetTickCount64() < deadline)
+	{
+		pollfd p = { s, POLLIN, 0 };
+		if (poll(&p, 1, 100) != 1)
+			continue;
+		char buffer[256];
+		ssize_t n = recv(s, buffer, sizeof(buffer), 0);
+		if (n <= 0)
+			break;
+		got.append(buffer, (size_t)n);
+	}
+	return got;
+}
+
+static void send_text(forwarder_t* forwarder, const char* text)
+{
+	forward(forwarder, text, (uint32_t)strlen(text));
+}
+
+static bool logged(uint32_t id)
+{
+	return std::find(logged_events.begin(), logged_events.end(), id) != logged_events.end();
+}
+
+TEST(forward_target_pipe)
+{
+	wchar_t host[64];
+	wchar_t port[16];
+	CHECK(forward_target_type(L"\\\\.\\pipe\\agent", host, 64, port, 16) == NSSM_FORWARD_PIPE);
+	CHECK(forward_target_type(L"\\\\.\\PIPE\\agent", host, 64, port, 16) == NSSM_FORWARD_PIPE);
+	/* A pipe needs a name and must be on this machine. */
+	CHECK(forward_target_type(L"\\\\.\\pipe\\", host, 64, port, 16) == NSSM_FORWARD_NONE);
+	CHECK(forward_target_type(L"\\\\server\\pipe\\agent", host, 64, port, 16) == NSSM_FORWARD_NONE);
+}
+
+TEST(forward_target_tcp)
+{
+	wchar_t host[64];
+	wchar_t port[16];
+	CHECK(forward_target_type(L"tcp://127.0.0.1:5140", host, 64, port, 16) == NSSM_FORWARD_TCP);
+	CHECK(!_wcsicmp(host, L"127.0.0.1") && !_wcsicmp(port, L"5140"));
+	CHECK(forward_target_type(L"TCP://localhost:24224", host, 64, port, 16) == NSSM_FORWARD_TCP);
+	CHECK(!_wcsicmp(host, L"localhost") && !_wcsicmp(port, L"24224"));
+	CHECK(forward_target_type(L"tcp://[::1]:5140", host, 64, port, 16) == NSSM_FORWARD_TCP);
+	CHECK(!_wcsicmp(host, L"::1") && !_wcsicmp(port, L"5140"));
+
+	/* No port, a bad port, an unbracketed IPv6 address, no host, or too long for the buffers. */
+	CHECK(forward_target_type(L"tcp://127.0.0.1", host, 64, port, 16) == NSSM_FORWARD_NONE);
+	CHECK(forward_target_type(L"tcp://127.0.0.1:", host, 64, port, 16) == NSSM_FORWARD_NONE);
+	CHECK(forward_target_type(L"tcp://127.0.0.1:51x", host, 64, port, 16) == NSSM_FORWARD_NONE);
+	CHECK(forward_target_type(L"tcp://::1:5140", host, 64, port, 16) == NSSM_FORWARD_NONE);
+	CHECK(forward_target_type(L"tcp://[::1]5140", host, 64, port, 16) == NSSM_FORWARD_NONE);
+	CHECK(forward_target_type(L"tcp://:5140", host, 64, port, 16) == NSSM_FORWARD_NONE);
+	CHECK(forward_target_type(L"tcp://127.0.0.1:5140", host, 9, port, 16) == NSSM_FORWARD_NONE);
+	CHECK(forward_target_type(L"tcp://127.0.0.1:5140", host, 64, port, 4) == NSSM_FORWARD_NONE);
+	CHECK(forward_target_type(L"udp://127.0.0.1:5140", host, 64, port, 16) == NSSM_FORWARD_NONE);
+	CHECK(forward_target_type(L"C:\\logs\\agent", host, 64, port, 16) == NSSM_FORWARD_NONE);
+}
+
+/* An invalid target gets no forwarder, so the stream is logged to its file only. */
+TEST(forward_bad_target)
+{
+	logged_events.clear();
+	CHECK(!create_forwarder((wchar_t*)L"service", (wchar_t*)L"udp://127.0.0.1:5140", 0, &stats));
+	CHECK(logged(NSSM_EVENT_BAD_FORWARD_TARGET));
+}
+
+/* Output reaches the listener in order, and is counted. */
+TEST(forward_delivery)
+{
+	reset_stats();
+	wchar_t target[64];
+	SOCKET listener = listen_loopback(target, std::size(target));
+	forwarder_t* forwarder = create_forwarder((wchar_t*)L"service", target, 0, &stats);
+	CHECK(forwarder);
+	if (!forwarder)
+	{
+		closesocket(listener);
+		return;
+	}
+
+	send_text(forwarder, "one\n");
+	send_text(forwarder, "two\n");
+	SOCKET agent = accept_within(listener, 5000);
+	CHECK(agent != INVALID_SOCKET);
+	send_text(forwarder, "three\n");
+	CHECK(receive(agent, "three\n") == "one\ntwo\nthree\n");
+
+	/* Whatever is queued is sent before the forwarder goes. */
+	send_text(forwarder, "last\n");
+	close_forwarder(forwarder);
+	CHECK(receive(agent, "last\n") == "last\n");
+	CHECK(stats.forwarded == 19);
+	CHECK(!stats.forward_dropped);
+	CHECK(!stats.forward_reconnects);
+	closesocket(agent);
+	closesocket(listener);
+}
+
+/* When the listener drops the connection the forwarder connects again and carries on. */
+TEST(forward_reconnect)
+{
+	reset_stats();
+	wchar_t target[64];
+	SOCKET listener = listen_loopback(target, std::size(target));
+	forwarder_t* forwarder = create_forwarder((wchar_t*)L"service", target, 0, &stats);
+	CHECK(forwarder);
+	if (!forwarder)
+	{
+		closesocket(listener);
+		return;
+	}
+
+	send_text(forwarder, "first\n");
+	SOCKET agent = accept_within(listener, 5000);
+	CHECK(agent != INVALID_SOCKET);
+	CHECK(receive(agent, "first\n") == "first\n");
+	closesocket(agent);
+
+	/* Output sent after the connection has gone is lost until the send fails. */
+	agent = INVALID_SOCKET;
+	for (int32_t tries = 0; tries < 250 && agent == INVALID_SOCKET; tries++)
+	{
+		send_text(forwarder, "lost\n");
+		agent = accept_within(listener, 20);
+	}
+	CHECK(agent != INVALID_SOCKET);
+
+	send_text(forwarder, "back\n");
+	std::string got = receive(agent, "back\n");
+	CHECK(got.size() >= 5 && !got.compare(got.size() - 5, 5, "back\n"));
+	close_forwarder(forwarder);
+	CHECK(stats.forward_reconnects == 1);
+	CHECK(stats.forward_dropped > 0);
+	closesocket(agent);
+	closesocket(listener);
+}
+
+/*
+  With nobody listening output waits in the queue.  A write which doesn't
+  fit is dropped whole and counted, and what is still queued when the
+  forwarder closes is dropped too.
+*/
+TEST(forward_queue_full)
+{
+	reset_stats();
+	logged_events.clear();
+	wchar_t target[64];
+	closesocket(listen_loopback(target, std::size(target)));
+	forwarder_t* forwarder = create_forwarder((wchar_t*)L"service", target, NSSM_FORWARD_MIN, &stats);
+	CHECK(forwarder);
+	if (!forwarder)
+		return;
+
+	/* Two pieces, each with a header. */
+	std::vector<char> big(100000, 'x');
+	forward(forwarder, big.data(), (uint32_t)big.size());
+	CHECK(!stats.forward_dropped);
+	forward(forwarder, big.data(), (uint32_t)big.size());
+	CHECK(stats.forward_dropped == 100000);
+	send_text(forwarder, "still fits\n");
+	CHECK(stats.forward_dropped == 100000);
+
+	close_forwarder(forwarder);
+	CHECK(stats.forward_dropped == 200000 + 11);
+	CHECK(!stats.forwarded);
+}
+
+/* Output must not leave the machine, whatever the target says. */
+TEST(forward_loopback_only)
+{
+	reset_stats();
+	logged_events.clear();
+	wchar_t target[64];
+	SOCKET listener = listen_loopback(target, std::size(target));
+	/* Connecting to 0.0.0.0 reaches the loopback listener here, but it isn't a loopback address. */
+	wchar_t any[64];
+	_snwprintf_s(any, std::size(any), _TRUNCATE, L"tcp://0.0.0.0:%s", ::wcschr(target + 6, L':') + 1);
+	forwarder_t* forwarder = create_forwarder((wchar_t*)L"service", any, 0, &stats);
+	CHECK(forwarder);
+	if (!forwarder)
+	{
+		closesocket(listener);
+		return;
+	}
+
+	send_text(forwarder, "secret\n");
+	SOCKET agent = accept_within(listener, 300);
+	CHECK(agent == INVALID_SOCKET);
+	if (agent != INVALID_SOCKET)
+		closesocket(agent);
+	close_forwarder(forwarder);
+	CHECK(logged(NSSM_EVENT_FORWARD_FAILED));
+	CHECK(!stats.forwarded);
+	CHECK(stats.forward_dropped == 7);
+	closesocket(listener);
+}
@@ -0,0 +1,415 @@
+/*******************************************************************************
+ handoff_test.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include <string>
+#include <thread>
+
+#include "test.h"
+
+static stream_stats_t stats;
+
+/* A stream with its own pair of ports, so each test can see what was posted. */
+static void start(handoff_t* h, uint32_t buffer_size, uint32_t queue_size, uint32_t policy)
+{
+	CHECK(!init_handoff(h, buffer_size, queue_size, policy, policy == NSSM_QUEUE_SPILL, &stats));
+	h->reader_port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, 0, 0, 1);
+	h->writer_port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, 0, 0, 1);
+	h->key = 1;
+}
+
+static void finish(handoff_t* h)
+{
+	fake_close_port(h->reader_port);
+	fake_close_port(h->writer_port);
+	free_handoff(h);
+}
+
+/* Read text from the pipe and queue it as the reading thread does. */
+static int32_t read_chunk(handoff_t* h, const char* text)
+{
+	uint32_t len = (uint32_t)strlen(text);
+	memmove(h->buffer, text, len);
+	return queue_chunk(h, len);
+}
+
+/* Number of packets waiting at a port, which are taken. */
+static uint32_t packets(HANDLE port)
+{
+	uint32_t count = 0;
+	uint32_t bytes;
+	ULONG_PTR key;
+	OVERLAPPED* overlapped;
+	while (GetQueuedCompletionStatus(port, &bytes, &key, &overlapped, 0))
+		count++;
+	return count;
+}
+
+/* Take the next chunk as the writing thread does. */
+static std::string take(handoff_t* h, int32_t* ret = 0)
+{
+	uint32_t len;
+	uint64_t dropped;
+	uint64_t spilled;
+	int32_t finished = take_chunk(h, &len, &dropped, &spilled);
+	if (ret)
+		*ret = finished;
+	return std::string(h->work, len);
+}
+
+/* Chunks come out in the order they went in, for a single wake. */
+TEST(handoff_order)
+{
+	handoff_t h;
+	start(&h, 64, 1024, NSSM_QUEUE_BLOCK);
+	CHECK(!read_chunk(&h, "one\n"));
+	CHECK(!read_chunk(&h, "two\n"));
+	CHECK(!read_chunk(&h, "three\n"));
+	CHECK(packets(h.writer_port) == 1);
+
+	start_draining(&h);
+	CHECK(take(&h) == "one\n");
+	CHECK(take(&h) == "two\n");
+	int32_t ret;
+	CHECK(take(&h) == "three\n");
+	CHECK(take(&h, &ret).empty());
+	CHECK(!ret);
+
+	/* Having drained the queue, the writer is woken again. */
+	CHECK(!read_chunk(&h, "four\n"));
+	CHECK(packets(h.writer_port) == 1);
+	CHECK(!packets(h.reader_port));
+	finish(&h);
+}
+
+/* With AppQueuePolicy 0 a full queue holds up reading the stream until the writer makes room. */
+TEST(handoff_block)
+{
+	handoff_t h;
+	/* Room for two 10 byte chunks with their headers. */
+	start(&h, 16, 28, NSSM_QUEUE_BLOCK);
+	CHECK(!read_chunk(&h, "aaaaaaaaa\n"));
+	CHECK(!read_chunk(&h, "bbbbbbbbb\n"));
+	CHECK(read_chunk(&h, "ccccccccc\n") == 1);
+	CHECK(h.blocked && h.pending == 10);
+	CHECK(packets(h.writer_port) == 1);
+
+	/* Taking one chunk makes room, so the reader is told to resume, once. */
+	start_draining(&h);
+	CHECK(take(&h) == "aaaaaaaaa\n");
+	CHECK(packets(h.reader_port) == 1);
+	CHECK(take(&h) == "bbbbbbbbb\n");
+	CHECK(take(&h).empty());
+	CHECK(!packets(h.reader_port));
+
+	/* The chunk kept back is queued, and the idle writer woken for it. */
+	CHECK(!resume_reading(&h));
+	CHECK(!h.blocked);
+	CHECK(packets(h.writer_port) == 1);
+	start_draining(&h);
+	CHECK(take(&h) == "ccccccccc\n");
+	CHECK(!stats.dropped.load());
+	finish(&h);
+}
+
+TEST(handoff_drop_oldest)
+{
+	handoff_t h;
+	start(&h, 16, 28, NSSM_QUEUE_DROP_OLDEST);
+	uint64_t dropped = stats.dropped.load();
+	CHECK(!read_chunk(&h, "aaaaaaaaa\n"));
+	CHECK(!read_chunk(&h, "bbbbbbbbb\n"));
+	CHECK(!read_chunk(&h, "ccccccccc\n"));
+	CHECK(!h.blocked);
+	CHECK(stats.dropped.load() - dropped == 10);
+
+	uint32_t len;
+	uint64_t total;
+	uint64_t spilled;
+	start_draining(&h);
+	CHECK(!take_chunk(&h, &len, &total, &spilled));
+	CHECK(std::string(h.work, len) == "bbbbbbbbb\n");
+	CHECK(total == 10 && !spilled);
+	CHECK(take(&h) == "ccccccccc\n");
+	finish(&h);
+}
+
+TEST(handoff_drop_newest)
+{
+	handoff_t h;
+	start(&h, 16, 28, NSSM_QUEUE_DROP_NEWEST);
+	CHECK(!read_chunk(&h, "aaaaaaaaa\n"));
+	CHECK(!read_chunk(&h, "bbbbbbbbb\n"));
+	CHECK(!read_chunk(&h, "ccccccccc\n"));
+	CHECK(h.dropped == 10);
+	start_draining(&h);
+	CHECK(take(&h) == "aaaaaaaaa\n");
+	CHECK(take(&h) == "bbbbbbbbb\n");
+	CHECK(take(&h).empty());
+	finish(&h);
+}
+
+/* Overflow goes to the spill queue for the writer to put on disk, and is dropped when that is full too. */
+TEST(handoff_spill)
+{
+	handoff_t h;
+	start(&h, 16, 28, NSSM_QUEUE_SPILL);
+	CHECK(!read_chunk(&h, "aaaaaaaaa\n"));
+	CHECK(!read_chunk(&h, "bbbbbbbbb\n"));
+	CHECK(!read_chunk(&h, "ccccccccc\n"));
+	CHECK(!read_chunk(&h, "ddddddddd\n"));
+	CHECK(!read_chunk(&h, "eeeeeeeee\n"));
+	CHECK(h.dropped == 10);
+
+	start_draining(&h);
+	uint32_t len = take_spilled(&h);
+	CHECK(std::string(h.work, len) == "ccccccccc\n");
+	count_spilled(&h, len, true);
+	len = take_spilled(&h);
+	CHECK(std::string(h.work, len) == "ddddddddd\n");
+	count_spilled(&h, len, false);
+	CHECK(!take_spilled(&h));
+	CHECK(h.spilled == 10 && h.dropped == 20);
+	CHECK(take(&h) == "aaaaaaaaa\n");
+	finish(&h);
+}
+
+/* A closed stream is finished with only once everything queued has been taken. */
+TEST(handoff_shutdown_drain)
+{
+	handoff_t h;
+	start(&h, 64, 1024, NSSM_QUEUE_BLOCK);
+	CHECK(!read_chunk(&h, "one\n"));
+	CHECK(!read_chunk(&h, "two\n"));
+	close_handoff(&h);
+	/* The wake for the data will do. */
+	CHECK(packets(h.writer_port) == 1);
+
+	int32_t ret;
+	start_draining(&h);
+	CHECK(take(&h, &ret) == "one\n" && !ret);
+	CHECK(take(&h, &ret) == "two\n" && !ret);
+	CHECK(take(&h, &ret).empty());
+	CHECK(ret == 1);
+	finish(&h);
+
+	/* Closed while the writer is draining: it waits for the wake which is on its way. */
+	start(&h, 64, 1024, NSSM_QUEUE_BLOCK);
+	CHECK(!read_chunk(&h, "one\n"));
+	CHECK(packets(h.writer_port) == 1);
+	start_draining(&h);
+	CHECK(take(&h, &ret) == "one\n");
+	CHECK(!read_chunk(&h, "two\n"));
+	close_handoff(&h);
+	CHECK(packets(h.writer_port) == 1);
+	CHECK(take(&h, &ret) == "two\n" && !ret);
+	CHECK(take(&h, &ret).empty() && !ret);
+	start_draining(&h);
+	CHECK(take(&h, &ret).empty());
+	CHECK(ret == 1);
+	finish(&h);
+}
+
+/* A file's owner is finished with after the streams which share it. */
+TEST(handoff_followers)
+{
+	handoff_t h;
+	start(&h, 64, 1024, NSSM_QUEUE_BLOCK);
+	h.followers = 1;
+	close_handoff(&h);
+	CHECK(packets(h.writer_port) == 1);
+	int32_t ret;
+	start_draining(&h);
+	CHECK(take(&h, &ret).empty() && !ret);
+	release_follower(&h);
+	CHECK(packets(h.writer_port) == 1);
+	start_draining(&h);
+	CHECK(take(&h, &ret).empty() && ret == 1);
+	finish(&h);
+}
+
+/* A writer which stops short of emptying the queue, as for a full disk, is woken once to carry on. */
+TEST(handoff_wake_stream)
+{
+	handoff_t h;
+	/* Room for two 10 byte chunks with their headers. */
+	start(&h, 16, 28, NSSM_QUEUE_BLOCK);
+	CHECK(!read_chunk(&h, "aaaaaaaaa\n"));
+	CHECK(!read_chunk(&h, "bbbbbbbbb\n"));
+	CHECK(packets(h.writer_port) == 1);
+	start_draining(&h);
+	CHECK(take(&h) == "aaaaaaaaa\n");
+	CHECK(packets(h.reader_port) == 0);
+
+	/* Meanwhile the reader keeps queueing, and blocks when the queue is full. */
+	CHECK(!read_chunk(&h, "ccccccccc\n"));
+	CHECK(read_chunk(&h, "ddddddddd\n") == 1);
+	CHECK(packets(h.writer_port) == 1);
+	start_draining(&h);
+
+	wake_stream(&h);
+	wake_stream(&h);
+	CHECK(packets(h.writer_port) == 1);
+	start_draining(&h);
+	CHECK(take(&h) == "bbbbbbbbb\n");
+	CHECK(packets(h.reader_port) == 1);
+	CHECK(take(&h) == "ccccccccc\n");
+	CHECK(!resume_reading(&h));
+	CHECK(packets(h.writer_port) == 1);
+	start_draining(&h);
+	CHECK(take(&h) == "ddddddddd\n");
+	CHECK(take(&h).empty());
+	finish(&h);
+}
+
+/* The read buffer doubles after successive full reads, up to half the queue, and the writer keeps up. */
+TEST(handoff_grow)
+{
+	handoff_t h;
+	start(&h, 16, 136, NSSM_QUEUE_BLOCK);
+	CHECK(max_read_size(136) == 64);
+	std::string full(16, 'x');
+	for (uint32_t i = 1; i < NSSM_STDIO_BUFFER_GROW; i++)
+		grow_buffer(&h, 16);
+	/* A short read starts the count again. */
+	grow_buffer(&h, 15);
+	for (uint32_t i = 1; i < NSSM_STDIO_BUFFER_GROW; i++)
+		grow_buffer(&h, 16);
+	CHECK(h.buffer_size == 16);
+	grow_buffer(&h, 16);
+	CHECK(h.buffer_size == 32);
+
+	for (uint32_t i = 0; i < NSSM_STDIO_BUFFER_GROW * 4; i++)
+		grow_buffer(&h, h.buffer_size);
+	CHECK(h.buffer_size == 64);
+
+	std::string big(64, 'y');
+	memmove(h.buffer, big.data(), big.size());
+	CHECK(!queue_chunk(&h, (uint32_t)big.size()));
+	start_draining(&h);
+	CHECK(take(&h) == big);
+	CHECK(h.work_size == 64);
+	finish(&h);
+}
+
+/*
+  The reading and writing threads as the service runs them, serving two
+  streams through one pair of ports with small queues, so the reader
+  often has to wait for the writer.  Every byte arrives, in order.
+*/
+TEST(handoff_threads)
+{
+	const uint32_t streams = 2;
+	HANDLE reader_port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, 0, 0, 1);
+	HANDLE writer_port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, 0, 0, 1);
+	handoff_t h[streams];
+	std::string expected[streams];
+	std::string written[streams];
+	for (uint32_t s = 0; s < streams; s++)
+	{
+		CHECK(!init_handoff(&h[s], 32, 256, NSSM_QUEUE_BLOCK, false, &stats));
+		h[s].reader_port = reader_port;
+		h[s].writer_port = writer_port;
+		h[s].key = s + 1;
+		for (uint32_t line = 0; line < 20000; line++)
+			expected[s] += "stream " + std::to_string(s) + " line " + std::to_string(line) + "\n";
+	}
+
+	std::thread writer([&]
+	{
+		uint32_t finished = 0;
+		while (finished < streams)
+		{
+			uint32_t bytes;
+			ULONG_PTR key;
+			OVERLAPPED* overlapped;
+			if (!GetQueuedCompletionStatus(writer_port, &bytes, &key, &overlapped, INFINITE))
+				break;
+			handoff_t* stream = &h[key - 1];
+			start_draining(stream);
+			while (true)
+			{
+				uint32_t len;
+				uint64_t dropped;
+				uint64_t spilled;
+				int32_t ret = take_chunk(stream, &len, &dropped, &spilled);
+				written[key - 1].append(stream->work, len);
+				if (ret == 1)
+					finished++;
+				if (!len)
+					break;
+			}
+		}
+	});
+
+	std::thread reader([&]
+	{
+		uint64_t random = 12345;
+		size_t offset[streams] = {};
+		bool closed[streams] = {};
+		uint32_t open = streams;
+		/* The first packet for a new stream. */
+		for (uint32_t s = 0; s < streams; s++)
+			resume_reading(&h[s]);
+
+		while (open)
+		{
+			bool waiting = true;
+			for (uint32_t s = 0; s < streams; s++)
+			{
+				if (closed[s] || h[s].blocked)
+					continue;
+				waiting = false;
+				if (offset[s] == expected[s].size())
+				{
+					close_handoff(&h[s]);
+					closed[s] = true;
+					open--;
+					continue;
+				}
+				uint32_t len = test_random(&random) % h[s].buffer_size + 1;
+				if (test_random(&random) % 4 == 0)
+					len = h[s].buffer_size;
+				len = (uint32_t)std::min((size_t)len, expected[s].size() - offset[s]);
+				memmove(h[s].buffer, expected[s].data() + offset[s], len);
+				offset[s] += len;
+				if (!queue_chunk(&h[s], len))
+					grow_buffer(&h[s], len);
+			}
+			if (!waiting)
+				continue;
+
+			/* Every open stream is blocked, so wait to be told there is room. */
+			uint32_t bytes;
+			ULONG_PTR key;
+			OVERLAPPED* overlapped;
+			if (!GetQueuedCompletionStatus(reader_port, &bytes, &key, &overlapped, INFINITE))
+				break;
+			resume_reading(&h[key - 1]);
+		}
+	});
+
+	reader.join();
+	writer.join();
+	for (uint32_t s = 0; s < streams; s++)
+	{
+		CHECK(written[s] == expected[s]);
+		CHECK(!h[s].dropped);
+		free_handoff(&h[s]);
+	}
+	fake_close_port(reader_port);
+	fake_close_port(writer_port);
+}
@@ -0,0 +1,95 @@
+/*******************************************************************************
+ json_test.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "test.h"
+
+static bool escapes_to(const char* in, const char* expected)
+{
+	char out[256];
+	uint32_t len = json_escape(in, (uint32_t)strlen(in), out);
+	return len == strlen(expected) && !memcmp(out, expected, len);
+}
+
+/* A byte at a time with snprintf(). */
+static uint32_t reference_escape(const uint8_t* buffer, uint32_t len, char* out)
+{
+	char* start = out;
+	for (uint32_t i = 0; i < len; i++)
+	{
+		uint8_t c = buffer[i];
+		const char* named = 0;
+		switch (c)
+		{
+		case '"': named = "\\\""; break;
+		case '\\': named = "\\\\"; break;
+		case '\b': named = "\\b"; break;
+		case '\f': named = "\\f"; break;
+		case '\n': named = "\\n"; break;
+		case '\r': named = "\\r"; break;
+		case '\t': named = "\\t"; break;
+		}
+		if (named)
+			out += sprintf(out, "%s", named);
+		else if (c < 0x20)
+			out += sprintf(out, "\\u%04x", c);
+		else
+			*out++ = (char)c;
+	}
+	return (uint32_t)(out - start);
+}
+
+TEST(json_escape_simple)
+{
+	CHECK(escapes_to("", ""));
+	CHECK(escapes_to("plain text", "plain text"));
+	CHECK(escapes_to("say \"hi\"\\n", "say \\\"hi\\\"\\\\n"));
+	CHECK(escapes_to("a\tb\r\n", "a\\tb\\r\\n"));
+	CHECK(escapes_to("\x01\x1f\x20\x7f", "\\u0001\\u001f \x7f"));
+	/* Multibyte UTF-8 passes through untouched. */
+	CHECK(escapes_to("caf\xc3\xa9 \xe2\x82\xac", "caf\xc3\xa9 \xe2\x82\xac"));
+}
+
+/* Compare the vector paths with the reference for every block size and alignment. */
+TEST(json_escape_reference)
+{
+	static uint8_t storage[1024 + 64];
+	static char out[(1024 + 64) * JSON_ESCAPE_MAX];
+	static char expected[(1024 + 64) * JSON_ESCAPE_MAX];
+	uint64_t seed = 15;
+
+	for (uint32_t round = 0; round < 2000; round++)
+	{
+		uint32_t offset = test_random(&seed) % 64;
+		uint32_t len = (round < 200) ? round : test_random(&seed) % 1024;
+		/* Mostly text, sometimes nothing but bytes to escape. */
+		uint32_t special = (round % 7) ? 8 : 1;
+		uint8_t* buffer = storage + offset;
+		for (uint32_t i = 0; i < len; i++)
+		{
+			uint8_t c = (uint8_t)test_random(&seed);
+			if (test_random(&seed) % special)
+				c = (uint8_t)(0x20 + c % 0x5f);
+			buffer[i] = c;
+		}
+
+		uint32_t want = reference_escape(buffer, len, expected);
+		uint32_t got = json_escape((const char*)buffer, len, out);
+		CHECK(got == want);
+		CHECK(!memcmp(out, expected, std::min(got, want)));
+		CHECK(got <= len * JSON_ESCAPE_MAX);
+	}
+}
@@ -0,0 +1,195 @@
+/*******************************************************************************
+ logread_test.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "test.h"
+
+static wchar_t live_path[] = L"C:\\logs\\foo.log";
+static wchar_t out_path[] = L"C:\\out.txt";
+
+/* Each file operation happens a millisecond after the last, so creation times differ. */
+static void tick()
+{
+	fake_now += 10000;
+}
+
+/* Write to the live file as the logger does, with a handle which lets it be renamed. */
+static void append(const wchar_t* path, const char* text)
+{
+	tick();
+	HANDLE file = CreateFileW(path, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	LARGE_INTEGER zero;
+	zero.QuadPart = 0;
+	unsigned long written;
+	SetFilePointerEx(file, zero, 0, FILE_END);
+	WriteFile(file, text, (uint32_t)strlen(text), &written, 0);
+	CloseHandle(file);
+}
+
+/* Rotate by renaming the live file, then start a new one with text. */
+static void rotate(const wchar_t* rotated, const char* text)
+{
+	tick();
+	MoveFileW(live_path, rotated);
+	append(live_path, text);
+}
+
+/* Rotate by copying the live file and truncating it, as AppRotateCopyTruncate does. */
+static void copy_truncate(const wchar_t* rotated, const char* text)
+{
+	tick();
+	CopyFileW(live_path, rotated, TRUE);
+	HANDLE live = CreateFileW(live_path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	HANDLE copy = CreateFileW(rotated, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	FILETIME created;
+	GetFileTime(live, &created, 0, 0);
+	SetFileTime(copy, &created, 0, 0);
+	LARGE_INTEGER zero;
+	zero.QuadPart = 0;
+	SetFilePointerEx(live, zero, 0, FILE_BEGIN);
+	SetEndOfFile(live);
+	CloseHandle(copy);
+	CloseHandle(live);
+	append(live_path, text);
+}
+
+typedef struct
+{
+	log_reader_t reader;
+	log_follower_t follower;
+} follow_test_t;
+
+static void start(follow_test_t* t, int64_t offset)
+{
+	fake_reset();
+	fake_now = 133000000000000000ULL;
+	logged_events.clear();
+	ZeroMemory(t, sizeof(*t));
+	t->reader.output = CreateFileW(out_path, GENERIC_WRITE, FILE_SHARE_READ, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	t->reader.buffer = (char*)HeapAlloc(GetProcessHeap(), 0, NSSM_LOGS_BUFFER_SIZE);
+	rotated_file_t seen;
+	ZeroMemory(&seen, sizeof(seen));
+	start_following(&t->follower, live_path, offset, &seen);
+}
+
+static void finish(follow_test_t* t)
+{
+	stop_following(&t->follower);
+	CloseHandle(t->reader.output);
+	HeapFree(GetProcessHeap(), 0, t->reader.buffer);
+	fake_now = 0;
+}
+
+/* Rotations made between two looks are all printed, in order, and nothing twice. */
+TEST(follow_two_rotations)
+{
+	follow_test_t t;
+	start(&t, 0);
+	append(live_path, "a1\n");
+	CHECK(!poll_log(&t.reader, &t.follower));
+	CHECK(fake_contents(out_path) == "a1\n");
+
+	append(live_path, "a2\n");
+	rotate(L"C:\\logs\\foo-20250601T120000.000.log", "b1\n");
+	append(live_path, "b2\n");
+	rotate(L"C:\\logs\\foo-20250601T120001.000.log", "c1\n");
+	CHECK(!poll_log(&t.reader, &t.follower));
+	CHECK(fake_contents(out_path) == "a1\na2\nb1\nb2\nc1\n");
+
+	/* Nothing new. */
+	CHECK(!poll_log(&t.reader, &t.follower));
+	CHECK(fake_contents(out_path) == "a1\na2\nb1\nb2\nc1\n");
+
+	append(live_path, "c2\n");
+	CHECK(!poll_log(&t.reader, &t.follower));
+	CHECK(fake_contents(out_path) == "a1\na2\nb1\nb2\nc1\nc2\n");
+	CHECK(logged_events.empty());
+	finish(&t);
+}
+
+/* The same with copy and truncate, where the live file is never renamed. */
+TEST(follow_two_copies)
+{
+	follow_test_t t;
+	start(&t, 0);
+	append(live_path, "a1\n");
+	CHECK(!poll_log(&t.reader, &t.follower));
+
+	append(live_path, "a2\n");
+	copy_truncate(L"C:\\logs\\foo-20250601T120000.000.log", "b1\n");
+	copy_truncate(L"C:\\logs\\foo-20250601T120001.000.log", "c1\n");
+	CHECK(!poll_log(&t.reader, &t.follower));
+	CHECK(fake_contents(out_path) == "a1\na2\nb1\nc1\n");
+
+	append(live_path, "c2\n");
+	CHECK(!poll_log(&t.reader, &t.follower));
+	CHECK(fake_contents(out_path) == "a1\na2\nb1\nc1\nc2\n");
+	finish(&t);
+}
+
+/* Following from the end of the file skips what was there, and rotations made before we started. */
+TEST(follow_from_end)
+{
+	follow_test_t t;
+	start(&t, 0);
+	append(live_path, "old\n");
+	rotate(L"C:\\logs\\foo-20250601T120000.000.log", "live\n");
+	rotated_file_t* files;
+	CHECK(find_rotated_files(live_path, &files) == 1);
+	start_following(&t.follower, live_path, 5, files);
+	HeapFree(GetProcessHeap(), 0, files);
+
+	CHECK(!poll_log(&t.reader, &t.follower));
+	CHECK(fake_contents(out_path).empty());
+	append(live_path, "new\n");
+	rotate(L"C:\\logs\\foo-20250601T120001.000.log", "b\n");
+	rotate(L"C:\\logs\\foo-20250601T120002.000.log", "c\n");
+	CHECK(!poll_log(&t.reader, &t.follower));
+	CHECK(fake_contents(out_path) == "new\nb\nc\n");
+	finish(&t);
+}
+
+/* A rotation compressed and removed before we looked is finished from our own handle. */
+TEST(follow_compressed_rotation)
+{
+	follow_test_t t;
+	start(&t, 0);
+	append(live_path, "a1\n");
+	CHECK(!poll_log(&t.reader, &t.follower));
+
+	append(live_path, "a2\n");
+	rotate(L"C:\\logs\\foo-20250601T120000.000.log", "b1\n");
+	fake_file(L"C:\\logs\\foo-20250601T120000.000.log.gz", "gzip");
+	CHECK(DeleteFileW(L"C:\\logs\\foo-20250601T120000.000.log"));
+	CHECK(!poll_log(&t.reader, &t.follower));
+	CHECK(fake_contents(out_path) == "a1\na2\nb1\n");
+	finish(&t);
+}
+
+/* Output read from a window of a file starts at the beginning of a line. */
+TEST(print_log_range)
+{
+	follow_test_t t;
+	start(&t, 0);
+	append(live_path, "one\ntwo\nthree\n");
+	int64_t printed;
+	CHECK(!print_log_range(&t.reader, live_path, 2, 8, &printed));
+	CHECK(fake_contents(out_path) == "two\n");
+	CHECK(printed == 8);
+	/* A rotation removed since it was listed. */
+	CHECK(!print_log_range(&t.reader, (wchar_t*)L"C:\\logs\\gone.log", 0, -1, 0));
+	finish(&t);
+}
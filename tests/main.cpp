@@ -0,0 +1,76 @@
+/*******************************************************************************
+ main.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "test.h"
+
+typedef struct
+{
+	const char* name;
+	test_function_t function;
+} test_t;
+
+static test_t tests[256];
+static uint32_t test_count;
+static uint32_t failures;
+
+int32_t register_test(const char* name, test_function_t function)
+{
+	if (test_count == std::size(tests))
+	{
+		fprintf(stderr, "Too many tests to register %s\n", name);
+		::exit(2);
+	}
+	tests[test_count].name = name;
+	tests[test_count].function = function;
+	return (int32_t)test_count++;
+}
+
+void test_failed(const char* file, int32_t line, const char* condition)
+{
+	fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, condition);
+	failures++;
+}
+
+/* Run every test, or those whose names start with the arguments. */
+int main(int argc, char** argv)
+{
+	uint32_t ran = 0;
+	uint32_t failed = 0;
+	for (uint32_t i = 0; i < test_count; i++)
+	{
+		bool wanted = (argc < 2);
+		for (int32_t j = 1; j < argc; j++)
+		{
+			if (!strncmp(tests[i].name, argv[j], strlen(argv[j])))
+				wanted = true;
+		}
+		if (!wanted)
+			continue;
+
+		uint32_t before = failures;
+		tests[i].function();
+		ran++;
+		if (failures != before)
+		{
+			fprintf(stderr, "FAILED %s\n", tests[i].name);
+			failed++;
+		}
+	}
+
+	printf("%u tests, %u failed (%s)\n", ran, failed, simd_path());
+	return failed ? 1 : 0;
+}
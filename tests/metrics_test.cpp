@@ -0,0 +1,53 @@
+/*******************************************************************************
+ metrics_test.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "test.h"
+
+TEST(metrics_latency_small)
+{
+	for (uint32_t us = 0; us < NSSM_LATENCY_SUB; us++)
+	{
+		CHECK(latency_bucket(us) == us);
+		CHECK(latency_bucket_value(us) == us);
+	}
+	CHECK(latency_bucket(NSSM_LATENCY_SUB) == NSSM_LATENCY_SUB);
+	CHECK(latency_bucket(~0ULL) == NSSM_LATENCY_BUCKETS - 1);
+}
+
+/* Each bucket starts where the last ended and holds values to within 12.5%. */
+TEST(metrics_latency_buckets)
+{
+	for (uint32_t bucket = 0; bucket + 1 < NSSM_LATENCY_BUCKETS; bucket++)
+	{
+		uint64_t low = latency_bucket_value(bucket);
+		uint64_t high = latency_bucket_value(bucket + 1);
+		CHECK(low < high);
+		CHECK(latency_bucket(low) == bucket);
+		CHECK(latency_bucket(high - 1) == bucket);
+		CHECK(high - low == 1 || (high - low) * NSSM_LATENCY_SUB <= low);
+	}
+
+	uint64_t seed = 12;
+	for (uint32_t round = 0; round < 100000; round++)
+	{
+		uint64_t us = ((uint64_t)test_random(&seed) << 32 | test_random(&seed)) >> (test_random(&seed) % 64);
+		uint32_t bucket = latency_bucket(us);
+		CHECK(latency_bucket_value(bucket) <= us);
+		if (bucket + 1 < NSSM_LATENCY_BUCKETS)
+			CHECK(us < latency_bucket_value(bucket + 1));
+	}
+}
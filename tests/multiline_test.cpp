@@ -0,0 +1,238 @@
+/*******************************************************************************
+ multiline_test.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "test.h"
+
+/* Does the pattern match the start of an 8-bit line? */
+static bool starts(const wchar_t* pattern, const char* line)
+{
+	multiline_t multiline;
+	ZeroMemory(&multiline, sizeof(multiline));
+	multiline.rule = NSSM_MULTILINE_PATTERN;
+	if (compile_pattern(pattern, &multiline))
+		return false;
+	return !continues_record(&multiline, line, (uint32_t)strlen(line), sizeof(char));
+}
+
+static bool compiles(const wchar_t* pattern)
+{
+	multiline_t multiline;
+	return !compile_pattern(pattern, &multiline);
+}
+
+TEST(multiline_indent)
+{
+	multiline_t multiline;
+	ZeroMemory(&multiline, sizeof(multiline));
+	multiline.rule = NSSM_MULTILINE_INDENT;
+	CHECK(continues_record(&multiline, " at Main()", 10, sizeof(char)));
+	CHECK(continues_record(&multiline, "\tat Main()", 10, sizeof(char)));
+	CHECK(!continues_record(&multiline, "Exception", 9, sizeof(char)));
+	CHECK(!continues_record(&multiline, "", 0, sizeof(char)));
+}
+
+TEST(multiline_literals_and_classes)
+{
+	CHECK(starts(L"^\\d{4}-\\d{2}-\\d{2}", "2025-05-31 12:00:00 started"));
+	CHECK(!starts(L"^\\d{4}-\\d{2}-\\d{2}", "   at Worker.Run()"));
+	CHECK(starts(L"\\[\\w+\\]", "[INFO] ok"));
+	CHECK(!starts(L"\\[\\w+\\]", "[] ok"));
+	CHECK(starts(L"[A-Z][a-z]+:", "Error: x"));
+	CHECK(!starts(L"[A-Z][a-z]+:", "error: x"));
+	CHECK(starts(L"[^ \\t]", "x"));
+	CHECK(!starts(L"[^ \\t]", "\tx"));
+	CHECK(starts(L"\\S\\s\\D\\W", "a 1!") == false);
+	CHECK(starts(L"\\S\\s\\D\\W", "a x!"));
+	CHECK(starts(L"a\\tb", "a\tb"));
+}
+
+TEST(multiline_repeats)
+{
+	CHECK(starts(L"a*b", "aaab"));
+	CHECK(starts(L"a*b", "b"));
+	CHECK(!starts(L"a*b", "c"));
+	CHECK(!starts(L"a+b", "b"));
+	CHECK(starts(L"a+b", "ab"));
+	CHECK(starts(L"x?y", "y"));
+	CHECK(starts(L"x?y", "xy"));
+	CHECK(!starts(L"x?y", "xxy"));
+	CHECK(!starts(L"a{2,4}b", "ab"));
+	CHECK(starts(L"a{2,4}b", "aab"));
+	CHECK(starts(L"a{2,4}b", "aaaab"));
+	CHECK(!starts(L"a{2,4}b", "aaaaab"));
+	CHECK(starts(L"a{2,}b", "aaaaaaab"));
+	CHECK(!starts(L"a{2,}b", "ab"));
+	CHECK(starts(L"a{0}b", "b"));
+
+	/* Matches which need a greedy repeat to give characters back. */
+	CHECK(starts(L".*x", "abcxdef"));
+	CHECK(starts(L"\\w+\\d", "abc1"));
+	CHECK(starts(L"a*a*ab", "aaaab"));
+}
+
+TEST(multiline_line_ends)
+{
+	/* The line may run on into the rest of the chunk. */
+	CHECK(!starts(L".*x", "abc\nx"));
+	CHECK(!starts(L"[^a]*x", "b\r\nx"));
+	CHECK(!starts(L"\\D*x", "b\nx"));
+}
+
+TEST(multiline_limits)
+{
+	CHECK(compiles(L".{63}"));
+	CHECK(!compiles(L".{64}"));
+	CHECK(!compiles(L"a{2,254}"));
+	CHECK(compiles(L"a{60,}b"));
+	CHECK(!compiles(L"a*b{63}"));
+	CHECK(!compiles(L"*a"));
+	CHECK(!compiles(L"a{2"));
+	CHECK(!compiles(L"a{3,2}"));
+	CHECK(!compiles(L"[abc"));
+	CHECK(!compiles(L"a\\"));
+
+	/* Only the start of a line is looked at. */
+	std::string line(NSSM_PATTERN_SCAN - 1, 'a');
+	CHECK(starts(L"a*x", (line + "x").c_str()));
+	CHECK(!starts(L"a*x", (line + "ax").c_str()));
+}
+
+TEST(multiline_utf16)
+{
+	multiline_t multiline;
+	ZeroMemory(&multiline, sizeof(multiline));
+	multiline.rule = NSSM_MULTILINE_PATTERN;
+
+	const wchar_t line[] = L"\x4e2d\x6587 text";
+	uint32_t bufsize = (uint32_t)sizeof(line) - sizeof(wchar_t);
+	CHECK(!compile_pattern(L"..\\s", &multiline));
+	CHECK(!continues_record(&multiline, line, bufsize, sizeof(wchar_t)));
+	CHECK(!compile_pattern(L"\\D\\W", &multiline));
+	CHECK(!continues_record(&multiline, line, bufsize, sizeof(wchar_t)));
+	CHECK(!compile_pattern(L"[a-z\\x]", &multiline));
+	CHECK(continues_record(&multiline, line, bufsize, sizeof(wchar_t)));
+	CHECK(!compile_pattern(L"\\w", &multiline));
+	CHECK(continues_record(&multiline, line, bufsize, sizeof(wchar_t)));
+}
+
+/* Patterns which send a backtracking matcher exponential take no time at all. */
+TEST(multiline_pathological)
+{
+	std::string line(NSSM_PATTERN_SCAN, 'a');
+	for (uint32_t i = 0; i < 1000; i++)
+	{
+		CHECK(!starts(L"a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*b", line.c_str()));
+		CHECK(!starts(L"a?a?a?a?a?a?a?a?a?a?a?a?a?a?a?a?a?a?a?a?a?a?a?a?a?a?a?a?a?a?b", line.c_str()));
+	}
+}
+
+/*
+  Compare with a plain backtracking matcher on random patterns made of
+  a, b, . and [ab] with every kind of repeat.
+*/
+typedef struct
+{
+	char c;
+	uint32_t min;
+	uint32_t max;
+} reference_token_t;
+
+static bool reference_match(const std::vector<reference_token_t>& tokens, size_t t, const std::string& line, size_t i)
+{
+	if (t == tokens.size())
+		return true;
+
+	const reference_token_t& token = tokens[t];
+	for (uint32_t n = 0; ; n++)
+	{
+		if (n >= token.min && reference_match(tokens, t + 1, line, i + n))
+			return true;
+		if (n == token.max || i + n == line.size())
+			return false;
+		char c = line[i + n];
+		bool matches = (token.c == '.') ? (c != '\n') : (token.c == 'x') ? (c == 'a' || c == 'b') : (c == token.c);
+		if (!matches)
+			return false;
+	}
+}
+
+TEST(multiline_reference)
+{
+	static const char* const sets[] = { "a", "b", ".", "[ab]" };
+	static const char set_chars[] = { 'a', 'b', '.', 'x' };
+	uint64_t seed = 18;
+	for (uint32_t round = 0; round < 20000; round++)
+	{
+		std::vector<reference_token_t> tokens;
+		std::wstring pattern;
+		std::string narrow;
+		uint32_t count = 1 + test_random(&seed) % 6;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint32_t set = test_random(&seed) % 4;
+			reference_token_t token = { set_chars[set], 1, 1 };
+			narrow += sets[set];
+
+			switch (test_random(&seed) % 6)
+			{
+			case 1:
+				narrow += '*';
+				token.min = 0;
+				token.max = UINT32_MAX;
+				break;
+
+			case 2:
+				narrow += '+';
+				token.max = UINT32_MAX;
+				break;
+
+			case 3:
+				narrow += '?';
+				token.min = 0;
+				break;
+
+			case 4:
+				token.min = test_random(&seed) % 3;
+				token.max = token.min + test_random(&seed) % 3;
+				narrow += '{' + std::to_string(token.min) + ',' + std::to_string(token.max) + '}';
+				break;
+
+			case 5:
+				token.min = test_random(&seed) % 3;
+				token.max = UINT32_MAX;
+				narrow += '{' + std::to_string(token.min) + ",}";
+				break;
+			}
+			tokens.push_back(token);
+		}
+		for (char c : narrow)
+			pattern += (wchar_t)c;
+
+		std::string line;
+		uint32_t len = test_random(&seed) % 10;
+		for (uint32_t i = 0; i < len; i++)
+			line += "abc\n"[test_random(&seed) % 4];
+
+		bool expected = reference_match(tokens, 0, line, 0);
+		if (starts(pattern.c_str(), line.c_str()) != expected)
+		{
+			fprintf(stderr, "pattern %s line \"%s\"\n", narrow.c_str(), line.c_str());
+			CHECK(!"matches as the reference does");
+			break;
+		}
+	}
+}
@@ -0,0 +1,102 @@
+/*******************************************************************************
+ queue_test.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "test.h"
+
+TEST(queue_simple)
+{
+	log_queue_t queue;
+	char out[16];
+	CHECK(!init_queue(&queue, 32));
+	CHECK(!queue_peek(&queue));
+	CHECK(!queue_get(&queue, out, sizeof(out)));
+	CHECK(!queue_drop(&queue));
+
+	CHECK(queue_put(&queue, "hello", 5));
+	CHECK(queue_put(&queue, "world", 5));
+	CHECK(queue.records == 2);
+	CHECK(queue.used == 2 * (NSSM_QUEUE_HEADER + 5));
+
+	/* Exactly full, then one byte too many. */
+	CHECK(queue_fits(&queue, 32 - queue.used - NSSM_QUEUE_HEADER));
+	CHECK(!queue_fits(&queue, 32 - queue.used - NSSM_QUEUE_HEADER + 1));
+	CHECK(!queue_put(&queue, "0123456789abcdef", 16));
+
+	/* A record too big for the buffer stays queued. */
+	CHECK(queue_peek(&queue) == 5);
+	CHECK(!queue_get(&queue, out, 4));
+	CHECK(queue_get(&queue, out, sizeof(out)) == 5 && !memcmp(out, "hello", 5));
+	CHECK(queue_drop(&queue) == 5);
+	CHECK(!queue.records && !queue.used && !queue.head);
+	free_queue(&queue);
+	CHECK(!queue.data);
+}
+
+/* Random puts, gets and drops on a small queue, so records wrap, against a list. */
+TEST(queue_reference)
+{
+	log_queue_t queue;
+	CHECK(!init_queue(&queue, 101));
+	std::vector<std::string> expected;
+	uint32_t expected_used = 0;
+	uint64_t seed = 11;
+
+	for (uint32_t round = 0; round < 20000; round++)
+	{
+		char record[64];
+		char out[64];
+		uint32_t operation = test_random(&seed) % 4;
+		if (operation < 2)
+		{
+			uint32_t len = test_random(&seed) % sizeof(record);
+			for (uint32_t i = 0; i < len; i++)
+				record[i] = (char)test_random(&seed);
+			bool fits = expected_used + NSSM_QUEUE_HEADER + len <= queue.size;
+			CHECK(queue_fits(&queue, len) == fits);
+			CHECK(queue_put(&queue, record, len) == fits);
+			if (fits)
+			{
+				expected.push_back(std::string(record, len));
+				expected_used += NSSM_QUEUE_HEADER + len;
+			}
+		}
+		else if (expected.empty())
+		{
+			CHECK(!queue_peek(&queue));
+			CHECK(!queue_drop(&queue));
+		}
+		else
+		{
+			uint32_t len = (uint32_t)expected.front().size();
+			CHECK(queue_peek(&queue) == len);
+			if (operation == 2)
+			{
+				CHECK(queue_get(&queue, out, sizeof(out)) == len);
+				CHECK(!memcmp(out, expected.front().data(), len));
+			}
+			else
+				CHECK(queue_drop(&queue) == len);
+			expected.erase(expected.begin());
+			expected_used -= NSSM_QUEUE_HEADER + len;
+		}
+
+		CHECK(queue.records == expected.size());
+		CHECK(queue.used == expected_used);
+	}
+
+	free_queue(&queue);
+}
@@ -0,0 +1,111 @@
+/*******************************************************************************
+ ratelimit_test.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "test.h"
+
+/* Start the clock at zero so the tests don't depend on GetTickCount64(). */
+static void start_limit(rate_limit_t* limit, uint32_t bytes, uint32_t lines, uint32_t policy, uint32_t sample)
+{
+	init_rate_limit(limit, bytes, lines, policy, sample);
+	limit->refilled_at = 0;
+}
+
+TEST(ratelimit_lines)
+{
+	rate_limit_t limit;
+	start_limit(&limit, 0, 10, NSSM_RATE_LIMIT_DROP, 0);
+	CHECK(want_rate_limit(&limit));
+
+	/* A second's worth as a burst, then nothing. */
+	for (uint32_t i = 0; i < 10; i++)
+		CHECK(admit_line(&limit, 80) == NSSM_LINE_ADMITTED);
+	CHECK(admit_line(&limit, 80) == NSSM_LINE_DROPPED);
+	CHECK(admit_line(&limit, 20) == NSSM_LINE_DROPPED);
+	CHECK(limit.dropped_lines == 2 && limit.dropped_bytes == 100);
+
+	/* A tenth of a second buys one line, and no time buys nothing. */
+	refill_rate_limit(&limit, 100);
+	refill_rate_limit(&limit, 100);
+	CHECK(admit_line(&limit, 80) == NSSM_LINE_ADMITTED);
+	CHECK(admit_line(&limit, 80) == NSSM_LINE_DROPPED);
+
+	/* The bucket holds no more than a second's worth. */
+	refill_rate_limit(&limit, 60000);
+	CHECK(limit.lines.tokens == 10 * 1000);
+}
+
+TEST(ratelimit_bytes)
+{
+	rate_limit_t limit;
+	start_limit(&limit, 1000, 0, NSSM_RATE_LIMIT_DROP, 0);
+
+	/* A line longer than the rate gets through but runs up a debt. */
+	CHECK(admit_line(&limit, 2500) == NSSM_LINE_ADMITTED);
+	refill_rate_limit(&limit, 1000);
+	CHECK(admit_line(&limit, 1) == NSSM_LINE_ADMITTED);
+
+	/* Refilling in single milliseconds loses nothing to rounding. */
+	start_limit(&limit, 7, 0, NSSM_RATE_LIMIT_DROP, 0);
+	CHECK(admit_line(&limit, 7) == NSSM_LINE_ADMITTED);
+	for (uint64_t now = 1; now <= 1000; now++)
+		refill_rate_limit(&limit, now);
+	CHECK(limit.bytes.tokens == 7 * 1000);
+
+	start_limit(&limit, 0, 0, NSSM_RATE_LIMIT_DROP, 0);
+	CHECK(!want_rate_limit(&limit));
+}
+
+TEST(ratelimit_sample)
+{
+	rate_limit_t limit;
+	start_limit(&limit, 0, 1, NSSM_RATE_LIMIT_SAMPLE, 4);
+	CHECK(admit_line(&limit, 1) == NSSM_LINE_ADMITTED);
+
+	uint32_t sampled = 0;
+	for (uint32_t i = 0; i < 40; i++)
+	{
+		if (admit_line(&limit, 1) == NSSM_LINE_SAMPLED)
+			sampled++;
+	}
+	CHECK(sampled == 10);
+	CHECK(limit.dropped_lines == 30);
+	/* Sampled lines don't spend tokens. */
+	CHECK(limit.lines.tokens == 0);
+
+	start_limit(&limit, 0, 1, NSSM_RATE_LIMIT_SAMPLE, 0);
+	CHECK(limit.sample == NSSM_RATE_LIMIT_SAMPLE_DEFAULT);
+}
+
+/* Random line lengths arriving faster than the limit average out to the rate. */
+TEST(ratelimit_average)
+{
+	rate_limit_t limit;
+	start_limit(&limit, 10000, 0, NSSM_RATE_LIMIT_DROP, 0);
+	uint64_t seed = 20;
+	uint64_t admitted = 0;
+	for (uint64_t now = 1; now <= 60000; now++)
+	{
+		refill_rate_limit(&limit, now);
+		uint32_t length = 1 + test_random(&seed) % 200;
+		if (admit_line(&limit, length) == NSSM_LINE_ADMITTED)
+			admitted += length;
+	}
+
+	/* A minute at the rate, plus the initial burst and at most one line's overdraft. */
+	CHECK(admitted >= 60 * 10000);
+	CHECK(admitted <= 61 * 10000 + 200);
+}
@@ -0,0 +1,383 @@
+/*******************************************************************************
+ retention_test.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "test.h"
+
+static wchar_t log_path[] = L"C:\\logs\\foo.log";
+
+/* A file of size bytes called name in the log directory. */
+static void log_file(const wchar_t* name, uint64_t size = 1)
+{
+	wchar_t path[MAX_PATH];
+	_snwprintf_s(path, std::size(path), _TRUNCATE, L"C:\\logs\\%s", name);
+	fake_file(path, std::string((size_t)size, 'x'));
+}
+
+static bool same(const wchar_t* a, const wchar_t* b)
+{
+	return !_wcsicmp(a, b);
+}
+
+TEST(retention_rotated_filename)
+{
+	SYSTEMTIME st = { 2025, 6, 0, 1, 12, 34, 56, 7 };
+	wchar_t rotated[MAX_PATH];
+	rotated_filename(log_path, rotated, std::size(rotated), &st, 0);
+	CHECK(same(rotated, L"C:\\logs\\foo-20250601T123456.007.log"));
+	rotated_filename(log_path, rotated, std::size(rotated), &st, 42);
+	CHECK(same(rotated, L"C:\\logs\\foo-20250601T123456.007-42.log"));
+
+	/* The suffix goes before the last extension only. */
+	rotated_filename((wchar_t*)L"C:\\logs\\foo.bar.log", rotated, std::size(rotated), &st, 0);
+	CHECK(same(rotated, L"C:\\logs\\foo.bar-20250601T123456.007.log"));
+	rotated_filename((wchar_t*)L"C:\\logs\\foo", rotated, std::size(rotated), &st, 0);
+	CHECK(same(rotated, L"C:\\logs\\foo-20250601T123456.007"));
+
+	/* A name written by rotated_filename() is read back as the same rotation. */
+	fake_reset();
+	rotated_filename(log_path, rotated, std::size(rotated), &st, 42);
+	fake_file(rotated, "x");
+	rotated_file_t* files;
+	CHECK(find_rotated_files(log_path, &files) == 1);
+	CHECK(files[0].stamp == 20250601123456007ULL && files[0].sequence == 42 && !files[0].gzip);
+	wchar_t path[MAX_PATH];
+	rotated_file_path(log_path, &files[0], path, std::size(path));
+	CHECK(same(path, rotated));
+	HeapFree(GetProcessHeap(), 0, files);
+}
+
+/* The next sequence number is one past the highest, whatever is missing below it. */
+TEST(retention_sequence_gaps)
+{
+	fake_reset();
+	CHECK(next_rotated_sequence(log_path) == 1);
+
+	log_file(L"foo.log");
+	CHECK(next_rotated_sequence(log_path) == 1);
+	/* Rotations made without AppRotateSequence have no number. */
+	log_file(L"foo-20250601T120000.000.log");
+	CHECK(next_rotated_sequence(log_path) == 1);
+
+	log_file(L"foo-20250601T120000.000-1.log");
+	log_file(L"foo-20250601T120000.000-2.log");
+	log_file(L"foo-20250601T120001.000-5.log");
+	CHECK(next_rotated_sequence(log_path) == 6);
+	/* Compressed rotations count too. */
+	log_file(L"foo-20250601T120002.000-9.log.gz");
+	CHECK(next_rotated_sequence(log_path) == 10);
+	/* The number is compared as a number, not a string. */
+	log_file(L"foo-20250601T120003.000-10.log");
+	CHECK(next_rotated_sequence(log_path) == 11);
+}
+
+TEST(retention_sequence_overflow)
+{
+	fake_reset();
+	log_file(L"foo-20250601T120000.000-4294967294.log");
+	CHECK(next_rotated_sequence(log_path) == 4294967295U);
+
+	/* The highest number is reused rather than wrapping to zero, which would mean no number. */
+	log_file(L"foo-20250601T120000.000-4294967295.log");
+	CHECK(next_rotated_sequence(log_path) == 4294967295U);
+
+	/* Numbers which don't fit aren't rotations at all. */
+	fake_reset();
+	log_file(L"foo-20250601T120000.000-4294967296.log");
+	log_file(L"foo-20250601T120000.000-99999999999.log");
+	log_file(L"foo-20250601T120000.000-18446744073709551617.log");
+	log_file(L"foo-20250601T120000.000-0.log");
+	log_file(L"foo-20250601T120000.000-.log");
+	log_file(L"foo-20250601T120000.000--1.log");
+	log_file(L"foo-20250601T120000.000-1a.log");
+	CHECK(next_rotated_sequence(log_path) == 1);
+	rotated_file_t* files;
+	CHECK(!find_rotated_files(log_path, &files));
+	CHECK(!files);
+}
+
+/* Rotations are listed newest first by the time in their names, whatever order the directory gives. */
+TEST(retention_timestamp_suffix)
+{
+	fake_reset();
+	log_file(L"foo-20250601T120000.000.log", 10);
+	log_file(L"foo-20241231T235959.999.log", 20);
+	log_file(L"foo-20250601T120000.001.log", 30);
+	log_file(L"FOO-20250601T120000.000-2.LOG", 40);
+	log_file(L"foo-20250601T120000.000-1.log", 50);
+
+	rotated_file_t* files;
+	uint32_t count = find_rotated_files(log_path, &files);
+	CHECK(count == 5);
+	if (count != 5)
+		return;
+	CHECK(files[0].stamp == 20250601120000001ULL && files[0].size == 30);
+	CHECK(files[1].stamp == 20250601120000000ULL && files[1].sequence == 2 && files[1].size == 40);
+	CHECK(files[2].stamp == 20250601120000000ULL && files[2].sequence == 1);
+	CHECK(files[3].stamp == 20250601120000000ULL && files[3].sequence == 0);
+	CHECK(files[4].stamp == 20241231235959999ULL && files[4].size == 20);
+
+	/* Rotations are in UTC, as FILETIMEs are. */
+	SYSTEMTIME st = { 2024, 12, 0, 31, 23, 59, 59, 999 };
+	FILETIME ft;
+	CHECK(SystemTimeToFileTime(&st, &ft));
+	CHECK(rotated_file_time(&files[4]) == (((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime));
+	HeapFree(GetProcessHeap(), 0, files);
+}
+
+/* Suffixes which are nearly but not quite a rotation time. */
+TEST(retention_timestamp_malformed)
+{
+	fake_reset();
+	log_file(L"foo-2025060T1120000.000.log");
+	log_file(L"foo-20250601 120000.000.log");
+	log_file(L"foo-20250601T120000,000.log");
+	log_file(L"foo-20250601T120000.00.log");
+	log_file(L"foo-20250601T12000.0000.log");
+	log_file(L"foo-2025O601T120000.000.log");
+	log_file(L"foo-20250601T120000.000x.log");
+	log_file(L"foo_20250601T120000.000.log");
+	log_file(L"foo-.log");
+
+	rotated_file_t* files;
+	CHECK(!find_rotated_files(log_path, &files));
+	CHECK(next_rotated_sequence(log_path) == 1);
+}
+
+/* Files which belong to something else must never be taken for rotations and deleted. */
+TEST(retention_foreign_names)
+{
+	fake_reset();
+	log_file(L"foo.log");
+	log_file(L"foo.log.bak");
+	log_file(L"foo-20250601T120000.000.log.bak");
+	log_file(L"foo-20250601T120000.000.log.idx");
+	log_file(L"foo-20250601T120000.000.txt");
+	/* A gzip copy still being written. */
+	log_file(L"foo-20250601T120000.000.log.gz.tmp");
+	/* Another service's rotations. */
+	log_file(L"foobar-20250601T120000.000.log");
+	log_file(L"foo-bar-20250601T120000.000.log");
+	log_file(L"bar-20250601T120000.000.log");
+	log_file(L"bar.foo-20250601T120000.000.log");
+	/* The same name in another directory. */
+	fake_file(L"C:\\other\\foo-20250601T120000.000.log", "x");
+
+	rotated_file_t* files;
+	CHECK(!find_rotated_files(log_path, &files));
+
+	log_file(L"foo-20250601T120000.000.log");
+	CHECK(find_rotated_files(log_path, &files) == 1);
+	HeapFree(GetProcessHeap(), 0, files);
+}
+
+/* A rotation replaced by its gzip copy keeps its place and is found under its new name. */
+TEST(retention_gzip_names)
+{
+	fake_reset();
+	log_file(L"foo-20250601T120000.000.log.gz");
+	log_file(L"foo-20250602T120000.000-3.log.GZ");
+
+	rotated_file_t* files;
+	uint32_t count = find_rotated_files(log_path, &files);
+	CHECK(count == 2);
+	if (count != 2)
+		return;
+	CHECK(files[0].stamp == 20250602120000000ULL && files[0].sequence == 3 && files[0].gzip);
+	CHECK(files[1].stamp == 20250601120000000ULL && !files[1].sequence && files[1].gzip);
+	wchar_t path[MAX_PATH];
+	rotated_file_path(log_path, &files[1], path, std::size(path));
+	CHECK(same(path, L"C:\\logs\\foo-20250601T120000.000.log.gz"));
+	HeapFree(GetProcessHeap(), 0, files);
+
+	/* A log whose own extension is .gz. */
+	fake_reset();
+	log_file(L"foo-20250601T120000.000.gz");
+	log_file(L"foo-20250602T120000.000.gz.gz");
+	count = find_rotated_files((wchar_t*)L"C:\\logs\\foo.gz", &files);
+	CHECK(count == 2);
+	if (count != 2)
+		return;
+	CHECK(files[0].gzip && !files[1].gzip);
+	HeapFree(GetProcessHeap(), 0, files);
+}
+
+static bool log_exists(const wchar_t* name)
+{
+	wchar_t path[MAX_PATH];
+	_snwprintf_s(path, std::size(path), _TRUNCATE, L"C:\\logs\\%s", name);
+	return fake_exists(path);
+}
+
+/* Sets the clock to midday on 2025-06-10 UTC. */
+static void set_now()
+{
+	SYSTEMTIME st = { 2025, 6, 0, 10, 12, 0, 0, 0 };
+	FILETIME ft;
+	SystemTimeToFileTime(&st, &ft);
+	fake_now = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
+
+/* Five daily rotations of 100 bytes, the newest a day old, and the live file. */
+static void daily_rotations()
+{
+	fake_reset();
+	log_file(L"foo.log", 1000);
+	log_file(L"foo-20250609T120000.000.log", 100);
+	log_file(L"foo-20250608T120000.000.log", 100);
+	log_file(L"foo-20250607T120000.000.log", 100);
+	log_file(L"foo-20250606T120000.000.log", 100);
+	log_file(L"foo-20250605T120000.000.log", 100);
+	log_file(L"foo-20250605T120000.000.log.idx", 16);
+	logged_events.clear();
+}
+
+TEST(retention_count)
+{
+	set_now();
+	daily_rotations();
+	retention_t retention = { 3, 0, 0 };
+	apply_retention((wchar_t*)L"foo", log_path, &retention);
+	CHECK(log_exists(L"foo.log"));
+	CHECK(log_exists(L"foo-20250609T120000.000.log"));
+	CHECK(log_exists(L"foo-20250608T120000.000.log"));
+	CHECK(log_exists(L"foo-20250607T120000.000.log"));
+	CHECK(!log_exists(L"foo-20250606T120000.000.log"));
+	CHECK(!log_exists(L"foo-20250605T120000.000.log"));
+	/* Indexes go with their files. */
+	CHECK(!log_exists(L"foo-20250605T120000.000.log.idx"));
+	CHECK(fake_file_count() == 4);
+	CHECK(logged_events.empty());
+
+	/* Running it again changes nothing. */
+	apply_retention((wchar_t*)L"foo", log_path, &retention);
+	CHECK(fake_file_count() == 4);
+
+	/* Bytes are counted newest first and the live file isn't counted. */
+	daily_rotations();
+	retention = { 0, 250, 0 };
+	apply_retention((wchar_t*)L"foo", log_path, &retention);
+	CHECK(log_exists(L"foo.log"));
+	CHECK(log_exists(L"foo-20250608T120000.000.log"));
+	CHECK(!log_exists(L"foo-20250607T120000.000.log"));
+	fake_now = 0;
+}
+
+TEST(retention_age)
+{
+	set_now();
+	daily_rotations();
+	/* The rotation made exactly three days ago is on the boundary and stays. */
+	retention_t retention = { 0, 0, 3 };
+	apply_retention((wchar_t*)L"foo", log_path, &retention);
+	CHECK(log_exists(L"foo.log"));
+	CHECK(log_exists(L"foo-20250609T120000.000.log"));
+	CHECK(log_exists(L"foo-20250607T120000.000.log"));
+	CHECK(!log_exists(L"foo-20250606T120000.000.log"));
+	CHECK(!log_exists(L"foo-20250605T120000.000.log"));
+
+	/* A millisecond later it is too old. */
+	fake_now += 10000;
+	apply_retention((wchar_t*)L"foo", log_path, &retention);
+	CHECK(!log_exists(L"foo-20250607T120000.000.log"));
+	CHECK(log_exists(L"foo-20250608T120000.000.log"));
+
+	/* The age comes from the name, not from when the file was last written. */
+	daily_rotations();
+	fake_file(L"C:\\logs\\foo-20250601T120000.000.log", "x", fake_now);
+	retention = { 0, 0, 30 };
+	apply_retention((wchar_t*)L"foo", log_path, &retention);
+	CHECK(fake_file_count() == 8);
+	retention = { 0, 0, 7 };
+	apply_retention((wchar_t*)L"foo", log_path, &retention);
+	CHECK(!log_exists(L"foo-20250601T120000.000.log"));
+	CHECK(fake_file_count() == 7);
+	fake_now = 0;
+}
+
+/* Whichever limit is tighter wins. */
+TEST(retention_count_and_age)
+{
+	set_now();
+	daily_rotations();
+	retention_t retention = { 4, 0, 2 };
+	apply_retention((wchar_t*)L"foo", log_path, &retention);
+	CHECK(log_exists(L"foo-20250609T120000.000.log"));
+	CHECK(log_exists(L"foo-20250608T120000.000.log"));
+	CHECK(!log_exists(L"foo-20250607T120000.000.log"));
+	CHECK(fake_file_count() == 3);
+
+	daily_rotations();
+	retention = { 2, 0, 4 };
+	apply_retention((wchar_t*)L"foo", log_path, &retention);
+	CHECK(log_exists(L"foo-20250608T120000.000.log"));
+	CHECK(!log_exists(L"foo-20250607T120000.000.log"));
+	CHECK(fake_file_count() == 3);
+
+	/* No limits means nothing is deleted. */
+	daily_rotations();
+	retention = { 0, 0, 0 };
+	apply_retention((wchar_t*)L"foo", log_path, &retention);
+	apply_retention((wchar_t*)L"foo", log_path, 0);
+	CHECK(fake_file_count() == 7);
+	fake_now = 0;
+}
+
+/* gzip copies count as the rotations they replaced and are deleted under their own names. */
+TEST(retention_gzip_sibling)
+{
+	set_now();
+	daily_rotations();
+	CHECK(MoveFileW(L"C:\\logs\\foo-20250608T120000.000.log", L"C:\\logs\\foo-20250608T120000.000.log.gz"));
+	CHECK(MoveFileW(L"C:\\logs\\foo-20250606T120000.000.log", L"C:\\logs\\foo-20250606T120000.000.log.gz"));
+	/* A copy being written of a rotation which is still there, which isn't counted. */
+	log_file(L"foo-20250609T120000.000.log.gz.tmp", 50);
+
+	retention_t retention = { 2, 0, 0 };
+	apply_retention((wchar_t*)L"foo", log_path, &retention);
+	CHECK(log_exists(L"foo-20250609T120000.000.log"));
+	CHECK(log_exists(L"foo-20250608T120000.000.log.gz"));
+	CHECK(!log_exists(L"foo-20250607T120000.000.log"));
+	CHECK(!log_exists(L"foo-20250606T120000.000.log.gz"));
+	CHECK(!log_exists(L"foo-20250605T120000.000.log"));
+	CHECK(log_exists(L"foo-20250609T120000.000.log.gz.tmp"));
+	CHECK(logged_events.empty());
+
+	retention = { 0, 0, 1 };
+	apply_retention((wchar_t*)L"foo", log_path, &retention);
+	CHECK(log_exists(L"foo-20250609T120000.000.log"));
+	CHECK(!log_exists(L"foo-20250608T120000.000.log.gz"));
+	fake_now = 0;
+}
+
+/* A rotation which can't be deleted is reported once and the rest are still removed. */
+TEST(retention_delete_failed)
+{
+	set_now();
+	daily_rotations();
+	HANDLE a = CreateFileW(L"C:\\logs\\foo-20250606T120000.000.log", GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	HANDLE b = CreateFileW(L"C:\\logs\\foo-20250605T120000.000.log", GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	retention_t retention = { 1, 0, 0 };
+	apply_retention((wchar_t*)L"foo", log_path, &retention);
+	CHECK(!log_exists(L"foo-20250608T120000.000.log"));
+	CHECK(!log_exists(L"foo-20250607T120000.000.log"));
+	CHECK(log_exists(L"foo-20250606T120000.000.log"));
+	CHECK(log_exists(L"foo-20250605T120000.000.log"));
+	CHECK(logged_events.size() == 1 && logged_events[0] == NSSM_EVENT_RETENTION_FAILED);
+	CloseHandle(a);
+	CloseHandle(b);
+	fake_now = 0;
+}
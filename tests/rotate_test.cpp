@@ -0,0 +1,297 @@
+/*******************************************************************************
+ rotate_test.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "test.h"
+
+static wchar_t live_path[] = L"C:\\logs\\foo.log";
+static wchar_t rotated_path[] = L"C:\\logs\\foo-1.log";
+
+/*
+  The shim's files, with the next few moves or opens made to fail.  A move
+  or open which isn't failed is passed through, so sharing violations come
+  from the handles which are really open.
+*/
+static uint32_t moves;
+static uint32_t opens;
+static uint32_t closes;
+static uint32_t fail_moves;
+static uint32_t fail_opens;
+
+static bool test_move(wchar_t* from, wchar_t* to)
+{
+	if (moves++ >= fail_moves)
+		return MoveFileW(from, to) ? true : false;
+	SetLastError(ERROR_ACCESS_DENIED);
+	return false;
+}
+
+static HANDLE test_open(wchar_t* path, uint32_t sharing, uint32_t disposition, uint32_t flags)
+{
+	if (opens++ < fail_opens)
+	{
+		SetLastError(ERROR_ACCESS_DENIED);
+		return INVALID_HANDLE_VALUE;
+	}
+	HANDLE file = CreateFileW(path, GENERIC_WRITE, sharing, 0, disposition, flags, 0);
+	LARGE_INTEGER zero;
+	zero.QuadPart = 0;
+	if (file != INVALID_HANDLE_VALUE)
+		SetFilePointerEx(file, zero, 0, FILE_END);
+	return file;
+}
+
+static void test_close(HANDLE* handle)
+{
+	closes++;
+	close_handle(handle);
+}
+
+static const rotate_fs_t test_fs = {test_move, test_open, test_close};
+
+/* Start with the live file open for writing with sharing, holding text. */
+static HANDLE start(uint32_t sharing, const char* text, uint32_t skip_moves, uint32_t failed_moves, uint32_t failed_opens)
+{
+	fake_reset();
+	moves = opens = closes = 0;
+	fail_moves = fail_opens = 0;
+	HANDLE file = test_open(live_path, sharing, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL);
+	unsigned long written;
+	WriteFile(file, text, (uint32_t)strlen(text), &written, 0);
+	/* Failures count from the calls made by the rotation. */
+	moves = 0 - skip_moves;
+	opens = 0;
+	fail_moves = failed_moves;
+	fail_opens = failed_opens;
+	return file;
+}
+
+static void append(HANDLE file, const char* text)
+{
+	unsigned long written;
+	WriteFile(file, text, (uint32_t)strlen(text), &written, 0);
+}
+
+#define SHARE_ALL (FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE)
+
+/* The file is renamed while open, and only then is the old handle closed. */
+TEST(rotate_rename)
+{
+	HANDLE file = start(SHARE_ALL, "old\n", 0, 0, 0);
+	HANDLE old = file;
+	uint32_t disposition = OPEN_ALWAYS;
+	uint32_t error;
+	const wchar_t* function;
+	CHECK(!rename_live_file(&test_fs, live_path, rotated_path, &file, SHARE_ALL, &disposition, FILE_ATTRIBUTE_NORMAL, &error, &function));
+	CHECK(error == ERROR_SUCCESS);
+	CHECK(file && file != INVALID_HANDLE_VALUE && file != old);
+	CHECK(moves == 1 && opens == 1 && closes == 1);
+	append(file, "new\n");
+	CHECK(fake_contents(rotated_path) == "old\n");
+	CHECK(fake_contents(live_path) == "new\n");
+	CHECK(disposition == OPEN_ALWAYS);
+	close_handle(&file);
+	CHECK(!fake_exists(L"C:\\logs\\foo-2.log") && fake_file_count() == 2);
+}
+
+/* The rename fails for some other reason: nothing changes. */
+TEST(rotate_rename_failed)
+{
+	HANDLE file = start(SHARE_ALL, "old\n", 0, 1, 0);
+	HANDLE old = file;
+	uint32_t disposition = OPEN_ALWAYS;
+	uint32_t error;
+	const wchar_t* function;
+	CHECK(!rename_live_file(&test_fs, live_path, rotated_path, &file, SHARE_ALL, &disposition, FILE_ATTRIBUTE_NORMAL, &error, &function));
+	CHECK(error == ERROR_ACCESS_DENIED);
+	CHECK(!_wcsicmp(function, L"::MoveFileW()"));
+	CHECK(file == old && !closes && !opens);
+	append(file, "more\n");
+	CHECK(fake_contents(live_path) == "old\nmore\n");
+	CHECK(!fake_exists(rotated_path));
+	close_handle(&file);
+}
+
+/* The new file can't be opened, so the old one is moved back and we keep writing to it. */
+TEST(rotate_reopen_failed)
+{
+	HANDLE file = start(SHARE_ALL, "old\n", 0, 0, 1);
+	HANDLE old = file;
+	uint32_t disposition = OPEN_ALWAYS;
+	uint32_t error;
+	const wchar_t* function;
+	CHECK(!rename_live_file(&test_fs, live_path, rotated_path, &file, SHARE_ALL, &disposition, FILE_ATTRIBUTE_NORMAL, &error, &function));
+	CHECK(error == ERROR_OPEN_FAILED);
+	CHECK(!_wcsicmp(function, L"::CreateFileW()"));
+	CHECK(file == old && !closes && moves == 2);
+	append(file, "more\n");
+	CHECK(fake_contents(live_path) == "old\nmore\n");
+	CHECK(!fake_exists(rotated_path));
+
+	/* The next rotation works. */
+	CHECK(!rename_live_file(&test_fs, live_path, rotated_path, &file, SHARE_ALL, &disposition, FILE_ATTRIBUTE_NORMAL, &error, &function));
+	CHECK(error == ERROR_SUCCESS && file != old);
+	CHECK(fake_contents(rotated_path) == "old\nmore\n");
+	close_handle(&file);
+}
+
+/* Nor can the old file be moved back, so we carry on writing it under its rotated name. */
+TEST(rotate_move_back_failed)
+{
+	HANDLE file = start(SHARE_ALL, "old\n", 1, 1, 1);
+	HANDLE old = file;
+	uint32_t disposition = OPEN_ALWAYS;
+	uint32_t error;
+	const wchar_t* function;
+	CHECK(!rename_live_file(&test_fs, live_path, rotated_path, &file, SHARE_ALL, &disposition, FILE_ATTRIBUTE_NORMAL, &error, &function));
+	CHECK(error == ERROR_ACCESS_DENIED);
+	CHECK(!_wcsicmp(function, L"::MoveFileW()"));
+	CHECK(file == old && !closes);
+	append(file, "more\n");
+	CHECK(fake_contents(rotated_path) == "old\nmore\n");
+	CHECK(!fake_exists(live_path));
+	close_handle(&file);
+}
+
+/* Opened without FILE_SHARE_DELETE, the file must be closed before it can be moved. */
+TEST(rotate_sharing_violation)
+{
+	uint32_t sharing = FILE_SHARE_READ | FILE_SHARE_WRITE;
+	HANDLE file = start(sharing, "old\n", 0, 0, 0);
+	uint32_t disposition = CREATE_ALWAYS;
+	uint32_t error;
+	const wchar_t* function;
+	CHECK(!rename_live_file(&test_fs, live_path, rotated_path, &file, sharing, &disposition, FILE_ATTRIBUTE_NORMAL, &error, &function));
+	CHECK(error == ERROR_SUCCESS);
+	CHECK(moves == 2 && closes == 1 && opens == 1);
+	CHECK(file && file != INVALID_HANDLE_VALUE);
+	append(file, "new\n");
+	CHECK(fake_contents(rotated_path) == "old\n");
+	CHECK(fake_contents(live_path) == "new\n");
+	CHECK(disposition == CREATE_ALWAYS);
+	close_handle(&file);
+}
+
+/* The move still fails after closing, so the old file is reopened and appended to. */
+TEST(rotate_sharing_violation_move_failed)
+{
+	uint32_t sharing = FILE_SHARE_READ | FILE_SHARE_WRITE;
+	HANDLE file = start(sharing, "old\n", 1, 1, 0);
+	uint32_t disposition = CREATE_ALWAYS;
+	uint32_t error;
+	const wchar_t* function;
+	CHECK(!rename_live_file(&test_fs, live_path, rotated_path, &file, sharing, &disposition, FILE_ATTRIBUTE_NORMAL, &error, &function));
+	CHECK(error == ERROR_ACCESS_DENIED);
+	CHECK(disposition == OPEN_ALWAYS);
+	CHECK(file && file != INVALID_HANDLE_VALUE);
+	append(file, "more\n");
+	CHECK(fake_contents(live_path) == "old\nmore\n");
+	CHECK(!fake_exists(rotated_path));
+	close_handle(&file);
+}
+
+/* Having closed the file we can't open one again, and can log nothing further. */
+TEST(rotate_sharing_violation_reopen_failed)
+{
+	uint32_t sharing = FILE_SHARE_READ | FILE_SHARE_WRITE;
+	HANDLE file = start(sharing, "old\n", 0, 0, 1);
+	uint32_t disposition = CREATE_ALWAYS;
+	uint32_t error;
+	const wchar_t* function;
+	CHECK(rename_live_file(&test_fs, live_path, rotated_path, &file, sharing, &disposition, FILE_ATTRIBUTE_NORMAL, &error, &function) < 0);
+	CHECK(!file);
+	CHECK(fake_contents(rotated_path) == "old\n");
+}
+
+static uint64_t utc(WORD year, WORD month, WORD day, WORD hour = 0, WORD minute = 0, WORD second = 0, WORD milliseconds = 0)
+{
+	SYSTEMTIME st = { year, month, 0, day, hour, minute, second, milliseconds };
+	FILETIME ft;
+	if (!SystemTimeToFileTime(&st, &ft))
+		return 0;
+	return ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
+
+#define HOUR NSSM_ROTATE_BOUNDARY_HOUR
+#define DAY NSSM_ROTATE_BOUNDARY_DAY
+
+TEST(boundary_month_end)
+{
+	set_time_zone("UTC0");
+	CHECK(next_boundary(DAY, utc(2025, 1, 31, 15)) == utc(2025, 2, 1));
+	CHECK(next_boundary(DAY, utc(2025, 2, 28, 23, 59, 59, 999)) == utc(2025, 3, 1));
+	CHECK(next_boundary(DAY, utc(2024, 2, 28, 12)) == utc(2024, 2, 29));
+	CHECK(next_boundary(DAY, utc(2024, 2, 29, 12)) == utc(2024, 3, 1));
+	CHECK(next_boundary(DAY, utc(2025, 4, 30, 0, 0, 0, 1)) == utc(2025, 5, 1));
+	CHECK(next_boundary(DAY, utc(2025, 12, 31, 18)) == utc(2026, 1, 1));
+	CHECK(next_boundary(HOUR, utc(2025, 12, 31, 23, 30)) == utc(2026, 1, 1));
+	/* Exactly on a boundary, the next one is due. */
+	CHECK(next_boundary(DAY, utc(2025, 6, 1)) == utc(2025, 6, 2));
+	CHECK(next_boundary(HOUR, utc(2025, 6, 1, 10)) == utc(2025, 6, 1, 11));
+
+	/* Local midnight at the end of the month, east and west of UTC. */
+	set_time_zone("JST-9");
+	CHECK(next_boundary(DAY, utc(2025, 6, 30, 12)) == utc(2025, 6, 30, 15));
+	set_time_zone("EST5");
+	CHECK(next_boundary(DAY, utc(2025, 7, 1, 3)) == utc(2025, 7, 1, 5));
+	set_time_zone("UTC0");
+}
+
+/* Days are 23 or 25 hours long when the clocks change, but hours are always an hour. */
+TEST(boundary_dst)
+{
+	/* London: clocks go forward at 01:00 UTC on 30 March 2025 and back at 01:00 UTC on 26 October. */
+	set_time_zone("GMT0BST,M3.5.0/1,M10.5.0");
+	CHECK(next_boundary(DAY, utc(2025, 3, 29, 12)) == utc(2025, 3, 30));
+	CHECK(next_boundary(DAY, utc(2025, 3, 30, 0, 30)) == utc(2025, 3, 30, 23));
+	CHECK(next_boundary(DAY, utc(2025, 10, 25, 12)) == utc(2025, 10, 25, 23));
+	CHECK(next_boundary(DAY, utc(2025, 10, 25, 23, 30)) == utc(2025, 10, 27));
+
+	/* 00:30 GMT; 02:00 BST is the next hour. */
+	CHECK(next_boundary(HOUR, utc(2025, 3, 30, 0, 30)) == utc(2025, 3, 30, 1));
+	CHECK(next_boundary(HOUR, utc(2025, 3, 30, 1, 30)) == utc(2025, 3, 30, 2));
+	/* 01:30 BST, then 01:00 and 01:30 GMT; the repeated hour gets its own file. */
+	CHECK(next_boundary(HOUR, utc(2025, 10, 26, 0, 30)) == utc(2025, 10, 26, 1));
+	CHECK(next_boundary(HOUR, utc(2025, 10, 26, 1, 30)) == utc(2025, 10, 26, 2));
+
+	/* Half-hour offsets have boundaries on the half hour. */
+	set_time_zone("IST-5:30");
+	CHECK(next_boundary(HOUR, utc(2025, 6, 1, 10, 45)) == utc(2025, 6, 1, 11, 30));
+	CHECK(next_boundary(DAY, utc(2025, 6, 1, 10, 45)) == utc(2025, 6, 1, 18, 30));
+	set_time_zone("UTC0");
+}
+
+/* An interval runs from when the file was started, and a boundary comes first if it is sooner. */
+TEST(rotation_interval)
+{
+	set_time_zone("UTC0");
+	uint32_t seven_hours = 7 * 3600;
+	CHECK(next_rotation(0, 0, utc(2025, 6, 1, 10)) == 0);
+	CHECK(next_rotation(seven_hours, 0, utc(2025, 6, 1, 10)) == utc(2025, 6, 1, 17));
+	CHECK(next_rotation(seven_hours, 0, utc(2025, 6, 1, 20)) == utc(2025, 6, 2, 3));
+	/* Rotated at midnight, then 7 hours later, and so on, with each day's last file cut short. */
+	uint64_t at = utc(2025, 6, 1);
+	uint64_t expected[] = { utc(2025, 6, 1, 7), utc(2025, 6, 1, 14), utc(2025, 6, 1, 21), utc(2025, 6, 2), utc(2025, 6, 2, 7) };
+	for (uint64_t next : expected)
+	{
+		at = next_rotation(seven_hours, DAY, at);
+		CHECK(at == next);
+	}
+	/* An interval shorter than an hour never reaches the boundary. */
+	CHECK(next_rotation(600, HOUR, utc(2025, 6, 1, 10, 5)) == utc(2025, 6, 1, 10, 15));
+	CHECK(next_rotation(600, HOUR, utc(2025, 6, 1, 10, 55)) == utc(2025, 6, 1, 11));
+	CHECK(next_rotation(0, HOUR, utc(2025, 6, 1, 10, 55)) == utc(2025, 6, 1, 11));
+}
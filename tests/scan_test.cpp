@@ -0,0 +1,125 @@
+/*******************************************************************************
+ scan_test.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "test.h"
+
+/* Newline-heavy random text with the odd UTF-16 lookalike thrown in. */
+static void fill_random(uint8_t* buffer, uint32_t len, uint64_t* seed)
+{
+	static const uint8_t alphabet[] = { '\n', '\n', 0, 0, 'a', 'b', ' ', '\r', 0x0a, 0xff };
+	for (uint32_t i = 0; i < len; i++)
+		buffer[i] = alphabet[test_random(seed) % std::size(alphabet)];
+}
+
+/* One character at a time, as the scanners did before they were vectorised. */
+static uint32_t reference_line_ends(const uint8_t* buffer, uint32_t len, uint32_t charsize, uint32_t* ends, uint32_t max)
+{
+	uint32_t count = 0;
+	for (uint32_t i = 0; i + charsize <= len && count < max; i += charsize)
+	{
+		if (buffer[i] == '\n' && (charsize == 1 || !buffer[i + 1]))
+			ends[count++] = i + charsize;
+	}
+	return count;
+}
+
+TEST(scan_line_ends_simple)
+{
+	uint32_t ends[4];
+	CHECK(find_line_ends("a\nbc\n\nd", 7, 1, ends, 4) == 3);
+	CHECK(ends[0] == 2 && ends[1] == 5 && ends[2] == 6);
+	CHECK(count_line_ends("a\nbc\n\nd", 7, 1) == 3);
+
+	/* 0x0a as the high byte of a code unit isn't a newline. */
+	const uint8_t wide[] = { 'a', 0, '\n', 0, 0, '\n', '\n', 0x0a, '\n', 0 };
+	CHECK(find_line_ends(wide, sizeof(wide), 2, ends, 4) == 2);
+	CHECK(ends[0] == 4 && ends[1] == 10);
+	CHECK(count_line_ends(wide, sizeof(wide), 2) == 2);
+
+	/* A trailing odd byte can't end a line. */
+	CHECK(count_line_ends(wide, 3, 2) == 0);
+	CHECK(find_line_ends(wide, sizeof(wide), 2, ends, 0) == 0);
+}
+
+/* Compare the vector paths with the reference for every block size and alignment. */
+TEST(scan_line_ends_reference)
+{
+	static uint8_t storage[4096 + 64];
+	static uint32_t ends[4096];
+	static uint32_t expected[4096];
+	uint64_t seed = 5;
+
+	for (uint32_t round = 0; round < 2000; round++)
+	{
+		uint32_t offset = test_random(&seed) % 64;
+		uint32_t len = (round < 200) ? round : test_random(&seed) % 4096;
+		uint32_t charsize = (round & 1) ? 2 : 1;
+		uint8_t* buffer = storage + offset;
+		fill_random(buffer, len, &seed);
+
+		uint32_t max = (round % 3) ? (uint32_t)std::size(ends) : 1 + test_random(&seed) % 8;
+		uint32_t want = reference_line_ends(buffer, len, charsize, expected, max);
+		uint32_t got = find_line_ends(buffer, len, charsize, ends, max);
+		CHECK(got == want);
+		CHECK(!memcmp(ends, expected, std::min(got, want) * sizeof(*ends)));
+
+		want = reference_line_ends(buffer, len, charsize, expected, (uint32_t)std::size(expected));
+		CHECK(count_line_ends(buffer, len, charsize) == want);
+	}
+}
+
+static int compare_hashes(const void* a, const void* b)
+{
+	uint64_t x = *(const uint64_t*)a;
+	uint64_t y = *(const uint64_t*)b;
+	return (x > y) - (x < y);
+}
+
+TEST(scan_hash_bytes)
+{
+	static uint8_t storage[256 + 8];
+	static uint64_t hashes[256 * 8];
+	uint64_t seed = 19;
+	for (uint32_t i = 0; i < sizeof(storage); i++)
+		storage[i] = (uint8_t)test_random(&seed);
+
+	/* Same bytes, same hash, wherever they are. */
+	uint8_t copy[64];
+	memcpy(copy, storage + 3, sizeof(copy));
+	CHECK(hash_bytes(copy, sizeof(copy)) == hash_bytes(storage + 3, sizeof(copy)));
+
+	/* Every length and every byte of the tail word counts. */
+	uint32_t count = 0;
+	for (uint32_t len = 0; len <= 256; len++)
+		hashes[count++] = hash_bytes(storage, len);
+	for (uint32_t i = 0; i < 64; i++)
+	{
+		uint8_t flipped[64];
+		memcpy(flipped, storage, sizeof(flipped));
+		flipped[i] ^= 1;
+		hashes[count++] = hash_bytes(flipped, sizeof(flipped));
+	}
+
+	/* Lines differing only in the length of a zero tail mustn't collide either. */
+	uint8_t zeros[16] = { 0 };
+	for (uint32_t len = 1; len <= sizeof(zeros); len++)
+		hashes[count++] = hash_bytes(zeros, len);
+
+	qsort(hashes, count, sizeof(*hashes), compare_hashes);
+	for (uint32_t i = 1; i < count; i++)
+		CHECK(hashes[i] != hashes[i - 1]);
+}
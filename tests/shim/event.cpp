@@ -0,0 +1,34 @@
+/*******************************************************************************
+ event.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+#include "nssm_pch.h"
+#include "common.h"
+
+/* Stand-ins for event.cpp which remember what was logged instead. */
+
+std::vector<uint32_t> logged_events;
+
+wchar_t* error_string(uint32_t)
+{
+	return (wchar_t*)L"error";
+}
+
+void log_event(uint16_t, uint32_t id, ...)
+{
+	logged_events.push_back(id);
+}
+
+void print_message(FILE*, uint32_t id, ...)
+{
+	logged_events.push_back(id);
+}
@@ -0,0 +1,559 @@
+/*******************************************************************************
+ files.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include <map>
+#include <memory>
+
+/*
+  An in-memory filesystem with Windows' rules: names are compared without
+  regard to case, sharing modes are enforced between handles and a file
+  can only be renamed or deleted while every open handle shares delete.
+  Paths are plain strings and directories aren't modelled, so a file's
+  directory is whatever comes before the last backslash.
+*/
+
+typedef struct
+{
+	std::vector<unsigned char> data;
+	uint64_t created;
+	uint64_t written;
+	uint32_t handles_open;
+	uint64_t index;
+} fake_file_t;
+
+typedef struct
+{
+	std::shared_ptr<fake_file_t> file;
+	uint32_t access;
+	uint32_t share;
+	uint64_t position;
+} fake_handle_t;
+
+typedef struct
+{
+	std::vector<std::u16string> names;
+	std::vector<std::shared_ptr<fake_file_t>> files;
+	size_t next;
+} fake_find_t;
+
+static std::map<std::u16string, std::shared_ptr<fake_file_t>> files;
+static std::vector<fake_handle_t*> handles;
+static uint64_t next_index;
+
+static std::u16string key(const wchar_t* path)
+{
+	std::u16string s;
+	for (; *path; path++)
+		s += (char16_t)towlower((wint_t)*path);
+	return s;
+}
+
+/* The name as it was given, for directory listings. */
+static std::map<std::u16string, std::u16string> names;
+
+static void set_time(FILETIME* ft, uint64_t time)
+{
+	ft->dwLowDateTime = (uint32_t)time;
+	ft->dwHighDateTime = (uint32_t)(time >> 32);
+}
+
+static uint64_t now()
+{
+	FILETIME ft;
+	GetSystemTimeAsFileTime(&ft);
+	return ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
+
+/* Whether a handle asking for access and sharing share can be opened alongside those already open. */
+static bool can_share(fake_file_t* file, uint32_t access, uint32_t share)
+{
+	for (fake_handle_t* h : handles)
+	{
+		if (h->file.get() != file)
+			continue;
+		if ((access & GENERIC_READ) && !(h->share & FILE_SHARE_READ))
+			return false;
+		if ((access & GENERIC_WRITE) && !(h->share & FILE_SHARE_WRITE))
+			return false;
+		if ((h->access & GENERIC_READ) && !(share & FILE_SHARE_READ))
+			return false;
+		if ((h->access & GENERIC_WRITE) && !(share & FILE_SHARE_WRITE))
+			return false;
+	}
+	return true;
+}
+
+/* Whether every handle to file shares delete, so it can be renamed or deleted. */
+static bool can_delete(fake_file_t* file)
+{
+	for (fake_handle_t* h : handles)
+	{
+		if (h->file.get() == file && !(h->share & FILE_SHARE_DELETE))
+			return false;
+	}
+	return true;
+}
+
+static fake_handle_t* handle(HANDLE h)
+{
+	for (fake_handle_t* open : handles)
+	{
+		if (open == h)
+			return open;
+	}
+	SetLastError(ERROR_INVALID_HANDLE);
+	return 0;
+}
+
+HANDLE CreateFileW(const wchar_t* path, uint32_t access, uint32_t share, void*, uint32_t disposition, uint32_t, HANDLE)
+{
+	std::u16string k = key(path);
+	auto found = files.find(k);
+	std::shared_ptr<fake_file_t> file;
+	if (found != files.end())
+	{
+		if (disposition == CREATE_NEW)
+		{
+			SetLastError(ERROR_FILE_EXISTS);
+			return INVALID_HANDLE_VALUE;
+		}
+		if (!can_share(found->second.get(), access, share))
+		{
+			SetLastError(ERROR_SHARING_VIOLATION);
+			return INVALID_HANDLE_VALUE;
+		}
+		file = found->second;
+		if (disposition == CREATE_ALWAYS || disposition == TRUNCATE_EXISTING)
+		{
+			file->data.clear();
+			file->written = now();
+		}
+		SetLastError((disposition == CREATE_ALWAYS || disposition == OPEN_ALWAYS) ? ERROR_ALREADY_EXISTS : ERROR_SUCCESS);
+	}
+	else
+	{
+		if (disposition == OPEN_EXISTING || disposition == TRUNCATE_EXISTING)
+		{
+			SetLastError(ERROR_FILE_NOT_FOUND);
+			return INVALID_HANDLE_VALUE;
+		}
+		file = std::make_shared<fake_file_t>();
+		file->created = file->written = now();
+		file->handles_open = 0;
+		file->index = ++next_index;
+		files[k] = file;
+		names[k] = std::u16string((const char16_t*)path, wcslen(path));
+		SetLastError(ERROR_SUCCESS);
+	}
+
+	fake_handle_t* h = new fake_handle_t;
+	h->file = file;
+	h->access = access;
+	h->share = share;
+	h->position = 0;
+	file->handles_open++;
+	handles.push_back(h);
+	return (HANDLE)h;
+}
+
+BOOL CloseHandle(HANDLE h)
+{
+	for (size_t i = 0; i < handles.size(); i++)
+	{
+		if (handles[i] == h)
+		{
+			handles[i]->file->handles_open--;
+			delete handles[i];
+			handles.erase(handles.begin() + (ptrdiff_t)i);
+			return 1;
+		}
+	}
+	return fake_close_object(h);
+}
+
+BOOL ReadFile(HANDLE h, void* buffer, uint32_t len, unsigned long* got, void*)
+{
+	fake_handle_t* open = handle(h);
+	if (!open)
+		return 0;
+	if (!(open->access & GENERIC_READ))
+	{
+		SetLastError(ERROR_ACCESS_DENIED);
+		return 0;
+	}
+	std::vector<unsigned char>& data = open->file->data;
+	uint64_t n = (open->position < data.size()) ? std::min((uint64_t)len, data.size() - open->position) : 0;
+	memmove(buffer, data.data() + open->position, (size_t)n);
+	open->position += n;
+	*got = (unsigned long)n;
+	return 1;
+}
+
+BOOL WriteFile(HANDLE h, const void* buffer, uint32_t len, unsigned long* written, void*)
+{
+	fake_handle_t* open = handle(h);
+	if (!open)
+		return 0;
+	if (!(open->access & GENERIC_WRITE))
+	{
+		SetLastError(ERROR_ACCESS_DENIED);
+		return 0;
+	}
+	std::vector<unsigned char>& data = open->file->data;
+	if (data.size() < open->position + len)
+		data.resize((size_t)(open->position + len));
+	memmove(data.data() + open->position, buffer, len);
+	open->position += len;
+	open->file->written = now();
+	*written = len;
+	return 1;
+}
+
+BOOL SetFilePointerEx(HANDLE h, LARGE_INTEGER distance, LARGE_INTEGER* position, uint32_t method)
+{
+	fake_handle_t* open = handle(h);
+	if (!open)
+		return 0;
+	int64_t base = 0;
+	if (method == FILE_CURRENT)
+		base = (int64_t)open->position;
+	else if (method == FILE_END)
+		base = (int64_t)open->file->data.size();
+	if (base + distance.QuadPart < 0)
+	{
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return 0;
+	}
+	open->position = (uint64_t)(base + distance.QuadPart);
+	if (position)
+		position->QuadPart = (int64_t)open->position;
+	return 1;
+}
+
+BOOL GetFileSizeEx(HANDLE h, LARGE_INTEGER* size)
+{
+	fake_handle_t* open = handle(h);
+	if (!open)
+		return 0;
+	size->QuadPart = (int64_t)open->file->data.size();
+	return 1;
+}
+
+BOOL SetEndOfFile(HANDLE h)
+{
+	fake_handle_t* open = handle(h);
+	if (!open)
+		return 0;
+	open->file->data.resize((size_t)open->position);
+	return 1;
+}
+
+BOOL FlushFileBuffers(HANDLE h)
+{
+	return handle(h) ? 1 : 0;
+}
+
+BOOL GetFileTime(HANDLE h, FILETIME* created, FILETIME* accessed, FILETIME* written)
+{
+	fake_handle_t* open = handle(h);
+	if (!open)
+		return 0;
+	if (created)
+		set_time(created, open->file->created);
+	if (accessed)
+		set_time(accessed, open->file->written);
+	if (written)
+		set_time(written, open->file->written);
+	return 1;
+}
+
+BOOL SetFileTime(HANDLE h, const FILETIME* created, const FILETIME*, const FILETIME* written)
+{
+	fake_handle_t* open = handle(h);
+	if (!open)
+		return 0;
+	if (created)
+		open->file->created = ((uint64_t)created->dwHighDateTime << 32) | created->dwLowDateTime;
+	if (written)
+		open->file->written = ((uint64_t)written->dwHighDateTime << 32) | written->dwLowDateTime;
+	return 1;
+}
+
+BOOL GetFileInformationByHandle(HANDLE h, BY_HANDLE_FILE_INFORMATION* info)
+{
+	fake_handle_t* open = handle(h);
+	if (!open)
+		return 0;
+	ZeroMemory(info, sizeof(*info));
+	info->dwFileAttributes = FILE_ATTRIBUTE_NORMAL;
+	set_time(&info->ftCreationTime, open->file->created);
+	set_time(&info->ftLastAccessTime, open->file->written);
+	set_time(&info->ftLastWriteTime, open->file->written);
+	info->dwVolumeSerialNumber = 1;
+	info->nFileSizeLow = (uint32_t)open->file->data.size();
+	info->nFileSizeHigh = (uint32_t)((uint64_t)open->file->data.size() >> 32);
+	info->nNumberOfLinks = 1;
+	info->nFileIndexLow = (uint32_t)open->file->index;
+	info->nFileIndexHigh = (uint32_t)(open->file->index >> 32);
+	return 1;
+}
+
+int32_t CompareFileTime(const FILETIME* a, const FILETIME* b)
+{
+	uint64_t x = ((uint64_t)a->dwHighDateTime << 32) | a->dwLowDateTime;
+	uint64_t y = ((uint64_t)b->dwHighDateTime << 32) | b->dwLowDateTime;
+	return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+/* There is no console, so output always goes through WriteFile(). */
+BOOL WriteConsoleW(HANDLE, const void*, uint32_t, unsigned long*, void*)
+{
+	SetLastError(ERROR_INVALID_HANDLE);
+	return 0;
+}
+
+/* As in ioimpl.cpp. */
+void close_handle(HANDLE* handle)
+{
+	if (*handle)
+		CloseHandle(*handle);
+	*handle = 0;
+}
+
+BOOL MoveFileExW(const wchar_t* from, const wchar_t* to, uint32_t flags)
+{
+	std::u16string from_key = key(from);
+	std::u16string to_key = key(to);
+	auto found = files.find(from_key);
+	if (found == files.end())
+	{
+		SetLastError(ERROR_FILE_NOT_FOUND);
+		return 0;
+	}
+	if (!can_delete(found->second.get()))
+	{
+		SetLastError(ERROR_SHARING_VIOLATION);
+		return 0;
+	}
+	if (from_key == to_key)
+		return 1;
+	auto existing = files.find(to_key);
+	if (existing != files.end())
+	{
+		if (!(flags & MOVEFILE_REPLACE_EXISTING))
+		{
+			SetLastError(ERROR_ALREADY_EXISTS);
+			return 0;
+		}
+		if (existing->second->handles_open)
+		{
+			SetLastError(ERROR_ACCESS_DENIED);
+			return 0;
+		}
+	}
+	files[to_key] = found->second;
+	names[to_key] = std::u16string((const char16_t*)to, wcslen(to));
+	files.erase(from_key);
+	names.erase(from_key);
+	return 1;
+}
+
+BOOL MoveFileW(const wchar_t* from, const wchar_t* to)
+{
+	return MoveFileExW(from, to, 0);
+}
+
+BOOL CopyFileW(const wchar_t* from, const wchar_t* to, BOOL fail_if_exists)
+{
+	auto found = files.find(key(from));
+	if (found == files.end())
+	{
+		SetLastError(ERROR_FILE_NOT_FOUND);
+		return 0;
+	}
+	if (!can_share(found->second.get(), GENERIC_READ, FILE_SHARE_READ))
+	{
+		SetLastError(ERROR_SHARING_VIOLATION);
+		return 0;
+	}
+	std::vector<unsigned char> data = found->second->data;
+	HANDLE h = CreateFileW(to, GENERIC_WRITE, 0, 0, fail_if_exists ? CREATE_NEW : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	if (h == INVALID_HANDLE_VALUE)
+		return 0;
+	((fake_handle_t*)h)->file->data = data;
+	((fake_handle_t*)h)->file->written = found->second->written;
+	CloseHandle(h);
+	return 1;
+}
+
+/* Handles already open keep the file, as with POSIX rather than Windows' delete pending. */
+BOOL DeleteFileW(const wchar_t* path)
+{
+	std::u16string k = key(path);
+	auto found = files.find(k);
+	if (found == files.end())
+	{
+		SetLastError(ERROR_FILE_NOT_FOUND);
+		return 0;
+	}
+	if (!can_delete(found->second.get()))
+	{
+		SetLastError(ERROR_SHARING_VIOLATION);
+		return 0;
+	}
+	files.erase(found);
+	names.erase(k);
+	return 1;
+}
+
+/* Whether name matches pattern with * and ?, both already folded to lower case. */
+static bool wildcard(const char16_t* pattern, const char16_t* name)
+{
+	if (!*pattern)
+		return !*name;
+	if (*pattern == u'*')
+		return wildcard(pattern + 1, name) || (*name && wildcard(pattern, name + 1));
+	if (!*name)
+		return false;
+	return (*pattern == u'?' || *pattern == *name) && wildcard(pattern + 1, name + 1);
+}
+
+static void find_data(fake_find_t* find, WIN32_FIND_DATAW* data)
+{
+	ZeroMemory(data, sizeof(*data));
+	const std::u16string& name = find->names[find->next];
+	fake_file_t* file = find->files[find->next].get();
+	data->dwFileAttributes = FILE_ATTRIBUTE_NORMAL;
+	set_time(&data->ftCreationTime, file->created);
+	set_time(&data->ftLastAccessTime, file->written);
+	set_time(&data->ftLastWriteTime, file->written);
+	data->nFileSizeLow = (uint32_t)file->data.size();
+	data->nFileSizeHigh = (uint32_t)((uint64_t)file->data.size() >> 32);
+	size_t len = std::min(name.size(), (size_t)MAX_PATH - 1);
+	memmove(data->cFileName, name.data(), len * sizeof(wchar_t));
+	find->next++;
+}
+
+HANDLE FindFirstFileExW(const wchar_t* pattern, FINDEX_INFO_LEVELS, WIN32_FIND_DATAW* data, FINDEX_SEARCH_OPS, void*, uint32_t)
+{
+	std::u16string p = key(pattern);
+	size_t slash = p.rfind(u'\\');
+	std::u16string directory = (slash == std::u16string::npos) ? u"" : p.substr(0, slash + 1);
+	std::u16string match = p.substr(directory.size());
+
+	fake_find_t* find = new fake_find_t;
+	find->next = 0;
+	for (auto& entry : files)
+	{
+		if (entry.first.compare(0, directory.size(), directory) || entry.first.find(u'\\', directory.size()) != std::u16string::npos)
+			continue;
+		if (!wildcard(match.c_str(), entry.first.c_str() + directory.size()))
+			continue;
+		find->names.push_back(names[entry.first].substr(directory.size()));
+		find->files.push_back(entry.second);
+	}
+	if (find->names.empty())
+	{
+		delete find;
+		SetLastError(ERROR_FILE_NOT_FOUND);
+		return INVALID_HANDLE_VALUE;
+	}
+	find_data(find, data);
+	return (HANDLE)find;
+}
+
+BOOL FindNextFileW(HANDLE h, WIN32_FIND_DATAW* data)
+{
+	fake_find_t* find = (fake_find_t*)h;
+	if (find->next == find->names.size())
+	{
+		SetLastError(ERROR_NO_MORE_FILES);
+		return 0;
+	}
+	find_data(find, data);
+	return 1;
+}
+
+BOOL FindClose(HANDLE h)
+{
+	delete (fake_find_t*)h;
+	return 1;
+}
+
+wchar_t* PathFindFileNameW(const wchar_t* path)
+{
+	const wchar_t* name = path;
+	for (const wchar_t* p = path; *p; p++)
+	{
+		if ((*p == L'\\' || *p == L'/') && p[1])
+			name = p + 1;
+	}
+	return (wchar_t*)name;
+}
+
+wchar_t* PathFindExtensionW(const wchar_t* path)
+{
+	const wchar_t* ext = 0;
+	const wchar_t* p = PathFindFileNameW(path);
+	for (; *p; p++)
+	{
+		if (*p == L'.')
+			ext = p;
+		else if (*p == L' ')
+			ext = 0;
+	}
+	return (wchar_t*)(ext ? ext : p);
+}
+
+void fake_reset()
+{
+	for (fake_handle_t* h : handles)
+		delete h;
+	handles.clear();
+	files.clear();
+	names.clear();
+}
+
+/* Create or replace a file, last written at written or now if it is zero. */
+void fake_file(const wchar_t* path, const std::string& data, uint64_t written)
+{
+	HANDLE h = CreateFileW(path, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	if (h == INVALID_HANDLE_VALUE)
+		return;
+	fake_file_t* file = ((fake_handle_t*)h)->file.get();
+	file->data.assign(data.begin(), data.end());
+	if (written)
+		file->written = written;
+	CloseHandle(h);
+}
+
+bool fake_exists(const wchar_t* path)
+{
+	return files.count(key(path)) != 0;
+}
+
+std::string fake_contents(const wchar_t* path)
+{
+	auto found = files.find(key(path));
+	if (found == files.end())
+		return std::string();
+	return std::string(found->second->data.begin(), found->second->data.end());
+}
+
+uint32_t fake_file_count()
+{
+	return (uint32_t)files.size();
+}
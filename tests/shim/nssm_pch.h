@@ -0,0 +1,544 @@
+/*******************************************************************************
+ nssm_pch.h - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#pragma once
+
+/*
+  Stand-in for projects/nssm_pch.h, so that modules can be built and
+  checked with GCC or Clang off Windows.  Only the few Win32 types and
+  calls those modules use are provided, and files live in memory (see
+  files.cpp).  wchar_t must be 16 bits, as on Windows, so build with
+  -fshort-wchar.
+
+  NSSM_TEST_SCALAR hides the target architecture so the modules build
+  without their SSE2/AVX2 paths.  NSSM_TEST_NO_AVX2 makes CPUID deny AVX2
+  so they take the SSE2 paths.
+*/
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cwchar>
+#include <cwctype>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <iterator>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <zlib.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+static_assert(sizeof(wchar_t) == 2, "build with -fshort-wchar");
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(NSSM_TEST_SCALAR)
+#ifdef __x86_64__
+#define _M_X64 100
+#else
+#define _M_IX86 600
+#endif
+#include <immintrin.h>
+#include <cpuid.h>
+
+/* GCC's own __cpuid() and __cpuidex() take their arguments differently. */
+#undef __cpuid
+#define __cpuid nssm_cpuid
+#define __cpuidex nssm_cpuidex
+static inline void nssm_cpuidex(int32_t* info, int32_t leaf, int32_t subleaf)
+{
+	uint32_t a, b, c, d;
+	__cpuid_count((uint32_t)leaf, (uint32_t)subleaf, a, b, c, d);
+#ifdef NSSM_TEST_NO_AVX2
+	if (leaf == 7)
+		b &= ~(1U << 5);
+#endif
+	info[0] = (int32_t)a;
+	info[1] = (int32_t)b;
+	info[2] = (int32_t)c;
+	info[3] = (int32_t)d;
+}
+
+static inline void nssm_cpuid(int32_t* info, int32_t leaf)
+{
+	nssm_cpuidex(info, leaf, 0);
+}
+
+static inline uint64_t nssm_xgetbv(uint32_t index)
+{
+	uint32_t low, high;
+	__asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(index));
+	return ((uint64_t)high << 32) | low;
+}
+#define _xgetbv nssm_xgetbv
+#endif
+
+#define UNICODE
+#define __cdecl
+#define __stdcall
+#define CONSIDERED_UNUSED 0
+
+typedef int32_t BOOL;
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef uint32_t ULONG;
+typedef void* HANDLE;
+
+typedef union
+{
+	struct
+	{
+		uint32_t LowPart;
+		int32_t HighPart;
+	};
+	int64_t QuadPart;
+} LARGE_INTEGER;
+
+typedef union
+{
+	struct
+	{
+		uint32_t LowPart;
+		uint32_t HighPart;
+	};
+	uint64_t QuadPart;
+} ULARGE_INTEGER;
+
+typedef struct
+{
+	WORD wYear;
+	WORD wMonth;
+	WORD wDayOfWeek;
+	WORD wDay;
+	WORD wHour;
+	WORD wMinute;
+	WORD wSecond;
+	WORD wMilliseconds;
+} SYSTEMTIME;
+
+#define ZeroMemory(address, size) memset((address), 0, (size))
+
+#define HEAP_ZERO_MEMORY 0x00000008
+static inline HANDLE GetProcessHeap()
+{
+	return (HANDLE)1;
+}
+
+static inline void* HeapAlloc(HANDLE, uint32_t flags, size_t size)
+{
+	return (flags & HEAP_ZERO_MEMORY) ? calloc(1, size) : malloc(size);
+}
+
+static inline void* HeapReAlloc(HANDLE, uint32_t, void* address, size_t size)
+{
+	return realloc(address, size);
+}
+
+static inline BOOL HeapFree(HANDLE, uint32_t, void* address)
+{
+	free(address);
+	return 1;
+}
+
+uint64_t GetTickCount64();
+void GetSystemTime(SYSTEMTIME*);
+BOOL QueryPerformanceCounter(LARGE_INTEGER*);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER*);
+BOOL IsTextUnicode(const void*, int32_t, int32_t*);
+extern BOOL text_unicode;
+extern uint32_t text_unicode_calls;
+
+#define TRUE 1
+#define FALSE 0
+#define _T(x) L##x
+
+#define ERROR_SUCCESS 0L
+#define ERROR_FILE_NOT_FOUND 2L
+#define ERROR_PATH_NOT_FOUND 3L
+#define ERROR_ACCESS_DENIED 5L
+#define ERROR_INVALID_HANDLE 6L
+#define ERROR_NOT_ENOUGH_MEMORY 8L
+#define ERROR_INVALID_DATA 13L
+#define ERROR_NO_MORE_FILES 18L
+#define ERROR_SHARING_VIOLATION 32L
+#define ERROR_HANDLE_EOF 38L
+#define ERROR_FILE_EXISTS 80L
+#define ERROR_INVALID_PARAMETER 87L
+#define ERROR_OPEN_FAILED 110L
+#define ERROR_ALREADY_EXISTS 183L
+#define ERROR_FILENAME_EXCED_RANGE 206L
+#define ERROR_PIPE_BUSY 231L
+#define ERROR_NO_DATA 232L
+#define WAIT_TIMEOUT 258L
+#define ERROR_IO_PENDING 997L
+#define ERROR_TIMEOUT 1460L
+
+uint32_t GetLastError();
+void SetLastError(uint32_t);
+
+/* Locks are exclusive only, as the modules under test use them. */
+typedef struct
+{
+	void* Ptr;
+} SRWLOCK;
+#define SRWLOCK_INIT {0}
+
+void InitializeSRWLock(SRWLOCK*);
+void AcquireSRWLockExclusive(SRWLOCK*);
+void ReleaseSRWLockExclusive(SRWLOCK*);
+
+/* Completion ports are queues of posted packets; nothing completes on them by itself. */
+typedef uintptr_t ULONG_PTR;
+#define INFINITE 0xFFFFFFFF
+
+typedef struct
+{
+	ULONG_PTR Internal;
+	ULONG_PTR InternalHigh;
+	uint64_t Offset;
+	HANDLE hEvent;
+} OVERLAPPED;
+
+HANDLE CreateIoCompletionPort(HANDLE, HANDLE, ULONG_PTR, uint32_t);
+BOOL PostQueuedCompletionStatus(HANDLE, uint32_t, ULONG_PTR, OVERLAPPED*);
+BOOL GetQueuedCompletionStatus(HANDLE, uint32_t*, ULONG_PTR*, OVERLAPPED**, uint32_t);
+void fake_close_port(HANDLE);
+
+/*
+  Threads and events are waitable objects, closed by CloseHandle().
+  Condition variables work with the SRW locks above.
+*/
+#define WAIT_OBJECT_0 0L
+#define WAIT_FAILED 0xFFFFFFFF
+
+typedef ULONG (*LPTHREAD_START_ROUTINE)(void*);
+HANDLE CreateThread(void*, size_t, LPTHREAD_START_ROUTINE, void*, uint32_t, uint32_t*);
+HANDLE CreateEventW(void*, BOOL, BOOL, const wchar_t*);
+BOOL SetEvent(HANDLE);
+uint32_t WaitForSingleObject(HANDLE, uint32_t);
+uint32_t WaitForMultipleObjects(uint32_t, const HANDLE*, BOOL, uint32_t);
+BOOL fake_close_object(HANDLE);
+void Sleep(uint32_t);
+
+typedef struct
+{
+	void* Ptr;
+} CONDITION_VARIABLE;
+
+void InitializeConditionVariable(CONDITION_VARIABLE*);
+BOOL SleepConditionVariableSRW(CONDITION_VARIABLE*, SRWLOCK*, uint32_t, ULONG);
+void WakeConditionVariable(CONDITION_VARIABLE*);
+
+/* Blocking calls can't be cancelled, so a stuck thread is only waited for. */
+static inline BOOL CancelSynchronousIo(HANDLE)
+{
+	return 0;
+}
+
+/* Events are recorded rather than logged, so tests can see what was reported. */
+#define EVENTLOG_ERROR_TYPE 0x0001
+#define EVENTLOG_WARNING_TYPE 0x0002
+#define EVENTLOG_INFORMATION_TYPE 0x0004
+
+/* Ids from resources/messages.mc which the modules under test use.  Only the values' difference matters. */
+#define NSSM_EVENT_OUT_OF_MEMORY 1
+#define NSSM_EVENT_RETENTION_FAILED 2
+#define NSSM_MESSAGE_READ_LOG_FAILED 3
+#define NSSM_EVENT_FORWARD_FAILED 4
+#define NSSM_EVENT_BAD_FORWARD_TARGET 5
+#define NSSM_EVENT_CREATETHREAD_FAILED 6
+
+wchar_t* error_string(uint32_t);
+void log_event(uint16_t, uint32_t, ...);
+void print_message(FILE*, uint32_t, ...);
+extern std::vector<uint32_t> logged_events;
+
+/* An in-memory filesystem, reset by fake_reset() and filled by fake_file(). */
+typedef struct
+{
+	uint32_t dwLowDateTime;
+	uint32_t dwHighDateTime;
+} FILETIME;
+
+#define MAX_PATH 260
+typedef struct
+{
+	uint32_t dwFileAttributes;
+	FILETIME ftCreationTime;
+	FILETIME ftLastAccessTime;
+	FILETIME ftLastWriteTime;
+	uint32_t nFileSizeHigh;
+	uint32_t nFileSizeLow;
+	uint32_t dwReserved0;
+	uint32_t dwReserved1;
+	wchar_t cFileName[MAX_PATH];
+	wchar_t cAlternateFileName[14];
+} WIN32_FIND_DATAW;
+
+typedef enum
+{
+	FindExInfoStandard,
+	FindExInfoBasic
+} FINDEX_INFO_LEVELS;
+
+typedef enum
+{
+	FindExSearchNameMatch
+} FINDEX_SEARCH_OPS;
+
+#define INVALID_HANDLE_VALUE ((HANDLE)(intptr_t)-1)
+#define GENERIC_READ 0x80000000U
+#define GENERIC_WRITE 0x40000000U
+#define FILE_SHARE_READ 0x00000001U
+#define FILE_SHARE_WRITE 0x00000002U
+#define FILE_SHARE_DELETE 0x00000004U
+#define CREATE_NEW 1
+#define CREATE_ALWAYS 2
+#define OPEN_EXISTING 3
+#define OPEN_ALWAYS 4
+#define TRUNCATE_EXISTING 5
+#define FILE_ATTRIBUTE_DIRECTORY 0x00000010U
+#define FILE_ATTRIBUTE_NORMAL 0x00000080U
+#define FILE_FLAG_SEQUENTIAL_SCAN 0x08000000U
+#define FILE_FLAG_OVERLAPPED 0x40000000U
+#define SECURITY_SQOS_PRESENT 0x00100000U
+#define SECURITY_IDENTIFICATION 0x00010000U
+#define FILE_BEGIN 0
+#define FILE_CURRENT 1
+#define FILE_END 2
+#define MOVEFILE_REPLACE_EXISTING 0x00000001U
+#define MOVEFILE_WRITE_THROUGH 0x00000008U
+#define FIND_FIRST_EX_LARGE_FETCH 0x00000002U
+
+typedef struct
+{
+	uint32_t dwFileAttributes;
+	FILETIME ftCreationTime;
+	FILETIME ftLastAccessTime;
+	FILETIME ftLastWriteTime;
+	uint32_t dwVolumeSerialNumber;
+	uint32_t nFileSizeHigh;
+	uint32_t nFileSizeLow;
+	uint32_t nNumberOfLinks;
+	uint32_t nFileIndexHigh;
+	uint32_t nFileIndexLow;
+} BY_HANDLE_FILE_INFORMATION;
+
+HANDLE CreateFileW(const wchar_t*, uint32_t, uint32_t, void*, uint32_t, uint32_t, HANDLE);
+BOOL CloseHandle(HANDLE);
+BOOL ReadFile(HANDLE, void*, uint32_t, unsigned long*, void*);
+BOOL WriteFile(HANDLE, const void*, uint32_t, unsigned long*, void*);
+BOOL SetFilePointerEx(HANDLE, LARGE_INTEGER, LARGE_INTEGER*, uint32_t);
+BOOL GetFileSizeEx(HANDLE, LARGE_INTEGER*);
+BOOL SetEndOfFile(HANDLE);
+BOOL FlushFileBuffers(HANDLE);
+BOOL GetFileTime(HANDLE, FILETIME*, FILETIME*, FILETIME*);
+BOOL SetFileTime(HANDLE, const FILETIME*, const FILETIME*, const FILETIME*);
+BOOL GetFileInformationByHandle(HANDLE, BY_HANDLE_FILE_INFORMATION*);
+int32_t CompareFileTime(const FILETIME*, const FILETIME*);
+BOOL WriteConsoleW(HANDLE, const void*, uint32_t, unsigned long*, void*);
+void close_handle(HANDLE*);
+BOOL MoveFileW(const wchar_t*, const wchar_t*);
+BOOL MoveFileExW(const wchar_t*, const wchar_t*, uint32_t);
+BOOL CopyFileW(const wchar_t*, const wchar_t*, BOOL);
+BOOL DeleteFileW(const wchar_t*);
+HANDLE FindFirstFileExW(const wchar_t*, FINDEX_INFO_LEVELS, WIN32_FIND_DATAW*, FINDEX_SEARCH_OPS, void*, uint32_t);
+BOOL FindNextFileW(HANDLE, WIN32_FIND_DATAW*);
+BOOL FindClose(HANDLE);
+wchar_t* PathFindExtensionW(const wchar_t*);
+wchar_t* PathFindFileNameW(const wchar_t*);
+
+/* There are no named pipes; a pipe target never connects. */
+static inline BOOL WaitNamedPipeW(const wchar_t*, uint32_t)
+{
+	SetLastError(ERROR_FILE_NOT_FOUND);
+	return 0;
+}
+
+static inline BOOL CancelIoEx(HANDLE, OVERLAPPED*)
+{
+	return 0;
+}
+
+static inline BOOL GetOverlappedResult(HANDLE, OVERLAPPED*, unsigned long*, BOOL)
+{
+	SetLastError(ERROR_INVALID_HANDLE);
+	return 0;
+}
+
+void fake_reset();
+void fake_file(const wchar_t*, const std::string&, uint64_t = 0);
+bool fake_exists(const wchar_t*);
+std::string fake_contents(const wchar_t*);
+uint32_t fake_file_count();
+
+/* FILETIMEs.  GetSystemTime() and GetSystemTimeAsFileTime() return fake_now if it isn't zero. */
+extern uint64_t fake_now;
+void GetSystemTimeAsFileTime(FILETIME*);
+BOOL SystemTimeToFileTime(const SYSTEMTIME*, FILETIME*);
+BOOL FileTimeToSystemTime(const FILETIME*, SYSTEMTIME*);
+/* Local time is the C library's, so tests choose a time zone by setting TZ. */
+typedef struct _TIME_ZONE_INFORMATION TIME_ZONE_INFORMATION;
+BOOL SystemTimeToTzSpecificLocalTime(const TIME_ZONE_INFORMATION*, const SYSTEMTIME*, SYSTEMTIME*);
+BOOL TzSpecificLocalTimeToSystemTime(const TIME_ZONE_INFORMATION*, const SYSTEMTIME*, SYSTEMTIME*);
+void set_time_zone(const char*);
+
+/* Winsock on the C library's sockets, which use the same calls and structures. */
+typedef int32_t SOCKET;
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+#define WSAEACCES 10013L
+#define WSAEADDRNOTAVAIL 10049L
+#define WSA_FLAG_NO_HANDLE_INHERIT 0x80
+#define MAKEWORD(low, high) ((WORD)(((BYTE)(low)) | ((WORD)((BYTE)(high))) << 8))
+
+typedef struct
+{
+	WORD wVersion;
+	WORD wHighVersion;
+} WSADATA;
+
+typedef struct addrinfo ADDRINFOW;
+
+int32_t WSAStartup(WORD, WSADATA*);
+int32_t WSACleanup();
+int32_t WSAGetLastError();
+SOCKET WSASocketW(int32_t, int32_t, int32_t, void*, uint32_t, uint32_t);
+int32_t closesocket(SOCKET);
+int32_t GetAddrInfoW(const wchar_t*, const wchar_t*, const ADDRINFOW*, ADDRINFOW**);
+void FreeAddrInfoW(ADDRINFOW*);
+
+/* MSVC's wide string functions, with %s meaning a wide string as it does there. */
+#define _TRUNCATE ((size_t)-1)
+int32_t _snwprintf_s(wchar_t*, size_t, size_t, const wchar_t*, ...);
+int32_t _wcsnicmp(const wchar_t*, const wchar_t*, size_t);
+int32_t _wcsicmp(const wchar_t*, const wchar_t*);
+
+#define IS_HIGH_SURROGATE(c) ((c) >= 0xd800 && (c) <= 0xdbff)
+#define IS_LOW_SURROGATE(c) ((c) >= 0xdc00 && (c) <= 0xdfff)
+
+/* The configuration string conversions aren't checked here. */
+#define CP_UTF8 65001
+#define _O_U8TEXT 0x40000
+static inline uint32_t GetConsoleOutputCP()
+{
+	return CP_UTF8;
+}
+
+static inline BOOL SetConsoleOutputCP(uint32_t)
+{
+	return 1;
+}
+
+static inline int32_t _setmode(int32_t, int32_t)
+{
+	return 0;
+}
+
+#define _fileno fileno
+
+static inline int32_t WideCharToMultiByte(uint32_t, uint32_t, const wchar_t*, int32_t, char*, int32_t, const char*, BOOL*)
+{
+	return 0;
+}
+
+static inline int32_t MultiByteToWideChar(uint32_t, uint32_t, const char*, int32_t, wchar_t*, int32_t)
+{
+	return 0;
+}
+
+/* The C library's wide string functions expect 32-bit characters. */
+static inline size_t nssm_wcslen(const wchar_t* s)
+{
+	size_t len = 0;
+	while (s[len])
+		len++;
+	return len;
+}
+#define wcslen nssm_wcslen
+
+static inline wchar_t* nssm_wcschr(const wchar_t* s, wchar_t c)
+{
+	for (; *s; s++)
+	{
+		if (*s == c)
+			return (wchar_t*)s;
+	}
+	return c ? nullptr : (wchar_t*)s;
+}
+#define wcschr nssm_wcschr
+
+static inline wchar_t* nssm_wmemcpy(wchar_t* to, const wchar_t* from, size_t len)
+{
+	return (wchar_t*)memcpy(to, from, len * sizeof(wchar_t));
+}
+#define wmemcpy nssm_wmemcpy
+
+static inline int32_t wcscpy_s(wchar_t* to, size_t size, const wchar_t* from)
+{
+	size_t len = nssm_wcslen(from);
+	if (len >= size)
+	{
+		if (size)
+			to[0] = L'\0';
+		return ERROR_INVALID_PARAMETER;
+	}
+	memcpy(to, from, (len + 1) * sizeof(wchar_t));
+	return 0;
+}
+
+static inline unsigned long nssm_wcstoul(const wchar_t* s, wchar_t** end, int32_t)
+{
+	unsigned long value = 0;
+	const wchar_t* p = s;
+	while (*p >= L'0' && *p <= L'9')
+		value = value * 10 + (unsigned long)(*p++ - L'0');
+	if (end)
+		*end = (wchar_t*)p;
+	return value;
+}
+#define wcstoul nssm_wcstoul
+
+/*
+  MSVC accepts a scoped enumerator such as nssmconst::pathlength as an
+  array bound but GCC doesn't, so read common.h's enums as unscoped ones.
+*/
+#define class
+#include "common.h"
+#undef class
+#include "scan.h"
+#include "utf8.h"
+#include "encoding.h"
+#include "json.h"
+#include "multiline.h"
+#include "queue.h"
+#include "ratelimit.h"
+#include "metrics.h"
+#include "handoff.h"
+#include "forward.h"
+#include "timestamp.h"
+#include "deflate.h"
+#include "retention.h"
+#include "rotate.h"
+#include "compress.h"
+#include "timeindex.h"
+#include "logread.h"
+#include "logs.h"
@@ -0,0 +1,71 @@
+/*******************************************************************************
+ sockets.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+
+/* The Winsock calls forward.cpp makes, on the C library's sockets. */
+
+/* Winsock reports a closed connection as an error, never with a signal. */
+int32_t WSAStartup(WORD version, WSADATA* data)
+{
+	signal(SIGPIPE, SIG_IGN);
+	data->wVersion = data->wHighVersion = version;
+	return 0;
+}
+
+int32_t WSACleanup()
+{
+	return 0;
+}
+
+int32_t WSAGetLastError()
+{
+	return errno;
+}
+
+SOCKET WSASocketW(int32_t family, int32_t type, int32_t protocol, void*, uint32_t, uint32_t flags)
+{
+	if (flags & WSA_FLAG_NO_HANDLE_INHERIT)
+		type |= SOCK_CLOEXEC;
+	return socket(family, type, protocol);
+}
+
+int32_t closesocket(SOCKET s)
+{
+	return close(s);
+}
+
+/* Names are ASCII here. */
+static std::string narrow(const wchar_t* s)
+{
+	std::string narrowed;
+	for (; *s; s++)
+		narrowed += (char)*s;
+	return narrowed;
+}
+
+int32_t GetAddrInfoW(const wchar_t* host, const wchar_t* port, const ADDRINFOW* hints, ADDRINFOW** addresses)
+{
+	return getaddrinfo(narrow(host).c_str(), narrow(port).c_str(), hints, addresses);
+}
+
+void FreeAddrInfoW(ADDRINFOW* addresses)
+{
+	freeaddrinfo(addresses);
+}
@@ -0,0 +1,406 @@
+/*******************************************************************************
+ system.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include <ctime>
+
+/* The few system calls the modules under test make, done the POSIX way. */
+
+uint64_t GetTickCount64()
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+static thread_local uint32_t last_error;
+
+uint32_t GetLastError()
+{
+	return last_error;
+}
+
+void SetLastError(uint32_t error)
+{
+	last_error = error;
+}
+
+/* 100ns intervals between 1601 and 1970. */
+#define UNIX_EPOCH 116444736000000000ULL
+#define TICKS_PER_DAY 864000000000ULL
+
+uint64_t fake_now;
+
+void GetSystemTimeAsFileTime(FILETIME* ft)
+{
+	uint64_t time = fake_now;
+	if (!time)
+	{
+		timespec now;
+		clock_gettime(CLOCK_REALTIME, &now);
+		time = UNIX_EPOCH + (uint64_t)now.tv_sec * 10000000 + (uint64_t)now.tv_nsec / 100;
+	}
+	ft->dwLowDateTime = (uint32_t)time;
+	ft->dwHighDateTime = (uint32_t)(time >> 32);
+}
+
+void GetSystemTime(SYSTEMTIME* st)
+{
+	FILETIME ft;
+	GetSystemTimeAsFileTime(&ft);
+	FileTimeToSystemTime(&ft, st);
+}
+
+/* Days from 1601-01-01 to the given date in the proleptic Gregorian calendar. */
+static int64_t days_from_civil(int64_t year, uint32_t month, uint32_t day)
+{
+	year -= (month <= 2);
+	int64_t era = year / 400;
+	uint32_t yoe = (uint32_t)(year - era * 400);
+	uint32_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	/* 1601-01-01 is 134774 days before 1970-01-01, which is day 719468 of era 0. */
+	return era * 146097 + (int64_t)doe - 719468 + 134774;
+}
+
+static uint32_t days_in_month(uint32_t year, uint32_t month)
+{
+	static const uint32_t days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	if (month == 2 && ((year % 4 == 0 && year % 100 != 0) || year % 400 == 0))
+		return 29;
+	return days[month - 1];
+}
+
+BOOL SystemTimeToFileTime(const SYSTEMTIME* st, FILETIME* ft)
+{
+	if (st->wYear < 1601 || st->wYear > 30827 || st->wMonth < 1 || st->wMonth > 12 || st->wDay < 1 || st->wDay > days_in_month(st->wYear, st->wMonth) || st->wHour > 23 || st->wMinute > 59 || st->wSecond > 59 || st->wMilliseconds > 999)
+	{
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return 0;
+	}
+	uint64_t time = (uint64_t)days_from_civil(st->wYear, st->wMonth, st->wDay) * TICKS_PER_DAY;
+	time += (((uint64_t)st->wHour * 60 + st->wMinute) * 60 + st->wSecond) * 10000000ULL + (uint64_t)st->wMilliseconds * 10000;
+	ft->dwLowDateTime = (uint32_t)time;
+	ft->dwHighDateTime = (uint32_t)(time >> 32);
+	return 1;
+}
+
+BOOL FileTimeToSystemTime(const FILETIME* ft, SYSTEMTIME* st)
+{
+	uint64_t time = ((uint64_t)ft->dwHighDateTime << 32) | ft->dwLowDateTime;
+	if (time >> 63)
+	{
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return 0;
+	}
+	uint64_t days = time / TICKS_PER_DAY;
+	uint64_t rest = time % TICKS_PER_DAY;
+	/* 1601-01-01 was a Monday. */
+	st->wDayOfWeek = (WORD)((days + 1) % 7);
+	st->wMilliseconds = (WORD)(rest / 10000 % 1000);
+	rest /= 10000000;
+	st->wSecond = (WORD)(rest % 60);
+	st->wMinute = (WORD)(rest / 60 % 60);
+	st->wHour = (WORD)(rest / 3600);
+
+	uint32_t year = 1601;
+	while (true)
+	{
+		uint32_t length = (days_in_month(year, 2) == 29) ? 366 : 365;
+		if (days < length)
+			break;
+		days -= length;
+		year++;
+	}
+	uint32_t month = 1;
+	while (days >= days_in_month(year, month))
+		days -= days_in_month(year, month++);
+	st->wYear = (WORD)year;
+	st->wMonth = (WORD)month;
+	st->wDay = (WORD)(days + 1);
+	return 1;
+}
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER* counter)
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	counter->QuadPart = (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+	return 1;
+}
+
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency)
+{
+	frequency->QuadPart = 1000000000;
+	return 1;
+}
+
+static int64_t unix_seconds(const SYSTEMTIME* st)
+{
+	FILETIME ft;
+	if (!SystemTimeToFileTime(st, &ft))
+		return INT64_MIN;
+	uint64_t time = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+	return ((int64_t)time - (int64_t)UNIX_EPOCH) / 10000000;
+}
+
+static void from_unix_seconds(int64_t seconds, WORD milliseconds, SYSTEMTIME* st)
+{
+	uint64_t time = (uint64_t)((int64_t)UNIX_EPOCH + seconds * 10000000) + (uint64_t)milliseconds * 10000;
+	FILETIME ft;
+	ft.dwLowDateTime = (uint32_t)time;
+	ft.dwHighDateTime = (uint32_t)(time >> 32);
+	FileTimeToSystemTime(&ft, st);
+}
+
+BOOL SystemTimeToTzSpecificLocalTime(const TIME_ZONE_INFORMATION*, const SYSTEMTIME* utc, SYSTEMTIME* local)
+{
+	int64_t seconds = unix_seconds(utc);
+	if (seconds == INT64_MIN)
+		return 0;
+	time_t t = (time_t)seconds;
+	tm broken;
+	if (!localtime_r(&t, &broken))
+		return 0;
+	/* The offset from UTC, so the conversion back is exact. */
+	from_unix_seconds(seconds + broken.tm_gmtoff, utc->wMilliseconds, local);
+	return 1;
+}
+
+BOOL TzSpecificLocalTimeToSystemTime(const TIME_ZONE_INFORMATION*, const SYSTEMTIME* local, SYSTEMTIME* utc)
+{
+	if (unix_seconds(local) == INT64_MIN)
+		return 0;
+	tm broken;
+	ZeroMemory(&broken, sizeof(broken));
+	broken.tm_year = local->wYear - 1900;
+	broken.tm_mon = local->wMonth - 1;
+	broken.tm_mday = local->wDay;
+	broken.tm_hour = local->wHour;
+	broken.tm_min = local->wMinute;
+	broken.tm_sec = local->wSecond;
+	broken.tm_isdst = -1;
+	time_t t = mktime(&broken);
+	from_unix_seconds((int64_t)t, local->wMilliseconds, utc);
+	return 1;
+}
+
+/* Use a POSIX TZ string such as "GMT0BST,M3.5.0/1,M10.5.0" for local time. */
+void set_time_zone(const char* zone)
+{
+	setenv("TZ", zone, 1);
+	tzset();
+}
+
+static wchar_t fold(wchar_t c)
+{
+	return (c >= L'A' && c <= L'Z') ? (wchar_t)(c - L'A' + L'a') : c;
+}
+
+int32_t _wcsnicmp(const wchar_t* a, const wchar_t* b, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+	{
+		wchar_t x = fold(a[i]);
+		wchar_t y = fold(b[i]);
+		if (x != y)
+			return (x < y) ? -1 : 1;
+		if (!x)
+			break;
+	}
+	return 0;
+}
+
+int32_t _wcsicmp(const wchar_t* a, const wchar_t* b)
+{
+	return _wcsnicmp(a, b, SIZE_MAX);
+}
+
+/* Append a character to a bounded buffer, counting what wouldn't fit. */
+typedef struct
+{
+	wchar_t* buffer;
+	size_t size;
+	size_t len;
+} format_t;
+
+static void put(format_t* f, wchar_t c)
+{
+	if (f->len + 1 < f->size)
+		f->buffer[f->len] = c;
+	f->len++;
+}
+
+static void put_padded(format_t* f, const wchar_t* s, size_t len, size_t width, bool left, wchar_t pad)
+{
+	if (!left)
+	{
+		for (size_t i = len; i < width; i++)
+			put(f, pad);
+	}
+	for (size_t i = 0; i < len; i++)
+		put(f, s[i]);
+	if (left)
+	{
+		for (size_t i = len; i < width; i++)
+			put(f, L' ');
+	}
+}
+
+/*
+  Enough of MSVC's _snwprintf_s() for the modules under test: the flags
+  - and 0, a width, precision for strings, the l, ll and I64 sizes and the
+  conversions s, c, d, i, u, x, X and %.
+*/
+int32_t _snwprintf_s(wchar_t* buffer, size_t size, size_t count, const wchar_t* format, ...)
+{
+	va_list arg;
+	va_start(arg, format);
+	format_t f = { buffer, (count == _TRUNCATE || count + 1 > size) ? size : count + 1, 0 };
+	for (const wchar_t* p = format; *p; p++)
+	{
+		if (*p != L'%')
+		{
+			put(&f, *p);
+			continue;
+		}
+		p++;
+		bool left = false;
+		wchar_t pad = L' ';
+		for (; *p == L'-' || *p == L'0'; p++)
+		{
+			if (*p == L'-')
+				left = true;
+			else
+				pad = L'0';
+		}
+		size_t width = 0;
+		for (; *p >= L'0' && *p <= L'9'; p++)
+			width = width * 10 + (size_t)(*p - L'0');
+		size_t precision = SIZE_MAX;
+		if (*p == L'.')
+		{
+			precision = 0;
+			for (p++; *p >= L'0' && *p <= L'9'; p++)
+				precision = precision * 10 + (size_t)(*p - L'0');
+		}
+		uint32_t longs = 0;
+		for (; *p == L'l'; p++)
+			longs++;
+		if (p[0] == L'I' && p[1] == L'6' && p[2] == L'4')
+		{
+			longs = 2;
+			p += 3;
+		}
+
+		wchar_t digits[24];
+		size_t len = 0;
+		switch (*p)
+		{
+		case L's':
+		{
+			const wchar_t* s = va_arg(arg, const wchar_t*);
+			if (!s)
+				s = L"(null)";
+			while (len < precision && s[len])
+				len++;
+			put_padded(&f, s, len, width, left, L' ');
+			break;
+		}
+
+		case L'c':
+			digits[0] = (wchar_t)va_arg(arg, int);
+			put_padded(&f, digits, 1, width, left, L' ');
+			break;
+
+		case L'd':
+		case L'i':
+		case L'u':
+		case L'x':
+		case L'X':
+		{
+			bool is_signed = (*p == L'd' || *p == L'i');
+			uint64_t value;
+			bool negative = false;
+			if (is_signed)
+			{
+				int64_t n = (longs == 2) ? va_arg(arg, long long) : (longs == 1) ? va_arg(arg, long) : va_arg(arg, int);
+				negative = (n < 0);
+				value = negative ? (uint64_t)0 - (uint64_t)n : (uint64_t)n;
+			}
+			else
+				value = (longs == 2) ? va_arg(arg, unsigned long long) : (longs == 1) ? va_arg(arg, unsigned long) : va_arg(arg, unsigned int);
+			uint32_t base = (*p == L'x' || *p == L'X') ? 16 : 10;
+			const wchar_t* symbols = (*p == L'X') ? L"0123456789ABCDEF" : L"0123456789abcdef";
+			wchar_t reversed[24];
+			size_t n = 0;
+			do
+			{
+				reversed[n++] = symbols[value % base];
+				value /= base;
+			} while (value);
+			if (negative)
+				digits[len++] = L'-';
+			/* Zeros go after the sign. */
+			if (pad == L'0' && !left)
+			{
+				for (size_t i = n + len; i < width; i++)
+					digits[len++] = L'0';
+			}
+			while (n)
+				digits[len++] = reversed[--n];
+			put_padded(&f, digits, len, width, left, L' ');
+			break;
+		}
+
+		case L'%':
+			put(&f, L'%');
+			break;
+
+		default:
+			va_end(arg);
+			SetLastError(ERROR_INVALID_PARAMETER);
+			if (size)
+				buffer[0] = L'\0';
+			return -1;
+		}
+	}
+	va_end(arg);
+
+	if (!f.size)
+		return -1;
+	if (f.len >= f.size)
+	{
+		/* Without _TRUNCATE the real one would invoke the invalid parameter handler. */
+		buffer[f.size - 1] = L'\0';
+		return -1;
+	}
+	buffer[f.len] = L'\0';
+	return (int32_t)f.len;
+}
+
+/*
+  The real IsTextUnicode() runs statistical tests we can't reproduce.
+  Tests say what it should answer and can see how often it was asked.
+*/
+BOOL text_unicode;
+uint32_t text_unicode_calls;
+
+BOOL IsTextUnicode(const void*, int32_t, int32_t*)
+{
+	text_unicode_calls++;
+	return text_unicode;
+}
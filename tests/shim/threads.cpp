@@ -0,0 +1,282 @@
+/*******************************************************************************
+ threads.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/* Locks, completion ports and waitable objects for the modules' threads. */
+
+void InitializeSRWLock(SRWLOCK* lock)
+{
+	lock->Ptr = 0;
+}
+
+void AcquireSRWLockExclusive(SRWLOCK* lock)
+{
+	void* unlocked = 0;
+	while (!__atomic_compare_exchange_n(&lock->Ptr, &unlocked, (void*)1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+	{
+		unlocked = 0;
+		std::this_thread::yield();
+	}
+}
+
+void ReleaseSRWLockExclusive(SRWLOCK* lock)
+{
+	__atomic_store_n(&lock->Ptr, (void*)0, __ATOMIC_RELEASE);
+}
+
+typedef struct
+{
+	uint32_t bytes;
+	ULONG_PTR key;
+	OVERLAPPED* overlapped;
+} packet_t;
+
+typedef struct
+{
+	std::mutex lock;
+	std::condition_variable posted;
+	std::deque<packet_t> packets;
+} port_t;
+
+/* Only creating a new port is supported. */
+HANDLE CreateIoCompletionPort(HANDLE file, HANDLE existing, ULONG_PTR, uint32_t)
+{
+	if (file != INVALID_HANDLE_VALUE || existing)
+	{
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return 0;
+	}
+	return (HANDLE) new port_t;
+}
+
+BOOL PostQueuedCompletionStatus(HANDLE h, uint32_t bytes, ULONG_PTR key, OVERLAPPED* overlapped)
+{
+	port_t* port = (port_t*)h;
+	if (!port)
+	{
+		SetLastError(ERROR_INVALID_HANDLE);
+		return 0;
+	}
+	std::lock_guard<std::mutex> guard(port->lock);
+	port->packets.push_back({ bytes, key, overlapped });
+	port->posted.notify_one();
+	return 1;
+}
+
+BOOL GetQueuedCompletionStatus(HANDLE h, uint32_t* bytes, ULONG_PTR* key, OVERLAPPED** overlapped, uint32_t timeout)
+{
+	port_t* port = (port_t*)h;
+	std::unique_lock<std::mutex> guard(port->lock);
+	auto ready = [port] { return !port->packets.empty(); };
+	if (timeout == INFINITE)
+		port->posted.wait(guard, ready);
+	else if (!port->posted.wait_for(guard, std::chrono::milliseconds(timeout), ready))
+	{
+		*overlapped = 0;
+		SetLastError(WAIT_TIMEOUT);
+		return 0;
+	}
+
+	packet_t packet = port->packets.front();
+	port->packets.pop_front();
+	*bytes = packet.bytes;
+	*key = packet.key;
+	*overlapped = packet.overlapped;
+	return 1;
+}
+
+void fake_close_port(HANDLE h)
+{
+	delete (port_t*)h;
+}
+
+/* A thread or event: signalled when the thread exits or the event is set. */
+typedef struct
+{
+	std::mutex lock;
+	std::condition_variable signalled;
+	bool set;
+	bool manual;
+} object_t;
+
+static std::mutex objects_lock;
+static std::vector<std::shared_ptr<object_t>> objects;
+
+static std::shared_ptr<object_t> find_object(HANDLE h)
+{
+	std::lock_guard<std::mutex> guard(objects_lock);
+	for (std::shared_ptr<object_t>& object : objects)
+	{
+		if (object.get() == h)
+			return object;
+	}
+	return nullptr;
+}
+
+static HANDLE new_object(std::shared_ptr<object_t> object)
+{
+	std::lock_guard<std::mutex> guard(objects_lock);
+	objects.push_back(object);
+	return (HANDLE)object.get();
+}
+
+static void signal_object(object_t* object)
+{
+	std::lock_guard<std::mutex> guard(object->lock);
+	object->set = true;
+	object->signalled.notify_all();
+}
+
+/* The thread keeps its object alive until it exits, even if the handle is closed first. */
+HANDLE CreateThread(void*, size_t, LPTHREAD_START_ROUTINE start, void* arg, uint32_t, uint32_t*)
+{
+	std::shared_ptr<object_t> object = std::make_shared<object_t>();
+	object->manual = true;
+	HANDLE h = new_object(object);
+	std::thread([object, start, arg] {
+		start(arg);
+		signal_object(object.get());
+	}).detach();
+	return h;
+}
+
+HANDLE CreateEventW(void*, BOOL manual, BOOL set, const wchar_t*)
+{
+	std::shared_ptr<object_t> object = std::make_shared<object_t>();
+	object->manual = manual;
+	object->set = set;
+	return new_object(object);
+}
+
+BOOL SetEvent(HANDLE h)
+{
+	std::shared_ptr<object_t> object = find_object(h);
+	if (!object)
+	{
+		SetLastError(ERROR_INVALID_HANDLE);
+		return 0;
+	}
+	signal_object(object.get());
+	return 1;
+}
+
+uint32_t WaitForSingleObject(HANDLE h, uint32_t timeout)
+{
+	std::shared_ptr<object_t> object = find_object(h);
+	if (!object)
+	{
+		SetLastError(ERROR_INVALID_HANDLE);
+		return WAIT_FAILED;
+	}
+
+	std::unique_lock<std::mutex> guard(object->lock);
+	auto set = [&object] { return object->set; };
+	if (timeout == INFINITE)
+		object->signalled.wait(guard, set);
+	else if (!object->signalled.wait_for(guard, std::chrono::milliseconds(timeout), set))
+		return WAIT_TIMEOUT;
+	if (!object->manual)
+		object->set = false;
+	return WAIT_OBJECT_0;
+}
+
+void Sleep(uint32_t ms)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+/* Waiting for any of several objects is done by looking at each in turn. */
+uint32_t WaitForMultipleObjects(uint32_t count, const HANDLE* handles, BOOL all, uint32_t timeout)
+{
+	if (all)
+		return WAIT_FAILED;
+
+	uint64_t deadline = GetTickCount64() + timeout;
+	while (true)
+	{
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint32_t ret = WaitForSingleObject(handles[i], 0);
+			if (ret != WAIT_TIMEOUT)
+				return (ret == WAIT_OBJECT_0) ? WAIT_OBJECT_0 + i : ret;
+		}
+		if (timeout != INFINITE && GetTickCount64() >= deadline)
+			return WAIT_TIMEOUT;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+/* Called by CloseHandle() for handles which aren't files. */
+BOOL fake_close_object(HANDLE h)
+{
+	std::lock_guard<std::mutex> guard(objects_lock);
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		if (objects[i].get() == h)
+		{
+			objects.erase(objects.begin() + (ptrdiff_t)i);
+			return 1;
+		}
+	}
+	SetLastError(ERROR_INVALID_HANDLE);
+	return 0;
+}
+
+/*
+  A condition variable counts wakes.  A sleeper notes the count before
+  letting go of its lock, so a wake which comes after that isn't missed.
+*/
+static std::mutex conditions_lock;
+static std::condition_variable conditions_woken;
+
+void InitializeConditionVariable(CONDITION_VARIABLE* condition)
+{
+	condition->Ptr = 0;
+}
+
+BOOL SleepConditionVariableSRW(CONDITION_VARIABLE* condition, SRWLOCK* lock, uint32_t timeout, ULONG)
+{
+	std::unique_lock<std::mutex> guard(conditions_lock);
+	void* wakes = condition->Ptr;
+	ReleaseSRWLockExclusive(lock);
+
+	auto woken = [condition, wakes] { return condition->Ptr != wakes; };
+	bool ret = true;
+	if (timeout == INFINITE)
+		conditions_woken.wait(guard, woken);
+	else
+		ret = conditions_woken.wait_for(guard, std::chrono::milliseconds(timeout), woken);
+	guard.unlock();
+
+	AcquireSRWLockExclusive(lock);
+	if (!ret)
+		SetLastError(ERROR_TIMEOUT);
+	return ret ? 1 : 0;
+}
+
+void WakeConditionVariable(CONDITION_VARIABLE* condition)
+{
+	std::lock_guard<std::mutex> guard(conditions_lock);
+	condition->Ptr = (void*)((uintptr_t)condition->Ptr + 1);
+	conditions_woken.notify_all();
+}
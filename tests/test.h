@@ -0,0 +1,60 @@
+/*******************************************************************************
+ test.h - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#pragma once
+
+#ifndef TEST_H
+#define TEST_H
+
+/*
+  Minimal test registry.  Each TEST() registers itself before main() runs
+  and CHECK() records a failure without stopping the test, so one run
+  reports every broken case.
+*/
+
+typedef void (*test_function_t)();
+
+int32_t register_test(const char*, test_function_t);
+void test_failed(const char*, int32_t, const char*);
+
+#define TEST(name) \
+	static void name(); \
+	static int32_t name##_registered = register_test(#name, name); \
+	static void name()
+
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+			test_failed(__FILE__, __LINE__, #condition); \
+	} while (0)
+
+/* Deterministic pseudo-random numbers, so failures can be reproduced. */
+static inline uint32_t test_random(uint64_t* state)
+{
+	*state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (uint32_t)(*state >> 33);
+}
+
+/* Which vector paths the modules under test were built to take. */
+static inline const char* simd_path()
+{
+#ifdef NSSM_SCAN_SIMD
+	return have_avx2() ? "avx2" : "sse2";
+#else
+	return "scalar";
+#endif
+}
+
+#endif
@@ -0,0 +1,296 @@
+/*******************************************************************************
+ timeindex_test.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "test.h"
+
+/* A UTC time as a FILETIME. */
+static uint64_t utc(WORD year, WORD month, WORD day, WORD hour = 0, WORD minute = 0, WORD second = 0, WORD milliseconds = 0)
+{
+	SYSTEMTIME st = { year, month, 0, day, hour, minute, second, milliseconds };
+	FILETIME ft;
+	if (!SystemTimeToFileTime(&st, &ft))
+		return 0;
+	return ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
+
+static bool parses_as(const wchar_t* s, uint64_t expected)
+{
+	uint64_t time = 0;
+	return parse_log_time(s, &time) && time == expected;
+}
+
+static bool rejected(const wchar_t* s)
+{
+	uint64_t time = 0;
+	return !parse_log_time(s, &time);
+}
+
+TEST(log_time_utc)
+{
+	CHECK(parses_as(L"2025-06-01 12:34:56.789Z", utc(2025, 6, 1, 12, 34, 56, 789)));
+	CHECK(parses_as(L"2025-06-01T12:34:56Z", utc(2025, 6, 1, 12, 34, 56)));
+	CHECK(parses_as(L"2025-06-01t12:34z", utc(2025, 6, 1, 12, 34)));
+	CHECK(parses_as(L"2025-06-01Z", utc(2025, 6, 1)));
+	CHECK(parses_as(L"2024-02-29 23:59:59.999Z", utc(2024, 2, 29, 23, 59, 59, 999)));
+	CHECK(parses_as(L"2000-02-29Z", utc(2000, 2, 29)));
+	CHECK(parses_as(L"1601-01-01 00:00:00.001Z", 10000));
+}
+
+TEST(log_time_offset)
+{
+	CHECK(parses_as(L"2025-06-01T14:34:56+02:00", utc(2025, 6, 1, 12, 34, 56)));
+	CHECK(parses_as(L"2025-06-01T07:04:56-05:30", utc(2025, 6, 1, 12, 34, 56)));
+	CHECK(parses_as(L"2025-06-01 12:00+00:00", utc(2025, 6, 1, 12)));
+	CHECK(parses_as(L"2025-06-01 12:00-00:00", utc(2025, 6, 1, 12)));
+	/* Offsets move the time across days, months and years. */
+	CHECK(parses_as(L"2025-06-01T01:00+02:00", utc(2025, 5, 31, 23)));
+	CHECK(parses_as(L"2024-12-31T22:00-03:00", utc(2025, 1, 1, 1)));
+	CHECK(parses_as(L"2025-03-01+14:00", utc(2025, 2, 28, 10)));
+	CHECK(parses_as(L"2025-06-01 12:00:00.500+23:59", utc(2025, 5, 31, 12, 1, 0, 500)));
+}
+
+TEST(log_time_local)
+{
+	/* The United Kingdom: GMT in winter, BST (UTC+1) in summer. */
+	set_time_zone("GMT0BST,M3.5.0/1,M10.5.0");
+	CHECK(parses_as(L"2025-01-15 12:00", utc(2025, 1, 15, 12)));
+	CHECK(parses_as(L"2025-06-01 12:00:00.250", utc(2025, 6, 1, 11, 0, 0, 250)));
+	CHECK(parses_as(L"2025-06-01", utc(2025, 5, 31, 23)));
+	/* Either side of the change to summer time at 01:00 UTC on the last Sunday of March. */
+	CHECK(parses_as(L"2025-03-30 00:59", utc(2025, 3, 30, 0, 59)));
+	CHECK(parses_as(L"2025-03-30 02:00", utc(2025, 3, 30, 1)));
+	/* An explicit zone ignores the local one. */
+	CHECK(parses_as(L"2025-06-01 12:00Z", utc(2025, 6, 1, 12)));
+
+	/* New York: UTC-5, or UTC-4 in summer. */
+	set_time_zone("EST5EDT,M3.2.0,M11.1.0");
+	CHECK(parses_as(L"2025-07-04 08:00", utc(2025, 7, 4, 12)));
+	CHECK(parses_as(L"2025-12-31 20:00", utc(2026, 1, 1, 1)));
+
+	set_time_zone("UTC0");
+	CHECK(parses_as(L"2025-06-01 12:00", utc(2025, 6, 1, 12)));
+}
+
+TEST(log_time_relative)
+{
+	fake_now = utc(2025, 6, 10, 12);
+	CHECK(parses_as(L"90s", utc(2025, 6, 10, 11, 58, 30)));
+	CHECK(parses_as(L"15m", utc(2025, 6, 10, 11, 45)));
+	CHECK(parses_as(L"2h", utc(2025, 6, 10, 10)));
+	CHECK(parses_as(L"1H", utc(2025, 6, 10, 11)));
+	CHECK(parses_as(L"10d", utc(2025, 5, 31, 12)));
+	CHECK(parses_as(L"0s", fake_now));
+	CHECK(parses_as(L"000000001d", utc(2025, 6, 9, 12)));
+
+	CHECK(rejected(L"d"));
+	CHECK(rejected(L"5"));
+	CHECK(rejected(L"5x"));
+	CHECK(rejected(L"5w"));
+	CHECK(rejected(L"5dd"));
+	CHECK(rejected(L"5 d"));
+	CHECK(rejected(L" 5d"));
+	CHECK(rejected(L"-5d"));
+	CHECK(rejected(L"+5d"));
+	CHECK(rejected(L"1.5h"));
+	/* Too far back for a FILETIME, or more digits than are needed to get there. */
+	CHECK(rejected(L"999999999d"));
+	CHECK(rejected(L"0000000001d"));
+	fake_now = 0;
+}
+
+/* Bad input is an error, never a time of zero which would mean no limit at all. */
+TEST(log_time_malformed)
+{
+	CHECK(rejected(L""));
+	CHECK(rejected(L"2025"));
+	CHECK(rejected(L"2025-06"));
+	CHECK(rejected(L"2025-6-01"));
+	CHECK(rejected(L"2025-06-1"));
+	CHECK(rejected(L"25-06-01"));
+	CHECK(rejected(L"2025/06/01"));
+	CHECK(rejected(L"2025-06-01 12"));
+	CHECK(rejected(L"2025-06-01 12:3"));
+	CHECK(rejected(L"2025-06-01 1:30"));
+	CHECK(rejected(L"2025-06-01 12:34:5"));
+	CHECK(rejected(L"2025-06-01 12:34:56."));
+	CHECK(rejected(L"2025-06-01 12:34:56.7"));
+	CHECK(rejected(L"2025-06-01 12:34:56.7890"));
+	CHECK(rejected(L"2025-06-01 12:34."));
+	CHECK(rejected(L"2025-06-01_12:34"));
+	CHECK(rejected(L" 2025-06-01"));
+	CHECK(rejected(L"2025-06-01 "));
+	CHECK(rejected(L"2025-06-01 12:00Zjunk"));
+	CHECK(rejected(L"2025-06-01 12:00ZZ"));
+
+	/* Dates and times which don't exist. */
+	CHECK(rejected(L"2025-00-01Z"));
+	CHECK(rejected(L"2025-13-01Z"));
+	CHECK(rejected(L"2025-06-00Z"));
+	CHECK(rejected(L"2025-06-31Z"));
+	CHECK(rejected(L"2025-02-29Z"));
+	CHECK(rejected(L"1900-02-29Z"));
+	CHECK(rejected(L"2025-06-01 24:00Z"));
+	CHECK(rejected(L"2025-06-01 12:60Z"));
+	CHECK(rejected(L"2025-06-01 12:00:60Z"));
+	CHECK(rejected(L"2025-02-30"));
+
+	/* Offsets. */
+	CHECK(rejected(L"2025-06-01 12:00+2"));
+	CHECK(rejected(L"2025-06-01 12:00+02"));
+	CHECK(rejected(L"2025-06-01 12:00+0200"));
+	CHECK(rejected(L"2025-06-01 12:00+24:00"));
+	CHECK(rejected(L"2025-06-01 12:00+02:60"));
+	CHECK(rejected(L"2025-06-01 12:00+02:00Z"));
+	CHECK(rejected(L"2025-06-01 12:00Z+02:00"));
+
+	/* Before FILETIMEs begin, and the very start which would read as no limit. */
+	CHECK(rejected(L"0000-01-01Z"));
+	CHECK(rejected(L"1600-12-31 23:59:59.999Z"));
+	CHECK(rejected(L"1601-01-01Z"));
+	CHECK(rejected(L"1601-01-01 00:00:00.000Z"));
+	CHECK(rejected(L"1601-01-01T00:30+01:00"));
+}
+
+static wchar_t indexed_path[] = L"C:\\logs\\foo.log";
+static wchar_t index_path[] = L"C:\\logs\\foo.log.idx";
+
+/* An index with entries at times 100, 200, 300 and 400 for offsets 0, 1000, 2000 and 3000. */
+static void write_index(uint32_t entries)
+{
+	std::string index;
+	for (uint32_t i = 0; i < entries; i++)
+	{
+		time_index_entry_t entry = { (i + 1) * 100ULL, i * 1000ULL };
+		index.append((const char*)&entry, sizeof(entry));
+	}
+	fake_file(index_path, index);
+}
+
+static bool range_is(uint64_t since, uint64_t until, int64_t start, int64_t end)
+{
+	int64_t got_start;
+	int64_t got_end;
+	return find_time_range(indexed_path, since, until, &got_start, &got_end) && got_start == start && got_end == end;
+}
+
+TEST(time_index_empty)
+{
+	int64_t start = 5;
+	int64_t end = 5;
+	fake_reset();
+	CHECK(!find_time_range(indexed_path, 150, 250, &start, &end));
+	CHECK(start == 0 && end == -1);
+
+	/* An index with no entries, or only part of one, is no index and the whole file is wanted. */
+	fake_file(index_path, "");
+	start = end = 5;
+	CHECK(!find_time_range(indexed_path, 150, 250, &start, &end));
+	CHECK(start == 0 && end == -1);
+	fake_file(index_path, std::string(sizeof(time_index_entry_t) - 1, '\0'));
+	CHECK(!find_time_range(indexed_path, 150, 250, &start, &end));
+	CHECK(start == 0 && end == -1);
+}
+
+TEST(time_index_range)
+{
+	fake_reset();
+	write_index(4);
+	CHECK(range_is(0, 0, 0, -1));
+	/* Starts at the entry at or before since. */
+	CHECK(range_is(250, 0, 1000, -1));
+	CHECK(range_is(200, 0, 1000, -1));
+	CHECK(range_is(199, 0, 0, -1));
+	/* Ends at the first entry after until. */
+	CHECK(range_is(0, 250, 0, 2000));
+	CHECK(range_is(0, 300, 0, 3000));
+	CHECK(range_is(250, 250, 1000, 2000));
+
+	/* A torn last entry is ignored. */
+	std::string index = fake_contents(index_path);
+	fake_file(index_path, index + "torn");
+	CHECK(range_is(0, 250, 0, 2000));
+
+	/* A single entry. */
+	write_index(1);
+	CHECK(range_is(50, 0, 0, -1));
+	CHECK(range_is(150, 0, 0, -1));
+	CHECK(range_is(0, 50, 0, 0));
+	CHECK(range_is(0, 150, 0, -1));
+}
+
+/* --since before the first entry starts at the beginning. */
+TEST(time_index_since_first)
+{
+	fake_reset();
+	write_index(4);
+	CHECK(range_is(1, 0, 0, -1));
+	CHECK(range_is(99, 0, 0, -1));
+	CHECK(range_is(100, 0, 0, -1));
+	CHECK(range_is(99, 350, 0, 3000));
+	/* Since after the last entry starts at the last entry. */
+	CHECK(range_is(500, 0, 3000, -1));
+}
+
+/* --until after the last entry runs to the end of the file. */
+TEST(time_index_until_last)
+{
+	fake_reset();
+	write_index(4);
+	CHECK(range_is(0, 400, 0, -1));
+	CHECK(range_is(0, 401, 0, -1));
+	CHECK(range_is(0, UINT64_MAX, 0, -1));
+	CHECK(range_is(350, 1000, 2000, -1));
+	/* Until before the first entry is an empty range. */
+	CHECK(range_is(0, 99, 0, 0));
+}
+
+/* What the logger writes is what the reader finds. */
+TEST(time_index_append)
+{
+	fake_reset();
+	fake_now = 1000000;
+	HANDLE index = open_time_index(indexed_path, 0);
+	CHECK(index);
+	if (!index)
+		return;
+	for (int64_t offset = 0; offset < 5000; offset += 1000)
+	{
+		CHECK(append_time_index(index, offset));
+		fake_now += 10000000;
+	}
+	CloseHandle(index);
+	CHECK(fake_contents(index_path).size() == 5 * sizeof(time_index_entry_t));
+
+	int64_t start;
+	int64_t end;
+	CHECK(find_time_range(indexed_path, 1000000 + 25000000, 1000000 + 25000000, &start, &end));
+	CHECK(start == 2000 && end == 3000);
+
+	/* Reopened for a file which is shorter than the index says, it starts again. */
+	index = open_time_index(indexed_path, 3500);
+	CHECK(index);
+	CloseHandle(index);
+	CHECK(fake_contents(index_path).empty());
+
+	/* Moved and deleted with its file. */
+	write_index(2);
+	move_time_index(indexed_path, L"C:\\logs\\foo-1.log", false);
+	CHECK(!fake_exists(index_path) && fake_exists(L"C:\\logs\\foo-1.log.idx"));
+	delete_time_index(L"C:\\logs\\foo-1.log");
+	CHECK(!fake_file_count());
+	fake_now = 0;
+}
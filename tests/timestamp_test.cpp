@@ -0,0 +1,94 @@
+/*******************************************************************************
+ timestamp_test.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "test.h"
+
+/* What write_timestamp() used to format for every line. */
+static bool formats_as_snprintf(timestamp_t* timestamp, SYSTEMTIME* time)
+{
+	char expected[64];
+	snprintf(expected, sizeof(expected), "%04u-%02u-%02u %02u:%02u:%02u.%03u: ", time->wYear, time->wMonth, time->wDay, time->wHour, time->wMinute, time->wSecond, time->wMilliseconds);
+	format_timestamp(timestamp, time);
+	for (uint32_t i = 0; i <= TIMESTAMP_LEN; i++)
+	{
+		if (timestamp->utf8[i] != expected[i] || timestamp->utf16[i] != (wchar_t)expected[i])
+			return false;
+	}
+	return true;
+}
+
+/* Only the fields which changed are reformatted, so walk through times as a clock would. */
+TEST(timestamp_format)
+{
+	timestamp_t timestamp;
+	ZeroMemory(&timestamp, sizeof(timestamp));
+	SYSTEMTIME time;
+	ZeroMemory(&time, sizeof(time));
+	time.wYear = 2025;
+	time.wMonth = 12;
+	time.wDay = 31;
+	time.wHour = 23;
+	time.wMinute = 59;
+	time.wSecond = 58;
+	uint64_t seed = 4;
+
+	for (uint32_t round = 0; round < 100000; round++)
+	{
+		CHECK(formats_as_snprintf(&timestamp, &time));
+
+		/* Mostly a few milliseconds on, sometimes a jump in any field. */
+		time.wMilliseconds += (WORD)(test_random(&seed) % 40);
+		if (time.wMilliseconds >= 1000)
+		{
+			time.wMilliseconds -= 1000;
+			time.wSecond++;
+		}
+		if (time.wSecond >= 60)
+		{
+			time.wSecond = 0;
+			time.wMinute++;
+		}
+		if (time.wMinute >= 60)
+		{
+			time.wMinute = 0;
+			time.wHour++;
+		}
+		if (time.wHour >= 24)
+		{
+			time.wHour = 0;
+			time.wDay = (WORD)(1 + time.wDay % 28);
+			if (time.wDay == 1)
+				time.wMonth = (WORD)(1 + time.wMonth % 12);
+			if (time.wDay == 1 && time.wMonth == 1)
+				time.wYear++;
+		}
+		if (!(test_random(&seed) % 1000))
+		{
+			time.wHour = (WORD)(test_random(&seed) % 24);
+			time.wMinute = (WORD)(test_random(&seed) % 60);
+		}
+	}
+
+	/* A cache which has never been used formats every field. */
+	ZeroMemory(&timestamp, sizeof(timestamp));
+	ZeroMemory(&time, sizeof(time));
+	time.wYear = 1601;
+	time.wMonth = 1;
+	time.wDay = 1;
+	CHECK(formats_as_snprintf(&timestamp, &time));
+	CHECK(!strcmp(timestamp.utf8, "1601-01-01 00:00:00.000: "));
+}
@@ -0,0 +1,281 @@
+/*******************************************************************************
+ utf8_test.cpp - 
+
+ SPDX-License-Identifier: CC0 1.0 Universal Public Domain
+ Original author Iain Patterson released nssm under Public Domain
+ https://creativecommons.org/publicdomain/zero/1.0/
+
+ NSSM source code - the Non-Sucking Service Manager
+
+ 2025-05-31 and onwards modified Jerker Bäck
+
+*******************************************************************************/
+
+
+#include "nssm_pch.h"
+#include "common.h"
+
+#include "test.h"
+
+/*
+  Random text built from pieces whose conversion we know: characters of
+  every UTF-8 length, including long runs of ASCII so that the vector
+  paths start and stop at every offset, and invalid sequences.
+*/
+typedef struct
+{
+	uint8_t utf16[8192];
+	uint32_t utf16_len;
+	char utf8[8192];
+	uint32_t utf8_len;
+	wchar_t wide[4096];
+	uint32_t wide_len;
+} sample_t;
+
+static void add_unit(sample_t* sample, uint32_t unit)
+{
+	sample->utf16[sample->utf16_len++] = (uint8_t)unit;
+	sample->utf16[sample->utf16_len++] = (uint8_t)(unit >> 8);
+}
+
+static void add_utf8(sample_t* sample, const char* bytes, uint32_t len)
+{
+	memmove(sample->utf8 + sample->utf8_len, bytes, len);
+	sample->utf8_len += len;
+}
+
+/* A valid character, which converts the same way in both directions. */
+static void add_character(sample_t* sample, uint32_t c)
+{
+	char bytes[4];
+	uint32_t len;
+	if (c < 0x80)
+	{
+		bytes[0] = (char)c;
+		len = 1;
+	}
+	else if (c < 0x800)
+	{
+		bytes[0] = (char)(0xc0 | (c >> 6));
+		bytes[1] = (char)(0x80 | (c & 0x3f));
+		len = 2;
+	}
+	else if (c < 0x10000)
+	{
+		bytes[0] = (char)(0xe0 | (c >> 12));
+		bytes[1] = (char)(0x80 | ((c >> 6) & 0x3f));
+		bytes[2] = (char)(0x80 | (c & 0x3f));
+		len = 3;
+	}
+	else
+	{
+		bytes[0] = (char)(0xf0 | (c >> 18));
+		bytes[1] = (char)(0x80 | ((c >> 12) & 0x3f));
+		bytes[2] = (char)(0x80 | ((c >> 6) & 0x3f));
+		bytes[3] = (char)(0x80 | (c & 0x3f));
+		len = 4;
+	}
+	add_utf8(sample, bytes, len);
+
+	if (c >= 0x10000)
+	{
+		add_unit(sample, 0xd800 + ((c - 0x10000) >> 10));
+		add_unit(sample, 0xdc00 + ((c - 0x10000) & 0x3ff));
+		sample->wide[sample->wide_len++] = (wchar_t)(0xd800 + ((c - 0x10000) >> 10));
+		sample->wide[sample->wide_len++] = (wchar_t)(0xdc00 + ((c - 0x10000) & 0x3ff));
+	}
+	else
+	{
+		add_unit(sample, c);
+		sample->wide[sample->wide_len++] = (wchar_t)c;
+	}
+}
+
+static const char replacement[] = "\xef\xbf\xbd";
+
+static void make_sample(sample_t* sample, uint64_t* seed, bool invalid)
+{
+	ZeroMemory(sample, sizeof(*sample));
+	uint32_t count = test_random(seed) % 200;
+	bool lone_high = false;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t kind = test_random(seed) % (invalid ? 9 : 6);
+		switch (kind)
+		{
+		case 0:
+			/* A run of ASCII. */
+			for (uint32_t run = 1 + test_random(seed) % 80; run; run--)
+				add_character(sample, 0x20 + test_random(seed) % 0x5f);
+			break;
+
+		case 1:
+			add_character(sample, 0x80 + test_random(seed) % 0x780);
+			break;
+
+		case 2:
+			add_character(sample, 0x800 + test_random(seed) % 0xd000);
+			break;
+
+		case 3:
+			add_character(sample, 0x10000 + test_random(seed) % 0x100000);
+			break;
+
+		case 4:
+			add_character(sample, '\n');
+			break;
+
+		case 5:
+			add_character(sample, 0xe000 + test_random(seed) % 0x2000);
+			break;
+
+		case 6:
+			/* Unpaired high surrogate, which mustn't be followed by a low one. */
+			add_unit(sample, 0xd800 + test_random(seed) % 0x400);
+			add_utf8(sample, replacement, 3);
+			lone_high = true;
+			continue;
+
+		case 7:
+			if (lone_high)
+				continue;
+			/* Unpaired low surrogate. */
+			add_unit(sample, 0xdc00 + test_random(seed) % 0x400);
+			add_utf8(sample, replacement, 3);
+			break;
+
+		case 8:
+			if (lone_high)
+				continue;
+			/* A surrogate pair the wrong way round. */
+			add_unit(sample, 0xdc00);
+			add_unit(sample, 0xd800);
+			add_utf8(sample, replacement, 3);
+			add_utf8(sample, replacement, 3);
+			add_character(sample, 'x');
+			break;
+		}
+		lone_high = false;
+	}
+}
+
+/* Convert in pieces of random length, as reads would deliver them. */
+static uint32_t utf16_in_pieces(const uint8_t* in, uint32_t len, char* out, uint64_t* seed, uint32_t largest)
+{
+	transcoder_t transcoder;
+	ZeroMemory(&transcoder, sizeof(transcoder));
+	uint32_t written = 0;
+	for (uint32_t i = 0; i < len;)
+	{
+		uint32_t piece = std::min(1 + test_random(seed) % largest, len - i);
+		uint32_t n = utf16_to_utf8(&transcoder, in + i, piece, out + written);
+		CHECK(n <= UTF8_SIZE_FROM_UTF16(piece));
+		written += n;
+		i += piece;
+	}
+	return written + utf16_to_utf8_end(&transcoder, out + written);
+}
+
+static uint32_t utf8_in_pieces(const char* in, uint32_t len, wchar_t* out, uint64_t* seed, uint32_t largest)
+{
+	transcoder_t transcoder;
+	ZeroMemory(&transcoder, sizeof(transcoder));
+	uint32_t written = 0;
+	for (uint32_t i = 0; i < len;)
+	{
+		uint32_t piece = std::min(1 + test_random(seed) % largest, len - i);
+		uint32_t n = utf8_to_utf16(&transcoder, in + i, piece, out + written);
+		CHECK(n <= UTF16_SIZE_FROM_UTF8(piece));
+		written += n;
+		i += piece;
+	}
+	return written + utf8_to_utf16_end(&transcoder, out + written);
+}
+
+TEST(utf8_from_utf16)
+{
+	static sample_t sample;
+	static char out[sizeof(sample.utf16) * 2];
+	uint64_t seed = 16;
+	for (uint32_t round = 0; round < 3000; round++)
+	{
+		make_sample(&sample, &seed, round & 1);
+		/* Whole, then in pieces of every size from odd bytes to big reads. */
+		uint32_t largest = (round % 3 == 0) ? sample.utf16_len + 1 : 1 + round % 9;
+		uint32_t len = utf16_in_pieces(sample.utf16, sample.utf16_len, out, &seed, largest);
+		CHECK(len == sample.utf8_len);
+		CHECK(!memcmp(out, sample.utf8, std::min(len, sample.utf8_len)));
+	}
+}
+
+TEST(utf8_to_utf16)
+{
+	static sample_t sample;
+	static wchar_t out[sizeof(sample.utf8) + 4];
+	uint64_t seed = 8;
+	for (uint32_t round = 0; round < 3000; round++)
+	{
+		make_sample(&sample, &seed, false);
+		uint32_t largest = (round % 3 == 0) ? sample.utf8_len + 1 : 1 + round % 9;
+		uint32_t len = utf8_in_pieces(sample.utf8, sample.utf8_len, out, &seed, largest);
+		CHECK(len == sample.wide_len);
+		CHECK(!memcmp(out, sample.wide, std::min(len, sample.wide_len) * sizeof(wchar_t)));
+	}
+}
+
+static bool utf8_converts_to(const char* in, const wchar_t* expected)
+{
+	wchar_t out[64];
+	uint32_t len = (uint32_t)strlen(in);
+	uint32_t expected_len = 0;
+	while (expected[expected_len])
+		expected_len++;
+
+	/* Split at every point, as well as whole. */
+	for (uint32_t split = 0; split <= len; split++)
+	{
+		transcoder_t transcoder;
+		ZeroMemory(&transcoder, sizeof(transcoder));
+		uint32_t n = utf8_to_utf16(&transcoder, in, split, out);
+		n += utf8_to_utf16(&transcoder, in + split, len - split, out + n);
+		n += utf8_to_utf16_end(&transcoder, out + n);
+		if (n != expected_len || memcmp(out, expected, n * sizeof(wchar_t)))
+			return false;
+	}
+	return true;
+}
+
+TEST(utf8_invalid)
+{
+	CHECK(utf8_converts_to("a\x80z", L"a\xfffdz"));
+	CHECK(utf8_converts_to("\xff\xfe", L"\xfffd\xfffd"));
+	/* Overlong, surrogate and out of range sequences are one error each. */
+	CHECK(utf8_converts_to("\xc0\xaf!", L"\xfffd!"));
+	CHECK(utf8_converts_to("\xed\xa0\x80!", L"\xfffd!"));
+	CHECK(utf8_converts_to("\xf4\x90\x80\x80!", L"\xfffd!"));
+	/* A broken sequence resumes at the byte which broke it. */
+	CHECK(utf8_converts_to("\xe2\x82z", L"\xfffdz"));
+	CHECK(utf8_converts_to("\xe2\x82\xe2\x82\xac", L"\xfffd\x20ac"));
+	/* The stream ends partway through a sequence. */
+	CHECK(utf8_converts_to("ok\xf0\x9f\x98", L"ok\xfffd"));
+	CHECK(utf8_converts_to("\xf0\x9f\x98\x80", L"\xd83d\xde00"));
+}
+
+TEST(utf8_odd_byte)
+{
+	/* A stream ending with half a code unit, or half a pair, gets a replacement. */
+	const uint8_t in[] = { 'a', 0, 0x3d, 0xd8, 'b' };
+	char out[16];
+	transcoder_t transcoder;
+	ZeroMemory(&transcoder, sizeof(transcoder));
+	uint32_t n = utf16_to_utf8(&transcoder, in, 3, out);
+	n += utf16_to_utf8(&transcoder, in + 3, 2, out + n);
+	n += utf16_to_utf8_end(&transcoder, out + n);
+	CHECK(n == 7 && !memcmp(out, "a\xef\xbf\xbd\xef\xbf\xbd", 7));
+
+	ZeroMemory(&transcoder, sizeof(transcoder));
+	n = utf16_to_utf8(&transcoder, in, 1, out);
+	CHECK(!n && transcoder.pending_len == 1);
+	n += utf16_to_utf8(&transcoder, in + 1, 1, out);
+	CHECK(n == 1 && out[0] == 'a' && !transcoder.pending_len);
+}